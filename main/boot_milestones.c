@@ -0,0 +1,50 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "boot_milestones.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+
+static const char TAG[] = "boot";
+
+static const char *boot_milestone_name_str[BOOT_MILESTONE_MAX] = {
+    "NVS ready",
+    "advertising",
+    "USB host ready",
+    "first report"
+};
+
+static portMUX_TYPE boot_milestones_lock = portMUX_INITIALIZER_UNLOCKED;
+static int64_t boot_milestones_us[BOOT_MILESTONE_MAX] = { 0 };
+volatile bool boot_milestones_done[BOOT_MILESTONE_MAX] = { false };
+
+void boot_milestone_mark(boot_milestone_e milestone) {
+    // esp_timer starts counting early in the startup code, close enough to power-on
+    const int64_t now_us = esp_timer_get_time();
+    bool all_done = true;
+
+    portENTER_CRITICAL(&boot_milestones_lock);
+    if (boot_milestones_done[milestone]) {
+        portEXIT_CRITICAL(&boot_milestones_lock);
+        return;
+    }
+    boot_milestones_us[milestone] = now_us;
+    boot_milestones_done[milestone] = true;
+    for (int i = 0; i < BOOT_MILESTONE_MAX; i++) {
+        all_done &= boot_milestones_done[i];
+    }
+    portEXIT_CRITICAL(&boot_milestones_lock);
+
+    ESP_LOGI(TAG, "Power-on to %s: %lld ms", boot_milestone_name_str[milestone], now_us / 1000);
+
+    if (all_done) {
+        ESP_LOGI(TAG, "Boot milestones | NVS %lld ms, advertising %lld ms, USB host %lld ms, first report %lld ms",
+                 boot_milestones_us[BOOT_MILESTONE_NVS_READY] / 1000,
+                 boot_milestones_us[BOOT_MILESTONE_ADVERTISING] / 1000,
+                 boot_milestones_us[BOOT_MILESTONE_USB_HOST_READY] / 1000,
+                 boot_milestones_us[BOOT_MILESTONE_FIRST_REPORT] / 1000);
+    }
+}
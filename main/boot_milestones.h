@@ -0,0 +1,29 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BOOT_MILESTONES_H
+#define BOOT_MILESTONES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    BOOT_MILESTONE_NVS_READY = 0,
+    BOOT_MILESTONE_ADVERTISING,
+    BOOT_MILESTONE_USB_HOST_READY,
+    BOOT_MILESTONE_FIRST_REPORT,
+    BOOT_MILESTONE_MAX
+} boot_milestone_e;
+
+extern volatile bool boot_milestones_done[BOOT_MILESTONE_MAX];
+
+/* Records the first time a milestone is reached, measured from power-on, later calls are ignored */
+void boot_milestone_mark(boot_milestone_e milestone);
+
+/* Cheap enough for the report path */
+static inline void boot_milestone_mark_once(boot_milestone_e milestone) {
+    if (!boot_milestones_done[milestone]) boot_milestone_mark(milestone);
+}
+
+#endif //BOOT_MILESTONES_H
@@ -4,7 +4,10 @@
 
 
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
 
+#include <stdatomic.h>
 #include <string.h>
 #include <host/ble_gatt.h>
 #include <host/ble_hs_id.h>
@@ -18,33 +21,61 @@
 
 #include <store/config/ble_store_config.h>
 
+#include "boot_milestones.h"
+#include "power_manager.h"
+#include "bt_app_keyboard.h"
+#include "bt_app_mouse.h"
+#include "bt_app_notify.h"
 #include "bt_constants.h"
 #include "bt_device_info_handlers.h"
 #include "bt_device_hid_handlers.h"
 #include "bt_device_battery_handlers.h"
+#include "bt_device_bench_handlers.h"
+#include "bt_device_config_handlers.h"
+#include "bt_device_inject_handlers.h"
 
 static uint8_t ble_addr_type = 0;
 static uint16_t bt_conn_handle;
+static uint16_t input_report_handle;
+static uint16_t nkro_input_report_handle;
+static uint16_t mouse_input_report_handle;
+static bt_app_notify_link_t bt_notify_link;                 // Report notifications of the connection
+static portMUX_TYPE bt_notify_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t bt_subscribed_reports = 0;                   // Input reports with notifications enabled, one bit each
+static bt_app_listen_cb_t bt_listen_callback = NULL;
+static bt_app_link_cb_t bt_link_callback = NULL;
+static atomic_bool bt_link_up = false;
+static atomic_bool bt_adv_fast = false;                     // Fast advertising running, a wake does not restart it
+static uint32_t bt_wakeups = 0;
+static uint32_t bt_conn_interval_us = BT_APP_CONN_INTERVAL_DEFAULT_US;
+static esp_timer_handle_t bt_conn_event_timer = NULL;
+static atomic_bool bt_conn_events_requested = false;
 
 static int bt_app_gap_event(struct ble_gap_event *event, void *arg);
+static void bt_app_update_conn_interval(uint16_t conn_handle);
+static void bt_app_log_notify_stats(void);
+static void bt_app_update_subscription(uint16_t attr_handle, bool notify);
+static void bt_app_set_link(bool connected);
+static void bt_app_clear_reports(void);
 
-const struct ble_gatt_chr_def input_report_characteristic = {
-    .uuid = BLE_UUID16_DECLARE(0x2A4D), // Input Report
-    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-    .access_cb = handle_hid_input_report,
-    // .descriptors = (struct ble_gatt_dsc_def[]) {
-    //     {
-    //         .uuid = BLE_UUID16_DECLARE(0x2908), // Report Reference Descriptor
-    //         .att_flags = BLE_ATT_F_READ,
-    //         .access_cb = handle_hid_input_report_descriptor
-    //     },
-    //     {
-    //         .uuid = BLE_UUID16_DECLARE(0x2908), // Client Characteristic Configuration Descriptor (CCCD)
-    //         .att_flags = BLE_ATT_F_READ,
-    //         .access_cb = handle_hid_input_report_descriptor
-    //     }
-    // }
-};
+/* Input Report characteristic of a Report ID, a macro as a const object can't initialize the service table */
+#define BT_APP_INPUT_REPORT_CHR(report_id, handle)                                  \
+    {                                                                               \
+        .uuid = BLE_UUID16_DECLARE(0x2A4D), /* Input Report */                      \
+        .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,                       \
+        .access_cb = handle_hid_input_report,                                       \
+        .arg = (void *) (report_id),                                                \
+        .val_handle = (handle),                                                     \
+        .descriptors = (struct ble_gatt_dsc_def[]) {                                \
+            {                                                                       \
+                .uuid = BLE_UUID16_DECLARE(0x2908), /* Report Reference */          \
+                .att_flags = BLE_ATT_F_READ,                                        \
+                .access_cb = handle_hid_report_reference,                           \
+                .arg = (void *) (report_id)                                         \
+            },                                                                      \
+            {0}                                                                     \
+        }                                                                           \
+    }
 
 static const struct ble_gatt_svc_def gatt_svcs[] = {
     {
@@ -74,44 +105,47 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
             {0}
         }
     },
-    // {
-    //     .type = BLE_GATT_SVC_TYPE_PRIMARY,
-    //     .uuid = BLE_UUID16_DECLARE(0x1812), // HID Device
-    //     .characteristics = (struct ble_gatt_chr_def[]) {
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A4A), // HID Information
-    //             .flags = BLE_GATT_CHR_F_READ,
-    //             .access_cb = handle_hid_read
-    //         },
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A4B), // Report Map
-    //             .flags = BLE_GATT_CHR_F_READ,
-    //             .access_cb = handle_report_map_read,
-    //         },
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A4C), // HID Control Point
-    //             .flags = BLE_GATT_CHR_F_WRITE_NO_RSP,
-    //             .access_cb = handle_hid_control_point_write
-    //         },
-    //         input_report_characteristic,
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A4E), // Protocol Mode
-    //             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE_NO_RSP,
-    //             .access_cb = handle_hid_protocol_mode
-    //         },
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A22), // Boot Input Report
-    //             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
-    //             .access_cb = handle_hid_input_report,
-    //         },
-    //         {
-    //             .uuid = BLE_UUID16_DECLARE(0x2A32), // Boot Output Report
-    //             .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
-    //             .access_cb = handle_hid_output_report,
-    //         },
-    //         {0}
-    //     },
-    // },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = BLE_UUID16_DECLARE(BLE_HID_SERVICE_UUID), // HID Device
+        .characteristics = (struct ble_gatt_chr_def[]) {
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A4A), // HID Information
+                .flags = BLE_GATT_CHR_F_READ,
+                .access_cb = handle_hid_read
+            },
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A4B), // Report Map
+                .flags = BLE_GATT_CHR_F_READ,
+                .access_cb = handle_report_map_read,
+            },
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A4C), // HID Control Point
+                .flags = BLE_GATT_CHR_F_WRITE_NO_RSP,
+                .access_cb = handle_hid_control_point_write
+            },
+            BT_APP_INPUT_REPORT_CHR(BT_APP_KEYBOARD_BOOT_REPORT_ID, &input_report_handle),
+            BT_APP_INPUT_REPORT_CHR(BT_APP_KEYBOARD_NKRO_REPORT_ID, &nkro_input_report_handle),
+            BT_APP_INPUT_REPORT_CHR(BT_APP_MOUSE_REPORT_ID, &mouse_input_report_handle),
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A4E), // Protocol Mode
+                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE_NO_RSP,
+                .access_cb = handle_hid_protocol_mode
+            },
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A22), // Boot Input Report
+                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_NOTIFY,
+                .access_cb = handle_hid_input_report,
+                .arg = (void *) BT_APP_KEYBOARD_BOOT_REPORT_ID  // Same layout as the boot compatible report
+            },
+            {
+                .uuid = BLE_UUID16_DECLARE(0x2A32), // Boot Output Report
+                .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_NO_RSP,
+                .access_cb = handle_hid_output_report,
+            },
+            {0}
+        },
+    },
 {
     .type = BLE_GATT_SVC_TYPE_PRIMARY,
     .uuid = BLE_UUID16_DECLARE(BLE_BATTERY_SERVICE_UUID), // Battery
@@ -124,6 +158,66 @@ static const struct ble_gatt_svc_def gatt_svcs[] = {
          {0}
         }
     },
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = BLE_CONFIG_UUID128_DECLARE(BLE_CONFIG_SERVICE_ID), // Bridge configuration
+        .characteristics = (struct ble_gatt_chr_def[]) {
+                {
+                    .uuid = BLE_CONFIG_UUID128_DECLARE(BLE_CONFIG_KEYMAP_ID),
+                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                             BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                    .access_cb = handle_config_keymap
+                },
+                {
+                    .uuid = BLE_CONFIG_UUID128_DECLARE(BLE_CONFIG_INJECT_ID),
+                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC |
+                             BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                    .access_cb = handle_config_inject
+                },
+                {
+                    .uuid = BLE_CONFIG_UUID128_DECLARE(BLE_CONFIG_MACRO_ID),
+                    .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                    .access_cb = handle_config_macro_write
+                },
+                {
+                    .uuid = BLE_CONFIG_UUID128_DECLARE(BLE_CONFIG_TASKS_ID),
+                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC,
+                    .access_cb = handle_config_tasks_read
+                },
+            {0}
+        }
+    },
+#if BT_APP_BENCH_SERVICE_ENABLED
+    {
+        .type = BLE_GATT_SVC_TYPE_PRIMARY,
+        .uuid = BLE_BENCH_UUID128_DECLARE(BLE_BENCH_SERVICE_ID), // Throughput/latency benchmark
+        .characteristics = (struct ble_gatt_chr_def[]) {
+                {
+                    .uuid = BLE_BENCH_UUID128_DECLARE(BLE_BENCH_CONTROL_ID),
+                    .flags = BLE_GATT_CHR_F_WRITE | BLE_GATT_CHR_F_WRITE_ENC,
+                    .access_cb = handle_bench_control_write
+                },
+                {
+                    .uuid = BLE_BENCH_UUID128_DECLARE(BLE_BENCH_STREAM_ID),
+                    .flags = BLE_GATT_CHR_F_NOTIFY,
+                    .access_cb = handle_bench_stream,
+                    .val_handle = &bt_bench_stream_handle
+                },
+                {
+                    .uuid = BLE_BENCH_UUID128_DECLARE(BLE_BENCH_ECHO_ID),
+                    .flags = BLE_GATT_CHR_F_WRITE_NO_RSP | BLE_GATT_CHR_F_WRITE_ENC | BLE_GATT_CHR_F_NOTIFY,
+                    .access_cb = handle_bench_echo_write,
+                    .val_handle = &bt_bench_echo_handle
+                },
+                {
+                    .uuid = BLE_BENCH_UUID128_DECLARE(BLE_BENCH_RESULTS_ID),
+                    .flags = BLE_GATT_CHR_F_READ | BLE_GATT_CHR_F_READ_ENC,
+                    .access_cb = handle_bench_results_read
+                },
+            {0}
+        }
+    },
+#endif
     {0}
 };
 
@@ -137,7 +231,8 @@ static void bt_configure_security() {
     ESP_LOGI(BT_TAG, "Security Mode 1 Configured (Level 2)");
 }
 
-static void bt_app_advertise() {
+/* Fast advertising for BT_APP_ADV_FAST_MS, then slow until a host connects */
+static void bt_app_advertise(bool fast) {
     struct ble_hs_adv_fields fields;
     const char *device_name = ble_svc_gap_device_name();
 
@@ -146,28 +241,41 @@ static void bt_app_advertise() {
     fields.flags = BLE_HS_ADV_F_DISC_GEN |
                        BLE_HS_ADV_F_BREDR_UNSUP;
 
-    fields.name = (uint8_t *)device_name;
-    fields.name_len = strlen(device_name);
-    fields.name_is_complete = 1;
     fields.appearance = BLE_APPEARANCE_HID_KEYBOARD;
     fields.uuids16 = (ble_uuid16_t[]) {
+        BLE_UUID16_INIT(BLE_HID_SERVICE_UUID),
         BLE_UUID16_INIT(BLE_BATTERY_SERVICE_UUID)
     };
-    fields.num_uuids16 = 1;
+    fields.num_uuids16 = 2;
     fields.uuids16_is_complete = 1;
     fields.tx_pwr_lvl_is_present = true;
     fields.tx_pwr_lvl = BLE_HS_ADV_TX_PWR_LVL_AUTO;
 
     ble_gap_adv_set_fields(&fields);
 
+    // The name goes in the scan response, with the HID service UUID it no longer fits the 31 advertising bytes
+    struct ble_hs_adv_fields rsp_fields;
+    memset(&rsp_fields, 0, sizeof(rsp_fields));
+    rsp_fields.name = (uint8_t *)device_name;
+    rsp_fields.name_len = strlen(device_name);
+    rsp_fields.name_is_complete = 1;
+    ble_gap_adv_rsp_set_fields(&rsp_fields);
+
     struct ble_gap_adv_params adv_params;
     memset(&adv_params, 0, sizeof(adv_params));
 
     adv_params.conn_mode = BLE_GAP_CONN_MODE_UND;
     adv_params.disc_mode = BLE_GAP_DISC_MODE_GEN;
+    const uint32_t itvl_ms = fast ? BT_APP_ADV_FAST_ITVL_MS : BT_APP_ADV_SLOW_ITVL_MS;
+    adv_params.itvl_min = BLE_GAP_ADV_ITVL_MS(itvl_ms);
+    adv_params.itvl_max = BLE_GAP_ADV_ITVL_MS(itvl_ms);
 
-    if (ble_gap_adv_start(ble_addr_type, NULL, BLE_HS_FOREVER, &adv_params, bt_app_gap_event, NULL) == 0) {
-        ESP_LOGI(BT_TAG, "Bluetooth advertising started...");
+    if (ble_gap_adv_active()) ble_gap_adv_stop();
+    atomic_store(&bt_adv_fast, fast);
+    const int32_t duration_ms = fast ? BT_APP_ADV_FAST_MS : BLE_HS_FOREVER;
+    if (ble_gap_adv_start(ble_addr_type, NULL, duration_ms, &adv_params, bt_app_gap_event, NULL) == 0) {
+        ESP_LOGI(BT_TAG, "Bluetooth advertising started (%lu ms interval)...", itvl_ms);
+        boot_milestone_mark_once(BOOT_MILESTONE_ADVERTISING);
     } else {
         ESP_LOGE(BT_TAG, "Failed to start bluetooth advertising!");
     }
@@ -177,9 +285,15 @@ int bt_app_gap_event(struct ble_gap_event *event, void *arg) {
     switch (event->type) {
         case BLE_GAP_EVENT_CONNECT:
             ESP_LOGI(BT_TAG, "Bluetooth connection status: %s", event->connect.status == 0 ? "OK" : "FAILED");
-            if (event->connect.status != 0) bt_app_advertise();
+            if (event->connect.status != 0) bt_app_advertise(true);
             else {
                 bt_conn_handle = event->connect.conn_handle;
+                atomic_store(&bt_adv_fast, false);
+                bt_app_set_link(true);
+                portENTER_CRITICAL(&bt_notify_lock);
+                bt_app_notify_init(&bt_notify_link, BT_APP_NOTIFY_MAX_PER_EVENT);
+                portEXIT_CRITICAL(&bt_notify_lock);
+                bt_app_update_conn_interval(bt_conn_handle);
                 int res;
                 if ((res = ble_gap_security_initiate(bt_conn_handle)) != 0) {
                     ESP_LOGE(BT_TAG, "Failed to initiate secure connection! Error: %d", res);
@@ -190,10 +304,34 @@ int bt_app_gap_event(struct ble_gap_event *event, void *arg) {
         case BLE_GAP_EVENT_DISCONNECT:
             ESP_LOGI(BT_TAG, "Bluetooth disconnected");
             bt_conn_handle = 0;
-            bt_app_advertise();
+            bt_app_log_notify_stats();
+            bt_app_update_subscription(BLE_HS_CONN_HANDLE_NONE, false);
+            bt_bench_stop();
+            bt_inject_stop();
+            bt_hid_stop();
+            bt_app_clear_reports();
+            bt_app_set_link(false);
+            bt_app_advertise(true);
+        break;
+        case BLE_GAP_EVENT_ADV_COMPLETE:
+            // Fast advertising ran out without a connection
+            if (event->adv_complete.reason == BLE_HS_ETIMEOUT) bt_app_advertise(false);
         break;
         case BLE_GAP_EVENT_SUBSCRIBE:
             ESP_LOGI(BT_TAG, "Bluetooth device notification subscriptions status: %d", event->subscribe.cur_notify);
+            bt_app_update_subscription(event->subscribe.attr_handle, event->subscribe.cur_notify);
+        break;
+        case BLE_GAP_EVENT_CONN_UPDATE:
+            if (event->conn_update.status == 0) bt_app_update_conn_interval(event->conn_update.conn_handle);
+        break;
+        case BLE_GAP_EVENT_NOTIFY_TX:
+            // Raised by NimBLE inside the notify call with the status the call returns, so the report paths count
+            // the outcome from the return code. It marks no over the air completion, pacing follows the connection
+            // interval instead.
+            if (event->notify_tx.status != 0) {
+                ESP_LOGD(BT_TAG, "Notification on handle %u failed: %d",
+                         event->notify_tx.attr_handle, event->notify_tx.status);
+            }
         break;
         case BLE_GAP_EVENT_PARING_COMPLETE:
             ESP_LOGI(BT_TAG, "Bluetooth pairing complete!");
@@ -222,12 +360,96 @@ int bt_app_gap_event(struct ble_gap_event *event, void *arg) {
     return 0;
 }
 
+static void bt_app_log_notify_stats(void) {
+    portENTER_CRITICAL(&bt_notify_lock);
+    const bt_app_notify_stats_t stats = bt_notify_link.stats;
+    portEXIT_CRITICAL(&bt_notify_lock);
+    ESP_LOGI(BT_TAG, "Notifications: %lu sent, %lu deferred, %lu out of buffers, %lu failed, %lu budget cuts, "
+             "%u in flight at most", stats.sent, stats.deferred, stats.nomem, stats.errors, stats.budget_cuts,
+             stats.max_in_flight);
+    bt_hid_log_stats();
+}
+
+static void bt_app_set_link(bool connected) {
+    atomic_store(&bt_link_up, connected);
+    if (bt_link_callback) bt_link_callback(connected);
+}
+
+static void bt_app_set_listening(bool listening) {
+    bt_hid_set_listening(listening);
+    if (bt_listen_callback) bt_listen_callback(listening);
+}
+
+/*
+ * Keeps the CCCD state of the input reports for the connection, BLE_HS_CONN_HANDLE_NONE clears all of them.
+ * Bonded hosts get their subscriptions restored on reconnect, which raises the same event.
+ */
+static void bt_app_update_subscription(uint16_t attr_handle, bool notify) {
+    const uint8_t was_subscribed = bt_subscribed_reports;
+    uint8_t bit = 0;
+    if (attr_handle == BLE_HS_CONN_HANDLE_NONE) bt_subscribed_reports = 0;
+    else if (attr_handle == input_report_handle) bit = 1 << 0;
+    else if (attr_handle == nkro_input_report_handle) bit = 1 << 1;
+    else if (attr_handle == mouse_input_report_handle) bit = 1 << 2;
+    else return;
+
+    if (notify) bt_subscribed_reports |= bit;
+    else bt_subscribed_reports &= ~bit;
+    if (!was_subscribed != !bt_subscribed_reports) {
+        ESP_LOGI(BT_TAG, "%s", bt_subscribed_reports ? "Host subscribed to the input reports" : "No host subscribed");
+        bt_app_set_listening(bt_subscribed_reports);
+    }
+}
+
 static void bt_app_on_sync() {
     if (ble_hs_id_infer_auto(false, &ble_addr_type) != 0) {
         ESP_LOGE(BT_TAG, "Failed to find best address type!");
         esp_restart();
     }
-    bt_app_advertise();
+    bt_app_advertise(true);
+}
+
+/*
+ * Reports wait in the schedulers, where they can still be merged, until the connection event that carries them.
+ * The timer runs at the connection interval only while a scheduler has work, idle links cost no wakeups.
+ */
+static void bt_app_connection_event(void *arg) {
+    atomic_store(&bt_conn_events_requested, false);
+    portENTER_CRITICAL(&bt_notify_lock);
+    bt_app_notify_connection_event(&bt_notify_link);
+    portEXIT_CRITICAL(&bt_notify_lock);
+    const bool hid_busy = bt_hid_connection_event();
+    const bool inject_busy = bt_inject_connection_event();
+    if (hid_busy || inject_busy) return;
+
+    esp_timer_stop(bt_conn_event_timer);
+    // A request that raced with the stop saw the timer still running
+    if (atomic_load(&bt_conn_events_requested) &&
+        esp_timer_start_periodic(bt_conn_event_timer, bt_conn_interval_us) == ESP_OK) return;
+    power_manager_release(POWER_MANAGER_LOCK_BLE_BURST);
+}
+
+void bt_app_request_connection_events(void) {
+    if (!bt_conn_event_timer) return;
+    atomic_store(&bt_conn_events_requested, true);
+    // Full clock while the timer runs, the burst is short and the reports should not wait for the CPU
+    if (esp_timer_is_active(bt_conn_event_timer)) return;
+    power_manager_acquire(POWER_MANAGER_LOCK_BLE_BURST);
+    if (esp_timer_start_periodic(bt_conn_event_timer, bt_conn_interval_us) != ESP_OK) {
+        power_manager_release(POWER_MANAGER_LOCK_BLE_BURST);
+    }
+}
+
+static void bt_app_update_conn_interval(uint16_t conn_handle) {
+    struct ble_gap_conn_desc conn_desc;
+    if (ble_gap_conn_find(conn_handle, &conn_desc) != 0) return;
+
+    bt_conn_interval_us = conn_desc.conn_itvl * 1250;
+    ESP_LOGI(BT_TAG, "Connection interval %lu us", bt_conn_interval_us);
+    if (esp_timer_is_active(bt_conn_event_timer)) {
+        esp_timer_stop(bt_conn_event_timer);
+        esp_timer_start_periodic(bt_conn_event_timer, bt_conn_interval_us);
+    }
 }
 
 void host_task(void *args) {
@@ -243,10 +465,98 @@ void bt_app_init() {
     ble_gatts_add_svcs(gatt_svcs);
 
     bt_configure_security();
+    const esp_timer_create_args_t conn_event_args = {
+        .callback = bt_app_connection_event,
+        .name = "bt_conn_event"
+    };
+    if (esp_timer_create(&conn_event_args, &bt_conn_event_timer) != ESP_OK) {
+        ESP_LOGE(BT_TAG, "Failed to create connection event timer!");
+        esp_restart();
+    }
+    bt_hid_setup();
+    bt_inject_setup();
     ble_hs_cfg.sync_cb = bt_app_on_sync;
     nimble_port_freertos_init(host_task);
 }
 
-void bt_app_send_input_report() {
-    ble_gatts_notify(bt_conn_handle, *input_report_characteristic.val_handle);
+/*
+ * Every HID report notification goes through here and takes a slot of the connection first, BLE_HS_EBUSY without
+ * one. A NULL report notifies the value the attribute returns on reads, any other report becomes that value once
+ * the stack took it.
+ */
+static int bt_app_notify_tracked(uint16_t attr_handle, uint8_t report_id, const uint8_t *report, uint16_t length) {
+    portENTER_CRITICAL(&bt_notify_lock);
+    const bool reserved = bt_app_notify_reserve(&bt_notify_link);
+    portEXIT_CRITICAL(&bt_notify_lock);
+    if (!reserved) return BLE_HS_EBUSY;
+
+    int rc = BLE_HS_ENOMEM;
+    struct os_mbuf *om = report ? ble_hs_mbuf_from_flat(report, length) : NULL;
+    if (om || !report) rc = ble_gatts_notify_custom(bt_conn_handle, attr_handle, om);
+
+    const bt_app_notify_status_t status = rc == 0 ? BT_APP_NOTIFY_OK
+                                        : rc == BLE_HS_ENOMEM ? BT_APP_NOTIFY_NOMEM
+                                        : BT_APP_NOTIFY_ERROR;
+    // The lock serializes the writers of the read value, the readers in the host task never take it
+    portENTER_CRITICAL(&bt_notify_lock);
+    bt_app_notify_complete(&bt_notify_link, status);
+    if (rc == 0 && report) bt_hid_publish_report(report_id, report, length);
+    portEXIT_CRITICAL(&bt_notify_lock);
+    return rc;
+}
+
+/* A new connection starts with nothing held, reads return all released reports until the first notification */
+static void bt_app_clear_reports(void) {
+    static const uint8_t released[BT_APP_KEYBOARD_NKRO_REPORT_LEN] = { 0 };
+    portENTER_CRITICAL(&bt_notify_lock);
+    bt_hid_publish_report(BT_APP_KEYBOARD_BOOT_REPORT_ID, released, BT_APP_KEYBOARD_BOOT_REPORT_LEN);
+    bt_hid_publish_report(BT_APP_KEYBOARD_NKRO_REPORT_ID, released, BT_APP_KEYBOARD_NKRO_REPORT_LEN);
+    bt_hid_publish_report(BT_APP_MOUSE_REPORT_ID, released, BT_APP_MOUSE_REPORT_LEN);
+    portEXIT_CRITICAL(&bt_notify_lock);
+}
+
+int bt_app_send_input_report() {
+    return bt_app_notify_tracked(input_report_handle, BT_APP_KEYBOARD_BOOT_REPORT_ID, NULL, 0);
+}
+
+int bt_app_notify_input_report(const uint8_t *report, uint16_t length) {
+    return bt_app_notify_tracked(input_report_handle, BT_APP_KEYBOARD_BOOT_REPORT_ID, report, length);
+}
+
+int bt_app_notify_nkro_report(const uint8_t *report, uint16_t length) {
+    if (ble_att_mtu(bt_conn_handle) < length + 3) return BLE_HS_EMSGSIZE;
+    return bt_app_notify_tracked(nkro_input_report_handle, BT_APP_KEYBOARD_NKRO_REPORT_ID, report, length);
+}
+
+int bt_app_notify_mouse_report(const uint8_t *report, uint16_t length) {
+    return bt_app_notify_tracked(mouse_input_report_handle, BT_APP_MOUSE_REPORT_ID, report, length);
+}
+
+void bt_app_key_event(uint8_t key_code, bool pressed) {
+    bt_hid_key_event(key_code, pressed);
+}
+
+void bt_app_mouse_event(uint8_t buttons, int16_t x, int16_t y, int16_t wheel) {
+    bt_hid_mouse_report(buttons, x, y, wheel);
+}
+
+void bt_app_set_listen_callback(bt_app_listen_cb_t callback) {
+    bt_listen_callback = callback;
+    if (callback) callback(bt_subscribed_reports);
+}
+
+void bt_app_set_link_callback(bt_app_link_cb_t callback) {
+    bt_link_callback = callback;
+    if (callback) callback(atomic_load(&bt_link_up));
+}
+
+void bt_app_wake(void) {
+    if (atomic_load(&bt_link_up) || atomic_load(&bt_adv_fast)) return;
+    bt_wakeups++;
+    ESP_LOGI(BT_TAG, "Woken by USB input (%lu times), advertising fast", bt_wakeups);
+    bt_app_advertise(true);
+}
+
+void bt_app_type_macro(uint8_t slot) {
+    bt_inject_macro(slot);
 }
\ No newline at end of file
@@ -5,8 +5,55 @@
 #ifndef BT_APP_H
 #define BT_APP_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void bt_app_init();
 
-void bt_app_send_input_report();
+/* Notifies the value of the input report attribute, returns the NimBLE error code */
+int bt_app_send_input_report();
+
+/*
+ * The report notifications below share the slots of the connection and return BLE_HS_EBUSY when none is left
+ * in this connection event, or BLE_HS_ENOMEM when the stack is out of buffers. The report is for the caller to
+ * retry at a later connection event.
+ */
+
+/* Notifies an 8 byte boot keyboard report on the input report, returns the NimBLE error code */
+int bt_app_notify_input_report(const uint8_t *report, uint16_t length);
+
+/* Notifies the NKRO bitmap report, BLE_HS_EMSGSIZE while the ATT MTU is too small for it */
+int bt_app_notify_nkro_report(const uint8_t *report, uint16_t length);
+
+/* Notifies a 4 byte mouse report, returns the NimBLE error code */
+int bt_app_notify_mouse_report(const uint8_t *report, uint16_t length);
+
+/* Starts the connection interval timer that feeds the report schedulers, safe to call from any task */
+void bt_app_request_connection_events(void);
+
+/* Forwards a key event of the bridged keyboards to the HID service */
+void bt_app_key_event(uint8_t key_code, bool pressed);
+
+/* Forwards a report of the bridged mice to the HID service */
+void bt_app_mouse_event(uint8_t buttons, int16_t x, int16_t y, int16_t wheel);
+
+/* Called when the first host subscribes to the input reports or the last one unsubscribes */
+typedef void (*bt_app_listen_cb_t)(bool listening);
+
+/* Registers the listener callback and calls it once with the current state */
+void bt_app_set_listen_callback(bt_app_listen_cb_t callback);
+
+/* Called when a host connects or the link drops */
+typedef void (*bt_app_link_cb_t)(bool connected);
+
+/* Registers the link callback and calls it once with the current state */
+void bt_app_set_link_callback(bt_app_link_cb_t callback);
+
+/* Advertises at the fast interval again while no host is connected, so a bonded host reconnects sooner. Safe to
+ * call from any task. */
+void bt_app_wake(void);
+
+/* Types a macro stored over GATT, safe to call from any task */
+void bt_app_type_macro(uint8_t slot);
 
 #endif //BT_APP_H
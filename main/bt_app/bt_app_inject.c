@@ -0,0 +1,168 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_inject.h"
+
+#include <string.h>
+
+#include "usb_app/hid_usage_keyboard.h"
+
+static const char bt_app_inject_symbols[] = "-=[]\\;'`,./";
+static const char bt_app_inject_shifted_symbols[] = "_+{}|:\"~<>?";
+static const uint8_t bt_app_inject_symbol_keys[] = {
+    HID_KEY_MINUS, HID_KEY_EQUAL, HID_KEY_OPEN_BRACKET, HID_KEY_CLOSE_BRACKET, HID_KEY_BACK_SLASH,
+    HID_KEY_COLON, HID_KEY_QUOTE, HID_KEY_TILDE, HID_KEY_LESS, HID_KEY_GREATER, HID_KEY_SLASH
+};
+static const char bt_app_inject_shifted_digits[] = ")!@#$%^&*(";
+
+bool bt_app_inject_char_to_key(char c, uint8_t *modifier, uint8_t *usage) {
+    *modifier = 0;
+    if (c >= 'a' && c <= 'z') {
+        *usage = HID_KEY_A + (c - 'a');
+    } else if (c >= 'A' && c <= 'Z') {
+        *modifier = HID_LEFT_SHIFT;
+        *usage = HID_KEY_A + (c - 'A');
+    } else if (c >= '1' && c <= '9') {
+        *usage = HID_KEY_1 + (c - '1');
+    } else if (c == '0') {
+        *usage = HID_KEY_0;
+    } else if (c == '\n') {
+        *usage = HID_KEY_ENTER;
+    } else if (c == '\t') {
+        *usage = HID_KEY_TAB;
+    } else if (c == '\b') {
+        *usage = HID_KEY_DEL;
+    } else if (c == ' ') {
+        *usage = HID_KEY_SPACE;
+    } else if (c == 0) {
+        return false;
+    } else {
+        const char *symbol = strchr(bt_app_inject_symbols, c);
+        const char *shifted = strchr(bt_app_inject_shifted_symbols, c);
+        const char *digit = strchr(bt_app_inject_shifted_digits, c);
+        if (symbol) {
+            *usage = bt_app_inject_symbol_keys[symbol - bt_app_inject_symbols];
+        } else if (shifted) {
+            *modifier = HID_LEFT_SHIFT;
+            *usage = bt_app_inject_symbol_keys[shifted - bt_app_inject_shifted_symbols];
+        } else if (digit) {
+            *modifier = HID_LEFT_SHIFT;
+            *usage = digit == bt_app_inject_shifted_digits ? HID_KEY_0 : HID_KEY_1 + (digit - bt_app_inject_shifted_digits - 1);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool bt_app_inject_report_empty(const uint8_t *report) {
+    for (int i = 0; i < BT_APP_INJECT_REPORT_LEN; i++) {
+        if (report[i]) return false;
+    }
+    return true;
+}
+
+/* Builds the report after inject->report, false once everything is typed and released */
+static bool bt_app_inject_next_report(bt_app_inject_t *inject, uint8_t *report) {
+    memset(report, 0, BT_APP_INJECT_REPORT_LEN);
+    const bool held = !bt_app_inject_report_empty(inject->report);
+
+    while (inject->pos < inject->length) {
+        uint8_t modifier;
+        uint8_t usage;
+        size_t consumed = 1;
+        if (inject->data[inject->pos] == BT_APP_INJECT_OP_KEY) {
+            if (inject->pos + 3 > inject->length) {
+                inject->pos = inject->length;
+                break;
+            }
+            modifier = inject->data[inject->pos + 1];
+            usage = inject->data[inject->pos + 2];
+            consumed = 3;
+        } else if (!bt_app_inject_char_to_key(inject->data[inject->pos], &modifier, &usage)) {
+            inject->pos++;
+            continue;
+        }
+
+        // The same key has to go up before it can go down again
+        if (held && (!inject->collapse_releases || usage == inject->report[2])) return true;
+
+        report[0] = modifier;
+        report[2] = usage;
+        inject->pos += consumed;
+        inject->stats.chars++;
+        return true;
+    }
+    return held;
+}
+
+void bt_app_inject_init(bt_app_inject_t *inject, uint8_t window, bt_app_inject_send_cb_t send, void *arg) {
+    memset(inject, 0, sizeof(*inject));
+    inject->collapse_releases = true;
+    inject->window = window ? window : 1;
+    inject->send = send;
+    inject->arg = arg;
+}
+
+int bt_app_inject_start(bt_app_inject_t *inject, const uint8_t *data, size_t length, int64_t now_us) {
+    if (inject->active || length > BT_APP_INJECT_MAX_LEN) return -1;
+
+    memcpy(inject->data, data, length);
+    inject->length = length;
+    inject->pos = 0;
+    inject->next_ready = false;
+    inject->started_us = now_us;
+    memset(&inject->stats, 0, sizeof(inject->stats));
+    inject->active = true;
+    inject->stats.active = 1;
+    return 0;
+}
+
+static void bt_app_inject_update_stats(bt_app_inject_t *inject, int64_t now_us) {
+    inject->stats.elapsed_ms = (now_us - inject->started_us) / 1000;
+    if (inject->stats.elapsed_ms) {
+        inject->stats.chars_per_s = (uint64_t) inject->stats.chars * 1000 / inject->stats.elapsed_ms;
+    }
+}
+
+bool bt_app_inject_pump(bt_app_inject_t *inject, int64_t now_us) {
+    while (inject->active && inject->in_flight < inject->window) {
+        if (!inject->next_ready) {
+            if (!bt_app_inject_next_report(inject, inject->next)) {
+                // Done once the last release is out
+                if (inject->in_flight == 0) {
+                    inject->active = false;
+                    inject->stats.active = 0;
+                    bt_app_inject_update_stats(inject, now_us);
+                }
+                return false;
+            }
+            inject->next_ready = true;
+        }
+
+        if (inject->send(inject->next, BT_APP_INJECT_REPORT_LEN, inject->arg) != 0) {
+            inject->stats.send_failures++;
+            return inject->in_flight == 0;
+        }
+        memcpy(inject->report, inject->next, BT_APP_INJECT_REPORT_LEN);
+        inject->next_ready = false;
+        inject->in_flight++;
+        inject->stats.reports++;
+    }
+    bt_app_inject_update_stats(inject, now_us);
+    return false;
+}
+
+bool bt_app_inject_connection_event(bt_app_inject_t *inject, int64_t now_us) {
+    inject->in_flight = 0;
+    return bt_app_inject_pump(inject, now_us);
+}
+
+void bt_app_inject_stop(bt_app_inject_t *inject) {
+    inject->active = false;
+    inject->stats.active = 0;
+    inject->in_flight = 0;
+    inject->next_ready = false;
+    memset(inject->report, 0, BT_APP_INJECT_REPORT_LEN);
+}
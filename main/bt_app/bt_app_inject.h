@@ -0,0 +1,82 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_INJECT_H
+#define BT_APP_INJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Text and macro injection.
+ *
+ * Text is typed on a US layout as 8 byte boot keyboard reports. A character whose key differs from the one
+ * held goes out as a single report that releases the old key and presses the new one, only repeated keys
+ * need a release report in between. One window of reports is handed to the stack per connection event, so
+ * typing runs as fast as the connection carries it.
+ *
+ * Data is text (printable ASCII, '\n', '\t', '\b') with one escape:
+ *      BT_APP_INJECT_OP_KEY | modifier u8 | usage u8 |     taps any key, e.g. Ctrl+C
+ */
+
+#define BT_APP_INJECT_MAX_LEN               512
+#define BT_APP_INJECT_REPORT_LEN            8
+#define BT_APP_INJECT_OP_KEY                0x01
+
+/* Returns 0 if the report was handed to the stack */
+typedef int (*bt_app_inject_send_cb_t)(const uint8_t *report, size_t length, void *arg);
+
+typedef struct {
+    uint32_t chars;                     // Characters and key taps typed
+    uint32_t reports;                   // Reports queued
+    uint32_t send_failures;             // Reports the stack refused, retried later
+    uint32_t elapsed_ms;
+    uint32_t chars_per_s;
+    uint8_t active;
+} bt_app_inject_stats_t;
+
+typedef struct {
+    uint8_t data[BT_APP_INJECT_MAX_LEN];
+    size_t length;
+    size_t pos;
+    bool active;
+    bool collapse_releases;             // Skip the release report between different keys, on by default
+    uint8_t window;                     // Reports handed to the stack per connection event
+    uint8_t in_flight;                  // Reports handed to the stack since the last connection event
+    uint8_t report[BT_APP_INJECT_REPORT_LEN];       // Last report queued
+    uint8_t next[BT_APP_INJECT_REPORT_LEN];
+    bool next_ready;
+    int64_t started_us;
+    bt_app_inject_stats_t stats;
+    bt_app_inject_send_cb_t send;
+    void *arg;
+} bt_app_inject_t;
+
+void bt_app_inject_init(bt_app_inject_t *inject, uint8_t window, bt_app_inject_send_cb_t send, void *arg);
+
+/**
+ * @brief Start typing data
+ *
+ * @return 0 on success, -1 if an injection is running or data is too long
+ */
+int bt_app_inject_start(bt_app_inject_t *inject, const uint8_t *data, size_t length, int64_t now_us);
+
+/**
+ * @brief Queue reports until the window is full
+ *
+ * @return true if a report was refused with nothing in flight, the caller has to call this again later
+ */
+bool bt_app_inject_pump(bt_app_inject_t *inject, int64_t now_us);
+
+/* Call once per connection interval, the reports handed to the stack before are on air by then */
+bool bt_app_inject_connection_event(bt_app_inject_t *inject, int64_t now_us);
+
+/* Drops the rest of the data, for a lost connection */
+void bt_app_inject_stop(bt_app_inject_t *inject);
+
+/* US layout, returns false for characters that cannot be typed */
+bool bt_app_inject_char_to_key(char c, uint8_t *modifier, uint8_t *usage);
+
+#endif //BT_APP_INJECT_H
@@ -0,0 +1,65 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_keyboard.h"
+
+#include <string.h>
+
+#include "usb_app/hid_usage_keyboard.h"
+
+#define BT_APP_KEYBOARD_MODIFIER_BYTE           (HID_KEY_LEFT_CONTROL >> 3)
+
+void bt_app_keyboard_init(bt_app_keyboard_t *keyboard) {
+    memset(keyboard, 0, sizeof(*keyboard));
+}
+
+/* Only needed when leaving rollover, the boot keys are then taken in usage order */
+static void bt_app_keyboard_refill_boot_keys(bt_app_keyboard_t *keyboard) {
+    keyboard->boot_count = 0;
+    for (int usage = HID_KEY_A; usage < HID_KEY_LEFT_CONTROL && keyboard->boot_count < keyboard->held; usage++) {
+        if (bt_app_keyboard_is_pressed(keyboard, usage)) keyboard->boot_keys[keyboard->boot_count++] = usage;
+    }
+}
+
+bool bt_app_keyboard_apply(bt_app_keyboard_t *keyboard, uint8_t usage, bool pressed) {
+    if (usage <= HID_KEY_ERROR_UNDEFINED || usage > BT_APP_KEYBOARD_USAGE_MAX) return false;
+    if (bt_app_keyboard_is_pressed(keyboard, usage) == pressed) return false;
+
+    keyboard->bits[usage >> 3] ^= 1 << (usage & 7);
+    if (usage >= HID_KEY_LEFT_CONTROL) return true;
+
+    if (pressed) {
+        keyboard->held++;
+        if (keyboard->boot_count < BT_APP_KEYBOARD_BOOT_KEYS) keyboard->boot_keys[keyboard->boot_count++] = usage;
+        return true;
+    }
+
+    keyboard->held--;
+    for (int i = 0; i < keyboard->boot_count; i++) {
+        if (keyboard->boot_keys[i] != usage) continue;
+        memmove(&keyboard->boot_keys[i], &keyboard->boot_keys[i + 1], keyboard->boot_count - i - 1);
+        keyboard->boot_count--;
+        break;
+    }
+    if (keyboard->held <= BT_APP_KEYBOARD_BOOT_KEYS && keyboard->boot_count != keyboard->held) {
+        bt_app_keyboard_refill_boot_keys(keyboard);
+    }
+    return true;
+}
+
+void bt_app_keyboard_boot_report(const bt_app_keyboard_t *keyboard, uint8_t report[BT_APP_KEYBOARD_BOOT_REPORT_LEN]) {
+    report[0] = keyboard->bits[BT_APP_KEYBOARD_MODIFIER_BYTE];
+    report[1] = 0;
+    if (keyboard->held > BT_APP_KEYBOARD_BOOT_KEYS) {
+        memset(report + 2, HID_KEY_ROLLOVER, BT_APP_KEYBOARD_BOOT_KEYS);
+        return;
+    }
+    memset(report + 2, 0, BT_APP_KEYBOARD_BOOT_KEYS);
+    memcpy(report + 2, keyboard->boot_keys, keyboard->boot_count);
+}
+
+void bt_app_keyboard_nkro_report(const bt_app_keyboard_t *keyboard, uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN]) {
+    report[0] = keyboard->bits[BT_APP_KEYBOARD_MODIFIER_BYTE];
+    memcpy(report + 1, keyboard->bits, BT_APP_KEYBOARD_NKRO_BITMAP_LEN);
+}
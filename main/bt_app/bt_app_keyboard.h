@@ -0,0 +1,54 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_KEYBOARD_H
+#define BT_APP_KEYBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Outgoing keyboard state.
+ *
+ * Every key event sets or clears one bit of a bitmap indexed by usage, so the NKRO report is a copy of the
+ * bitmap and costs the same with 1 or 100 keys down. The boot compatible report keeps the first six keys in
+ * press order next to it and switches to ErrorRollOver while more than six keys are held.
+ *
+ * Boot report:    modifiers u8 | reserved u8 | usage u8 x6 |
+ * NKRO report:    modifiers u8 | bitmap of usages 0x00-0xDF, 28 bytes |
+ */
+
+#define BT_APP_KEYBOARD_BOOT_REPORT_LEN         8
+#define BT_APP_KEYBOARD_BOOT_KEYS               6
+#define BT_APP_KEYBOARD_NKRO_BITMAP_LEN         28          // Usages 0x00-0xDF, modifiers come first
+#define BT_APP_KEYBOARD_NKRO_REPORT_LEN         (1 + BT_APP_KEYBOARD_NKRO_BITMAP_LEN)
+#define BT_APP_KEYBOARD_BOOT_REPORT_ID          1
+#define BT_APP_KEYBOARD_NKRO_REPORT_ID          2
+#define BT_APP_KEYBOARD_USAGE_MAX               0xE7        // Right GUI, the last modifier
+
+typedef struct {
+    uint8_t bits[32];                                   // One bit per usage, the modifiers are byte 28
+    uint8_t boot_keys[BT_APP_KEYBOARD_BOOT_KEYS];       // Keys of the boot report in press order
+    uint8_t boot_count;
+    uint8_t held;                                       // Keys down, modifiers excluded
+} bt_app_keyboard_t;
+
+void bt_app_keyboard_init(bt_app_keyboard_t *keyboard);
+
+/**
+ * @brief Press or release one usage, modifiers included
+ *
+ * @return true if the reports changed, false for repeated or out of range events
+ */
+bool bt_app_keyboard_apply(bt_app_keyboard_t *keyboard, uint8_t usage, bool pressed);
+
+static inline bool bt_app_keyboard_is_pressed(const bt_app_keyboard_t *keyboard, uint8_t usage) {
+    return keyboard->bits[usage >> 3] & (1 << (usage & 7));
+}
+
+void bt_app_keyboard_boot_report(const bt_app_keyboard_t *keyboard, uint8_t report[BT_APP_KEYBOARD_BOOT_REPORT_LEN]);
+
+void bt_app_keyboard_nkro_report(const bt_app_keyboard_t *keyboard, uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN]);
+
+#endif //BT_APP_KEYBOARD_H
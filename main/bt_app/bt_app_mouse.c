@@ -0,0 +1,128 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_mouse.h"
+
+#include <string.h>
+
+void bt_app_mouse_init(bt_app_mouse_t *mouse, uint8_t window, bt_app_mouse_policy_t policy,
+                       bt_app_mouse_send_cb_t send, void *arg) {
+    memset(mouse, 0, sizeof(*mouse));
+    mouse->window = window ? window : 1;
+    mouse->policy = policy;
+    mouse->send = send;
+    mouse->arg = arg;
+}
+
+static int16_t bt_app_mouse_add(int16_t pending, int16_t delta) {
+    const int32_t sum = pending + delta;
+    return sum > INT16_MAX ? INT16_MAX : sum < INT16_MIN ? INT16_MIN : sum;
+}
+
+static int8_t bt_app_mouse_clamp(int16_t value) {
+    return value > INT8_MAX ? INT8_MAX : value < -INT8_MAX ? -INT8_MAX : value;
+}
+
+static void bt_app_mouse_apply_motion(bt_app_mouse_t *mouse, bt_app_mouse_entry_t *entry,
+                                      int16_t x, int16_t y, int16_t wheel) {
+    if (mouse->policy == BT_APP_MOUSE_POLICY_DROP) {
+        if (entry->x || entry->y || entry->wheel) mouse->stats.dropped++;
+        entry->x = x;
+        entry->y = y;
+        entry->wheel = wheel;
+        return;
+    }
+    entry->x = bt_app_mouse_add(entry->x, x);
+    entry->y = bt_app_mouse_add(entry->y, y);
+    entry->wheel = bt_app_mouse_add(entry->wheel, wheel);
+    mouse->stats.merged++;
+}
+
+static void bt_app_mouse_pump(bt_app_mouse_t *mouse) {
+    while (mouse->count && mouse->sent < mouse->window) {
+        bt_app_mouse_entry_t *entry = &mouse->entries[mouse->head];
+        const int8_t x = bt_app_mouse_clamp(entry->x);
+        const int8_t y = bt_app_mouse_clamp(entry->y);
+        const int8_t wheel = bt_app_mouse_clamp(entry->wheel);
+        const uint8_t report[BT_APP_MOUSE_REPORT_LEN] = { entry->buttons, x, y, wheel };
+        if (mouse->send(report, mouse->arg) != 0) {
+            mouse->stats.send_failures++;
+            return;
+        }
+        mouse->sent++;
+        mouse->stats.reports++;
+
+        // Motion beyond one report stays at the head for the next one
+        entry->x -= x;
+        entry->y -= y;
+        entry->wheel -= wheel;
+        if (entry->x || entry->y || entry->wheel) continue;
+        mouse->head = (mouse->head + 1) % BT_APP_MOUSE_DEPTH;
+        mouse->count--;
+    }
+}
+
+void bt_app_mouse_report(bt_app_mouse_t *mouse, uint8_t buttons, int16_t x, int16_t y, int16_t wheel) {
+    if (buttons == mouse->buttons && !x && !y && !wheel) return;
+    mouse->stats.events++;
+    if (mouse->paused) {
+        mouse->buttons = buttons;
+        return;
+    }
+
+    bt_app_mouse_entry_t *tail = mouse->count
+        ? &mouse->entries[(mouse->head + mouse->count - 1) % BT_APP_MOUSE_DEPTH]
+        : NULL;
+
+    if (tail && tail->buttons == buttons) {
+        bt_app_mouse_apply_motion(mouse, tail, x, y, wheel);
+    } else if (mouse->count < BT_APP_MOUSE_DEPTH) {
+        if (tail) mouse->stats.splits++;
+        tail = &mouse->entries[(mouse->head + mouse->count) % BT_APP_MOUSE_DEPTH];
+        *tail = (bt_app_mouse_entry_t) { buttons, x, y, wheel };
+        if (++mouse->count > mouse->stats.max_depth) mouse->stats.max_depth = mouse->count;
+    } else {
+        tail->buttons = buttons;
+        bt_app_mouse_apply_motion(mouse, tail, x, y, wheel);
+        mouse->stats.overflows++;
+    }
+    mouse->buttons = buttons;
+
+    bt_app_mouse_pump(mouse);
+}
+
+bool bt_app_mouse_connection_event(bt_app_mouse_t *mouse) {
+    if (mouse->paused) return false;
+    const bool busy = mouse->sent || mouse->count;
+    mouse->sent = 0;
+    bt_app_mouse_pump(mouse);
+    return busy;
+}
+
+void bt_app_mouse_reset(bt_app_mouse_t *mouse) {
+    mouse->head = 0;
+    mouse->count = 0;
+    mouse->sent = 0;
+
+    // A new connection starts with no button held on the host side
+    if (mouse->paused || !mouse->buttons) return;
+    mouse->entries[0] = (bt_app_mouse_entry_t) { mouse->buttons, 0, 0, 0 };
+    mouse->count = 1;
+}
+
+void bt_app_mouse_pause(bt_app_mouse_t *mouse) {
+    mouse->head = 0;
+    mouse->count = 0;
+    mouse->sent = 0;
+    mouse->paused = true;
+}
+
+void bt_app_mouse_resume(bt_app_mouse_t *mouse) {
+    if (!mouse->paused) return;
+    mouse->paused = false;
+    mouse->entries[0] = (bt_app_mouse_entry_t) { mouse->buttons, 0, 0, 0 };
+    mouse->head = 0;
+    mouse->count = 1;
+    bt_app_mouse_pump(mouse);
+}
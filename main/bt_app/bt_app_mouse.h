@@ -0,0 +1,92 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_MOUSE_H
+#define BT_APP_MOUSE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Outgoing mouse report queue.
+ *
+ * Like the keyboard scheduler, only window reports are handed to the stack per connection event. Motion that
+ * arrives in between is folded into the newest pending report by the policy, while a button change always starts
+ * a new report so no click is lost. Motion above the 8 bit range of a report is sent over several reports.
+ *
+ * While no host is subscribed the queue is paused: motion is dropped, the buttons are latched and resuming queues
+ * them once.
+ */
+
+#define BT_APP_MOUSE_DEPTH                  8           // Pending reports, one per button change
+#define BT_APP_MOUSE_REPORT_ID              3
+#define BT_APP_MOUSE_REPORT_LEN             4           // Buttons, X, Y, wheel
+
+typedef enum {
+    BT_APP_MOUSE_POLICY_MERGE,          // Sum the motion into the pending report, nothing is lost
+    BT_APP_MOUSE_POLICY_DROP            // Replace the pending motion with the newest, stale motion is dropped
+} bt_app_mouse_policy_t;
+
+/* Returns 0 if the report was handed to the stack */
+typedef int (*bt_app_mouse_send_cb_t)(const uint8_t *report, void *arg);
+
+typedef struct {
+    uint8_t buttons;
+    int16_t x;                          // Motion not sent yet
+    int16_t y;
+    int16_t wheel;
+} bt_app_mouse_entry_t;
+
+typedef struct {
+    uint32_t events;                    // USB reports in
+    uint32_t reports;                   // Reports handed to the stack
+    uint32_t merged;                    // Motion folded into a pending report
+    uint32_t dropped;                   // Pending motion replaced by newer motion
+    uint32_t splits;                    // Reports started by a button change
+    uint32_t overflows;                 // Button changes merged into a full queue, the host misses a click
+    uint32_t send_failures;             // Reports the stack refused, kept for the next connection event
+    uint8_t max_depth;
+} bt_app_mouse_stats_t;
+
+typedef struct {
+    bt_app_mouse_entry_t entries[BT_APP_MOUSE_DEPTH];
+    uint8_t head;
+    uint8_t count;
+    uint8_t window;                     // Reports handed to the stack per connection event
+    uint8_t sent;                       // Reports handed to the stack since the last connection event
+    uint8_t buttons;                    // Newest button state
+    bool paused;                        // No host subscribed, nothing is queued
+    bt_app_mouse_policy_t policy;
+    bt_app_mouse_stats_t stats;
+    bt_app_mouse_send_cb_t send;
+    void *arg;
+} bt_app_mouse_t;
+
+void bt_app_mouse_init(bt_app_mouse_t *mouse, uint8_t window, bt_app_mouse_policy_t policy,
+                       bt_app_mouse_send_cb_t send, void *arg);
+
+/* Applies one USB mouse report and sends what the window allows, motion past 8 bits goes out over several reports */
+void bt_app_mouse_report(bt_app_mouse_t *mouse, uint8_t buttons, int16_t x, int16_t y, int16_t wheel);
+
+/**
+ * @brief Call once per connection interval, the reports handed to the stack before are on air by then
+ *
+ * @return true while reports are pending or were sent in the last interval
+ */
+bool bt_app_mouse_connection_event(bt_app_mouse_t *mouse);
+
+/* Drops pending reports when the connection drops, held buttons are queued once for the next connection */
+void bt_app_mouse_reset(bt_app_mouse_t *mouse);
+
+/* Drops pending reports when the last host unsubscribes, button changes keep updating the latched state */
+void bt_app_mouse_pause(bt_app_mouse_t *mouse);
+
+/* Queues the latched buttons once when a host subscribes */
+void bt_app_mouse_resume(bt_app_mouse_t *mouse);
+
+static inline uint8_t bt_app_mouse_pending(const bt_app_mouse_t *mouse) {
+    return mouse->count;
+}
+
+#endif //BT_APP_MOUSE_H
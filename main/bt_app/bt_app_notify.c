@@ -0,0 +1,52 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_notify.h"
+
+#include <string.h>
+
+void bt_app_notify_init(bt_app_notify_link_t *link, uint8_t limit) {
+    memset(link, 0, sizeof(*link));
+    link->limit = limit ? limit : 1;
+    link->budget = link->limit;
+}
+
+bool bt_app_notify_reserve(bt_app_notify_link_t *link) {
+    if (link->stalled || link->in_flight >= link->budget) {
+        link->stats.deferred++;
+        return false;
+    }
+    if (++link->in_flight > link->stats.max_in_flight) link->stats.max_in_flight = link->in_flight;
+    return true;
+}
+
+void bt_app_notify_complete(bt_app_notify_link_t *link, bt_app_notify_status_t status) {
+    switch (status) {
+        case BT_APP_NOTIFY_OK:
+            link->stats.sent++;
+            return;
+        case BT_APP_NOTIFY_NOMEM:
+            // Nothing else goes out this interval, the buffers only come back once the controller sent them
+            link->stalled = true;
+            link->stats.nomem++;
+            break;
+        default:
+            link->stats.errors++;
+            break;
+    }
+    if (link->in_flight) link->in_flight--;
+}
+
+void bt_app_notify_connection_event(bt_app_notify_link_t *link) {
+    if (link->stalled) {
+        if (link->budget > 1) {
+            link->budget /= 2;
+            link->stats.budget_cuts++;
+        }
+    } else if (link->in_flight >= link->budget && link->budget < link->limit) {
+        link->budget++;
+    }
+    link->in_flight = 0;
+    link->stalled = false;
+}
@@ -0,0 +1,59 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_NOTIFY_H
+#define BT_APP_NOTIFY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Notification backpressure of one connection.
+ *
+ * Every report notification takes a slot before it is handed to the stack. At most budget slots are handed out
+ * per connection event, and none after the stack ran out of buffers, so a slow link does not drain the buffer
+ * pool that every other notification shares. A report that gets no slot stays with its source: key reports
+ * wait in the scheduler and are never dropped, mouse motion is merged or dropped by the mouse policy.
+ *
+ * The budget halves after a connection event in which the stack ran out of buffers, and grows back by one after
+ * each event that used it all without running out.
+ */
+
+#define BT_APP_NOTIFY_MAX_PER_EVENT         4           // Budget limit, notifications per connection event
+
+typedef enum {
+    BT_APP_NOTIFY_OK,
+    BT_APP_NOTIFY_NOMEM,                // Stack out of buffers, the report is retried at the next connection event
+    BT_APP_NOTIFY_ERROR
+} bt_app_notify_status_t;
+
+typedef struct {
+    uint32_t sent;                      // Handed to the stack
+    uint32_t deferred;                  // No slot left, kept by the source
+    uint32_t nomem;                     // Refused by the stack for lack of buffers
+    uint32_t errors;                    // Refused by the stack for any other reason
+    uint32_t budget_cuts;
+    uint8_t max_in_flight;
+} bt_app_notify_stats_t;
+
+typedef struct {
+    uint8_t limit;
+    uint8_t budget;                     // Slots per connection event
+    uint8_t in_flight;                  // Slots taken since the last connection event
+    bool stalled;                       // Out of buffers until the next connection event
+    bt_app_notify_stats_t stats;
+} bt_app_notify_link_t;
+
+void bt_app_notify_init(bt_app_notify_link_t *link, uint8_t limit);
+
+/* Takes a slot for one notification, false if the report has to wait for the next connection event */
+bool bt_app_notify_reserve(bt_app_notify_link_t *link);
+
+/* Outcome of the notification a slot was taken for */
+void bt_app_notify_complete(bt_app_notify_link_t *link, bt_app_notify_status_t status);
+
+/* Call once per connection interval before the sources send, the notifications of the last one are on air */
+void bt_app_notify_connection_event(bt_app_notify_link_t *link);
+
+#endif //BT_APP_NOTIFY_H
@@ -0,0 +1,88 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_replay.h"
+
+#include <string.h>
+
+void bt_app_replay_init(bt_app_replay_t *replay, uint32_t max_age_ms) {
+    memset(replay, 0, sizeof(*replay));
+    bt_app_keyboard_init(&replay->held);
+    replay->max_age_ms = max_age_ms;
+}
+
+void bt_app_replay_begin(bt_app_replay_t *replay, bt_app_sched_t *sched) {
+    // Events not replayed to the lost host stay in the ring, in front of the new ones
+    replay->recording = true;
+    replay->replaying = false;
+    bt_app_sched_pause(sched);
+    bt_app_keyboard_init(&sched->current);
+}
+
+static void bt_app_replay_push(bt_app_replay_t *replay, uint8_t usage, bool pressed, uint32_t now_ms) {
+    if (replay->count == BT_APP_REPLAY_DEPTH) {
+        replay->head = (replay->head + 1) % BT_APP_REPLAY_DEPTH;
+        replay->count--;
+        replay->stats.overflows++;
+    }
+    replay->events[(replay->head + replay->count) % BT_APP_REPLAY_DEPTH] = (bt_app_replay_event_t) {
+        now_ms, usage, pressed
+    };
+    if (++replay->count > replay->stats.max_count) replay->stats.max_count = replay->count;
+    replay->stats.recorded++;
+}
+
+/* The replay is over once the ring is empty, the host gets the keys held right now */
+static bool bt_app_replay_finish(bt_app_replay_t *replay, bt_app_sched_t *sched) {
+    bool queued = false;
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        const bool held = bt_app_keyboard_is_pressed(&replay->held, usage);
+        if (held == bt_app_keyboard_is_pressed(&sched->current, usage)) continue;
+        if (bt_app_sched_event(sched, usage, held)) {
+            replay->stats.corrected++;
+            queued = true;
+        }
+    }
+    replay->replaying = false;
+    return queued;
+}
+
+bool bt_app_replay_pump(bt_app_replay_t *replay, bt_app_sched_t *sched) {
+    if (!replay->replaying || sched->paused) return false;
+
+    // A transition merges into the last pending report or takes a new one, it never overflows the queue
+    bool queued = false;
+    while (replay->count && bt_app_sched_pending(sched) < BT_APP_SCHED_DEPTH) {
+        const bt_app_replay_event_t *event = &replay->events[replay->head];
+        replay->head = (replay->head + 1) % BT_APP_REPLAY_DEPTH;
+        replay->count--;
+        replay->stats.replayed++;
+        if (bt_app_sched_event(sched, event->usage, event->pressed)) queued = true;
+    }
+    if (replay->count || bt_app_sched_pending(sched) == BT_APP_SCHED_DEPTH) return queued;
+    return bt_app_replay_finish(replay, sched) || queued;
+}
+
+bool bt_app_replay_event(bt_app_replay_t *replay, bt_app_sched_t *sched, uint8_t usage, bool pressed,
+                         uint32_t now_ms) {
+    if (!bt_app_keyboard_apply(&replay->held, usage, pressed)) return false;
+    if (!bt_app_replay_pending(replay)) return bt_app_sched_event(sched, usage, pressed);
+
+    bt_app_replay_push(replay, usage, pressed, now_ms);
+    return bt_app_replay_pump(replay, sched);
+}
+
+void bt_app_replay_resume(bt_app_replay_t *replay, bt_app_sched_t *sched, uint32_t now_ms) {
+    if (!bt_app_replay_pending(replay)) return;
+
+    if (replay->recording) replay->stats.sessions++;
+    replay->recording = false;
+    replay->replaying = true;
+    while (replay->count && now_ms - replay->events[replay->head].at_ms > replay->max_age_ms) {
+        replay->head = (replay->head + 1) % BT_APP_REPLAY_DEPTH;
+        replay->count--;
+        replay->stats.expired++;
+    }
+    bt_app_replay_pump(replay, sched);
+}
@@ -0,0 +1,83 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_REPLAY_H
+#define BT_APP_REPLAY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_app_keyboard.h"
+#include "bt_app_sched.h"
+
+/*
+ * Key events typed while the BLE link is down.
+ *
+ * Once the link drops every key transition goes into a bounded ring with the time it happened, the host already let
+ * go of every key. When a host subscribes again the events older than max_age_ms are dropped and the rest drain into
+ * the keyboard scheduler in order, no faster than it can queue them. Events of a full ring push out the oldest ones.
+ * Only a prefix of the typing is ever dropped, so a dropped press at worst turns its release into a no-op.
+ *
+ * Events arriving while the ring drains are appended to it, nothing overtakes the replay. Once it is empty the host
+ * is brought in line with the keys held right now: a key held across the reconnect is pressed again and nothing
+ * replayed stays down, so the host ends all released when no key is held.
+ */
+
+#define BT_APP_REPLAY_DEPTH                 128         // Buffered transitions, 64 keystrokes
+
+typedef struct {
+    uint32_t at_ms;
+    uint8_t usage;
+    bool pressed;
+} bt_app_replay_event_t;
+
+typedef struct {
+    uint32_t recorded;                  // Transitions buffered
+    uint32_t replayed;                  // Transitions handed to the scheduler
+    uint32_t expired;                   // Dropped for their age when the host came back
+    uint32_t overflows;                 // Pushed out of a full ring
+    uint32_t corrected;                 // Keys pressed or released after the replay to match the held ones
+    uint32_t sessions;                  // Replays started
+    uint16_t max_count;
+} bt_app_replay_stats_t;
+
+typedef struct {
+    bt_app_replay_event_t events[BT_APP_REPLAY_DEPTH];
+    uint16_t head;
+    uint16_t count;
+    uint32_t max_age_ms;
+    bt_app_keyboard_t held;             // Keys down on the USB side right now
+    bool recording;                     // Link down, events wait for a host
+    bool replaying;                     // Host back, the ring drains into the scheduler
+    bt_app_replay_stats_t stats;
+} bt_app_replay_t;
+
+void bt_app_replay_init(bt_app_replay_t *replay, uint32_t max_age_ms);
+
+/* Call when the link drops, pauses the scheduler and starts it over with every key released */
+void bt_app_replay_begin(bt_app_replay_t *replay, bt_app_sched_t *sched);
+
+/**
+ * @brief Every key event goes through here instead of bt_app_sched_event()
+ *
+ * @return true if the scheduler got new work, false for repeated events and while recording
+ */
+bool bt_app_replay_event(bt_app_replay_t *replay, bt_app_sched_t *sched, uint8_t usage, bool pressed,
+                         uint32_t now_ms);
+
+/* Call once the scheduler resumed for a subscribed host, drops the expired events and starts the replay */
+void bt_app_replay_resume(bt_app_replay_t *replay, bt_app_sched_t *sched, uint32_t now_ms);
+
+/**
+ * @brief Call before bt_app_sched_connection_event(), moves events into the scheduler while it has room
+ *
+ * @return true if the scheduler got new work
+ */
+bool bt_app_replay_pump(bt_app_replay_t *replay, bt_app_sched_t *sched);
+
+static inline bool bt_app_replay_pending(const bt_app_replay_t *replay) {
+    return replay->recording || replay->replaying;
+}
+
+#endif //BT_APP_REPLAY_H
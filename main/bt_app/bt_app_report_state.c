@@ -0,0 +1,49 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_report_state.h"
+
+#include <string.h>
+
+#define BT_APP_REPORT_STATE_USED_WORDS(length)      (((length) + 3) / 4)
+
+void bt_app_report_state_init(bt_app_report_state_t *state, uint8_t length) {
+    atomic_init(&state->seq, 0);
+    for (int i = 0; i < BT_APP_REPORT_STATE_WORDS; i++) {
+        atomic_init(&state->words[i], 0);
+    }
+    state->length = length <= BT_APP_REPORT_STATE_MAX_LEN ? length : BT_APP_REPORT_STATE_MAX_LEN;
+}
+
+void bt_app_report_state_publish(bt_app_report_state_t *state, const uint8_t *report) {
+    uint32_t words[BT_APP_REPORT_STATE_WORDS] = { 0 };
+    memcpy(words, report, state->length);
+
+    const unsigned int seq = atomic_load_explicit(&state->seq, memory_order_relaxed);
+    atomic_store_explicit(&state->seq, seq + 1, memory_order_relaxed);
+    // A reader that sees any of the new words also sees the odd sequence
+    atomic_thread_fence(memory_order_release);
+    for (int i = 0; i < BT_APP_REPORT_STATE_USED_WORDS(state->length); i++) {
+        atomic_store_explicit(&state->words[i], words[i], memory_order_relaxed);
+    }
+    atomic_store_explicit(&state->seq, seq + 2, memory_order_release);
+}
+
+uint32_t bt_app_report_state_read(bt_app_report_state_t *state, uint8_t *report) {
+    uint32_t words[BT_APP_REPORT_STATE_WORDS];
+    uint32_t retries = 0;
+    for (;; retries++) {
+        const unsigned int seq = atomic_load_explicit(&state->seq, memory_order_acquire);
+        if (seq & 1) continue;
+
+        for (int i = 0; i < BT_APP_REPORT_STATE_USED_WORDS(state->length); i++) {
+            words[i] = atomic_load_explicit(&state->words[i], memory_order_relaxed);
+        }
+        // The words are read before the sequence is checked again
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&state->seq, memory_order_relaxed) == seq) break;
+    }
+    memcpy(report, words, state->length);
+    return retries;
+}
@@ -0,0 +1,42 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_REPORT_STATE_H
+#define BT_APP_REPORT_STATE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Latest value of one input report, published through a seqlock.
+ *
+ * The writer makes the sequence odd, copies the report and makes it even again, it never waits for a reader. A
+ * reader copies the report between two reads of the sequence and retries while it was odd or changed, so it never
+ * returns a report that is half old and half new. Writers of the same report have to be serialized by the caller,
+ * and should not be preempted mid copy: a reader on the same core would then spin until the writer runs again.
+ */
+
+#define BT_APP_REPORT_STATE_MAX_LEN         32
+#define BT_APP_REPORT_STATE_WORDS           (BT_APP_REPORT_STATE_MAX_LEN / 4)
+
+typedef struct {
+    atomic_uint seq;                                    // Odd while the writer copies
+    atomic_uint words[BT_APP_REPORT_STATE_WORDS];       // Report bytes, copied a word at a time
+    uint8_t length;                                     // Fixed by the report ID
+} bt_app_report_state_t;
+
+/* The report reads as all zeros until the first publish */
+void bt_app_report_state_init(bt_app_report_state_t *state, uint8_t length);
+
+/* Writer side, report has the length given at init */
+void bt_app_report_state_publish(bt_app_report_state_t *state, const uint8_t *report);
+
+/**
+ * @brief Reader side, copies a consistent report
+ *
+ * @return Retries needed because a publish overlapped the copy
+ */
+uint32_t bt_app_report_state_read(bt_app_report_state_t *state, uint8_t *report);
+
+#endif //BT_APP_REPORT_STATE_H
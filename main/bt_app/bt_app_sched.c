@@ -0,0 +1,104 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "bt_app_sched.h"
+
+#include <string.h>
+
+void bt_app_sched_init(bt_app_sched_t *sched, uint8_t window, bt_app_sched_send_cb_t send, void *arg) {
+    memset(sched, 0, sizeof(*sched));
+    bt_app_keyboard_init(&sched->current);
+    sched->window = window ? window : 1;
+    sched->send = send;
+    sched->arg = arg;
+}
+
+static void bt_app_sched_pump(bt_app_sched_t *sched) {
+    while (sched->count && sched->sent < sched->window) {
+        if (sched->send(&sched->entries[sched->head].state, sched->arg) != 0) {
+            sched->stats.send_failures++;
+            return;
+        }
+        sched->head = (sched->head + 1) % BT_APP_SCHED_DEPTH;
+        sched->count--;
+        sched->sent++;
+        sched->stats.reports++;
+    }
+}
+
+bool bt_app_sched_event(bt_app_sched_t *sched, uint8_t usage, bool pressed) {
+    if (!bt_app_keyboard_apply(&sched->current, usage, pressed)) return false;
+    sched->stats.events++;
+    if (sched->paused) return true;
+
+    const uint8_t bit = 1 << (usage & 7);
+    bt_app_sched_entry_t *tail = sched->count
+        ? &sched->entries[(sched->head + sched->count - 1) % BT_APP_SCHED_DEPTH]
+        : NULL;
+
+    if (tail && !(tail->touched[usage >> 3] & bit)) {
+        // The pending report does not change this usage yet, it can carry this transition too
+        bt_app_keyboard_apply(&tail->state, usage, pressed);
+        tail->touched[usage >> 3] |= bit;
+        sched->stats.merged++;
+    } else if (sched->count < BT_APP_SCHED_DEPTH) {
+        if (tail) sched->stats.splits++;
+        tail = &sched->entries[(sched->head + sched->count) % BT_APP_SCHED_DEPTH];
+        tail->state = sched->current;
+        memset(tail->touched, 0, sizeof(tail->touched));
+        tail->touched[usage >> 3] = bit;
+        if (++sched->count > sched->stats.max_depth) sched->stats.max_depth = sched->count;
+    } else {
+        tail->state = sched->current;
+        sched->stats.overflows++;
+    }
+
+    bt_app_sched_pump(sched);
+    return true;
+}
+
+bool bt_app_sched_connection_event(bt_app_sched_t *sched) {
+    if (sched->paused) return false;
+    const bool busy = sched->sent || sched->count;
+    sched->sent = 0;
+    bt_app_sched_pump(sched);
+    return busy;
+}
+
+void bt_app_sched_reset(bt_app_sched_t *sched) {
+    sched->head = 0;
+    sched->count = 0;
+    sched->sent = 0;
+    if (sched->paused) return;
+
+    // A new connection starts with nothing held on the host side
+    bt_app_keyboard_t released;
+    bt_app_keyboard_init(&released);
+    if (memcmp(sched->current.bits, released.bits, sizeof(released.bits)) == 0) return;
+
+    bt_app_sched_entry_t *entry = &sched->entries[0];
+    entry->state = sched->current;
+    memcpy(entry->touched, sched->current.bits, sizeof(entry->touched));
+    sched->count = 1;
+}
+
+void bt_app_sched_pause(bt_app_sched_t *sched) {
+    sched->head = 0;
+    sched->count = 0;
+    sched->sent = 0;
+    sched->paused = true;
+}
+
+void bt_app_sched_resume(bt_app_sched_t *sched) {
+    if (!sched->paused) return;
+    sched->paused = false;
+
+    // What the host holds is unknown, every usage counts as changed so the next event starts a new report
+    bt_app_sched_entry_t *entry = &sched->entries[0];
+    entry->state = sched->current;
+    memset(entry->touched, 0xFF, sizeof(entry->touched));
+    sched->head = 0;
+    sched->count = 1;
+    bt_app_sched_pump(sched);
+}
@@ -0,0 +1,91 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_APP_SCHED_H
+#define BT_APP_SCHED_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bt_app_keyboard.h"
+
+/*
+ * Outgoing keyboard report scheduler.
+ *
+ * Only window reports are handed to the stack per connection event. Key events arriving in between are folded
+ * into the newest pending report, unless that report already changes the same usage: merging would then hide
+ * a press or release from the host, so a new report is started instead. The host therefore sees every
+ * transition in the order it happened, with as few reports as the link allows.
+ *
+ * The queue is bounded. A full queue merges anyway and counts an overflow, which takes one usage toggling more
+ * often than BT_APP_SCHED_DEPTH times while the link is stalled.
+ *
+ * While no host is subscribed the scheduler is paused: events only update the latched state, and resuming queues
+ * that state once.
+ */
+
+#define BT_APP_SCHED_DEPTH                  16          // Pending reports
+
+/* Returns 0 if the report of the state was handed to the stack */
+typedef int (*bt_app_sched_send_cb_t)(const bt_app_keyboard_t *state, void *arg);
+
+typedef struct {
+    bt_app_keyboard_t state;            // Keyboard state once this report is out
+    uint8_t touched[32];                // Usages this report changes against the one before
+} bt_app_sched_entry_t;
+
+typedef struct {
+    uint32_t events;                    // Key transitions in
+    uint32_t reports;                   // Reports handed to the stack
+    uint32_t merged;                    // Transitions folded into a pending report
+    uint32_t splits;                    // Reports started because merging would hide a transition
+    uint32_t overflows;                 // Transitions merged into a full queue, the host misses a toggle
+    uint32_t send_failures;             // Reports the stack refused, kept for the next connection event
+    uint8_t max_depth;
+} bt_app_sched_stats_t;
+
+typedef struct {
+    bt_app_keyboard_t current;          // Newest state, the tail of the queue or the last report sent
+    bt_app_sched_entry_t entries[BT_APP_SCHED_DEPTH];
+    uint8_t head;
+    uint8_t count;
+    uint8_t window;                     // Reports handed to the stack per connection event
+    uint8_t sent;                       // Reports handed to the stack since the last connection event
+    bool paused;                        // No host subscribed, nothing is queued
+    bt_app_sched_stats_t stats;
+    bt_app_sched_send_cb_t send;
+    void *arg;
+} bt_app_sched_t;
+
+void bt_app_sched_init(bt_app_sched_t *sched, uint8_t window, bt_app_sched_send_cb_t send, void *arg);
+
+/**
+ * @brief Apply one key event and send what the window allows
+ *
+ * @return false for repeated or out of range events, nothing is queued then
+ */
+bool bt_app_sched_event(bt_app_sched_t *sched, uint8_t usage, bool pressed);
+
+/**
+ * @brief Call once per connection interval, the reports handed to the stack before are on air by then
+ *
+ * @return true while reports are pending or were sent in the last interval, false once the scheduler is idle
+ *         and the next event goes out right away
+ */
+bool bt_app_sched_connection_event(bt_app_sched_t *sched);
+
+/* Drops pending reports when the connection drops, the newest state is queued once for the next connection */
+void bt_app_sched_reset(bt_app_sched_t *sched);
+
+/* Drops pending reports when the last host unsubscribes, events keep updating the latched state */
+void bt_app_sched_pause(bt_app_sched_t *sched);
+
+/* Queues the latched state once when a host subscribes, so its first report carries the keys held right now */
+void bt_app_sched_resume(bt_app_sched_t *sched);
+
+static inline uint8_t bt_app_sched_pending(const bt_app_sched_t *sched) {
+    return sched->count;
+}
+
+#endif //BT_APP_SCHED_H
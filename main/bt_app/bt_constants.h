@@ -11,6 +11,30 @@
 
 #define BLE_DEVICE_INFO_SERVICE_UUID    0x180A
 #define BLE_BATTERY_SERVICE_UUID        0x180F
+#define BLE_HID_SERVICE_UUID            0x1812
+
+#define BT_APP_BENCH_SERVICE_ENABLED    0      // Register the throughput/latency benchmark service
+#define BT_APP_CONN_INTERVAL_DEFAULT_US 30000  // Report pacing until the connection interval is known
+#define BT_APP_ADV_FAST_ITVL_MS         20     // Advertising interval after a disconnect or a wake from the USB side
+#define BT_APP_ADV_FAST_MS              30000  // Fast advertising lasts this long
+#define BT_APP_ADV_SLOW_ITVL_MS         1022   // Advertising interval afterwards, hosts still find it when scanning
+/* 5b8dGGII-7f5e-4c1e-9a2b-3c4d5e6f7a8b, GG service group, II attribute, little endian as NimBLE expects */
+#define BLE_VENDOR_UUID128_DECLARE(group, id) \
+                                        BLE_UUID128_DECLARE(0x8b, 0x7a, 0x6f, 0x5e, 0x4d, 0x3c, 0x2b, 0x9a, \
+                                                            0x1e, 0x4c, 0x5e, 0x7f, (id), (group), 0x8d, 0x5b)
+#define BLE_BENCH_UUID128_DECLARE(id)   BLE_VENDOR_UUID128_DECLARE(0x00, id)
+#define BLE_BENCH_SERVICE_ID            0x00
+#define BLE_BENCH_CONTROL_ID            0x01
+#define BLE_BENCH_STREAM_ID             0x02
+#define BLE_BENCH_ECHO_ID               0x03
+#define BLE_BENCH_RESULTS_ID            0x04
+
+#define BLE_CONFIG_UUID128_DECLARE(id)  BLE_VENDOR_UUID128_DECLARE(0x01, id)
+#define BLE_CONFIG_SERVICE_ID           0x00
+#define BLE_CONFIG_KEYMAP_ID            0x01
+#define BLE_CONFIG_INJECT_ID            0x02
+#define BLE_CONFIG_MACRO_ID             0x03
+#define BLE_CONFIG_TASKS_ID             0x04
 
 #define BLE_APPEARANCE_HID_KEYBOARD     0x03C1 // 961
 #define BLE_BOOT_PROTOCOL_MODE          0x00
@@ -0,0 +1,256 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <string.h>
+#include <freertos/FreeRTOS.h>
+#include <host/ble_gatt.h>
+#include <host/ble_hs.h>
+
+#include "bt_constants.h"
+#include "bt_device_bench_handlers.h"
+
+#define BT_BENCH_PING_LEN               9
+
+uint16_t bt_bench_stream_handle;
+uint16_t bt_bench_echo_handle;
+
+static esp_timer_handle_t bt_bench_stream_timer = NULL;
+static esp_timer_handle_t bt_bench_ping_timer = NULL;
+static portMUX_TYPE bt_bench_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t bt_bench_conn_handle = BLE_HS_CONN_HANDLE_NONE;   // Written by the GATT handlers, read by the timers
+static uint16_t bt_bench_size = BT_BENCH_MIN_SIZE;
+static uint32_t bt_bench_remaining = 0;          // Stream notifications left, 0 runs until STOP
+static bool bt_bench_unbounded = false;
+static uint16_t bt_bench_pings_left = 0;
+static uint32_t bt_bench_ping_seq = 0;
+static int64_t bt_bench_started_us = 0;
+static uint64_t bt_bench_rtt_sum_us = 0;
+static bt_bench_results_t bt_bench_results = { 0 };
+
+static void bt_bench_put_u32(uint8_t *dst, uint32_t value) {
+    dst[0] = value;
+    dst[1] = value >> 8;
+    dst[2] = value >> 16;
+    dst[3] = value >> 24;
+}
+
+static uint32_t bt_bench_get_u32(const uint8_t *src) {
+    return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+}
+
+/* Notify is consumed by the host stack even when it fails, so the sequence number is lost either way */
+static int bt_bench_notify(uint16_t attr_handle, const uint8_t *data, uint16_t length) {
+    portENTER_CRITICAL(&bt_bench_lock);
+    const uint16_t conn_handle = bt_bench_conn_handle;
+    portEXIT_CRITICAL(&bt_bench_lock);
+    if (conn_handle == BLE_HS_CONN_HANDLE_NONE) return BLE_HS_ENOTCONN;
+
+    struct os_mbuf *om = ble_hs_mbuf_from_flat(data, length);
+    if (!om) return BLE_HS_ENOMEM;
+    return ble_gatts_notify_custom(conn_handle, attr_handle, om);
+}
+
+static void bt_bench_set_conn(uint16_t conn_handle) {
+    portENTER_CRITICAL(&bt_bench_lock);
+    bt_bench_conn_handle = conn_handle;
+    portEXIT_CRITICAL(&bt_bench_lock);
+}
+
+static void bt_bench_stream_tick(void *arg) {
+    uint8_t payload[BT_BENCH_MAX_SIZE];
+    const int64_t now_us = esp_timer_get_time();
+
+    portENTER_CRITICAL(&bt_bench_lock);
+    const uint32_t seq = bt_bench_results.next_seq++;
+    const uint16_t size = bt_bench_size;
+    portEXIT_CRITICAL(&bt_bench_lock);
+
+    bt_bench_put_u32(payload, seq);
+    bt_bench_put_u32(payload + 4, now_us);
+    for (uint16_t i = 8; i < size; i++) {
+        payload[i] = seq + i;
+    }
+
+    const int rc = bt_bench_notify(bt_bench_stream_handle, payload, size);
+
+    portENTER_CRITICAL(&bt_bench_lock);
+    if (rc == 0) {
+        bt_bench_results.sent++;
+        bt_bench_results.bytes += size;
+    } else {
+        bt_bench_results.failed++;
+        if (rc == BLE_HS_ENOMEM) bt_bench_results.no_mem++;
+    }
+    bt_bench_results.elapsed_ms = (now_us - bt_bench_started_us) / 1000;
+    if (bt_bench_results.elapsed_ms) {
+        bt_bench_results.throughput_bps = (uint64_t) bt_bench_results.bytes * 8000 / bt_bench_results.elapsed_ms;
+    }
+    const bool done = !bt_bench_unbounded && --bt_bench_remaining == 0;
+    // A START or RESET may change the results as soon as the lock is given
+    const bt_bench_results_t results = bt_bench_results;
+    portEXIT_CRITICAL(&bt_bench_lock);
+
+    if (done) {
+        esp_timer_stop(bt_bench_stream_timer);
+        ESP_LOGI(BT_TAG, "Benchmark stream done: %lu sent, %lu failed, %lu bps",
+                 results.sent, results.failed, results.throughput_bps);
+    }
+}
+
+static void bt_bench_ping_tick(void *arg) {
+    uint8_t ping[BT_BENCH_PING_LEN] = { BT_BENCH_OP_PING };
+
+    portENTER_CRITICAL(&bt_bench_lock);
+    const bool done = bt_bench_pings_left == 0 || --bt_bench_pings_left == 0;
+    const uint32_t seq = ++bt_bench_ping_seq;
+    portEXIT_CRITICAL(&bt_bench_lock);
+
+    bt_bench_put_u32(ping + 1, seq);
+    bt_bench_put_u32(ping + 5, esp_timer_get_time());
+    bt_bench_notify(bt_bench_echo_handle, ping, sizeof(ping));
+
+    if (done) esp_timer_stop(bt_bench_ping_timer);
+}
+
+static esp_err_t bt_bench_create_timers(void) {
+    if (bt_bench_stream_timer) return ESP_OK;
+
+    const esp_timer_create_args_t stream_args = {
+        .callback = bt_bench_stream_tick,
+        .name = "bt_bench_stream"
+    };
+    const esp_timer_create_args_t ping_args = {
+        .callback = bt_bench_ping_tick,
+        .name = "bt_bench_ping"
+    };
+    esp_err_t err = esp_timer_create(&stream_args, &bt_bench_stream_timer);
+    if (err == ESP_OK) err = esp_timer_create(&ping_args, &bt_bench_ping_timer);
+    return err;
+}
+
+void bt_bench_stop(void) {
+    // A tick already running sees no connection and sends nothing to a handle that may be reused
+    bt_bench_set_conn(BLE_HS_CONN_HANDLE_NONE);
+    if (!bt_bench_stream_timer) return;
+    esp_timer_stop(bt_bench_stream_timer);
+    esp_timer_stop(bt_bench_ping_timer);
+}
+
+int handle_bench_control_write(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t cmd[9] = { 0 };
+    uint16_t len = 0;
+    if (ble_hs_mbuf_to_flat(ctxt->om, cmd, sizeof(cmd), &len) != 0 || len == 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+    if (bt_bench_create_timers() != ESP_OK) {
+        ESP_LOGE(BT_TAG, "Failed to create benchmark timers!");
+        return BLE_ATT_ERR_INSUFFICIENT_RES;
+    }
+
+    bt_bench_set_conn(conn_handle);
+    switch (cmd[0]) {
+        case BT_BENCH_OP_START: {
+            if (len < 9) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            const uint16_t rate_hz = cmd[1] | (cmd[2] << 8);
+            const uint16_t size = cmd[3] | (cmd[4] << 8);
+            const uint32_t count = bt_bench_get_u32(cmd + 5);
+            if (rate_hz == 0 || rate_hz > BT_BENCH_MAX_RATE_HZ || size < BT_BENCH_MIN_SIZE || size > BT_BENCH_MAX_SIZE) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+
+            esp_timer_stop(bt_bench_stream_timer);
+            portENTER_CRITICAL(&bt_bench_lock);
+            bt_bench_size = size;
+            bt_bench_remaining = count;
+            bt_bench_unbounded = count == 0;
+            bt_bench_started_us = esp_timer_get_time();
+            bt_bench_results.sent = 0;
+            bt_bench_results.failed = 0;
+            bt_bench_results.no_mem = 0;
+            bt_bench_results.bytes = 0;
+            bt_bench_results.elapsed_ms = 0;
+            bt_bench_results.throughput_bps = 0;
+            portEXIT_CRITICAL(&bt_bench_lock);
+
+            ESP_LOGI(BT_TAG, "Benchmark stream: %d Hz, %d bytes, %lu notifications", rate_hz, size, count);
+            esp_timer_start_periodic(bt_bench_stream_timer, 1000000 / rate_hz);
+        }
+        break;
+        case BT_BENCH_OP_STOP:
+            bt_bench_stop();
+        break;
+        case BT_BENCH_OP_PING:
+            if (len < 3) return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            esp_timer_stop(bt_bench_ping_timer);
+            portENTER_CRITICAL(&bt_bench_lock);
+            bt_bench_pings_left = cmd[1] | (cmd[2] << 8);
+            const bool ping = bt_bench_pings_left != 0;
+            portEXIT_CRITICAL(&bt_bench_lock);
+            if (ping) {
+                esp_timer_start_periodic(bt_bench_ping_timer, BT_BENCH_PING_PERIOD_MS * 1000);
+            }
+        break;
+        case BT_BENCH_OP_RESET:
+            bt_bench_stop();
+            portENTER_CRITICAL(&bt_bench_lock);
+            memset(&bt_bench_results, 0, sizeof(bt_bench_results));
+            bt_bench_rtt_sum_us = 0;
+            portEXIT_CRITICAL(&bt_bench_lock);
+        break;
+        default:
+            return BLE_ATT_ERR_REQ_NOT_SUPPORTED;
+    }
+    return 0;
+}
+
+int handle_bench_stream(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    // Notify only, nothing to read
+    return 0;
+}
+
+int handle_bench_echo_write(uint16_t conn_handle, uint16_t attr_handle,
+                            struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t data[BT_BENCH_MAX_SIZE];
+    uint16_t len = 0;
+    if (ble_hs_mbuf_to_flat(ctxt->om, data, sizeof(data), &len) != 0) {
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    if (len == BT_BENCH_PING_LEN && data[0] == BT_BENCH_OP_PING) {
+        // One of our pings came back
+        const uint32_t rtt_us = (uint32_t) esp_timer_get_time() - bt_bench_get_u32(data + 5);
+        portENTER_CRITICAL(&bt_bench_lock);
+        bt_bench_results.rtt_count++;
+        bt_bench_rtt_sum_us += rtt_us;
+        bt_bench_results.rtt_avg_us = bt_bench_rtt_sum_us / bt_bench_results.rtt_count;
+        if (bt_bench_results.rtt_count == 1 || rtt_us < bt_bench_results.rtt_min_us) bt_bench_results.rtt_min_us = rtt_us;
+        if (rtt_us > bt_bench_results.rtt_max_us) bt_bench_results.rtt_max_us = rtt_us;
+        portEXIT_CRITICAL(&bt_bench_lock);
+        return 0;
+    }
+
+    bt_bench_set_conn(conn_handle);
+    if (bt_bench_notify(bt_bench_echo_handle, data, len) == 0) {
+        portENTER_CRITICAL(&bt_bench_lock);
+        bt_bench_results.echoes++;
+        portEXIT_CRITICAL(&bt_bench_lock);
+    }
+    return 0;
+}
+
+int handle_bench_results_read(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    bt_bench_results_t results;
+    portENTER_CRITICAL(&bt_bench_lock);
+    results = bt_bench_results;
+    portEXIT_CRITICAL(&bt_bench_lock);
+
+    os_mbuf_append(ctxt->om, &results, sizeof(results));
+    return 0;
+}
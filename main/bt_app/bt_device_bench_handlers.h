@@ -0,0 +1,68 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_DEVICE_BENCH_HANDLERS_H
+#define BT_DEVICE_BENCH_HANDLERS_H
+
+#include <stdint.h>
+
+/*
+ * Throughput and latency benchmark service, registered only with BT_APP_BENCH_SERVICE_ENABLED.
+ * All fields are little endian, utils/ble-bench-client is the matching client.
+ *
+ * Control (write):     START | rate_hz u16 | size u16 | count u32 (0 runs until STOP) |
+ *                      STOP, RESET
+ *                      PING | count u16 |
+ * Stream (notify):     seq u32 | timestamp_us u32 | filler up to size |
+ * Echo (write without response, notify):
+ *                      writes are notified back unchanged, so the client measures the round trip.
+ *                      Device pings are notified as PING | seq u32 | timestamp_us u32 | and the client
+ *                      writes them back unchanged, so the device measures the round trip too.
+ * Results (read):      bt_bench_results_t
+ */
+
+#define BT_BENCH_OP_START               0x01
+#define BT_BENCH_OP_STOP                0x02
+#define BT_BENCH_OP_PING                0x03
+#define BT_BENCH_OP_RESET               0x04
+
+#define BT_BENCH_MIN_SIZE               8
+#define BT_BENCH_MAX_SIZE               244         // Fits one LL packet with the 251 byte data length extension
+#define BT_BENCH_MAX_RATE_HZ            2000
+#define BT_BENCH_PING_PERIOD_MS         50
+
+typedef struct {
+    uint32_t sent;                  // Notifications accepted by the host stack
+    uint32_t failed;                // Sequence numbers never sent, ble_gatts_notify_custom failed
+    uint32_t no_mem;                // Of those, failed for lack of mbufs
+    uint32_t bytes;                 // Payload bytes sent
+    uint32_t elapsed_ms;            // Since START
+    uint32_t throughput_bps;        // Payload bits per second
+    uint32_t next_seq;
+    uint32_t echoes;                // Client writes echoed back
+    uint32_t rtt_count;             // Device pings that came back
+    uint32_t rtt_min_us;
+    uint32_t rtt_avg_us;
+    uint32_t rtt_max_us;
+} __attribute__((packed)) bt_bench_results_t;
+
+extern uint16_t bt_bench_stream_handle;
+extern uint16_t bt_bench_echo_handle;
+
+int handle_bench_control_write(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int handle_bench_stream(uint16_t conn_handle, uint16_t attr_handle,
+                        struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int handle_bench_echo_write(uint16_t conn_handle, uint16_t attr_handle,
+                            struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int handle_bench_results_read(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+/* Stops a running benchmark, called when the connection drops */
+void bt_bench_stop(void);
+
+#endif //BT_DEVICE_BENCH_HANDLERS_H
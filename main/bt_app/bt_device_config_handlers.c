@@ -0,0 +1,51 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <esp_log.h>
+#include <stdint.h>
+#include <host/ble_gatt.h>
+#include <host/ble_hs.h>
+
+#include "bt_constants.h"
+#include "bt_device_config_handlers.h"
+#include "task_profiler.h"
+#include "usb_app/usb_app.h"
+#include "usb_app/usb_app_keymap.h"
+
+int handle_config_keymap(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t blob[USB_APP_KEYMAP_MAX_LEN];
+    uint16_t length = 0;
+
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR:
+            length = usb_app_get_keymap(blob, sizeof(blob));
+            os_mbuf_append(ctxt->om, blob, length);
+        break;
+        case BLE_GATT_ACCESS_OP_WRITE_CHR: {
+            if (ble_hs_mbuf_to_flat(ctxt->om, blob, sizeof(blob), &length) != 0) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            const esp_err_t err = usb_app_set_keymap(blob, length, true);
+            if (err == ESP_ERR_INVALID_ARG || err == ESP_ERR_INVALID_SIZE) {
+                return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(BT_TAG, "Failed to set keymap: %s", esp_err_to_name(err));
+                return BLE_ATT_ERR_UNLIKELY;
+            }
+        }
+        break;
+        default:
+        break;
+    }
+    return 0;
+}
+
+int handle_config_tasks_read(uint16_t conn_handle, uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t report[TASK_PROFILER_REPORT_MAX_LEN];
+    const size_t length = task_profiler_get_report(report, sizeof(report));
+    return os_mbuf_append(ctxt->om, report, length) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
+}
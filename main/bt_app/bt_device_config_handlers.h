@@ -0,0 +1,26 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_DEVICE_CONFIG_HANDLERS_H
+#define BT_DEVICE_CONFIG_HANDLERS_H
+
+#include <stdint.h>
+
+/*
+ * Bridge configuration service.
+ *
+ * Keymap (read, write):    keymap blob as described in usb_app/usb_app_keymap.h, up to 510 bytes so it
+ *                          needs a long write. It is swapped in between two key events and stored in NVS,
+ *                          an empty write restores the identity keymap.
+ * Tasks (read):            CPU load and least free stack of the tasks as described in task_profiler.h, up to
+ *                          512 bytes so it needs a long read.
+ */
+
+int handle_config_keymap(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int handle_config_tasks_read(uint16_t conn_handle, uint16_t attr_handle,
+                             struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+#endif //BT_DEVICE_CONFIG_HANDLERS_H
@@ -2,16 +2,27 @@
 // Created by Kok on 12/21/24.
 //
 
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
 #include <host/ble_gatt.h>
 #include <host/ble_hs_id.h>
 #include <host/ble_hs.h>
 
+#include "bt_app.h"
+#include "bt_app_keyboard.h"
+#include "bt_app_mouse.h"
+#include "bt_app_replay.h"
+#include "bt_app_report_state.h"
+#include "bt_app_sched.h"
 #include "bt_constants.h"
+#include "bt_device_hid_handlers.h"
 
 static const uint8_t keyboard_report_map[] = {
     0x05, 0x01,         // Usage Page (Generic Desktop Ctrls)
     0x09, 0x06,         // Usage (Keyboard)
     0xA1, 0x01,         // Collection (Application)
+    0x85, 0x01,         //   Report ID (1)
 
     // Modifier keys (1 byte)
     0x05, 0x07,         //   Usage Page (Keyboard/Keypad)
@@ -38,9 +49,79 @@ static const uint8_t keyboard_report_map[] = {
     0x29, 0x65,         //   Usage Maximum (101 keys)
     0x81, 0x00,         //   Input (Data, Array)
 
+    0xC0,               // End Collection
+
+    // NKRO keyboard, one bit per usage
+    0x05, 0x01,         // Usage Page (Generic Desktop Ctrls)
+    0x09, 0x06,         // Usage (Keyboard)
+    0xA1, 0x01,         // Collection (Application)
+    0x85, 0x02,         //   Report ID (2)
+
+    // Modifier keys (1 byte)
+    0x05, 0x07,         //   Usage Page (Keyboard/Keypad)
+    0x19, 0xE0,         //   Usage Minimum (Left Control)
+    0x29, 0xE7,         //   Usage Maximum (Right GUI)
+    0x15, 0x00,         //   Logical Minimum (0)
+    0x25, 0x01,         //   Logical Maximum (1)
+    0x75, 0x01,         //   Report Size (1 bit)
+    0x95, 0x08,         //   Report Count (8 bits for modifiers)
+    0x81, 0x02,         //   Input (Data, Var, Abs)
+
+    // Key bitmap (28 bytes)
+    0x19, 0x00,         //   Usage Minimum (0)
+    0x29, 0xDF,         //   Usage Maximum (223)
+    0x95, 0xE0,         //   Report Count (224 bits, one per usage)
+    0x81, 0x02,         //   Input (Data, Var, Abs)
+
+    0xC0,               // End Collection
+
+    // Mouse
+    0x05, 0x01,         // Usage Page (Generic Desktop Ctrls)
+    0x09, 0x02,         // Usage (Mouse)
+    0xA1, 0x01,         // Collection (Application)
+    0x85, 0x03,         //   Report ID (3)
+    0x09, 0x01,         //   Usage (Pointer)
+    0xA1, 0x00,         //   Collection (Physical)
+
+    // Buttons (1 byte)
+    0x05, 0x09,         //     Usage Page (Button)
+    0x19, 0x01,         //     Usage Minimum (1)
+    0x29, 0x03,         //     Usage Maximum (3)
+    0x15, 0x00,         //     Logical Minimum (0)
+    0x25, 0x01,         //     Logical Maximum (1)
+    0x75, 0x01,         //     Report Size (1 bit)
+    0x95, 0x03,         //     Report Count (3 buttons)
+    0x81, 0x02,         //     Input (Data, Var, Abs)
+    0x75, 0x05,         //     Report Size (5 bits)
+    0x95, 0x01,         //     Report Count (1)
+    0x81, 0x01,         //     Input (Const)
+
+    // X, Y and wheel (3 bytes)
+    0x05, 0x01,         //     Usage Page (Generic Desktop Ctrls)
+    0x09, 0x30,         //     Usage (X)
+    0x09, 0x31,         //     Usage (Y)
+    0x09, 0x38,         //     Usage (Wheel)
+    0x15, 0x81,         //     Logical Minimum (-127)
+    0x25, 0x7F,         //     Logical Maximum (127)
+    0x75, 0x08,         //     Report Size (8 bits)
+    0x95, 0x03,         //     Report Count (3)
+    0x81, 0x06,         //     Input (Data, Var, Rel)
+
+    0xC0,               //   End Collection
     0xC0                // End Collection
 };
 
+static bt_app_sched_t hid_sched;
+static bt_app_mouse_t hid_mouse;
+static bt_app_replay_t hid_replay;
+static SemaphoreHandle_t hid_sched_mutex = NULL;           // Guards the keyboard scheduler, its replay and the mouse queue
+static volatile uint8_t hid_protocol_mode = BLE_REPORT_PROTOCOL_MODE;
+static bt_app_report_state_t hid_report_states[BT_APP_MOUSE_REPORT_ID + 1];    // Indexed by Report ID
+static uint32_t hid_report_reads = 0;                                         // NimBLE host task only
+static uint32_t hid_report_read_retries = 0;
+static uint8_t hid_keyboard_report_id = 0;          // Report the last key state went out on, 0 before the first
+static uint32_t hid_stats_report_switches = 0;      // Key state moved to the other report, the old one released
+
 int handle_hid_read(uint16_t conn_handle, uint16_t attr_handle,
                            struct ble_gatt_access_ctxt *ctxt, void *arg) {
     ESP_LOGI(BT_TAG, "Reading HID Info...");
@@ -68,15 +149,19 @@ int handle_hid_control_point_write(uint16_t conn_handle, uint16_t attr_handle,
     return 0;
 }
 
+/* arg is the Report ID, the value is the last report of that ID handed to the stack */
 int handle_hid_input_report(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg) {
-    uint8_t report[8] = {0};
-    report[0] = 0x00; // no modifier keys are pressed;
-    report[2] = 0x04; // letter 'a';
+    const uint8_t report_id = (uint8_t) (uintptr_t) arg;
+    if (report_id == 0 || report_id > BT_APP_MOUSE_REPORT_ID) return BLE_ATT_ERR_UNLIKELY;
 
-    ESP_LOGI(BT_TAG, "Sending input report");
-    os_mbuf_append(ctxt->om, report, sizeof(report));
-    return 0;
+    uint8_t report[BT_APP_REPORT_STATE_MAX_LEN];
+    bt_app_report_state_t *state = &hid_report_states[report_id];
+    hid_report_read_retries += bt_app_report_state_read(state, report);
+    hid_report_reads++;
+
+    ESP_LOGD(BT_TAG, "Reading input report %u", report_id);
+    return os_mbuf_append(ctxt->om, report, state->length) == 0 ? 0 : BLE_ATT_ERR_INSUFFICIENT_RES;
 }
 
 int handle_hid_output_report(uint16_t conn_handle, uint16_t attr_handle,
@@ -87,17 +172,179 @@ int handle_hid_output_report(uint16_t conn_handle, uint16_t attr_handle,
 int handle_hid_protocol_mode(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg) {
     ESP_LOGI(BT_TAG, "Reading HID Protocol Mode...");
-    uint8_t protocol_mode = 0x01;
+    uint8_t protocol_mode = hid_protocol_mode;
     if (ctxt->op == BLE_GATT_ACCESS_OP_READ_CHR) {
         os_mbuf_append(ctxt->om, &protocol_mode, sizeof(protocol_mode));
     } else if (ctxt->op == BLE_GATT_ACCESS_OP_WRITE_CHR) {
-        protocol_mode = ctxt->om->om_data[0];
+        if (ble_hs_mbuf_to_flat(ctxt->om, &protocol_mode, sizeof(protocol_mode), NULL) != 0) {
+            return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+        }
+        if (protocol_mode != BLE_BOOT_PROTOCOL_MODE && protocol_mode != BLE_REPORT_PROTOCOL_MODE) {
+            return BLE_ATT_ERR_VALUE_NOT_ALLOWED;
+        }
+        hid_protocol_mode = protocol_mode;
     }
 
     return 0;
 }
 
+int handle_hid_report_reference(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    const uint8_t report_reference[] = { (uint8_t) (uintptr_t) arg, 0x01 };    // Report ID, Input
+    os_mbuf_append(ctxt->om, report_reference, sizeof(report_reference));
+    return 0;
+}
+
 int handle_hid_input_report_descriptor(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg) {
     return 0;
-}
\ No newline at end of file
+}
+
+/* Sends the state on the report the host reads now, report_id is set to the one it went out on */
+static int hid_send_keyboard(const bt_app_keyboard_t *state, uint8_t *report_id) {
+#if BT_HID_NKRO_ENABLED
+    // Falls back to the boot compatible report while the ATT MTU is too small for the bitmap
+    if (hid_protocol_mode == BLE_REPORT_PROTOCOL_MODE) {
+        uint8_t nkro_report[BT_APP_KEYBOARD_NKRO_REPORT_LEN];
+        bt_app_keyboard_nkro_report(state, nkro_report);
+        *report_id = BT_APP_KEYBOARD_NKRO_REPORT_ID;
+        const int rc = bt_app_notify_nkro_report(nkro_report, sizeof(nkro_report));
+        if (rc != BLE_HS_EMSGSIZE) return rc;
+    }
+#endif
+
+    uint8_t report[BT_APP_KEYBOARD_BOOT_REPORT_LEN];
+    bt_app_keyboard_boot_report(state, report);
+    *report_id = BT_APP_KEYBOARD_BOOT_REPORT_ID;
+    return bt_app_notify_input_report(report, sizeof(report));
+}
+
+/*
+ * Called by the scheduler with the mutex held. When the MTU exchange or a Protocol Mode write moves the keys to the
+ * other report, the host still holds what the old one last carried, it gets an all released report after the new
+ * state went out. A failed release is retried with the next attempt, the state is sent again before it.
+ */
+static int hid_send_state(const bt_app_keyboard_t *state, void *arg) {
+    static const uint8_t released[BT_APP_KEYBOARD_NKRO_REPORT_LEN] = { 0 };
+    uint8_t report_id;
+    int rc = hid_send_keyboard(state, &report_id);
+    if (rc != 0) return rc;
+
+    const uint8_t previous_id = hid_keyboard_report_id;
+    if (previous_id != 0 && previous_id != report_id) {
+        rc = previous_id == BT_APP_KEYBOARD_NKRO_REPORT_ID
+                 ? bt_app_notify_nkro_report(released, BT_APP_KEYBOARD_NKRO_REPORT_LEN)
+                 : bt_app_notify_input_report(released, BT_APP_KEYBOARD_BOOT_REPORT_LEN);
+        if (rc != 0) return rc;
+        hid_stats_report_switches++;
+    }
+    hid_keyboard_report_id = report_id;
+    return 0;
+}
+
+/* Called by the mouse queue with the mutex held */
+static int hid_send_mouse(const uint8_t *report, void *arg) {
+    return bt_app_notify_mouse_report(report, BT_APP_MOUSE_REPORT_LEN);
+}
+
+void bt_hid_setup(void) {
+    hid_sched_mutex = xSemaphoreCreateMutex();
+    if (!hid_sched_mutex) {
+        ESP_LOGE(BT_TAG, "Failed to set up the keyboard report scheduler!");
+        return;
+    }
+    bt_app_sched_init(&hid_sched, BT_HID_REPORTS_PER_EVENT, hid_send_state, NULL);
+    bt_app_replay_init(&hid_replay, BT_HID_REPLAY_MAX_AGE_MS);
+    bt_app_report_state_init(&hid_report_states[BT_APP_KEYBOARD_BOOT_REPORT_ID], BT_APP_KEYBOARD_BOOT_REPORT_LEN);
+    bt_app_report_state_init(&hid_report_states[BT_APP_KEYBOARD_NKRO_REPORT_ID], BT_APP_KEYBOARD_NKRO_REPORT_LEN);
+    bt_app_report_state_init(&hid_report_states[BT_APP_MOUSE_REPORT_ID], BT_APP_MOUSE_REPORT_LEN);
+    bt_app_mouse_init(&hid_mouse, BT_HID_MOUSE_REPORTS_PER_EVENT, BT_HID_MOUSE_POLICY, hid_send_mouse, NULL);
+}
+
+void bt_hid_key_event(uint8_t key_code, bool pressed) {
+    if (!hid_sched_mutex) return;
+
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    const bool applied = bt_app_replay_event(&hid_replay, &hid_sched, key_code, pressed,
+                                             esp_timer_get_time() / 1000);
+    xSemaphoreGive(hid_sched_mutex);
+    if (applied) bt_app_request_connection_events();
+}
+
+void bt_hid_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t wheel) {
+    if (!hid_sched_mutex) return;
+
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    bt_app_mouse_report(&hid_mouse, buttons & BT_HID_MOUSE_BUTTONS_MASK, x, y, wheel);
+    const bool pending = bt_app_mouse_pending(&hid_mouse);
+    xSemaphoreGive(hid_sched_mutex);
+    if (pending) bt_app_request_connection_events();
+}
+
+bool bt_hid_connection_event(void) {
+    if (!hid_sched_mutex) return false;
+
+    // Key reports take the slots of the connection event first, replayed keys queue up behind the pending ones
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    const bool replaying = bt_app_replay_pump(&hid_replay, &hid_sched);
+    const bool keys_busy = bt_app_sched_connection_event(&hid_sched) || replaying;
+    const bool mouse_busy = bt_app_mouse_connection_event(&hid_mouse);
+    xSemaphoreGive(hid_sched_mutex);
+    return keys_busy || mouse_busy;
+}
+
+void bt_hid_set_listening(bool listening) {
+    if (!hid_sched_mutex) return;
+
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    if (listening) {
+        bt_app_sched_resume(&hid_sched);
+        bt_app_replay_resume(&hid_replay, &hid_sched, esp_timer_get_time() / 1000);
+        bt_app_mouse_resume(&hid_mouse);
+    } else {
+        bt_app_sched_pause(&hid_sched);
+        bt_app_mouse_pause(&hid_mouse);
+    }
+    xSemaphoreGive(hid_sched_mutex);
+    if (listening) bt_app_request_connection_events();
+}
+
+void bt_hid_log_stats(void) {
+    if (!hid_sched_mutex) return;
+
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    const bt_app_sched_stats_t keys = hid_sched.stats;
+    const bt_app_replay_stats_t replay = hid_replay.stats;
+    const bt_app_mouse_stats_t mouse = hid_mouse.stats;
+    const uint32_t report_switches = hid_stats_report_switches;
+    xSemaphoreGive(hid_sched_mutex);
+    ESP_LOGI(BT_TAG, "Key reports: %lu events, %lu sent, %lu merged, %lu split, %lu overflows, %lu retried",
+             keys.events, keys.reports, keys.merged, keys.splits, keys.overflows, keys.send_failures);
+    ESP_LOGI(BT_TAG, "Key replay: %lu sessions, %lu buffered, %lu replayed, %lu expired, %lu overflows, "
+             "%lu corrected, %u buffered at most", replay.sessions, replay.recorded, replay.replayed, replay.expired,
+             replay.overflows, replay.corrected, replay.max_count);
+    ESP_LOGI(BT_TAG, "Mouse reports: %lu events, %lu sent, %lu merged, %lu dropped, %lu overflows, %lu retried",
+             mouse.events, mouse.reports, mouse.merged, mouse.dropped, mouse.overflows, mouse.send_failures);
+    ESP_LOGI(BT_TAG, "Input report reads: %lu, %lu retried", hid_report_reads, hid_report_read_retries);
+    ESP_LOGI(BT_TAG, "Key report switches: %lu", report_switches);
+}
+
+void bt_hid_stop(void) {
+    hid_protocol_mode = BLE_REPORT_PROTOCOL_MODE;
+    if (!hid_sched_mutex) return;
+
+    xSemaphoreTake(hid_sched_mutex, portMAX_DELAY);
+    bt_app_sched_reset(&hid_sched);
+    hid_keyboard_report_id = 0;
+    // The host let go of every key, the ones typed from now on wait for the next host
+    if (BT_HID_REPLAY_ENABLED) bt_app_replay_begin(&hid_replay, &hid_sched);
+    bt_app_mouse_reset(&hid_mouse);
+    xSemaphoreGive(hid_sched_mutex);
+}
+
+void bt_hid_publish_report(uint8_t report_id, const uint8_t *report, uint16_t length) {
+    if (report_id == 0 || report_id > BT_APP_MOUSE_REPORT_ID) return;
+    bt_app_report_state_t *state = &hid_report_states[report_id];
+    if (length != state->length) return;
+    bt_app_report_state_publish(state, report);
+}
@@ -5,6 +5,46 @@
 #ifndef BT_DEVICE_HID_HANDLERS_H
 #define BT_DEVICE_HID_HANDLERS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BT_HID_NKRO_ENABLED             1           // Bitmap report in report protocol mode, boot report otherwise
+#define BT_HID_REPORTS_PER_EVENT        1           // Keyboard reports handed to the stack per connection event
+#define BT_HID_MOUSE_REPORTS_PER_EVENT  1           // Mouse reports handed to the stack per connection event
+#define BT_HID_MOUSE_POLICY             BT_APP_MOUSE_POLICY_MERGE  // Or BT_APP_MOUSE_POLICY_DROP for stale motion
+#define BT_HID_MOUSE_BUTTONS_MASK       0x07        // Buttons the mouse report carries
+#define BT_HID_REPLAY_ENABLED           1           // Keys typed while the link is down are replayed to the next host
+#define BT_HID_REPLAY_MAX_AGE_MS        5000        // Older keys are dropped when the host comes back
+
+void bt_hid_setup(void);
+
+/*
+ * Applies a key event of the bridged keyboards, the report goes out now or with the next connection event. While
+ * the link is down the event is buffered for the next host, see bt_app_replay.h.
+ */
+void bt_hid_key_event(uint8_t key_code, bool pressed);
+
+/* Applies a report of the bridged mice, motion waiting for the link is merged or dropped by BT_HID_MOUSE_POLICY */
+void bt_hid_mouse_report(uint8_t buttons, int16_t x, int16_t y, int16_t wheel);
+
+/* Opens the next window of the report scheduler, called once per connection interval, true while busy */
+bool bt_hid_connection_event(void);
+
+/* Pauses report building while no host is subscribed to the input reports, resuming sends the latched state */
+void bt_hid_set_listening(bool listening);
+
+/* Logs the counters of the keyboard scheduler and the mouse queue */
+void bt_hid_log_stats(void);
+
+/* Called when the connection drops, hosts start every connection in report protocol mode with no key down */
+void bt_hid_stop(void);
+
+/*
+ * Publishes a report handed to the stack as the value GATT reads of its input report return. Writers of one report
+ * ID have to be serialized, reads never block them.
+ */
+void bt_hid_publish_report(uint8_t report_id, const uint8_t *report, uint16_t length);
+
 int handle_hid_read(uint16_t conn_handle, uint16_t attr_handle,
                            struct ble_gatt_access_ctxt *ctxt, void *arg);
 
@@ -23,6 +63,10 @@ int handle_hid_output_report(uint16_t conn_handle, uint16_t attr_handle,
 int handle_hid_protocol_mode(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg);
 
+/* Report Reference descriptor, arg is the Report ID */
+int handle_hid_report_reference(uint16_t conn_handle, uint16_t attr_handle,
+                               struct ble_gatt_access_ctxt *ctxt, void *arg);
+
 int handle_hid_input_report_descriptor(uint16_t conn_handle, uint16_t attr_handle,
                                struct ble_gatt_access_ctxt *ctxt, void *arg);
 
@@ -0,0 +1,173 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <host/ble_gatt.h>
+#include <host/ble_hs.h>
+
+#include "bt_app.h"
+#include "bt_app_inject.h"
+#include "bt_constants.h"
+#include "bt_device_inject_handlers.h"
+
+static bt_app_inject_t bt_inject;
+static SemaphoreHandle_t bt_inject_mutex = NULL;
+static uint32_t bt_inject_retries = 0;
+
+static int bt_inject_send(const uint8_t *report, size_t length, void *arg) {
+    return bt_app_notify_input_report(report, length);
+}
+
+/* Pumps the engine, with a fresh window on a connection event, returns true while typing */
+static bool bt_inject_run(bool connection_event) {
+    if (!bt_inject_mutex) return false;
+
+    xSemaphoreTake(bt_inject_mutex, portMAX_DELAY);
+    const bool was_active = bt_inject.active;
+    const int64_t now_us = esp_timer_get_time();
+    const bool stalled = connection_event ? bt_app_inject_connection_event(&bt_inject, now_us)
+                                          : bt_app_inject_pump(&bt_inject, now_us);
+    if (!stalled) {
+        bt_inject_retries = 0;
+    } else if (++bt_inject_retries > BT_INJECT_MAX_RETRIES) {
+        bt_app_inject_stop(&bt_inject);
+        ESP_LOGW(BT_TAG, "Injection dropped, the input report is not accepted");
+    }
+    const bool active = bt_inject.active;
+    const bt_app_inject_stats_t stats = bt_inject.stats;
+    xSemaphoreGive(bt_inject_mutex);
+
+    if (was_active && !active) {
+        ESP_LOGI(BT_TAG, "Injected %lu chars in %lu ms, %lu chars/s, %lu reports",
+                 stats.chars, stats.elapsed_ms, stats.chars_per_s, stats.reports);
+    }
+    return active;
+}
+
+static esp_err_t bt_inject_start(const uint8_t *data, size_t length) {
+    if (!bt_inject_mutex) return ESP_ERR_INVALID_STATE;
+
+    xSemaphoreTake(bt_inject_mutex, portMAX_DELAY);
+    const int rc = bt_app_inject_start(&bt_inject, data, length, esp_timer_get_time());
+    xSemaphoreGive(bt_inject_mutex);
+    if (rc != 0) return ESP_ERR_INVALID_STATE;
+
+    bt_inject_run(false);
+    bt_app_request_connection_events();
+    return ESP_OK;
+}
+
+void bt_inject_setup(void) {
+    bt_inject_mutex = xSemaphoreCreateMutex();
+    if (!bt_inject_mutex) {
+        ESP_LOGE(BT_TAG, "Failed to set up text injection!");
+        return;
+    }
+    bt_app_inject_init(&bt_inject, BT_INJECT_WINDOW, bt_inject_send, NULL);
+}
+
+bool bt_inject_connection_event(void) {
+    return bt_inject_run(true);
+}
+
+void bt_inject_stop(void) {
+    if (!bt_inject_mutex) return;
+
+    xSemaphoreTake(bt_inject_mutex, portMAX_DELAY);
+    bt_app_inject_stop(&bt_inject);
+    xSemaphoreGive(bt_inject_mutex);
+}
+
+void bt_inject_macro(uint8_t slot) {
+    char key[16];
+    snprintf(key, sizeof(key), "macro%d", slot);
+
+    nvs_handle_t nvs;
+    if (slot >= BT_INJECT_MACRO_SLOTS || nvs_open(BT_INJECT_NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        ESP_LOGW(BT_TAG, "Macro %d is not set", slot);
+        return;
+    }
+
+    uint8_t *data = malloc(BT_APP_INJECT_MAX_LEN);
+    size_t length = BT_APP_INJECT_MAX_LEN;
+    esp_err_t err = data ? nvs_get_blob(nvs, key, data, &length) : ESP_ERR_NO_MEM;
+    nvs_close(nvs);
+
+    if (err == ESP_OK) err = bt_inject_start(data, length);
+    if (err != ESP_OK) ESP_LOGW(BT_TAG, "Failed to type macro %d: %s", slot, esp_err_to_name(err));
+    free(data);
+}
+
+int handle_config_inject(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    switch (ctxt->op) {
+        case BLE_GATT_ACCESS_OP_READ_CHR: {
+            if (!bt_inject_mutex) return BLE_ATT_ERR_UNLIKELY;
+            xSemaphoreTake(bt_inject_mutex, portMAX_DELAY);
+            const bt_app_inject_stats_t stats = bt_inject.stats;
+            xSemaphoreGive(bt_inject_mutex);
+            // The fields without the trailing padding, the layout the characteristic always had
+            os_mbuf_append(ctxt->om, &stats, offsetof(bt_app_inject_stats_t, active) + sizeof(stats.active));
+        }
+        break;
+        case BLE_GATT_ACCESS_OP_WRITE_CHR: {
+            uint8_t *data = malloc(BT_APP_INJECT_MAX_LEN);
+            uint16_t length = 0;
+            if (!data) return BLE_ATT_ERR_INSUFFICIENT_RES;
+            int rc = 0;
+            if (ble_hs_mbuf_to_flat(ctxt->om, data, BT_APP_INJECT_MAX_LEN, &length) != 0) {
+                rc = BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+            } else if (bt_inject_start(data, length) != ESP_OK) {
+                // Still typing the previous one
+                rc = BLE_ATT_ERR_UNLIKELY;
+            }
+            free(data);
+            return rc;
+        }
+        default:
+        break;
+    }
+    return 0;
+}
+
+int handle_config_macro_write(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg) {
+    uint8_t *data = malloc(BT_APP_INJECT_MAX_LEN + 1);
+    uint16_t length = 0;
+    if (!data) return BLE_ATT_ERR_INSUFFICIENT_RES;
+    if (ble_hs_mbuf_to_flat(ctxt->om, data, BT_APP_INJECT_MAX_LEN + 1, &length) != 0 ||
+        length == 0 || data[0] >= BT_INJECT_MACRO_SLOTS) {
+        free(data);
+        return BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN;
+    }
+
+    char key[16];
+    snprintf(key, sizeof(key), "macro%d", data[0]);
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(BT_INJECT_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        if (length > 1) {
+            err = nvs_set_blob(nvs, key, data + 1, length - 1);
+        } else {
+            err = nvs_erase_key(nvs, key);
+            if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+        }
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    free(data);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(BT_TAG, "Failed to store macro: %s", esp_err_to_name(err));
+        return BLE_ATT_ERR_UNLIKELY;
+    }
+    return 0;
+}
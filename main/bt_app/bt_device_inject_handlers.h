@@ -0,0 +1,43 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef BT_DEVICE_INJECT_HANDLERS_H
+#define BT_DEVICE_INJECT_HANDLERS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Text and macro injection characteristics of the bridge configuration service, see bt_app_inject.h for
+ * the data format.
+ *
+ * Inject (read, write):    writing data types it right away, reading returns bt_app_inject_stats_t of the
+ *                          running or last injection.
+ * Macro (write):           slot u8 | data |, stored in NVS and typed when a keymap MACRO key for the slot
+ *                          is pressed. A slot without data is erased.
+ */
+
+#define BT_INJECT_WINDOW                1           // Reports handed to the stack per connection event
+#define BT_INJECT_MAX_RETRIES           50          // Connection events in a row with the report refused before the injection is dropped
+#define BT_INJECT_MACRO_SLOTS           8
+#define BT_INJECT_NVS_NAMESPACE         "bt_app"
+
+void bt_inject_setup(void);
+
+/* Opens the next window, called once per connection interval, returns true while typing */
+bool bt_inject_connection_event(void);
+
+/* Drops a running injection, called when the connection drops */
+void bt_inject_stop(void);
+
+/* Types a stored macro, safe to call from any task */
+void bt_inject_macro(uint8_t slot);
+
+int handle_config_inject(uint16_t conn_handle, uint16_t attr_handle,
+                         struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+int handle_config_macro_write(uint16_t conn_handle, uint16_t attr_handle,
+                              struct ble_gatt_access_ctxt *ctxt, void *arg);
+
+#endif //BT_DEVICE_INJECT_HANDLERS_H
@@ -1,17 +1,58 @@
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <nvs_flash.h>
+#include "boot_milestones.h"
+#include "power_manager.h"
+#include "task_profiler.h"
+#include "tasks_common.h"
 #include "bt_app/bt_app.h"
 #include "usb_app/usb_app.h"
 
-int app_main(void) {
-    // Initialize NVS
+static const char TAG[] = "main";
+
+static void usb_init_task(void *args) {
+    usb_init();
+    vTaskDelete(NULL);
+}
+
+static void bt_init_task(void *args) {
+    // Initialize NVS, the BLE bond store lives there
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         err = nvs_flash_init();
     }
     ESP_ERROR_CHECK(err);
+    boot_milestone_mark(BOOT_MILESTONE_NVS_READY);
+
+    // Keys pass through unmapped until here, a bad stored keymap only costs the remapping
+    err = usb_app_load_keymap();
+    if (err != ESP_OK) ESP_LOGW(TAG, "Failed to load keymap: %s", esp_err_to_name(err));
 
-    // usb_init();
     bt_app_init();
+    usb_app_set_macro_callback(bt_app_type_macro);
+    usb_app_set_key_callback(bt_app_key_event);
+    usb_app_set_mouse_callback(bt_app_mouse_event);
+    bt_app_set_listen_callback(usb_app_set_listening);
+    bt_app_set_link_callback(usb_app_set_link);
+    usb_app_set_wake_callback(bt_app_wake);
+    vTaskDelete(NULL);
+}
+
+int app_main(void) {
+    power_manager_init();
+    task_profiler_init();
+    // USB host does not need NVS, so both stacks come up at the same time
+    if (!xTaskCreatePinnedToCore(usb_init_task, "usb_init", USB_APP_INIT_TASK_STACK_SIZE, NULL,
+                                 USB_APP_INIT_TASK_PRIORITY, NULL, USB_APP_INIT_TASK_CORE_ID)) {
+        ESP_LOGE(TAG, "Failed to create USB init task!");
+        esp_restart();
+    }
+    if (!xTaskCreatePinnedToCore(bt_init_task, "bt_init", BT_APP_INIT_TASK_STACK_SIZE, NULL,
+                                 BT_APP_INIT_TASK_PRIORITY, NULL, BT_APP_INIT_TASK_CORE_ID)) {
+        ESP_LOGE(TAG, "Failed to create BT init task!");
+        esp_restart();
+    }
     return 0;
 }
@@ -0,0 +1,284 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "power_manager.h"
+
+#include <esp_log.h>
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/timers.h>
+#include <stdio.h>
+
+#include "usb_app/usb_app.h"
+
+/* Keys pay for the idle USB poll interval first, the switch to full clock gets the rest */
+#define POWER_MANAGER_RAMP_BUDGET_US    (POWER_MANAGER_LATENCY_BUDGET_US - USB_APP_POLL_IDLE_INTERVAL_MS * 1000)
+
+_Static_assert(POWER_MANAGER_RAMP_BUDGET_US > 0, "USB_APP_POLL_IDLE_INTERVAL_MS alone exceeds the latency budget");
+
+static const char TAG[] = "power";
+
+typedef struct {
+    esp_pm_lock_type_t type;
+    const char *name;
+} power_manager_lock_def_t;
+
+static const power_manager_lock_def_t power_manager_lock_defs[POWER_MANAGER_LOCK_MAX] = {
+    [POWER_MANAGER_LOCK_USB_TRANSFERS] = { ESP_PM_NO_LIGHT_SLEEP, "usb_transfers" },
+    [POWER_MANAGER_LOCK_USB_ACTIVE] = { ESP_PM_CPU_FREQ_MAX, "usb_active" },
+    [POWER_MANAGER_LOCK_BLE_BURST] = { ESP_PM_CPU_FREQ_MAX, "ble_burst" },
+    [POWER_MANAGER_LOCK_USB_VBUS] = { ESP_PM_NO_LIGHT_SLEEP, "usb_vbus" },
+};
+
+static esp_pm_lock_handle_t power_manager_locks[POWER_MANAGER_LOCK_MAX];    // NULL while not configured
+static esp_pm_lock_handle_t power_manager_pin_lock = NULL;
+static int32_t power_manager_refs[POWER_MANAGER_LOCK_MAX];             // Below 0 while a release overtook its acquire
+static bool power_manager_held[POWER_MANAGER_LOCK_MAX];                 // Whether the pm lock is taken
+static bool power_manager_switching[POWER_MANAGER_LOCK_MAX];            // A task is taking or giving the pm lock
+static portMUX_TYPE power_manager_mux = portMUX_INITIALIZER_UNLOCKED;
+static power_manager_stats_t power_manager_stats = { 0 };
+static power_manager_state_e power_manager_state = POWER_MANAGER_STATE_SLEEP_ALLOWED;
+static int64_t power_manager_state_since_us = 0;
+static uint32_t power_manager_state_changes = 0;
+static bool power_manager_configured = false;
+static bool power_manager_light_sleep = false;
+static esp_pm_config_t power_manager_config;
+static esp_timer_handle_t power_manager_probe_timer = NULL;
+static int64_t power_manager_probe_due_us = 0;
+static uint32_t power_manager_probe_changes = 0;                       // State changes when the probe was armed
+
+/* Call with the mux held */
+static void power_manager_update_state(int64_t now_us) {
+    power_manager_state_e state = POWER_MANAGER_STATE_SLEEP_ALLOWED;
+    if (power_manager_stats.pinned || power_manager_refs[POWER_MANAGER_LOCK_USB_ACTIVE] > 0 ||
+        power_manager_refs[POWER_MANAGER_LOCK_BLE_BURST] > 0) {
+        state = POWER_MANAGER_STATE_MAX_FREQ;
+    } else if (power_manager_refs[POWER_MANAGER_LOCK_USB_TRANSFERS] > 0 ||
+               power_manager_refs[POWER_MANAGER_LOCK_USB_VBUS] > 0) {
+        state = POWER_MANAGER_STATE_MIN_FREQ;
+    }
+    if (state == power_manager_state) return;
+
+    power_manager_stats.residency_us[power_manager_state] += now_us - power_manager_state_since_us;
+    power_manager_state = state;
+    power_manager_state_since_us = now_us;
+    power_manager_state_changes++;
+}
+
+/* Call with the mux held, whether taking the pm lock raises the clock */
+static bool power_manager_ramps(power_manager_lock_e lock) {
+    if (power_manager_lock_defs[lock].type != ESP_PM_CPU_FREQ_MAX || power_manager_stats.pinned) return false;
+    for (int i = 0; i < POWER_MANAGER_LOCK_MAX; i++) {
+        if (power_manager_held[i] && power_manager_lock_defs[i].type == ESP_PM_CPU_FREQ_MAX) return false;
+    }
+    return true;
+}
+
+/*
+ * Brings the pm lock in line with the references. Switching the clock stalls the caller, so the pm lock is taken
+ * and given outside the mux. One task switches at a time and repeats until nothing changed meanwhile, the others
+ * only count their reference.
+ */
+static void power_manager_sync(power_manager_lock_e lock) {
+    bool pin = false;
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    while (!power_manager_switching[lock] && (power_manager_refs[lock] > 0) != power_manager_held[lock]) {
+        const bool hold = power_manager_refs[lock] > 0;
+        const bool ramp = hold && power_manager_ramps(lock);
+        power_manager_held[lock] = hold;
+        power_manager_switching[lock] = true;
+        portEXIT_CRITICAL_SAFE(&power_manager_mux);
+
+        const int64_t start_us = esp_timer_get_time();
+        // The clock is switched before this returns, the caller stalls for it
+        if (power_manager_locks[lock] && hold) esp_pm_lock_acquire(power_manager_locks[lock]);
+        if (power_manager_locks[lock] && !hold) esp_pm_lock_release(power_manager_locks[lock]);
+        const int64_t now_us = esp_timer_get_time();
+
+        portENTER_CRITICAL_SAFE(&power_manager_mux);
+        power_manager_switching[lock] = false;
+        if (ramp) {
+            const uint32_t ramp_us = now_us - start_us;
+            power_manager_stats.ramps++;
+            power_manager_stats.ramp_sum_us += ramp_us;
+            if (ramp_us > power_manager_stats.ramp_max_us) power_manager_stats.ramp_max_us = ramp_us;
+            if (ramp_us > POWER_MANAGER_RAMP_BUDGET_US && power_manager_pin_lock && !power_manager_stats.pinned) {
+                power_manager_stats.pinned = true;
+                power_manager_update_state(now_us);
+                pin = true;
+            }
+        }
+    }
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+    if (pin) esp_pm_lock_acquire(power_manager_pin_lock);
+}
+
+void power_manager_acquire(power_manager_lock_e lock) {
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    power_manager_refs[lock]++;
+    power_manager_update_state(esp_timer_get_time());
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+    power_manager_sync(lock);
+}
+
+void power_manager_release(power_manager_lock_e lock) {
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    power_manager_refs[lock]--;
+    power_manager_update_state(esp_timer_get_time());
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+    power_manager_sync(lock);
+}
+
+void power_manager_get_stats(power_manager_stats_t *stats) {
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    *stats = power_manager_stats;
+    stats->residency_us[power_manager_state] += esp_timer_get_time() - power_manager_state_since_us;
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+}
+
+/* Call with the mux held, the probe fires POWER_MANAGER_WAKE_PROBE_MS from now */
+static void power_manager_arm_probe(int64_t now_us) {
+    power_manager_probe_due_us = now_us + POWER_MANAGER_WAKE_PROBE_MS * 1000LL;
+    power_manager_probe_changes = power_manager_state_changes;
+}
+
+/*
+ * Runs in the esp_timer task. The chip wakes from light sleep for the timer, so how late the callback runs is what
+ * leaving light sleep costs. Only a probe with sleep allowed from arming to firing counts, the chip may not have
+ * slept at all while any lock was held. Light sleep is turned off for good once a probe breaks the budget.
+ */
+static void power_manager_wake_probe(void *arg) {
+    const int64_t now_us = esp_timer_get_time();
+    uint32_t late_us = 0;
+    bool over_budget = false;
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    if (power_manager_state == POWER_MANAGER_STATE_SLEEP_ALLOWED &&
+        power_manager_state_changes == power_manager_probe_changes) {
+        late_us = now_us > power_manager_probe_due_us ? now_us - power_manager_probe_due_us : 0;
+        power_manager_stats.wake_probes++;
+        power_manager_stats.wake_late_sum_us += late_us;
+        if (late_us > power_manager_stats.wake_late_max_us) power_manager_stats.wake_late_max_us = late_us;
+        over_budget = late_us > POWER_MANAGER_LATENCY_BUDGET_US;
+        if (over_budget) power_manager_stats.light_sleep_off = true;
+    }
+    power_manager_arm_probe(now_us);
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+
+    if (!over_budget) {
+        esp_timer_start_once(power_manager_probe_timer, POWER_MANAGER_WAKE_PROBE_MS * 1000ULL);
+        return;
+    }
+    power_manager_config.light_sleep_enable = false;
+    const esp_err_t err = esp_pm_configure(&power_manager_config);
+    if (err == ESP_OK) power_manager_light_sleep = false;
+    ESP_LOGW(TAG, "Light sleep wake-up took %lu us, over the %d us budget, light sleep off: %s",
+             late_us, POWER_MANAGER_LATENCY_BUDGET_US, esp_err_to_name(err));
+}
+
+static void power_manager_start_probe() {
+    const esp_timer_create_args_t timer_args = {
+        .callback = power_manager_wake_probe,
+        .name = "power_probe"
+    };
+    if (esp_timer_create(&timer_args, &power_manager_probe_timer) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to create light sleep probe timer!");
+        return;
+    }
+    portENTER_CRITICAL_SAFE(&power_manager_mux);
+    power_manager_arm_probe(esp_timer_get_time());
+    portEXIT_CRITICAL_SAFE(&power_manager_mux);
+    esp_timer_start_once(power_manager_probe_timer, POWER_MANAGER_WAKE_PROBE_MS * 1000ULL);
+}
+
+static void power_manager_log_stats(TimerHandle_t timer) {
+    power_manager_stats_t stats;
+    power_manager_get_stats(&stats);
+
+    uint64_t total_us = 0;
+    for (int i = 0; i < POWER_MANAGER_STATE_MAX; i++) {
+        total_us += stats.residency_us[i];
+    }
+    if (!total_us) return;
+
+    ESP_LOGI(TAG, "Power (%s%s): max freq %llu%%, min freq %llu%%, sleep allowed %llu%% | "
+             "ramps %lu, avg %llu us, max %lu us%s",
+             power_manager_configured ? "DFS" : "not configured",
+             power_manager_light_sleep ? " + light sleep" : "",
+             stats.residency_us[POWER_MANAGER_STATE_MAX_FREQ] * 100 / total_us,
+             stats.residency_us[POWER_MANAGER_STATE_MIN_FREQ] * 100 / total_us,
+             stats.residency_us[POWER_MANAGER_STATE_SLEEP_ALLOWED] * 100 / total_us,
+             stats.ramps, stats.ramps ? stats.ramp_sum_us / stats.ramps : 0, stats.ramp_max_us,
+             stats.pinned ? ", full clock pinned" : "");
+    if (stats.wake_probes) {
+        ESP_LOGI(TAG, "Light sleep wake-up: %lu probes, late avg %llu us, max %lu us%s", stats.wake_probes,
+                 stats.wake_late_sum_us / stats.wake_probes, stats.wake_late_max_us,
+                 stats.light_sleep_off ? ", over budget, light sleep off" : "");
+    }
+#if CONFIG_PM_PROFILING
+    // Time actually spent in each mode, including the locks of the drivers
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+static void power_manager_start_stats() {
+    if (POWER_MANAGER_STATS_PERIOD_MS == 0) {
+        return;
+    }
+
+    TimerHandle_t stats_timer = xTimerCreate(
+        "power_stats",
+        pdMS_TO_TICKS(POWER_MANAGER_STATS_PERIOD_MS),
+        pdTRUE,
+        NULL,
+        power_manager_log_stats
+    );
+    if (!stats_timer || xTimerStart(stats_timer, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start power stats timer!");
+    }
+}
+
+static void power_manager_configure() {
+    esp_pm_config_t config = {
+        .max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz = POWER_MANAGER_MIN_FREQ_MHZ,
+        .light_sleep_enable = POWER_MANAGER_LIGHT_SLEEP_ENABLED
+    };
+    esp_err_t err = esp_pm_configure(&config);
+    if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable) {
+        // Light sleep also needs CONFIG_FREERTOS_USE_TICKLESS_IDLE, frequency scaling alone may still work
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Power management not configured: %s, enable CONFIG_PM_ENABLE", esp_err_to_name(err));
+        return;
+    }
+
+    for (int i = 0; i < POWER_MANAGER_LOCK_MAX; i++) {
+        if (esp_pm_lock_create(power_manager_lock_defs[i].type, 0, power_manager_lock_defs[i].name,
+                               &power_manager_locks[i]) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to create power lock %s!", power_manager_lock_defs[i].name);
+            esp_restart();
+        }
+    }
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "power_pin", &power_manager_pin_lock) != ESP_OK) {
+        power_manager_pin_lock = NULL;
+    }
+    power_manager_configured = true;
+    power_manager_config = config;
+    power_manager_light_sleep = config.light_sleep_enable;
+    ESP_LOGI(TAG, "Power management: %d-%d MHz, light sleep %s, latency budget %d us",
+             POWER_MANAGER_MIN_FREQ_MHZ, CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+             power_manager_light_sleep ? "on" : "off", POWER_MANAGER_LATENCY_BUDGET_US);
+    if (power_manager_light_sleep && POWER_MANAGER_WAKE_PROBE_MS) power_manager_start_probe();
+}
+
+void power_manager_init(void) {
+    power_manager_state_since_us = esp_timer_get_time();
+#if POWER_MANAGER_ENABLED
+    power_manager_configure();
+#endif
+    power_manager_start_stats();
+}
@@ -0,0 +1,75 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Dynamic frequency scaling and automatic light sleep, both need CONFIG_PM_ENABLE and light sleep also
+ * CONFIG_FREERTOS_USE_TICKLESS_IDLE. Without them the locks below are only counted for the residency log. The
+ * sdkconfig has both on, with BT modem sleep on the main XTAL kept powered in light sleep so the link holds.
+ *
+ * The CPU runs at the lowest frequency unless a lock is held: the USB side holds one while IN transfers run,
+ * since the host controller stops in light sleep, and one at full clock while an interface is active. The BLE
+ * side holds one at full clock while its reports wait for connection events.
+ *
+ * Power saving may add at most POWER_MANAGER_LATENCY_BUDGET_US from a key press to its report. Light sleep never
+ * happens while IN transfers run, so keys only pay for the idle USB poll interval and the switch to full clock.
+ * The wake-up cost of light sleep is measured on the device: a probe timer fires every POWER_MANAGER_WAKE_PROBE_MS
+ * and how late it runs while sleep is allowed is the cost of leaving light sleep. Light sleep is turned off once a
+ * probe exceeds the budget, and full clock is pinned once a measured switch does.
+ */
+
+#define POWER_MANAGER_ENABLED                   1           // Needs CONFIG_PM_ENABLE, light sleep CONFIG_FREERTOS_USE_TICKLESS_IDLE
+#define POWER_MANAGER_MIN_FREQ_MHZ              40          // XTAL, the maximum is CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+#define POWER_MANAGER_LIGHT_SLEEP_ENABLED       1
+#define POWER_MANAGER_WAKE_PROBE_MS             10000       // Period of the light sleep wake-up probe, 0 disables it
+#define POWER_MANAGER_LATENCY_BUDGET_US         20000       // Max latency power saving adds from a key press to its report
+#define POWER_MANAGER_STATS_PERIOD_MS           60000       // Period of the residency log, 0 disables it
+
+typedef enum {
+    POWER_MANAGER_LOCK_USB_TRANSFERS = 0,                   // No light sleep, one reference per running interface
+    POWER_MANAGER_LOCK_USB_ACTIVE,                          // Full clock, one reference per active interface
+    POWER_MANAGER_LOCK_BLE_BURST,                           // Full clock while reports wait for connection events
+    POWER_MANAGER_LOCK_USB_VBUS,                            // No light sleep while a VBUS change is debounced
+    POWER_MANAGER_LOCK_MAX
+} power_manager_lock_e;
+
+typedef enum {
+    POWER_MANAGER_STATE_MAX_FREQ = 0,                       // A full clock lock is held
+    POWER_MANAGER_STATE_MIN_FREQ,                           // Only light sleep is blocked
+    POWER_MANAGER_STATE_SLEEP_ALLOWED,                      // No lock held, the chip sleeps unless a driver holds one
+    POWER_MANAGER_STATE_MAX
+} power_manager_state_e;
+
+typedef struct {
+    uint64_t residency_us[POWER_MANAGER_STATE_MAX];         // The current period not included
+    uint32_t ramps;                                         // Switches to full clock
+    uint64_t ramp_sum_us;                                   // Time the caller stalled while the clock went up
+    uint32_t ramp_max_us;
+    bool pinned;                                            // Full clock held for good, a switch broke the budget
+    uint32_t wake_probes;                                   // Probes that fired with sleep allowed since they were armed
+    uint64_t wake_late_sum_us;                              // How late those ran, light sleep exit included
+    uint32_t wake_late_max_us;
+    bool light_sleep_off;                                   // Light sleep turned off, a probe broke the budget
+} power_manager_stats_t;
+
+/* Call first thing in app_main, before any task takes a lock */
+void power_manager_init(void);
+
+/*
+ * Takes one reference of the lock, safe from any task but not inside a critical section, raising the clock stalls
+ * the caller. A release may overtake its acquire from another task, the pm lock follows once both ran.
+ */
+void power_manager_acquire(power_manager_lock_e lock);
+
+void power_manager_release(power_manager_lock_e lock);
+
+/* Copies the stats with the current period counted up to now */
+void power_manager_get_stats(power_manager_stats_t *stats);
+
+#endif //POWER_MANAGER_H
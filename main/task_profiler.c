@@ -0,0 +1,234 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "task_profiler.h"
+
+#include <esp_console.h>
+#include <esp_log.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <freertos/timers.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "tasks_common.h"
+
+#define TASK_PROFILER_STATUS_MAX        (TASK_PROFILER_WINDOW_MAX_TASKS + 8)    // uxTaskGetSystemState fails if too few
+#define TASK_PROFILER_REPORT_MAX_TASKS  ((TASK_PROFILER_REPORT_MAX_LEN - sizeof(task_profiler_report_header_t)) / \
+                                         sizeof(task_profiler_report_task_t))
+
+#define TASK_PROFILER_LOG_SAMPLES       (TASK_PROFILER_LOG_PERIOD_MS == 0 ? 0 : \
+                                         TASK_PROFILER_LOG_PERIOD_MS > TASK_PROFILER_SAMPLE_PERIOD_MS ? \
+                                         TASK_PROFILER_LOG_PERIOD_MS / TASK_PROFILER_SAMPLE_PERIOD_MS : 1)
+
+static const char TAG[] = "profiler";
+
+static const uint8_t task_profiler_windows[TASK_PROFILER_WINDOW_COUNT] = TASK_PROFILER_WINDOWS;
+
+_Static_assert(TASK_PROFILER_SAMPLE_PERIOD_MS > 0, "The window math needs a sample period");
+
+static task_profiler_window_t task_profiler_window;
+static SemaphoreHandle_t task_profiler_mutex = NULL;        // NULL while the profiler is not running
+static SemaphoreHandle_t task_profiler_print_mutex = NULL;
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+
+static void task_profiler_sample(TimerHandle_t timer) {
+    static TaskStatus_t status[TASK_PROFILER_STATUS_MAX];
+    static task_profiler_sample_t samples[TASK_PROFILER_STATUS_MAX];
+    configRUN_TIME_COUNTER_TYPE total_run_time = 0;
+
+    const UBaseType_t count = uxTaskGetSystemState(status, TASK_PROFILER_STATUS_MAX, &total_run_time);
+    if (count == 0) {
+        ESP_LOGW(TAG, "More than %d tasks, sample skipped", TASK_PROFILER_STATUS_MAX);
+        return;
+    }
+    for (UBaseType_t i = 0; i < count; i++) {
+        const BaseType_t core = xTaskGetCoreID(status[i].xHandle);
+        samples[i] = (task_profiler_sample_t) {
+            .number = status[i].xTaskNumber,
+            .run_time = (uint32_t) status[i].ulRunTimeCounter,
+            .stack_free = status[i].usStackHighWaterMark,
+            .priority = (uint8_t) status[i].uxCurrentPriority,
+            .core = core == tskNO_AFFINITY ? TASK_PROFILER_WINDOW_NO_AFFINITY : (uint8_t) core,
+        };
+        strncpy(samples[i].name, status[i].pcTaskName, sizeof(samples[i].name));
+    }
+
+    xSemaphoreTake(task_profiler_mutex, portMAX_DELAY);
+    task_profiler_window_add(&task_profiler_window, samples, count, (uint32_t) total_run_time);
+    const uint32_t sampled = task_profiler_window.stats.sampled;
+    xSemaphoreGive(task_profiler_mutex);
+
+    if (TASK_PROFILER_LOG_SAMPLES && sampled % TASK_PROFILER_LOG_SAMPLES == 0) {
+        task_profiler_print();
+    }
+}
+
+#endif
+
+/* Rows of the tracked tasks, busiest over the longest window first, returns how many are tracked */
+static size_t task_profiler_snapshot(task_profiler_report_task_t *rows, size_t max_rows,
+                                     task_profiler_window_stats_t *stats) {
+    const uint16_t longest = task_profiler_windows[TASK_PROFILER_WINDOW_COUNT - 1];
+    size_t slots[TASK_PROFILER_WINDOW_MAX_TASKS];
+    uint16_t loads[TASK_PROFILER_WINDOW_MAX_TASKS];
+    size_t count = 0;
+
+    xSemaphoreTake(task_profiler_mutex, portMAX_DELAY);
+    for (size_t slot = 0; slot < TASK_PROFILER_WINDOW_MAX_TASKS; slot++) {
+        if (!task_profiler_window.tasks[slot].used) continue;
+
+        const uint16_t load = task_profiler_window_load(&task_profiler_window, slot, longest);
+        size_t i = count++;
+        for (; i > 0 && loads[i - 1] < load; i--) {
+            loads[i] = loads[i - 1];
+            slots[i] = slots[i - 1];
+        }
+        loads[i] = load;
+        slots[i] = slot;
+    }
+    for (size_t i = 0; i < count && i < max_rows; i++) {
+        const task_profiler_sample_t *last = &task_profiler_window.tasks[slots[i]].last;
+        rows[i] = (task_profiler_report_task_t) {
+            .priority = last->priority,
+            .core = last->core,
+            .stack_free = last->stack_free > UINT16_MAX ? UINT16_MAX : last->stack_free,
+        };
+        strncpy(rows[i].name, last->name, sizeof(rows[i].name));
+        for (int window = 0; window < TASK_PROFILER_WINDOW_COUNT; window++) {
+            rows[i].load[window] = task_profiler_window_load(&task_profiler_window, slots[i],
+                                                             task_profiler_windows[window]);
+        }
+    }
+    if (stats) *stats = task_profiler_window.stats;
+    xSemaphoreGive(task_profiler_mutex);
+    return count;
+}
+
+size_t task_profiler_get_report(uint8_t *report, size_t max_length) {
+    task_profiler_report_header_t header = {
+        .sample_period_ms = TASK_PROFILER_SAMPLE_PERIOD_MS,
+    };
+    memcpy(header.window_samples, task_profiler_windows, sizeof(header.window_samples));
+    if (max_length < sizeof(header)) return 0;
+
+    size_t max_rows = (max_length - sizeof(header)) / sizeof(task_profiler_report_task_t);
+    if (max_rows > TASK_PROFILER_REPORT_MAX_TASKS) max_rows = TASK_PROFILER_REPORT_MAX_TASKS;
+    if (task_profiler_mutex) {
+        // The rows go straight into the report, the packed struct has no alignment to keep
+        task_profiler_report_task_t *rows = (task_profiler_report_task_t *) (report + sizeof(header));
+        const size_t count = task_profiler_snapshot(rows, max_rows, NULL);
+        header.tracked = count;
+        header.task_count = count < max_rows ? count : max_rows;
+    }
+    memcpy(report, &header, sizeof(header));
+    return sizeof(header) + header.task_count * sizeof(task_profiler_report_task_t);
+}
+
+void task_profiler_print(void) {
+    if (!task_profiler_mutex) {
+        printf("Task profiler not running, it needs CONFIG_FREERTOS_USE_TRACE_FACILITY and "
+               "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n");
+        return;
+    }
+
+    // Printing takes long at the console baud rate, the sampler and GATT reads only wait for the snapshot
+    static task_profiler_report_task_t rows[TASK_PROFILER_WINDOW_MAX_TASKS];
+    xSemaphoreTake(task_profiler_print_mutex, portMAX_DELAY);
+    task_profiler_window_stats_t stats;
+    const size_t count = task_profiler_snapshot(rows, TASK_PROFILER_WINDOW_MAX_TASKS, &stats);
+
+    printf("Tasks: %u tracked, %lu untracked | %lu samples every %d ms, %lu created, %lu deleted\n",
+           (unsigned) count, stats.untracked, stats.sampled, TASK_PROFILER_SAMPLE_PERIOD_MS,
+           stats.created, stats.deleted);
+    printf("  %-16s core prio stack free", "name");
+    for (int window = 0; window < TASK_PROFILER_WINDOW_COUNT; window++) {
+        printf("  %4u s", (unsigned) (task_profiler_windows[window] * TASK_PROFILER_SAMPLE_PERIOD_MS / 1000));
+    }
+    printf("\n");
+    for (size_t i = 0; i < count; i++) {
+        char name[TASK_PROFILER_WINDOW_NAME_LEN + 1] = { 0 };
+        memcpy(name, rows[i].name, sizeof(rows[i].name));
+        char core[4] = "any";
+        if (rows[i].core != TASK_PROFILER_WINDOW_NO_AFFINITY) snprintf(core, sizeof(core), "%u", rows[i].core);
+
+        printf("  %-16s %4s %4u %10u", name, core, rows[i].priority, rows[i].stack_free);
+        for (int window = 0; window < TASK_PROFILER_WINDOW_COUNT; window++) {
+            printf(" %3u.%02u%%", rows[i].load[window] / 100, rows[i].load[window] % 100);
+        }
+        printf("\n");
+    }
+    xSemaphoreGive(task_profiler_print_mutex);
+}
+
+#if TASK_PROFILER_CONSOLE_ENABLED
+
+static int task_profiler_tasks_command(int argc, char **argv) {
+    task_profiler_print();
+    return 0;
+}
+
+static void task_profiler_start_console() {
+    esp_console_repl_t *repl = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt = "bridge>";
+    repl_config.task_stack_size = TASK_PROFILER_CONSOLE_TASK_STACK_SIZE;
+    repl_config.task_priority = TASK_PROFILER_CONSOLE_TASK_PRIORITY;
+
+    esp_err_t err = ESP_ERR_NOT_SUPPORTED;
+#if CONFIG_ESP_CONSOLE_UART_DEFAULT || CONFIG_ESP_CONSOLE_UART_CUSTOM
+    esp_console_dev_uart_config_t uart_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    err = esp_console_new_repl_uart(&uart_config, &repl_config, &repl);
+#elif CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG
+    esp_console_dev_usb_serial_jtag_config_t jtag_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    err = esp_console_new_repl_usb_serial_jtag(&jtag_config, &repl_config, &repl);
+#endif
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to create console: %s", esp_err_to_name(err));
+        return;
+    }
+
+    const esp_console_cmd_t command = {
+        .command = "tasks",
+        .help = "CPU load and least free stack of every task",
+        .func = task_profiler_tasks_command,
+    };
+    err = esp_console_cmd_register(&command);
+    if (err == ESP_OK) err = esp_console_start_repl(repl);
+    if (err != ESP_OK) ESP_LOGW(TAG, "Failed to start console: %s", esp_err_to_name(err));
+}
+
+#endif
+
+void task_profiler_init(void) {
+#if TASK_PROFILER_ENABLED && configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    task_profiler_window_init(&task_profiler_window);
+    task_profiler_print_mutex = xSemaphoreCreateMutex();
+    task_profiler_mutex = xSemaphoreCreateMutex();
+    if (!task_profiler_mutex || !task_profiler_print_mutex) {
+        ESP_LOGW(TAG, "Failed to create task profiler mutex!");
+        task_profiler_mutex = NULL;
+        return;
+    }
+
+    TimerHandle_t sample_timer = xTimerCreate(
+        "task_profiler",
+        pdMS_TO_TICKS(TASK_PROFILER_SAMPLE_PERIOD_MS),
+        pdTRUE,
+        NULL,
+        task_profiler_sample
+    );
+    if (!sample_timer || xTimerStart(sample_timer, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start task profiler timer!");
+    }
+#elif TASK_PROFILER_ENABLED
+    ESP_LOGW(TAG, "Task profiler needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS");
+#endif
+#if TASK_PROFILER_CONSOLE_ENABLED
+    task_profiler_start_console();
+#endif
+}
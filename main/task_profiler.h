@@ -0,0 +1,67 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef TASK_PROFILER_H
+#define TASK_PROFILER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "task_profiler_window.h"
+
+/*
+ * CPU load and stack use of every task, the data to size the stacks and priorities in tasks_common.h with.
+ * Needs CONFIG_FREERTOS_USE_TRACE_FACILITY and CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS, without them the profiler
+ * reports no tasks.
+ *
+ * The run-time counters and stack high-water marks of all tasks are sampled every TASK_PROFILER_SAMPLE_PERIOD_MS,
+ * the load is computed over the windows below, see task_profiler_window.h. The table is printed by the "tasks"
+ * console command and the periodic log, and read over BLE from the tasks characteristic of the configuration
+ * service. Each sample wakes the chip from light sleep.
+ */
+
+#define TASK_PROFILER_ENABLED                   1
+#define TASK_PROFILER_SAMPLE_PERIOD_MS          1000
+#define TASK_PROFILER_WINDOWS                   { 1, 10, 60 }   // Sample periods of each window, the longest fits TASK_PROFILER_WINDOW_MAX_SAMPLES
+#define TASK_PROFILER_WINDOW_COUNT              3
+#define TASK_PROFILER_CONSOLE_ENABLED           1               // UART REPL with the "tasks" command
+#define TASK_PROFILER_LOG_PERIOD_MS             0               // Period of the task table log, 0 disables it
+
+/*
+ * Tasks characteristic: header | task * task_count |, busiest task over the longest window first. Only the tasks
+ * that fit an attribute are in it, tracked tells how many there are. The value changes once per sample, a long read
+ * spanning a sample can mix two of them.
+ */
+
+typedef struct {
+    uint16_t sample_period_ms;
+    uint8_t window_samples[TASK_PROFILER_WINDOW_COUNT];
+    uint8_t tracked;                                        // Tasks in the profiler
+    uint8_t task_count;                                     // Tasks in this report
+} __attribute__((packed)) task_profiler_report_header_t;
+
+typedef struct {
+    char name[TASK_PROFILER_WINDOW_NAME_LEN];               // Zero padded
+    uint8_t priority;
+    uint8_t core;                                           // TASK_PROFILER_WINDOW_NO_AFFINITY if not pinned
+    uint16_t stack_free;                                    // Least free stack so far in bytes, saturates
+    uint16_t load[TASK_PROFILER_WINDOW_COUNT];              // In 0.01 % of one core, see TASK_PROFILER_WINDOWS
+} __attribute__((packed)) task_profiler_report_task_t;
+
+#define TASK_PROFILER_REPORT_MAX_LEN            512         // Longest attribute value
+
+/* Call in app_main, the console starts here too */
+void task_profiler_init(void);
+
+/**
+ * @brief Fills the tasks characteristic
+ *
+ * @return Length of the report, only the header while nothing has been sampled
+ */
+size_t task_profiler_get_report(uint8_t *report, size_t max_length);
+
+/* Prints the task table to the console */
+void task_profiler_print(void);
+
+#endif //TASK_PROFILER_H
@@ -0,0 +1,90 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "task_profiler_window.h"
+
+#include <string.h>
+
+void task_profiler_window_init(task_profiler_window_t *window) {
+    memset(window, 0, sizeof(*window));
+}
+
+static int task_profiler_window_find(const task_profiler_window_t *window, uint32_t number) {
+    for (int i = 0; i < TASK_PROFILER_WINDOW_MAX_TASKS; i++) {
+        if (window->tasks[i].used && window->tasks[i].last.number == number) return i;
+    }
+    return -1;
+}
+
+static int task_profiler_window_free_slot(const task_profiler_window_t *window) {
+    for (int i = 0; i < TASK_PROFILER_WINDOW_MAX_TASKS; i++) {
+        if (!window->tasks[i].used) return i;
+    }
+    return -1;
+}
+
+void task_profiler_window_add(task_profiler_window_t *window, const task_profiler_sample_t *tasks, size_t count,
+                              uint32_t total_run_time) {
+    const uint16_t head = window->samples ? (window->head + 1) % TASK_PROFILER_WINDOW_RING : 0;
+    window->head = head;
+    window->total[head] = total_run_time;
+    if (window->samples < TASK_PROFILER_WINDOW_RING) window->samples++;
+    window->stats.sampled++;
+
+    // Tasks not in this sample are gone, their slots are free for the new ones below
+    bool seen[TASK_PROFILER_WINDOW_MAX_TASKS] = { false };
+    for (size_t i = 0; i < count; i++) {
+        const int slot = task_profiler_window_find(window, tasks[i].number);
+        if (slot >= 0) seen[slot] = true;
+    }
+    for (int i = 0; i < TASK_PROFILER_WINDOW_MAX_TASKS; i++) {
+        if (!window->tasks[i].used || seen[i]) continue;
+        window->tasks[i].used = false;
+        window->stats.deleted++;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        int slot = task_profiler_window_find(window, tasks[i].number);
+        if (slot < 0) {
+            slot = task_profiler_window_free_slot(window);
+            if (slot < 0) {
+                window->stats.untracked++;
+                continue;
+            }
+            window->tasks[slot].used = true;
+            window->tasks[slot].samples = 0;
+            window->stats.created++;
+        }
+
+        task_profiler_window_task_t *task = &window->tasks[slot];
+        task->last = tasks[i];
+        task->last.name[TASK_PROFILER_WINDOW_NAME_LEN - 1] = '\0';
+        task->run_time[head] = tasks[i].run_time;
+        if (task->samples < TASK_PROFILER_WINDOW_RING) task->samples++;
+    }
+}
+
+uint16_t task_profiler_window_span(const task_profiler_window_t *window, size_t task, uint16_t window_samples) {
+    if (task >= TASK_PROFILER_WINDOW_MAX_TASKS || !window->tasks[task].used) return 0;
+
+    // n periods need n + 1 samples
+    uint16_t span = window_samples;
+    if (span > window->tasks[task].samples - 1) span = window->tasks[task].samples - 1;
+    if (span > TASK_PROFILER_WINDOW_MAX_SAMPLES) span = TASK_PROFILER_WINDOW_MAX_SAMPLES;
+    return span;
+}
+
+uint16_t task_profiler_window_load(const task_profiler_window_t *window, size_t task, uint16_t window_samples) {
+    const uint16_t span = task_profiler_window_span(window, task, window_samples);
+    if (span == 0) return 0;
+
+    const uint16_t from = (window->head + TASK_PROFILER_WINDOW_RING - span) % TASK_PROFILER_WINDOW_RING;
+    const uint32_t elapsed = window->total[window->head] - window->total[from];
+    const uint32_t run = window->tasks[task].run_time[window->head] - window->tasks[task].run_time[from];
+    if (elapsed == 0) return 0;
+
+    // The task and the total counter are read a moment apart, a busy task can come out a bit above a full core
+    const uint64_t load = (uint64_t) run * TASK_PROFILER_WINDOW_LOAD_FULL / elapsed;
+    return load > TASK_PROFILER_WINDOW_LOAD_FULL ? TASK_PROFILER_WINDOW_LOAD_FULL : (uint16_t) load;
+}
@@ -0,0 +1,82 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef TASK_PROFILER_WINDOW_H
+#define TASK_PROFILER_WINDOW_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * CPU load per task over sliding windows, computed from periodic samples of the FreeRTOS run-time counters.
+ *
+ * Each sample holds the run-time counter of every task and the total counter of the same moment. The load over a
+ * window of n samples is the run time the task gained across the last n periods over the time that passed, so 100 %
+ * is one core busy, summed over both cores all tasks give 200 %. The counters are 32 bits and wrap, the unsigned
+ * differences stay right as long as a window is shorter than one wrap (71 minutes of a microsecond counter).
+ *
+ * Tasks are matched by their task number, which FreeRTOS never hands out twice, so a task created on the slot of a
+ * deleted one with the same name starts a new history. A task younger than the window gets its load over the
+ * periods it has been seen in, a task missing from a sample is dropped.
+ */
+
+#define TASK_PROFILER_WINDOW_MAX_TASKS      24
+#define TASK_PROFILER_WINDOW_MAX_SAMPLES    60          // Longest window in sample periods
+#define TASK_PROFILER_WINDOW_NAME_LEN       16          // CONFIG_FREERTOS_MAX_TASK_NAME_LEN with the terminator
+#define TASK_PROFILER_WINDOW_LOAD_FULL      10000       // Load of a task that kept one core busy, in 0.01 %
+
+#define TASK_PROFILER_WINDOW_RING           (TASK_PROFILER_WINDOW_MAX_SAMPLES + 1)
+
+typedef struct {
+    uint32_t number;                                    // Task number, unique per created task
+    char name[TASK_PROFILER_WINDOW_NAME_LEN];
+    uint32_t run_time;                                  // Run-time counter of the task
+    uint32_t stack_free;                                // Stack high-water mark, least free space so far
+    uint8_t priority;
+    uint8_t core;                                       // Pinned core, TASK_PROFILER_WINDOW_NO_AFFINITY if any
+} task_profiler_sample_t;
+
+#define TASK_PROFILER_WINDOW_NO_AFFINITY    0xFF
+
+typedef struct {
+    task_profiler_sample_t last;                        // Latest sample of the task
+    uint32_t run_time[TASK_PROFILER_WINDOW_RING];       // Same slots as the total ring
+    uint16_t samples;                                   // Samples of the task in the ring
+    bool used;
+} task_profiler_window_task_t;
+
+typedef struct {
+    uint32_t sampled;                                   // Samples taken
+    uint32_t created;                                   // Tasks seen for the first time
+    uint32_t deleted;                                   // Tasks gone from a sample
+    uint32_t untracked;                                 // Tasks left out of a sample, no free slot
+} task_profiler_window_stats_t;
+
+typedef struct {
+    task_profiler_window_task_t tasks[TASK_PROFILER_WINDOW_MAX_TASKS];
+    uint32_t total[TASK_PROFILER_WINDOW_RING];          // Total run-time counter of each sample
+    uint16_t head;                                      // Slot of the latest sample
+    uint16_t samples;                                   // Samples in the ring
+    task_profiler_window_stats_t stats;
+} task_profiler_window_t;
+
+void task_profiler_window_init(task_profiler_window_t *window);
+
+/* Adds one sample of all tasks, total_run_time is the total counter of the same moment */
+void task_profiler_window_add(task_profiler_window_t *window, const task_profiler_sample_t *tasks, size_t count,
+                              uint32_t total_run_time);
+
+/**
+ * @brief Load of a task over the last window_samples sample periods
+ *
+ * @return Load in 0.01 % of one core, over fewer periods if the task or the ring is younger, 0 before the task
+ *         has been seen twice
+ */
+uint16_t task_profiler_window_load(const task_profiler_window_t *window, size_t task, uint16_t window_samples);
+
+/* Sample periods the load of the task is really computed over when asking for window_samples */
+uint16_t task_profiler_window_span(const task_profiler_window_t *window, size_t task, uint16_t window_samples);
+
+#endif //TASK_PROFILER_WINDOW_H
@@ -7,6 +7,10 @@
 
 /* ------------- CORE 0 ------------- */
 
+#define USB_APP_INIT_TASK_PRIORITY               5
+#define USB_APP_INIT_TASK_STACK_SIZE             4096
+#define USB_APP_INIT_TASK_CORE_ID                0
+
 #define USB_APP_DEAMON_TASK_PRIORITY                5
 #define USB_APP_DEAMON_TASK_STACK_SIZE              4096
 #define USB_APP_DEAMON_TASK_CORE_ID                 0
@@ -15,7 +19,24 @@
 #define USB_APP_HID_TASK_STACK_SIZE              4096
 #define USB_APP_HID_TASK_CORE_ID                 0
 
+#define USB_APP_ENUM_TASK_PRIORITY               4
+#define USB_APP_ENUM_TASK_STACK_SIZE             4096
+#define USB_APP_ENUM_TASK_CORE_ID                0
+#define USB_APP_ENUM_TASK_COUNT                  3
+
+#define USB_APP_UNIFIED_TASK_PRIORITY            5
+#define USB_APP_UNIFIED_TASK_STACK_SIZE          4096
+#define USB_APP_UNIFIED_TASK_CORE_ID             0
+
 /* ------------- CORE 1 ------------- */
 
+#define BT_APP_INIT_TASK_PRIORITY                5
+#define BT_APP_INIT_TASK_STACK_SIZE              4096
+#define BT_APP_INIT_TASK_CORE_ID                 1
+
+/* ------------- ANY CORE ------------- */
+
+#define TASK_PROFILER_CONSOLE_TASK_PRIORITY      2
+#define TASK_PROFILER_CONSOLE_TASK_STACK_SIZE    4096
 
 #endif //TASKS_COMMON_H
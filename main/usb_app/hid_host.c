@@ -69,17 +69,25 @@ static const char *TAG = "hid-host";
 
 #define DEFAULT_TIMEOUT_MS  (5000)
 
+#define USB_DEV_ADDR_MAX            (128)   // USB device address is 7 bits wide
+#define CLIENT_EVENT_MSG_MAX        (32)    // Enough NEW_DEV/DEV_GONE messages for a hub burst
+
 /**
  * @brief HID Device structure.
  *
  */
 typedef struct hid_host_device {
     STAILQ_ENTRY(hid_host_device) tailq_entry;  /**< HID device queue */
+    STAILQ_HEAD(device_ifaces, hid_interface) ifaces_tailq; /**< STAILQ of this device HID interfaces */
     SemaphoreHandle_t device_busy;              /**< HID device main mutex */
     SemaphoreHandle_t ctrl_xfer_done;           /**< Control transfer semaphore */
     usb_transfer_t *ctrl_xfer;                  /**< Pointer to control transfer buffer */
     usb_device_handle_t dev_hdl;                /**< USB device handle */
     uint8_t dev_addr;                           /**< USB device address */
+    size_t holds;                               /**< Holds of the application, see hid_host_device_hold() */
+    uint32_t setup_failures;                    /**< Failed Interface setups the application counted */
+    bool gone;                                  /**< Device detached, its Interfaces can not be held */
+    bool disconnect_pending;                    /**< Detached while held, the last unhold disconnects it */
 } hid_device_t;
 
 /**
@@ -100,6 +108,7 @@ typedef enum {
  */
 typedef struct hid_interface {
     STAILQ_ENTRY(hid_interface) tailq_entry;
+    STAILQ_ENTRY(hid_interface) dev_tailq_entry;    /**< Entry in parent device interfaces list */
     hid_device_t *parent;                   /**< Parent USB HID device */
     hid_host_dev_params_t dev_params;       /**< USB device parameters */
     uint8_t ep_in;                          /**< Interrupt IN EP number */
@@ -111,6 +120,9 @@ typedef struct hid_interface {
     hid_host_interface_event_cb_t user_cb;  /**< Interface application callback */
     void *user_cb_arg;                      /**< Interface application callback arg */
     hid_iface_state_t state;                /**< Interface state */
+    uint32_t in_xfer_delay_ms;              /**< Delay of the IN transfer after each report */
+    bool in_xfer_deferred;                  /**< IN transfer waits for in_xfer_due */
+    TickType_t in_xfer_due;                 /**< Tick the deferred IN transfer is submitted at */
 } hid_iface_t;
 
 /**
@@ -121,12 +133,17 @@ typedef struct hid_interface {
 typedef struct {
     STAILQ_HEAD(devices, hid_host_device) hid_devices_tailq;    /**< STAILQ of HID interfaces */
     STAILQ_HEAD(interfaces, hid_interface) hid_ifaces_tailq;    /**< STAILQ of HID interfaces */
+    hid_device_t *devices_by_addr[USB_DEV_ADDR_MAX];            /**< HID devices indexed by USB address */
+    size_t iface_count;                                         /**< Number of HID interfaces in the list */
     usb_host_client_handle_t client_handle;                     /**< Client task handle */
     hid_host_driver_event_cb_t user_cb;                         /**< User application callback */
     void *user_arg;                                             /**< User application callback args */
     bool event_handling_started;                                /**< Events handler started flag */
+    TaskHandle_t event_task;                                    /**< Task calling hid_host_handle_events */
+    volatile bool in_event_handling;                            /**< Client events are being handled right now */
     SemaphoreHandle_t all_events_handled;                       /**< Events handler semaphore */
     volatile bool end_client_event_handling;                    /**< Client event handling flag */
+    size_t deferred_count;                                      /**< Interfaces with a deferred IN transfer */
 } hid_driver_t;
 
 static hid_driver_t *s_hid_driver;                              /**< Internal pointer to HID driver */
@@ -141,6 +158,8 @@ static esp_err_t hid_host_install_device(uint8_t dev_addr,
 
 static esp_err_t hid_host_uninstall_device(hid_device_t *hid_device);
 
+static esp_err_t hid_host_device_disconnected(usb_device_handle_t dev_hdl);
+
 // --------------------------- Internal Logic ----------------------------------
 /**
  * @brief HID class specific request
@@ -173,7 +192,7 @@ static void event_handler_task(void *arg)
 }
 
 /**
- * @brief Return HID device in devices list by USB device handle
+ * @brief Return HID device in devices table by USB device handle
  *
  * @param[in] usb_device_handle_t   USB device handle
  * @return hid_device_t Pointer to device, NULL if device not present
@@ -181,16 +200,19 @@ static void event_handler_task(void *arg)
 static hid_device_t *get_hid_device_by_handle(usb_device_handle_t usb_handle)
 {
     hid_device_t *device = NULL;
+    uint8_t dev_addr = 0;
+
+    if (usb_host_device_addr(usb_handle, &dev_addr) != ESP_OK || dev_addr >= USB_DEV_ADDR_MAX) {
+        return NULL;
+    }
 
     HID_ENTER_CRITICAL();
-    STAILQ_FOREACH(device, &s_hid_driver->hid_devices_tailq, tailq_entry) {
-        if (usb_handle == device->dev_hdl) {
-            HID_EXIT_CRITICAL();
-            return device;
-        }
+    device = s_hid_driver->devices_by_addr[dev_addr];
+    if (device && device->dev_hdl != usb_handle) {
+        device = NULL;
     }
     HID_EXIT_CRITICAL();
-    return NULL;
+    return device;
 }
 
 /**
@@ -344,6 +366,10 @@ static esp_err_t hid_host_add_interface(hid_device_t *hid_device,
                                         const hid_descriptor_t *hid_desc,
                                         const usb_ep_desc_t *ep_in_desc)
 {
+    HID_RETURN_ON_FALSE(s_hid_driver->iface_count < HID_HOST_MAX_INTERFACES,
+                        ESP_ERR_NO_MEM,
+                        "Too many HID Interfaces");
+
     hid_iface_t *hid_iface = calloc(1, sizeof(hid_iface_t));
 
     HID_RETURN_ON_FALSE(hid_iface,
@@ -383,11 +409,28 @@ static esp_err_t hid_host_add_interface(hid_device_t *hid_device,
     }
 
     STAILQ_INSERT_TAIL(&s_hid_driver->hid_ifaces_tailq, hid_iface, tailq_entry);
+    STAILQ_INSERT_TAIL(&hid_device->ifaces_tailq, hid_iface, dev_tailq_entry);
+    s_hid_driver->iface_count++;
     HID_EXIT_CRITICAL();
 
     return ESP_OK;
 }
 
+/**
+ * @brief Drop the deferred IN transfer of an interface
+ *
+ * Use only inside critical section
+ *
+ * @param[in] hid_iface    HID interface handle
+ */
+static void _hid_host_cancel_deferred_transfer(hid_iface_t *hid_iface)
+{
+    if (hid_iface->in_xfer_deferred) {
+        hid_iface->in_xfer_deferred = false;
+        s_hid_driver->deferred_count--;
+    }
+}
+
 /**
  * @brief Remove interface from a list
  *
@@ -398,8 +441,13 @@ static esp_err_t hid_host_add_interface(hid_device_t *hid_device,
  */
 static esp_err_t _hid_host_remove_interface(hid_iface_t *hid_iface)
 {
+    _hid_host_cancel_deferred_transfer(hid_iface);
     hid_iface->state = HID_INTERFACE_STATE_NOT_INITIALIZED;
     STAILQ_REMOVE(&s_hid_driver->hid_ifaces_tailq, hid_iface, hid_interface, tailq_entry);
+    if (hid_iface->parent) {
+        STAILQ_REMOVE(&hid_iface->parent->ifaces_tailq, hid_iface, hid_interface, dev_tailq_entry);
+    }
+    s_hid_driver->iface_count--;
     free(hid_iface);
     return ESP_OK;
 }
@@ -412,16 +460,14 @@ static esp_err_t _hid_host_remove_interface(hid_iface_t *hid_iface)
 static void hid_host_notify_interface_connected(hid_device_t *hid_device)
 {
     HID_ENTER_CRITICAL();
-    hid_iface_t *iface = STAILQ_FIRST(&s_hid_driver->hid_ifaces_tailq);
+    hid_iface_t *iface = STAILQ_FIRST(&hid_device->ifaces_tailq);
     hid_iface_t *tmp = NULL;
 
     while (iface != NULL) {
-        tmp = STAILQ_NEXT(iface, tailq_entry);
+        tmp = STAILQ_NEXT(iface, dev_tailq_entry);
         HID_EXIT_CRITICAL();
 
-        if (iface->parent && (iface->parent->dev_addr == hid_device->dev_addr)) {
-            hid_host_user_device_callback(iface, HID_HOST_DRIVER_EVENT_CONNECTED);
-        }
+        hid_host_user_device_callback(iface, HID_HOST_DRIVER_EVENT_CONNECTED);
         iface = tmp;
 
         HID_ENTER_CRITICAL();
@@ -494,10 +540,12 @@ static bool hid_host_device_init_attempt(uint8_t dev_addr)
     const usb_config_desc_t *config_desc = NULL;
     hid_device_t *hid_device = NULL;
 
-    if (usb_host_device_open(s_hid_driver->client_handle, dev_addr, &dev_hdl) == ESP_OK) {
-        if (usb_host_get_active_config_descriptor(dev_hdl, &config_desc) == ESP_OK) {
-            is_hid_device = hid_interface_present(config_desc);
-        }
+    if (usb_host_device_open(s_hid_driver->client_handle, dev_addr, &dev_hdl) != ESP_OK) {
+        // Unplugged before its NEW_DEV event was handled
+        return false;
+    }
+    if (usb_host_get_active_config_descriptor(dev_hdl, &config_desc) == ESP_OK) {
+        is_hid_device = hid_interface_present(config_desc);
     }
 
     // Create HID interfaces list in RAM, connected to the particular USB dev
@@ -505,7 +553,12 @@ static bool hid_host_device_init_attempt(uint8_t dev_addr)
         // Proceed, add HID device to the list, get handle if necessary
         ESP_ERROR_CHECK( hid_host_install_device(dev_addr, dev_hdl, &hid_device) );
         // Create Interfaces list for a possibility to claim Interface
-        ESP_ERROR_CHECK( hid_host_interface_list_create(hid_device, config_desc) );
+        if (hid_host_interface_list_create(hid_device, config_desc) != ESP_OK) {
+            // Interfaces over HID_HOST_MAX_INTERFACES, the device stays unused until it is plugged in again
+            ESP_LOGE(TAG, "HID device at USB port %d not used", dev_addr);
+            hid_host_device_disconnected(dev_hdl);
+            is_hid_device = false;
+        }
     } else {
         usb_host_device_close(s_hid_driver->client_handle, dev_hdl);
         ESP_LOGW(TAG, "No HID device at USB port %d", dev_addr);
@@ -528,16 +581,14 @@ static esp_err_t hid_host_device_disconnected(usb_device_handle_t dev_hdl)
     HID_ENTER_CRITICAL();
     hid_iface_t *hid_iface_curr;
     hid_iface_t *hid_iface_next;
-    // Go through list
-    hid_iface_curr = STAILQ_FIRST(&s_hid_driver->hid_ifaces_tailq);
+    // Go through device interfaces only
+    hid_iface_curr = STAILQ_FIRST(&hid_device->ifaces_tailq);
     while (hid_iface_curr != NULL) {
-        hid_iface_next = STAILQ_NEXT(hid_iface_curr, tailq_entry);
+        hid_iface_next = STAILQ_NEXT(hid_iface_curr, dev_tailq_entry);
         HID_EXIT_CRITICAL();
 
-        if (hid_iface_curr->parent && (hid_iface_curr->parent->dev_addr == hid_device->dev_addr)) {
-            HID_RETURN_ON_ERROR( hid_host_device_close(hid_iface_curr),
-                                 "Unable to close device");
-        }
+        HID_RETURN_ON_ERROR( hid_host_device_close(hid_iface_curr),
+                             "Unable to close device");
         HID_ENTER_CRITICAL();
         hid_iface_curr = hid_iface_next;
     }
@@ -561,7 +612,19 @@ static void client_event_cb(const usb_host_client_event_msg_t *event, void *arg)
     if (event->event == USB_HOST_CLIENT_EVENT_NEW_DEV) {
         hid_host_device_init_attempt(event->new_dev.address);
     } else if (event->event == USB_HOST_CLIENT_EVENT_DEV_GONE) {
-        hid_host_device_disconnected(event->dev_gone.dev_hdl);
+        hid_device_t *hid_device = get_hid_device_by_handle(event->dev_gone.dev_hdl);
+        bool held = false;
+
+        HID_ENTER_CRITICAL();
+        if (hid_device) {
+            hid_device->gone = true;
+            hid_device->disconnect_pending = held = hid_device->holds > 0;
+        }
+        HID_EXIT_CRITICAL();
+
+        if (!held) {
+            hid_host_device_disconnected(event->dev_gone.dev_hdl);
+        }
     }
 }
 
@@ -632,13 +695,21 @@ static esp_err_t hid_host_disable_interface(hid_iface_t *iface)
                         ESP_ERR_INVALID_STATE,
                         "Interface wrong state");
 
+    HID_ENTER_CRITICAL();
+    _hid_host_cancel_deferred_transfer(iface);
+    HID_EXIT_CRITICAL();
+
     HID_RETURN_ON_ERROR( usb_host_endpoint_halt(iface->parent->dev_hdl, iface->ep_in),
                          "Unable to HALT EP");
     HID_RETURN_ON_ERROR( usb_host_endpoint_flush(iface->parent->dev_hdl, iface->ep_in),
                          "Unable to FLUSH EP");
     usb_host_endpoint_clear(iface->parent->dev_hdl, iface->ep_in);
 
+    // A deferred transfer must not be submitted while the interface is READY again
+    HID_ENTER_CRITICAL();
+    _hid_host_cancel_deferred_transfer(iface);
     iface->state = HID_INTERFACE_STATE_READY;
+    HID_EXIT_CRITICAL();
 
     return ESP_OK;
 }
@@ -659,6 +730,17 @@ static void in_xfer_done(usb_transfer_t *in_xfer)
     case USB_TRANSFER_STATUS_COMPLETED:
         // Notify user
         hid_host_user_interface_callback(iface, HID_HOST_INTERFACE_EVENT_INPUT_REPORT);
+        if (iface->in_xfer_delay_ms) {
+            // Relaunched by the client event handling once the delay has passed
+            HID_ENTER_CRITICAL();
+            if (!iface->in_xfer_deferred && HID_INTERFACE_STATE_ACTIVE == iface->state) {
+                iface->in_xfer_due = xTaskGetTickCount() + MAX(pdMS_TO_TICKS(iface->in_xfer_delay_ms), 1);
+                iface->in_xfer_deferred = true;
+                s_hid_driver->deferred_count++;
+            }
+            HID_EXIT_CRITICAL();
+            return;
+        }
         // Relaunch transfer
         usb_host_transfer_submit(in_xfer);
         return;
@@ -713,6 +795,92 @@ static void ctrl_xfer_done(usb_transfer_t *ctrl_xfer)
     xSemaphoreGive(hid_device->ctrl_xfer_done);
 }
 
+/**
+ * @brief Submit the deferred IN transfers that are due
+ *
+ * @return Ticks until the next deferred IN transfer is due, portMAX_DELAY if there is none
+ */
+static TickType_t hid_host_submit_deferred_transfers(void)
+{
+    TickType_t next_due = portMAX_DELAY;
+    hid_iface_t *due_iface;
+
+    do {
+        due_iface = NULL;
+        const TickType_t now = xTaskGetTickCount();
+        HID_ENTER_CRITICAL();
+        if (s_hid_driver->deferred_count) {
+            hid_iface_t *iface;
+            STAILQ_FOREACH(iface, &s_hid_driver->hid_ifaces_tailq, tailq_entry) {
+                if (!iface->in_xfer_deferred) {
+                    continue;
+                }
+                const TickType_t left = iface->in_xfer_due - now;
+                if (left == 0 || left > portMAX_DELAY / 2) {
+                    iface->in_xfer_deferred = false;
+                    s_hid_driver->deferred_count--;
+                    due_iface = iface;
+                    break;
+                }
+                next_due = MIN(next_due, left);
+            }
+        }
+        HID_EXIT_CRITICAL();
+        if (due_iface) {
+            usb_host_transfer_submit(due_iface->in_xfer);
+        }
+    } while (due_iface);
+
+    return next_due;
+}
+
+/**
+ * @brief Handle USB Host client events and mark the driver as handling them
+ *
+ * @param[in] timeout  Timeout in ticks
+ * @return esp_err_t
+ */
+static esp_err_t hid_host_client_handle_events(uint32_t timeout)
+{
+    // Wake up in time for the deferred IN transfers, that is not a timeout for the caller
+    const TickType_t next_due = hid_host_submit_deferred_transfers();
+    const bool cut_short = next_due < timeout;
+
+    s_hid_driver->in_event_handling = true;
+    esp_err_t ret = usb_host_client_handle_events(s_hid_driver->client_handle, cut_short ? next_due : timeout);
+    s_hid_driver->in_event_handling = false;
+    if (cut_short && ret == ESP_ERR_TIMEOUT) {
+        ret = ESP_OK;
+    }
+    return ret;
+}
+
+/**
+ * @brief Wait for control transfer completion while handling client events
+ *
+ * Used when the control transfer is issued by the event handling task itself,
+ * e.g. when the application handles the HID client events and driver events from a single task.
+ * The USB Host Library events must be handled by another task meanwhile, the completion passes there first.
+ *
+ * @param[in] hid_device  Pointer to HID device structure
+ * @param[in] timeout_ms  Timeout in ms
+ * @return pdTRUE when the transfer has finished
+ */
+static BaseType_t hid_control_transfer_wait_handling_events(hid_device_t *hid_device, uint32_t timeout_ms)
+{
+    const TickType_t start = xTaskGetTickCount();
+
+    while (xSemaphoreTake(hid_device->ctrl_xfer_done, 0) != pdTRUE) {
+        const TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= pdMS_TO_TICKS(timeout_ms)) {
+            return pdFALSE;
+        }
+        // The completion is a client event, so this wakes up right when it arrives
+        hid_host_client_handle_events(pdMS_TO_TICKS(timeout_ms) - elapsed);
+    }
+    return pdTRUE;
+}
+
 /**
  * @brief HID control transfer synchronous.
  *
@@ -743,7 +911,13 @@ static esp_err_t hid_control_transfer(hid_device_t *hid_device,
     HID_RETURN_ON_ERROR( usb_host_transfer_submit_control(s_hid_driver->client_handle, ctrl_xfer),
                          "Unable to submit control transfer");
 
-    BaseType_t received = xSemaphoreTake(hid_device->ctrl_xfer_done, pdMS_TO_TICKS(ctrl_xfer->timeout_ms));
+    BaseType_t received;
+    if (xTaskGetCurrentTaskHandle() == s_hid_driver->event_task && !s_hid_driver->in_event_handling) {
+        // The only task able to deliver the completion is waiting here, so handle events meanwhile
+        received = hid_control_transfer_wait_handling_events(hid_device, ctrl_xfer->timeout_ms);
+    } else {
+        received = xSemaphoreTake(hid_device->ctrl_xfer_done, pdMS_TO_TICKS(ctrl_xfer->timeout_ms));
+    }
 
     if (received != pdTRUE) {
         // Transfer was not finished, error in USB LIB. Reset the endpoint
@@ -757,6 +931,12 @@ static esp_err_t hid_control_transfer(hid_device_t *hid_device,
         return ESP_ERR_TIMEOUT;
     }
 
+    if (ctrl_xfer->status != USB_TRANSFER_STATUS_COMPLETED) {
+        // Mostly a request the device stalled
+        ESP_LOGE(TAG, "Control Transfer failed, status %d", ctrl_xfer->status);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
     ESP_LOG_BUFFER_HEXDUMP(TAG, ctrl_xfer->data_buffer, ctrl_xfer->actual_num_bytes, ESP_LOG_DEBUG);
 
     return ESP_OK;
@@ -988,6 +1168,7 @@ esp_err_t hid_host_install_device(uint8_t dev_addr,
 
     hid_device->dev_addr = dev_addr;
     hid_device->dev_hdl = dev_hdl;
+    STAILQ_INIT(&hid_device->ifaces_tailq);
 
     HID_GOTO_ON_FALSE( hid_device->ctrl_xfer_done = xSemaphoreCreateBinary(),
                        ESP_ERR_NO_MEM,
@@ -1007,7 +1188,10 @@ esp_err_t hid_host_install_device(uint8_t dev_addr,
     HID_ENTER_CRITICAL();
     HID_GOTO_ON_FALSE_CRITICAL( s_hid_driver, ESP_ERR_INVALID_STATE );
     HID_GOTO_ON_FALSE_CRITICAL( s_hid_driver->client_handle, ESP_ERR_INVALID_STATE );
+    HID_GOTO_ON_FALSE_CRITICAL( dev_addr < USB_DEV_ADDR_MAX, ESP_ERR_INVALID_ARG );
+    HID_GOTO_ON_FALSE_CRITICAL( !s_hid_driver->devices_by_addr[dev_addr], ESP_ERR_INVALID_STATE );
     STAILQ_INSERT_TAIL(&s_hid_driver->hid_devices_tailq, hid_device, tailq_entry);
+    s_hid_driver->devices_by_addr[dev_addr] = hid_device;
     HID_EXIT_CRITICAL();
 
     if (hid_device_handle) {
@@ -1043,7 +1227,11 @@ esp_err_t hid_host_uninstall_device(hid_device_t *hid_device)
              hid_device->dev_addr);
 
     HID_ENTER_CRITICAL();
-    STAILQ_REMOVE(&s_hid_driver->hid_devices_tailq, hid_device, hid_host_device, tailq_entry);
+    if (hid_device->dev_addr < USB_DEV_ADDR_MAX &&
+            s_hid_driver->devices_by_addr[hid_device->dev_addr] == hid_device) {
+        s_hid_driver->devices_by_addr[hid_device->dev_addr] = NULL;
+        STAILQ_REMOVE(&s_hid_driver->hid_devices_tailq, hid_device, hid_host_device, tailq_entry);
+    }
     HID_EXIT_CRITICAL();
 
     free(hid_device);
@@ -1085,7 +1273,7 @@ esp_err_t hid_host_install(const hid_host_driver_config_t *config)
         .is_synchronous = false,
         .async.client_event_callback = client_event_cb,
         .async.callback_arg = NULL,
-        .max_num_event_msg = 10,
+        .max_num_event_msg = CLIENT_EVENT_MSG_MAX,
     };
 
     driver->end_client_event_handling = false;
@@ -1150,7 +1338,8 @@ esp_err_t hid_host_uninstall(void)
     s_hid_driver->end_client_event_handling = true;
     HID_EXIT_CRITICAL();
 
-    if (s_hid_driver->event_handling_started) {
+    // Event handling task uninstalling the driver itself is not inside hid_host_handle_events
+    if (s_hid_driver->event_handling_started && s_hid_driver->event_task != xTaskGetCurrentTaskHandle()) {
         ESP_ERROR_CHECK( usb_host_client_unblock(s_hid_driver->client_handle) );
         // In case the event handling started, we must wait until it finishes
         xSemaphoreTake(s_hid_driver->all_events_handled, portMAX_DELAY);
@@ -1193,6 +1382,83 @@ esp_err_t hid_host_device_open(hid_host_device_handle_t hid_dev_handle,
     return ESP_OK;
 }
 
+esp_err_t hid_host_device_hold(hid_host_device_handle_t hid_dev_handle, uint8_t *dev_addr)
+{
+    hid_iface_t *hid_iface = (hid_iface_t *) hid_dev_handle;
+    hid_iface_t *interface = NULL;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    HID_RETURN_ON_FALSE(s_hid_driver,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Driver is not installed");
+
+    HID_RETURN_ON_FALSE(dev_addr,
+                        ESP_ERR_INVALID_ARG,
+                        "Wrong argument");
+
+    HID_ENTER_CRITICAL();
+    STAILQ_FOREACH(interface, &s_hid_driver->hid_ifaces_tailq, tailq_entry) {
+        if (interface == hid_iface) {
+            if (hid_iface->parent && !hid_iface->parent->gone) {
+                hid_iface->parent->holds++;
+                *dev_addr = hid_iface->parent->dev_addr;
+                ret = ESP_OK;
+            }
+            break;
+        }
+    }
+    HID_EXIT_CRITICAL();
+    return ret;
+}
+
+void hid_host_device_unhold(uint8_t dev_addr)
+{
+    bool disconnect = false;
+
+    // A held device is never uninstalled, its address still maps to it
+    HID_ENTER_CRITICAL();
+    hid_device_t *hid_device = dev_addr < USB_DEV_ADDR_MAX ? s_hid_driver->devices_by_addr[dev_addr] : NULL;
+    if (hid_device && hid_device->holds && --hid_device->holds == 0) {
+        disconnect = hid_device->disconnect_pending;
+        hid_device->disconnect_pending = false;
+    }
+    HID_EXIT_CRITICAL();
+
+    if (disconnect) {
+        hid_host_device_disconnected(hid_device->dev_hdl);
+    }
+}
+
+esp_err_t hid_host_device_count_failure(hid_host_device_handle_t hid_dev_handle, uint32_t *failures)
+{
+    hid_iface_t *hid_iface = (hid_iface_t *) hid_dev_handle;
+    hid_iface_t *interface = NULL;
+    esp_err_t ret = ESP_ERR_NOT_FOUND;
+
+    HID_RETURN_ON_FALSE(s_hid_driver,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Driver is not installed");
+
+    HID_RETURN_ON_FALSE(failures,
+                        ESP_ERR_INVALID_ARG,
+                        "Wrong argument");
+
+    HID_ENTER_CRITICAL();
+    STAILQ_FOREACH(interface, &s_hid_driver->hid_ifaces_tailq, tailq_entry) {
+        if (interface == hid_iface) {
+            if (hid_iface->parent) {
+                *failures = ++hid_iface->parent->setup_failures;
+                if (!hid_iface->parent->gone) {
+                    ret = ESP_OK;
+                }
+            }
+            break;
+        }
+    }
+    HID_EXIT_CRITICAL();
+    return ret;
+}
+
 esp_err_t hid_host_device_close(hid_host_device_handle_t hid_dev_handle)
 {
     hid_iface_t *hid_iface = get_iface_by_handle(hid_dev_handle);
@@ -1239,6 +1505,33 @@ esp_err_t hid_host_device_close(hid_host_device_handle_t hid_dev_handle)
     return ESP_OK;
 }
 
+esp_err_t hid_host_device_close_all(void)
+{
+    esp_err_t ret = ESP_OK;
+
+    HID_RETURN_ON_FALSE(s_hid_driver,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Driver is not installed");
+
+    HID_ENTER_CRITICAL();
+    hid_device_t *hid_device = STAILQ_FIRST(&s_hid_driver->hid_devices_tailq);
+    while (hid_device != NULL) {
+        hid_device_t *hid_device_next = STAILQ_NEXT(hid_device, tailq_entry);
+        HID_EXIT_CRITICAL();
+
+        // Same path as a detached device, user is notified about every interface
+        if (hid_host_device_disconnected(hid_device->dev_hdl) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+
+        HID_ENTER_CRITICAL();
+        hid_device = hid_device_next;
+    }
+    HID_EXIT_CRITICAL();
+
+    return ret;
+}
+
 esp_err_t hid_host_handle_events(uint32_t timeout)
 {
     HID_RETURN_ON_FALSE(s_hid_driver != NULL,
@@ -1247,7 +1540,8 @@ esp_err_t hid_host_handle_events(uint32_t timeout)
 
     ESP_LOGD(TAG, "USB HID handling");
     s_hid_driver->event_handling_started = true;
-    esp_err_t ret = usb_host_client_handle_events(s_hid_driver->client_handle, timeout);
+    s_hid_driver->event_task = xTaskGetCurrentTaskHandle();
+    esp_err_t ret = hid_host_client_handle_events(timeout);
     if (s_hid_driver->end_client_event_handling) {
         xSemaphoreGive(s_hid_driver->all_events_handled);
         return ESP_FAIL;
@@ -1255,6 +1549,15 @@ esp_err_t hid_host_handle_events(uint32_t timeout)
     return ret;
 }
 
+esp_err_t hid_host_unblock(void)
+{
+    HID_RETURN_ON_FALSE(s_hid_driver != NULL,
+                        ESP_ERR_INVALID_STATE,
+                        "HID Driver is not installed");
+
+    return usb_host_client_unblock(s_hid_driver->client_handle);
+}
+
 esp_err_t hid_host_device_get_params(hid_host_device_handle_t hid_dev_handle,
                                      hid_host_dev_params_t *dev_params)
 {
@@ -1340,6 +1643,16 @@ esp_err_t hid_host_device_stop(hid_host_device_handle_t hid_dev_handle)
     return hid_host_disable_interface(iface);
 }
 
+esp_err_t hid_host_device_set_poll_delay(hid_host_device_handle_t hid_dev_handle, uint32_t delay_ms)
+{
+    hid_iface_t *iface = get_iface_by_handle(hid_dev_handle);
+
+    HID_RETURN_ON_INVALID_ARG(iface);
+
+    iface->in_xfer_delay_ms = delay_ms;
+    return ESP_OK;
+}
+
 uint8_t *hid_host_get_report_descriptor(hid_host_device_handle_t hid_dev_handle,
                                         size_t *report_desc_len)
 {
@@ -29,6 +29,17 @@ extern "C" {
 */
 #define HID_STR_DESC_MAX_LENGTH           32
 
+/**
+ * @brief USB HID HOST maximal number of HID Interfaces
+ *
+ * Upper bound of HID Interfaces (over all connected devices) kept by the driver at once.
+ * Every Interface generates at most one HID_HOST_DRIVER_EVENT_CONNECTED event, but the event of an
+ * unplugged Interface may still be pending when the replug raises the next one, and the handle of a
+ * removed Interface may be given to a new one. Applications key pending events by handle and drop
+ * the ones of removed Interfaces to stay within this bound.
+*/
+#define HID_HOST_MAX_INTERFACES           32
+
 typedef struct hid_interface *hid_host_device_handle_t;    /**< Device Handle. Handle to a particular HID interface */
 
 // ------------------------ USB HID Host events --------------------------------
@@ -139,6 +150,39 @@ esp_err_t hid_host_uninstall(void);
 esp_err_t hid_host_device_open(hid_host_device_handle_t hid_dev_handle,
                                const hid_host_device_config_t *config);
 
+/**
+ * @brief USB HID Host hold a device while the application sets it up from a task of its own
+ *
+ * A device detached while held is disconnected by its last hid_host_device_unhold() instead of the
+ * client task, so its Interfaces and their callback arguments stay valid in between. Interfaces of
+ * a detached device can not be held.
+ *
+ * @param[in] hid_dev_handle   Handle of the HID device to hold
+ * @param[out] dev_addr        USB address of the held device, for hid_host_device_unhold()
+ * @return esp_err_t ESP_ERR_NOT_FOUND if the Interface is not listed or its device is gone
+ */
+esp_err_t hid_host_device_hold(hid_host_device_handle_t hid_dev_handle, uint8_t *dev_addr);
+
+/**
+ * @brief USB HID Host end a hold, the last one disconnects the device if it was detached meanwhile
+ *
+ * Must not be called with a lock the HID_HOST_INTERFACE_EVENT_DISCONNECTED callback takes.
+ *
+ * @param[in] dev_addr         USB address hid_host_device_hold() returned
+ */
+void hid_host_device_unhold(uint8_t dev_addr);
+
+/**
+ * @brief USB HID Host count a failed setup of an Interface against its device
+ *
+ * The count lives as long as the device stays plugged in, a replug starts over at zero.
+ *
+ * @param[in] hid_dev_handle   Handle of the HID device that failed its setup
+ * @param[out] failures        Failed setups of its device so far, this one included
+ * @return esp_err_t ESP_ERR_NOT_FOUND if the Interface is not listed or its device is gone
+ */
+esp_err_t hid_host_device_count_failure(hid_host_device_handle_t hid_dev_handle, uint32_t *failures);
+
 /**
  * @brief USB HID Host close device
  *
@@ -147,6 +191,16 @@ esp_err_t hid_host_device_open(hid_host_device_handle_t hid_dev_handle,
  */
 esp_err_t hid_host_device_close(hid_host_device_handle_t hid_dev_handle);
 
+/**
+ * @brief USB HID Host close all devices
+ *
+ * Closes every HID device as if it was detached, HID_HOST_INTERFACE_EVENT_DISCONNECTED is delivered
+ * for every opened Interface. Used before hid_host_uninstall() when the USB stack is torn down.
+ *
+ * @return esp_err_t
+ */
+esp_err_t hid_host_device_close_all(void);
+
 /**
  * @brief HID Host USB event handler
  *
@@ -154,11 +208,24 @@ esp_err_t hid_host_device_close(hid_host_device_handle_t hid_dev_handle);
  * application needs to handle USB Host events itself.
  * Do not used if HID host install was made with create_background_task=true configuration
  *
+ * HID class requests may be issued from the task calling this function (outside of the callbacks),
+ * events are then handled while waiting for the control transfer to finish. Its completion passes the
+ * USB Host Library first, so another task must keep handling the library events.
+ *
  * @param[in]  timeout  Timeout in ticks. For milliseconds, please use 'pdMS_TO_TICKS()' macros
  * @return esp_err_t
  */
 esp_err_t hid_host_handle_events(uint32_t timeout);
 
+/**
+ * @brief Make the task waiting in hid_host_handle_events return
+ *
+ * Call only where the driver can not be uninstalled meanwhile, e.g. from the task that installs it.
+ *
+ * @return esp_err_t
+ */
+esp_err_t hid_host_unblock(void);
+
 /**
  * @brief HID Device get parameters by handle.
  *
@@ -208,6 +275,20 @@ esp_err_t hid_host_device_start(hid_host_device_handle_t hid_dev_handle);
  */
 esp_err_t hid_host_device_stop(hid_host_device_handle_t hid_dev_handle);
 
+/**
+ * @brief HID Host delay the IN transfer after each report
+ *
+ * The transfer is resubmitted by the task handling the client events once the delay has passed,
+ * so a device that repeats its report every bInterval wakes it less often.
+ * Call from the interface callback to apply the delay to the report being handled.
+ *
+ * @param[in] hid_dev_handle  HID Device handle
+ * @param[in] delay_ms        Delay after each report, 0 resubmits the transfer at once
+ *
+ * @return esp_err_t
+ */
+esp_err_t hid_host_device_set_poll_delay(hid_host_device_handle_t hid_dev_handle, uint32_t delay_ms);
+
 /**
  * @brief HID Host Get Report Descriptor
  *
@@ -4,64 +4,652 @@
 
 #include "usb_app.h"
 
+#include <driver/gpio.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/param.h>
+#include <freertos/timers.h>
+#include <nvs.h>
 #include <usb/usb_host.h>
 
+#include "boot_milestones.h"
 #include "hid_host.h"
 #include "hid_usage_keyboard.h"
+#include "hid_usage_mouse.h"
+#include "power_manager.h"
+#include "usb_app_capture.h"
+#include "usb_app_keyboard.h"
+#include "usb_app_keymap.h"
+#include "usb_app_poll.h"
+#include "usb_app_router.h"
+#include "usb_app_taphold.h"
+#include "usb_app_vbus.h"
 #include "tasks_common.h"
 
 static const char TAG[] = "usb_app";
 
 QueueHandle_t usb_app_event_queue = NULL;
 
-static void daemon_task(void *args) {
-    ESP_LOGI(TAG, "Starting USB daemon task...");
-    TaskHandle_t *notify_task_handle = (TaskHandle_t *)args;
+/* Wakeups count how often a USB task returned from a blocking wait with work to do */
+typedef struct {
+    uint32_t event_count;
+    uint64_t event_latency_sum_us;
+    uint32_t event_latency_max_us;
+    uint32_t lib_wakeups;
+    uint32_t client_wakeups;
+    uint32_t queue_hops;
+    uint32_t idle_periods;              // Times the IN transfers were paused for lack of a BLE listener
+    uint64_t idle_us;                   // Time spent paused, the current period not included
+    uint32_t wakeups;                   // Input that woke the BLE side while the link was down
+    uint64_t watch_us;                  // Time the input only woke, the current period not included
+    uint32_t resume_max_us;             // Listener change to IN transfers running again
+    uint32_t wake_reconnect_max_ms;     // Wake to a listening host
+} usb_app_event_stats_t;
+
+static usb_app_event_stats_t usb_app_event_stats = { 0 };
+
+static usb_app_recovery_stats_t usb_app_recovery_stats = { 0 };
+static portMUX_TYPE usb_app_recovery_lock = portMUX_INITIALIZER_UNLOCKED;  // Guards the stats and the request below
+static volatile bool usb_app_recovery_requested = false;
+static int64_t usb_app_recovery_requested_us = 0;
+static int64_t usb_app_stack_installed_us = 0;
+static uint32_t usb_app_recovery_backoff_ms = USB_APP_RECOVERY_BACKOFF_MIN_MS;
+static uint32_t usb_app_recovery_failed_in_row = 0;
+
+static usb_app_vbus_t usb_app_vbus;
+static portMUX_TYPE usb_app_vbus_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t usb_app_vbus_task = NULL;                           // Task that installs the stack
+static atomic_bool usb_app_vbus_attaching = false;                      // Cold attach not measured to its end yet
+static bool usb_app_vbus_debouncing = false;                            // Holds the chip awake, owner task only
+
+static usb_app_keymap_t usb_app_keymap;
+static atomic_bool usb_app_keymap_ready = false;                     // Keys pass through unmapped until NVS is read
+static portMUX_TYPE usb_app_keymap_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t usb_app_keymap_blob[USB_APP_KEYMAP_MAX_LEN];         // Installed blob, returned on GATT reads
+static size_t usb_app_keymap_blob_len = 0;
+static usb_app_macro_cb_t usb_app_macro_callback = NULL;
+static usb_app_key_cb_t usb_app_key_callback = NULL;
+static usb_app_mouse_cb_t usb_app_mouse_callback = NULL;
+static usb_app_keyboard_merge_t usb_app_keyboard_merge;                 // Keys held across all attached keyboards
+
+/* Open HID interfaces, so their IN transfers can be paused while no BLE host listens */
+typedef struct {
+    hid_host_device_handle_t handle;
+    usb_app_iface_route_t *route;
+    uint32_t id;                        // Never reused, a freed handle or route may come back for another interface
+} usb_app_device_t;
+
+static usb_app_device_t usb_app_devices[HID_HOST_MAX_INTERFACES];
+static SemaphoreHandle_t usb_app_devices_mutex = NULL;                  // Taken before a listed route is freed
+static uint32_t usb_app_device_next_id = 1;
+static bool usb_app_devices_running = true;                             // IN transfers as last applied to the list
+static atomic_bool usb_app_listening = true;
+static atomic_bool usb_app_listening_pending = false;                   // Change not applied by the USB side yet
+static int64_t usb_app_idle_since_us = 0;
+static atomic_bool usb_app_link_up = true;
+static atomic_bool usb_app_watching = false;                            // Input only wakes the BLE side
+static int64_t usb_app_watch_since_us = 0;
+static atomic_uint usb_app_wake_ms = 0;                                 // Last wake, 0 once a host listens again
+static atomic_bool usb_app_resume_report_pending = false;
+static int64_t usb_app_resumed_us = 0;
+static usb_app_wake_cb_t usb_app_wake_callback = NULL;
+
+/* Activity of the listed interfaces, taken inside usb_app_devices_mutex when both are needed */
+static portMUX_TYPE usb_app_poll_lock = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t usb_app_poll_timer = NULL;
+static bool usb_app_poll_timer_armed = false;
+static size_t usb_app_poll_active = 0;                                  // Active interfaces, each holds full clock once
+
+#if USB_APP_UNIFIED_EVENT_LOOP
+#define USB_APP_EVENT_WORKERS   1
+#else
+#define USB_APP_EVENT_WORKERS   USB_APP_ENUM_TASK_COUNT
+#endif
+
+/* One token per task handling driver events, recovery takes all of them */
+static SemaphoreHandle_t usb_app_enum_tokens = NULL;
+
+static void hid_host_device_callback(
+    hid_host_device_handle_t hid_device_handle,
+    const hid_host_driver_event_t event,
+    void *arg);
+
+/*
+ * CONNECTED events not handled yet, one per handle in arrival order. A handle unplugged and replugged before its
+ * event ran keeps the one entry, the driver may hand the freed handle to the new interface.
+ */
+static usb_app_event_queue_t usb_app_connected_events[HID_HOST_MAX_INTERFACES];
+static size_t usb_app_connected_count = 0;
+static portMUX_TYPE usb_app_connected_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if USB_APP_UNIFIED_EVENT_LOOP
+static TaskHandle_t usb_app_client_task = NULL;
+#endif
+
+static void usb_app_connected_clear() {
+    portENTER_CRITICAL(&usb_app_connected_lock);
+    usb_app_connected_count = 0;
+    portEXIT_CRITICAL(&usb_app_connected_lock);
+}
+
+/* Returns false if the set is full, an entry of the same handle only takes the newer timestamp */
+static bool usb_app_connected_insert(const usb_app_event_queue_t *evt_queue) {
+    bool inserted = false;
+    portENTER_CRITICAL(&usb_app_connected_lock);
+    for (size_t i = 0; i < usb_app_connected_count && !inserted; i++) {
+        if (usb_app_connected_events[i].hid_host_device.handle != evt_queue->hid_host_device.handle) continue;
+        usb_app_connected_events[i].timestamp_us = evt_queue->timestamp_us;
+        inserted = true;
+    }
+    if (!inserted && usb_app_connected_count < HID_HOST_MAX_INTERFACES) {
+        usb_app_connected_events[usb_app_connected_count++] = *evt_queue;
+        inserted = true;
+    }
+    portEXIT_CRITICAL(&usb_app_connected_lock);
+    return inserted;
+}
+
+/*
+ * Drops the entries of interfaces the driver removed already. Runs in the client task, the only one listing new
+ * interfaces, so a handle found unlisted here can not belong to a new interface before this returns.
+ */
+static void usb_app_connected_purge() {
+    hid_host_device_handle_t handles[HID_HOST_MAX_INTERFACES];
+    portENTER_CRITICAL(&usb_app_connected_lock);
+    const size_t count = usb_app_connected_count;
+    for (size_t i = 0; i < count; i++) handles[i] = usb_app_connected_events[i].hid_host_device.handle;
+    portEXIT_CRITICAL(&usb_app_connected_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        hid_host_dev_params_t dev_params;
+        if (hid_host_device_get_params(handles[i], &dev_params) == ESP_OK) continue;
+
+        portENTER_CRITICAL(&usb_app_connected_lock);
+        for (size_t j = 0; j < usb_app_connected_count; j++) {
+            if (usb_app_connected_events[j].hid_host_device.handle != handles[i]) continue;
+            memmove(&usb_app_connected_events[j], &usb_app_connected_events[j + 1],
+                    (usb_app_connected_count - j - 1) * sizeof(usb_app_event_queue_t));
+            usb_app_connected_count--;
+            break;
+        }
+        portEXIT_CRITICAL(&usb_app_connected_lock);
+    }
+}
+
+/* Takes the oldest entry, returns false if there is none */
+static bool usb_app_connected_take(usb_app_event_queue_t *evt_queue) {
+    bool taken = false;
+    portENTER_CRITICAL(&usb_app_connected_lock);
+    if (usb_app_connected_count) {
+        *evt_queue = usb_app_connected_events[0];
+        memmove(&usb_app_connected_events[0], &usb_app_connected_events[1],
+                (usb_app_connected_count - 1) * sizeof(usb_app_event_queue_t));
+        usb_app_connected_count--;
+        taken = true;
+    }
+    portEXIT_CRITICAL(&usb_app_connected_lock);
+    return taken;
+}
+
+static void usb_app_handle_lib_events(TickType_t timeout) {
+    uint32_t event_flags = 0;
 
-    usb_host_config_t host_config = {
+    esp_err_t err = usb_host_lib_handle_events(timeout, &event_flags);
+    if (err == ESP_ERR_TIMEOUT) {
+        return;
+    }
+    usb_app_event_stats.lib_wakeups++;
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to handle USB Host Library events");
+        return;
+    }
+
+    if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
+        ESP_LOGI(TAG, "No more USB Clients!");
+        if (ESP_OK == usb_host_device_free_all()) {
+            ESP_LOGI(TAG, "All USB devices are freed!");
+        } else {
+            ESP_LOGI(TAG, "Waiting for ALL_FREE Event...");
+        }
+    }
+
+    if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
+        ESP_LOGI(TAG, "All devices disconnected!");
+    }
+}
+
+static esp_err_t usb_app_install_stack(bool hid_background_task) {
+    const int64_t start_us = esp_timer_get_time();
+    const usb_host_config_t host_config = {
         .skip_phy_setup = false,
         .intr_flags = ESP_INTR_FLAG_LEVEL1
     };
-    ESP_ERROR_CHECK(usb_host_install(&host_config));
+    esp_err_t err = usb_host_install(&host_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install USB Host Library: %s", esp_err_to_name(err));
+        return err;
+    }
 
-    // Send signal that host is installed
-    xTaskNotifyGive(notify_task_handle);
+    const hid_host_driver_config_t hid_host_driver_config = {
+        .create_background_task = hid_background_task,
+        .task_priority = USB_APP_HID_TASK_PRIORITY,
+        .stack_size =  USB_APP_HID_TASK_STACK_SIZE,
+        .core_id = USB_APP_HID_TASK_CORE_ID,
+        .callback = hid_host_device_callback,
+        .callback_arg = NULL
+    };
+    err = hid_host_install(&hid_host_driver_config);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to install HID Host driver: %s", esp_err_to_name(err));
+        usb_host_uninstall();
+        return err;
+    }
 
-    // wait until HID driver is initialized
-    if (!ulTaskNotifyTake(true, pdMS_TO_TICKS(USB_APP_HID_INIT_TIMEOUT_MS))) {
-        ESP_LOGE(TAG, "TIMEOUT | HID Driver was not initialized in time!");
+    boot_milestone_mark(BOOT_MILESTONE_USB_HOST_READY);
+    usb_app_stack_installed_us = esp_timer_get_time();
+    portENTER_CRITICAL(&usb_app_recovery_lock);
+    const bool recovered = usb_app_recovery_requested_us != 0;
+    if (recovered) {
+        usb_app_recovery_stats.recovered++;
+        usb_app_recovery_stats.last_recovery_ms = (usb_app_stack_installed_us - usb_app_recovery_requested_us) / 1000;
+        usb_app_recovery_requested_us = 0;
+    }
+    const usb_app_recovery_stats_t stats = usb_app_recovery_stats;
+    portEXIT_CRITICAL(&usb_app_recovery_lock);
+    if (recovered) {
+        ESP_LOGI(TAG, "USB stack recovered in %lu ms (requested %lu, recovered %lu, failed %lu)",
+                 stats.last_recovery_ms, stats.requested, stats.recovered, stats.failed);
+    } else {
+        ESP_LOGI(TAG, "USB stack installed in %lld ms", (usb_app_stack_installed_us - start_us) / 1000);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t usb_app_uninstall_stack() {
+    // Every HID interface reports DISCONNECTED, so the application releases its state as on unplug
+    esp_err_t err = hid_host_device_close_all();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to close HID devices: %s", esp_err_to_name(err));
+    }
+    err = hid_host_uninstall();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to uninstall HID Host driver: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (usb_host_device_free_all() != ESP_OK) {
+        const int64_t deadline_us = esp_timer_get_time() + USB_APP_RECOVERY_FREE_TIMEOUT_MS * 1000LL;
+        uint32_t event_flags = 0;
+        while (!(event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) && esp_timer_get_time() < deadline_us) {
+            usb_host_lib_handle_events(pdMS_TO_TICKS(USB_APP_RECOVERY_FREE_TIMEOUT_MS), &event_flags);
+        }
+    }
+
+    err = usb_host_uninstall();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to uninstall USB Host Library: %s", esp_err_to_name(err));
+    }
+    return err;
+}
+
+/* Tear the stack down and drop the events queued for it, returns false if it failed to uninstall */
+static bool usb_app_teardown_stack(bool installed) {
+    // Wait until no task handling driver events uses a HID handle
+    for (int i = 0; i < USB_APP_EVENT_WORKERS; i++) {
+        xSemaphoreTake(usb_app_enum_tokens, portMAX_DELAY);
+    }
+
+    bool failed = false;
+    if (installed && usb_app_uninstall_stack() != ESP_OK) {
+        failed = true;
+    }
+
+#if !USB_APP_UNIFIED_EVENT_LOOP
+    xQueueReset(usb_app_event_queue);
+#endif
+    usb_app_connected_clear();
+    for (int i = 0; i < USB_APP_EVENT_WORKERS; i++) {
+        xSemaphoreGive(usb_app_enum_tokens);
+    }
+#if !USB_APP_UNIFIED_EVENT_LOOP
+    // A listener change dropped with the queue is posted again
+    if (atomic_exchange(&usb_app_listening_pending, false)) usb_app_set_listening(atomic_load(&usb_app_listening));
+#endif
+    return !failed;
+}
+
+/* Tear the stack down and wait out the backoff, the caller installs it again. NimBLE is not touched. */
+static void usb_app_recover_stack(bool installed) {
+    portENTER_CRITICAL(&usb_app_recovery_lock);
+    usb_app_recovery_requested = false;
+    portEXIT_CRITICAL(&usb_app_recovery_lock);
+
+    const bool failed = !usb_app_teardown_stack(installed);
+    if (failed || !installed) {
+        portENTER_CRITICAL(&usb_app_recovery_lock);
+        usb_app_recovery_stats.failed++;
+        portEXIT_CRITICAL(&usb_app_recovery_lock);
+        if (++usb_app_recovery_failed_in_row >= USB_APP_RECOVERY_MAX_FAILED) {
+            ESP_LOGE(TAG, "USB stack could not be recovered, restarting...");
+            esp_restart();
+        }
+    } else {
+        usb_app_recovery_failed_in_row = 0;
+    }
+
+    // A stack that stayed up long enough earns the shortest backoff again
+    if (usb_app_stack_installed_us &&
+        esp_timer_get_time() - usb_app_stack_installed_us > USB_APP_RECOVERY_STABLE_MS * 1000LL) {
+        usb_app_recovery_backoff_ms = USB_APP_RECOVERY_BACKOFF_MIN_MS;
+    }
+    usb_app_stack_installed_us = 0;
+
+    ESP_LOGW(TAG, "Reinstalling USB stack in %lu ms", usb_app_recovery_backoff_ms);
+    vTaskDelay(pdMS_TO_TICKS(usb_app_recovery_backoff_ms));
+    usb_app_recovery_backoff_ms = MIN(usb_app_recovery_backoff_ms * 2, USB_APP_RECOVERY_BACKOFF_MAX_MS);
+}
+
+void usb_app_request_recovery(const char *reason) {
+    ESP_LOGW(TAG, "USB stack recovery requested: %s", reason);
+    const int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&usb_app_recovery_lock);
+    if (!usb_app_recovery_requested) {
+        usb_app_recovery_stats.requested++;
+        usb_app_recovery_requested_us = now_us;
+        usb_app_recovery_requested = true;
+    }
+    portEXIT_CRITICAL(&usb_app_recovery_lock);
+    usb_host_lib_unblock();
+}
+
+void usb_app_get_recovery_stats(usb_app_recovery_stats_t *stats) {
+    portENTER_CRITICAL(&usb_app_recovery_lock);
+    *stats = usb_app_recovery_stats;
+    portEXIT_CRITICAL(&usb_app_recovery_lock);
+}
+
+#if USB_APP_VBUS_GATING
+/* Runs in the timer task, neither call is allowed from an interrupt */
+static void usb_app_vbus_wake(void *arg, uint32_t unused) {
+    if (usb_app_vbus_task) xTaskNotifyGive(usb_app_vbus_task);
+    if (usb_app_stack_installed_us) usb_host_lib_unblock();
+}
+
+static void usb_app_vbus_isr(void *arg) {
+    const bool level = gpio_get_level(USB_APP_VBUS_GPIO);
+    portENTER_CRITICAL_ISR(&usb_app_vbus_lock);
+    usb_app_vbus_edge(&usb_app_vbus, level, esp_timer_get_time() / 1000);
+    portEXIT_CRITICAL_ISR(&usb_app_vbus_lock);
+
+    // Contact bounce may fill the timer queue, the debounce timeout of the owner task catches up then
+    BaseType_t task_woken = pdFALSE;
+    xTimerPendFunctionCallFromISR(usb_app_vbus_wake, NULL, 0, &task_woken);
+    portYIELD_FROM_ISR(task_woken);
+}
+
+static void usb_app_vbus_setup() {
+    const gpio_config_t vbus_config = {
+        .pin_bit_mask = 1ULL << USB_APP_VBUS_GPIO,
+        .mode = GPIO_MODE_INPUT,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type = GPIO_INTR_ANYEDGE
+    };
+    esp_err_t err = gpio_config(&vbus_config);
+    if (err == ESP_OK) {
+        err = gpio_install_isr_service(0);
+        if (err == ESP_ERR_INVALID_STATE) err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        usb_app_vbus_init(&usb_app_vbus, USB_APP_VBUS_DEBOUNCE_MS, gpio_get_level(USB_APP_VBUS_GPIO),
+                          esp_timer_get_time() / 1000);
+        err = gpio_isr_handler_add(USB_APP_VBUS_GPIO, usb_app_vbus_isr, NULL);
+    }
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to set up VBUS monitor: %s", esp_err_to_name(err));
         esp_restart();
     }
+    atomic_store(&usb_app_vbus_attaching, usb_app_vbus.powered);
+    ESP_LOGI(TAG, "VBUS %s at start", usb_app_vbus.powered ? "present" : "absent");
+}
+
+/* Returns whether the stack should be installed */
+static bool usb_app_vbus_update() {
+    // The pin does not wake the chip from light sleep, edges that happened there show up here
+    const bool level = gpio_get_level(USB_APP_VBUS_GPIO);
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+
+    portENTER_CRITICAL(&usb_app_vbus_lock);
+    usb_app_vbus_edge(&usb_app_vbus, level, now_ms);
+    const usb_app_vbus_event_e event = usb_app_vbus_poll(&usb_app_vbus, now_ms);
+    const bool powered = usb_app_vbus.powered;
+    const bool debouncing = usb_app_vbus_wait_ms(&usb_app_vbus, now_ms) != UINT32_MAX;
+    const uint32_t glitches = usb_app_vbus.stats.glitches;
+    portEXIT_CRITICAL(&usb_app_vbus_lock);
+
+    // Light sleep would swallow the end of a glitch, which then passes the debounce
+    if (debouncing != usb_app_vbus_debouncing) {
+        if (debouncing) power_manager_acquire(POWER_MANAGER_LOCK_USB_VBUS);
+        else power_manager_release(POWER_MANAGER_LOCK_USB_VBUS);
+        usb_app_vbus_debouncing = debouncing;
+    }
+
+    if (event == USB_APP_VBUS_EVENT_ATTACH) {
+        atomic_store(&usb_app_vbus_attaching, true);
+        ESP_LOGI(TAG, "VBUS on, installing USB stack (glitches %lu)", glitches);
+    } else if (event == USB_APP_VBUS_EVENT_DETACH) {
+        atomic_store(&usb_app_vbus_attaching, false);
+        ESP_LOGI(TAG, "VBUS off, uninstalling USB stack (glitches %lu)", glitches);
+    }
+    return powered;
+}
+
+/* Longest wait of the owner task before the VBUS state needs a look again */
+static TickType_t usb_app_vbus_timeout() {
+    portENTER_CRITICAL(&usb_app_vbus_lock);
+    const uint32_t wait_ms = usb_app_vbus_wait_ms(&usb_app_vbus, esp_timer_get_time() / 1000);
+    portEXIT_CRITICAL(&usb_app_vbus_lock);
+
+    if (wait_ms == UINT32_MAX) return pdMS_TO_TICKS(USB_APP_VBUS_RECHECK_MS);
+    // One tick more, so the wait does not end right before the debounce does
+    return pdMS_TO_TICKS(wait_ms) + 1;
+}
+
+/* Blocks while VBUS is absent, nothing of the USB stack runs without a device to power */
+static void usb_app_vbus_wait_powered() {
+    usb_app_vbus_task = xTaskGetCurrentTaskHandle();
+    while (!usb_app_vbus_update()) {
+        ulTaskNotifyTake(pdTRUE, usb_app_vbus_timeout());
+    }
+}
+
+/* Ends the cold attach phases, the interfaces pass here at their start and on every report */
+static void usb_app_vbus_on_ready(bool report) {
+    if (!atomic_load(&usb_app_vbus_attaching)) return;
+
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&usb_app_vbus_lock);
+    const bool ready = usb_app_vbus_ready(&usb_app_vbus, now_ms);
+    const bool reported = report && usb_app_vbus_report(&usb_app_vbus, now_ms);
+    const usb_app_vbus_stats_t stats = usb_app_vbus.stats;
+    portEXIT_CRITICAL(&usb_app_vbus_lock);
+
+    if (ready) ESP_LOGI(TAG, "Cold attach: first interface started in %lu ms", stats.cold_ready_last_ms);
+    if (reported) {
+        atomic_store(&usb_app_vbus_attaching, false);
+        ESP_LOGI(TAG, "Cold attach: first report in %lu ms", stats.cold_attach_last_ms);
+    }
+}
+
+static void usb_app_log_vbus_stats() {
+    portENTER_CRITICAL(&usb_app_vbus_lock);
+    const usb_app_vbus_stats_t stats = usb_app_vbus.stats;
+    const bool powered = usb_app_vbus.powered;
+    portEXIT_CRITICAL(&usb_app_vbus_lock);
+
+    ESP_LOGI(TAG, "VBUS %s: attaches %lu, detaches %lu, glitches %lu | cold attach ready max %lu ms, "
+             "first report avg %llu ms max %lu ms over %lu",
+             powered ? "on" : "off", stats.attaches, stats.detaches, stats.glitches, stats.cold_ready_max_ms,
+             stats.cold_attaches ? stats.cold_attach_sum_ms / stats.cold_attaches : 0,
+             stats.cold_attach_max_ms, stats.cold_attaches);
+}
+#else
+static void usb_app_vbus_setup() {
+}
+
+static bool usb_app_vbus_update() {
+    return true;
+}
+
+static TickType_t usb_app_vbus_timeout() {
+    return portMAX_DELAY;
+}
+
+static void usb_app_vbus_wait_powered() {
+}
+
+static void usb_app_vbus_on_ready(bool report) {
+}
+
+static void usb_app_log_vbus_stats() {
+}
+#endif
+
+static const uint8_t usb_app_keymap_identity[USB_APP_KEYMAP_HEADER_LEN] = {
+    USB_APP_KEYMAP_MAGIC_0, USB_APP_KEYMAP_MAGIC_1, USB_APP_KEYMAP_VERSION, 1, 0, 0
+};
+
+static esp_err_t usb_app_keymap_store(const uint8_t *blob, size_t length) {
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(USB_APP_KEYMAP_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err != ESP_OK) return err;
+
+    if (length) {
+        err = nvs_set_blob(nvs, USB_APP_KEYMAP_NVS_KEY, blob, length);
+    } else {
+        err = nvs_erase_key(nvs, USB_APP_KEYMAP_NVS_KEY);
+        if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+    }
+    if (err == ESP_OK) err = nvs_commit(nvs);
+    nvs_close(nvs);
+    return err;
+}
+
+esp_err_t usb_app_set_keymap(const uint8_t *blob, size_t length, bool persist) {
+    const uint8_t *installed = length ? blob : usb_app_keymap_identity;
+    const size_t installed_len = length ? length : sizeof(usb_app_keymap_identity);
+    if (installed_len > USB_APP_KEYMAP_MAX_LEN) return ESP_ERR_INVALID_SIZE;
+
+    // Busy only while the USB task is still reading the bank it replaced, which takes a few instructions
+    int attempts = 0;
+    int rc;
+    while ((rc = usb_app_keymap_install(&usb_app_keymap, installed, installed_len)) == USB_APP_KEYMAP_ERR_BUSY) {
+        if (++attempts == USB_APP_KEYMAP_INSTALL_ATTEMPTS) return ESP_ERR_TIMEOUT;
+        vTaskDelay(1);
+    }
+    if (rc != 0) return ESP_ERR_INVALID_ARG;
+
+    portENTER_CRITICAL(&usb_app_keymap_lock);
+    if (length) memcpy(usb_app_keymap_blob, blob, length);
+    usb_app_keymap_blob_len = length;
+    portEXIT_CRITICAL(&usb_app_keymap_lock);
+    ESP_LOGI(TAG, "Keymap installed, %u layers, %u rules", installed[3], installed[4] | (installed[5] << 8));
+
+    return persist ? usb_app_keymap_store(blob, length) : ESP_OK;
+}
+
+size_t usb_app_get_keymap(uint8_t *blob, size_t max_length) {
+    portENTER_CRITICAL(&usb_app_keymap_lock);
+    const size_t length = MIN(usb_app_keymap_blob_len, max_length);
+    memcpy(blob, usb_app_keymap_blob, length);
+    portEXIT_CRITICAL(&usb_app_keymap_lock);
+    return length;
+}
+
+void usb_app_set_macro_callback(usb_app_macro_cb_t callback) {
+    usb_app_macro_callback = callback;
+}
+
+void usb_app_set_key_callback(usb_app_key_cb_t callback) {
+    usb_app_key_callback = callback;
+}
+
+void usb_app_set_mouse_callback(usb_app_mouse_cb_t callback) {
+    usb_app_mouse_callback = callback;
+}
+
+void usb_app_set_wake_callback(usb_app_wake_cb_t callback) {
+    usb_app_wake_callback = callback;
+}
+
+esp_err_t usb_app_load_keymap(void) {
+    usb_app_keymap_init(&usb_app_keymap);
+    atomic_store(&usb_app_keymap_ready, true);
+
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(USB_APP_KEYMAP_NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) return ESP_OK;
+    if (err != ESP_OK) return err;
+
+    uint8_t *blob = malloc(USB_APP_KEYMAP_MAX_LEN);
+    size_t length = USB_APP_KEYMAP_MAX_LEN;
+    if (!blob) {
+        nvs_close(nvs);
+        return ESP_ERR_NO_MEM;
+    }
+    err = nvs_get_blob(nvs, USB_APP_KEYMAP_NVS_KEY, blob, &length);
+    nvs_close(nvs);
+
+    if (err == ESP_OK) {
+        err = usb_app_set_keymap(blob, length, false);
+        if (err != ESP_OK) ESP_LOGW(TAG, "Stored keymap rejected: %s", esp_err_to_name(err));
+    } else if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    free(blob);
+    return err;
+}
+
+static void daemon_task(void *args) {
+    ESP_LOGI(TAG, "Starting USB daemon task...");
 
     while (1) {
-        uint32_t event_flags;
+        usb_app_vbus_wait_powered();
+        bool installed = usb_app_install_stack(!USB_APP_UNIFIED_EVENT_LOOP) == ESP_OK;
+#if USB_APP_UNIFIED_EVENT_LOOP
+        if (installed) xTaskNotifyGive(usb_app_client_task);
+#endif
 
-        esp_err_t err = usb_host_lib_handle_events(portMAX_DELAY, &event_flags);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to handle USB Host Library events");
-            continue;
+        while (installed && !usb_app_recovery_requested && usb_app_vbus_update()) {
+            usb_app_handle_lib_events(usb_app_vbus_timeout());
+#if USB_APP_UNIFIED_EVENT_LOOP
+            // Only this task may unblock the client, the driver could be going away under any other
+            if (atomic_load(&usb_app_listening_pending)) hid_host_unblock();
+#endif
         }
 
-        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS) {
-            ESP_LOGI(TAG, "No more USB Clients!");
-            if (ESP_OK == usb_host_device_free_all()) {
-                ESP_LOGI(TAG, "All USB devices are freed!");
-            } else {
-                ESP_LOGI(TAG, "Waiting for ALL_FREE Event...");
+        if (installed && !usb_app_recovery_requested) {
+            // VBUS gone, not a failure: no backoff, the next rising edge installs the stack again
+            if (usb_app_teardown_stack(true)) {
+                usb_app_stack_installed_us = 0;
+                continue;
             }
+            installed = false;
         }
-
-        if (event_flags & USB_HOST_LIB_EVENT_FLAGS_ALL_FREE) {
-            ESP_LOGI(TAG, "All devices disconnected!");
+        const int64_t now_us = esp_timer_get_time();
+        portENTER_CRITICAL(&usb_app_recovery_lock);
+        if (!installed && !usb_app_recovery_requested_us) {
+            usb_app_recovery_stats.requested++;
+            usb_app_recovery_requested_us = now_us;
         }
+        portEXIT_CRITICAL(&usb_app_recovery_lock);
+        usb_app_recover_stack(installed);
     }
-
-    ESP_LOGI(TAG, "No more USB Clients and Devices!");
-    ESP_ERROR_CHECK(usb_host_uninstall());
 }
 
 static void hid_print_new_device_report_header(hid_protocol_t proto) {
@@ -97,9 +685,11 @@ static bool hid_keyboard_get_char(uint8_t modifier, uint8_t key_code, unsigned c
     return true;
 }
 
-static void key_event_callback(key_event_t *key_event) {
+static void key_event_callback(const key_event_t *key_event, void *arg) {
     unsigned char key_char;
 
+    if (usb_app_key_callback) usb_app_key_callback(key_event->key_code, key_event->state == KEY_STATE_PRESSED);
+
     hid_print_new_device_report_header(HID_PROTOCOL_KEYBOARD);
 
     if (key_event->state == KEY_STATE_PRESSED) {
@@ -109,47 +699,595 @@ static void key_event_callback(key_event_t *key_event) {
     }
 }
 
-static bool key_found(const uint8_t *const src,
-                             uint8_t key,
-                             unsigned int length)
-{
-    for (unsigned int i = 0; i < length; i++) {
-        if (src[i] == key) {
-            return true;
-        }
+#if USB_APP_TAPHOLD_ENABLED
+static const usb_app_taphold_key_t usb_app_taphold_keys[] = {
+    { HID_KEY_CAPS_LOCK, HID_KEY_ESC, HID_KEY_LEFT_CONTROL },
+};
+
+static const usb_app_taphold_combo_t usb_app_taphold_combos[] = {
+    { { HID_KEY_J, HID_KEY_K }, HID_KEY_ESC },
+};
+
+static const usb_app_taphold_config_t usb_app_taphold_config = {
+    .keys = usb_app_taphold_keys,
+    .key_count = sizeof(usb_app_taphold_keys) / sizeof(usb_app_taphold_keys[0]),
+    .combos = usb_app_taphold_combos,
+    .combo_count = sizeof(usb_app_taphold_combos) / sizeof(usb_app_taphold_combos[0]),
+    .tapping_term_ms = USB_APP_TAPHOLD_TAPPING_TERM_MS,
+    .combo_term_ms = USB_APP_TAPHOLD_COMBO_TERM_MS,
+    .tick_ms = USB_APP_TAPHOLD_TICK_MS
+};
+
+static usb_app_taphold_t usb_app_taphold;
+static SemaphoreHandle_t usb_app_taphold_mutex = NULL;
+static esp_timer_handle_t usb_app_taphold_timer = NULL;
+static bool usb_app_taphold_timer_running = false;
+
+/* The wheel only ticks while a decision is open, so idle typing costs no timer wakeups */
+static void usb_app_taphold_update_timer() {
+    const bool pending = usb_app_taphold_pending(&usb_app_taphold);
+    if (pending && !usb_app_taphold_timer_running) {
+        usb_app_taphold_timer_running = esp_timer_start_periodic(usb_app_taphold_timer,
+                                                                 USB_APP_TAPHOLD_TICK_MS * 1000) == ESP_OK;
+    } else if (!pending && usb_app_taphold_timer_running) {
+        esp_timer_stop(usb_app_taphold_timer);
+        usb_app_taphold_timer_running = false;
     }
-    return false;
 }
 
-static void hid_host_keyboard_report_callback(const uint8_t *const data, const size_t length) {
-    hid_keyboard_input_report_boot_t *kb_report = (hid_keyboard_input_report_boot_t*) data;
+static void usb_app_taphold_tick_callback(void *arg) {
+    xSemaphoreTake(usb_app_taphold_mutex, portMAX_DELAY);
+    usb_app_taphold_tick(&usb_app_taphold, esp_timer_get_time() / 1000);
+    usb_app_taphold_update_timer();
+    xSemaphoreGive(usb_app_taphold_mutex);
+}
 
-    if (length < sizeof(hid_keyboard_input_report_boot_t)) {
+static void usb_app_taphold_setup() {
+    const esp_timer_create_args_t timer_args = {
+        .callback = usb_app_taphold_tick_callback,
+        .name = "usb_taphold"
+    };
+    usb_app_taphold_mutex = xSemaphoreCreateMutex();
+    if (!usb_app_taphold_mutex || esp_timer_create(&timer_args, &usb_app_taphold_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create tap-hold timer!");
+        esp_restart();
+    }
+    usb_app_taphold_init(&usb_app_taphold, &usb_app_taphold_config, key_event_callback, NULL);
+}
+#endif
+
+/* Remapped key events go through tap-hold and combos, if enabled, on the way to the report builder */
+static void keyboard_output(const key_event_t *key_event) {
+#if USB_APP_TAPHOLD_ENABLED
+    xSemaphoreTake(usb_app_taphold_mutex, portMAX_DELAY);
+    usb_app_taphold_process(&usb_app_taphold, key_event, esp_timer_get_time() / 1000);
+    usb_app_taphold_update_timer();
+    xSemaphoreGive(usb_app_taphold_mutex);
+#else
+    key_event_callback(key_event, NULL);
+#endif
+}
+
+static void keymap_event_callback(const key_event_t *key_event, void *arg) {
+    key_event_t mapped;
+    if (!atomic_load(&usb_app_keymap_ready)) {
+        keyboard_output(key_event);
         return;
     }
 
-    static uint8_t prev_keys[HID_KEYBOARD_KEY_MAX] = { 0 };
-    key_event_t key_event;
+    switch (usb_app_keymap_translate(&usb_app_keymap, key_event, &mapped)) {
+        case USB_APP_KEYMAP_KEY:
+            keyboard_output(&mapped);
+        break;
+        case USB_APP_KEYMAP_MACRO:
+            if (usb_app_macro_callback) usb_app_macro_callback(mapped.key_code);
+        break;
+        default:
+        break;
+    }
+}
+
+/*
+ * Every keyboard keeps its own previous report in its route, the merge holds what all of them have down. Report
+ * protocol keyboards are brought to the boot layout first.
+ */
+static void hid_host_keyboard_report_callback(usb_app_iface_route_t *route, const uint8_t *const data, const size_t length) {
+    hid_keyboard_input_report_boot_t converted;
+    const hid_keyboard_input_report_boot_t *report = usb_app_keyboard_to_boot(&route->keyboard_layout, data, length,
+                                                                              &converted);
+    if (!report) {
+        return;
+    }
+
+    usb_app_keyboard_merge_report(&usb_app_keyboard_merge, &route->keyboard, report, keymap_event_callback, NULL);
+}
+
+static void hid_host_mouse_report_callback(usb_app_iface_route_t *route, const uint8_t *const data, const size_t length) {
+    usb_app_mouse_report_t mouse;
+    if (!usb_app_mouse_parse(&route->mouse_layout, data, length, &mouse)) {
+        return;
+    }
+
+    ESP_LOGD(TAG, "Mouse buttons: 0x%02x, X: %d, Y: %d, wheel: %d", mouse.buttons, mouse.x, mouse.y, mouse.wheel);
+    if (usb_app_mouse_callback) {
+        usb_app_mouse_callback(mouse.buttons, mouse.x, mouse.y, mouse.wheel);
+    }
+}
+
+static void hid_host_consumer_report_callback(usb_app_iface_route_t *route, const uint8_t *const data, const size_t length) {
+    if (length < sizeof(uint16_t)) {
+        return;
+    }
+
+    const uint16_t usage = data[0] | (data[1] << 8);
+    ESP_LOGD(TAG, "Consumer control usage: 0x%04x", usage);
+}
+
+static void hid_host_vendor_report_callback(usb_app_iface_route_t *route, const uint8_t *const data, const size_t length) {
+    ESP_LOG_BUFFER_HEXDUMP(TAG, data, length, ESP_LOG_DEBUG);
+}
+
+static const usb_app_report_handler_t usb_app_report_handlers[USB_APP_REPORT_KIND_MAX] = {
+    [USB_APP_REPORT_KIND_UNKNOWN] = NULL,
+    [USB_APP_REPORT_KIND_KEYBOARD] = hid_host_keyboard_report_callback,
+    [USB_APP_REPORT_KIND_MOUSE] = hid_host_mouse_report_callback,
+    [USB_APP_REPORT_KIND_CONSUMER] = hid_host_consumer_report_callback,
+    [USB_APP_REPORT_KIND_VENDOR] = hid_host_vendor_report_callback
+};
+
+#if USB_APP_CAPTURE_ENABLED
+static uint8_t usb_app_capture_ring[USB_APP_CAPTURE_RING_SIZE];
+static usb_app_capture_t usb_app_capture = {
+    .ring = usb_app_capture_ring,
+    .ring_size = USB_APP_CAPTURE_RING_SIZE
+};
+static portMUX_TYPE usb_app_capture_lock = portMUX_INITIALIZER_UNLOCKED;
+/* Set while the capture is printed, nothing is recorded meanwhile */
+static volatile bool usb_app_capture_paused = false;
+
+static void usb_app_capture_on_attach(usb_app_iface_route_t *route,
+                                      hid_host_device_handle_t hid_device_handle,
+                                      const uint8_t *report_desc,
+                                      size_t report_desc_len) {
+    usb_app_capture_attach_t attach = {
+        .addr = route->dev_params.addr,
+        .iface_num = route->dev_params.iface_num,
+        .sub_class = route->dev_params.sub_class,
+        .proto = route->dev_params.proto
+    };
+    hid_host_dev_info_t dev_info;
+    if (hid_host_get_device_info(hid_device_handle, &dev_info) == ESP_OK) {
+        attach.vid = dev_info.VID;
+        attach.pid = dev_info.PID;
+    }
+
+    usb_app_capture_channel_t *channel = usb_app_capture_alloc_channel();
+    route->capture_channel = -1;
+    portENTER_CRITICAL(&usb_app_capture_lock);
+    if (!usb_app_capture_paused) {
+        route->capture_channel = usb_app_capture_attach(&usb_app_capture, channel, &attach,
+                                                        report_desc, report_desc_len, esp_timer_get_time());
+    }
+    portEXIT_CRITICAL(&usb_app_capture_lock);
 
-    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) {
-        // Key has been released
-        if (prev_keys[i] > HID_KEY_ERROR_UNDEFINED && !key_found(kb_report->key, prev_keys[i], HID_KEYBOARD_KEY_MAX)) {
-            key_event.key_code = prev_keys[i];
-            key_event.modifier = 0;
-            key_event.state = KEY_STATE_RELEASED;
-            key_event_callback(&key_event);
+    if (route->capture_channel < 0) {
+        ESP_LOGW(TAG, "Addr %d iface %d is not captured", attach.addr, attach.iface_num);
+        free(channel);
+    }
+}
+
+static void usb_app_capture_on_input(const usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    const uint32_t timestamp_us = esp_timer_get_time();
+    portENTER_CRITICAL(&usb_app_capture_lock);
+    if (!usb_app_capture_paused) {
+        usb_app_capture_input(&usb_app_capture, route->capture_channel, data, length, timestamp_us);
+    }
+    portEXIT_CRITICAL(&usb_app_capture_lock);
+}
+
+static void usb_app_capture_on_detach(const usb_app_iface_route_t *route) {
+    const uint32_t timestamp_us = esp_timer_get_time();
+    portENTER_CRITICAL(&usb_app_capture_lock);
+    if (!usb_app_capture_paused) {
+        usb_app_capture_detach(&usb_app_capture, route->capture_channel, timestamp_us);
+    }
+    portEXIT_CRITICAL(&usb_app_capture_lock);
+}
+
+static void usb_app_capture_print_hex(const uint8_t *data, size_t length, void *arg) {
+    size_t *column = arg;
+    for (size_t i = 0; i < length; i++) {
+        if (*column == 0) printf("UCAP:");
+        printf("%02x", data[i]);
+        if (++(*column) == 32) {
+            printf("\r\n");
+            *column = 0;
+        }
+    }
+}
+
+void usb_app_capture_dump(void) {
+    portENTER_CRITICAL(&usb_app_capture_lock);
+    usb_app_capture_paused = true;
+    portEXIT_CRITICAL(&usb_app_capture_lock);
+
+    size_t column = 0;
+    ESP_LOGI(TAG, "HID capture, %u bytes, %lu records dropped",
+             (unsigned) usb_app_capture_size(&usb_app_capture), usb_app_capture.dropped_records);
+    usb_app_capture_export(&usb_app_capture, usb_app_capture_print_hex, &column);
+    if (column) printf("\r\n");
+    fflush(stdout);
+
+    portENTER_CRITICAL(&usb_app_capture_lock);
+    usb_app_capture_paused = false;
+    portEXIT_CRITICAL(&usb_app_capture_lock);
+}
+#else
+static void usb_app_capture_on_attach(usb_app_iface_route_t *route,
+                                      hid_host_device_handle_t hid_device_handle,
+                                      const uint8_t *report_desc,
+                                      size_t report_desc_len) {
+    route->capture_channel = -1;
+}
+
+static void usb_app_capture_on_input(const usb_app_iface_route_t *route, const uint8_t *data, size_t length) { }
+
+static void usb_app_capture_on_detach(const usb_app_iface_route_t *route) { }
+
+void usb_app_capture_dump(void) {
+    ESP_LOGW(TAG, "HID capture is disabled, set USB_APP_CAPTURE_ENABLED");
+}
+#endif
+
+/* Call with the mutex held, NULL once the interface is gone */
+static usb_app_device_t *usb_app_device_find(uint32_t id) {
+    for (size_t i = 0; i < HID_HOST_MAX_INTERFACES; i++) {
+        if (usb_app_devices[i].handle && usb_app_devices[i].id == id) return &usb_app_devices[i];
+    }
+    return NULL;
+}
+
+/* Call with the mutex held, returns whether the interface was listed */
+static bool usb_app_device_remove(hid_host_device_handle_t handle) {
+    bool listed = false;
+    for (size_t i = 0; i < HID_HOST_MAX_INTERFACES; i++) {
+        if (usb_app_devices[i].handle == handle) {
+            usb_app_devices[i] = (usb_app_device_t) { 0 };
+            if (usb_app_devices_running) power_manager_release(POWER_MANAGER_LOCK_USB_TRANSFERS);
+            listed = true;
+        }
+    }
+    return listed;
+}
+
+/* Call with usb_app_poll_lock held after an interface changed its state, returns the change of active interfaces */
+static int usb_app_poll_count(bool was_idle, bool idle) {
+    if (was_idle == idle) return 0;
+    if (idle) {
+        usb_app_poll_active--;
+        return -1;
+    }
+    usb_app_poll_active++;
+    return 1;
+}
+
+/* Call after usb_app_poll_lock is released, raising the clock stalls the caller */
+static void usb_app_poll_power(int change) {
+    for (; change > 0; change--) power_manager_acquire(POWER_MANAGER_LOCK_USB_ACTIVE);
+    for (; change < 0; change++) power_manager_release(POWER_MANAGER_LOCK_USB_ACTIVE);
+}
+
+/* Call with usb_app_poll_lock held, returns whether the caller has to start the idle check */
+static bool usb_app_poll_arm() {
+    if (!usb_app_poll_active || usb_app_poll_timer_armed) return false;
+    usb_app_poll_timer_armed = true;
+    return true;
+}
+
+static void usb_app_poll_start_timer() {
+    if (esp_timer_start_once(usb_app_poll_timer, USB_APP_POLL_TICK_MS * 1000) == ESP_OK) return;
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    usb_app_poll_timer_armed = false;
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    ESP_LOGW(TAG, "Failed to start USB poll timer!");
+}
+
+/* Runs only while an interface is active, a device that honors SET_IDLE sends nothing once it is idle */
+static void usb_app_poll_tick_callback(void *arg) {
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    int change = 0;
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    for (size_t i = 0; i < HID_HOST_MAX_INTERFACES; i++) {
+        usb_app_iface_route_t *route = usb_app_devices[i].route;
+        if (route && usb_app_poll_tick(&route->poll, now_ms)) change += usb_app_poll_count(false, true);
+    }
+    usb_app_poll_timer_armed = false;
+    const bool arm = usb_app_poll_arm();
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    xSemaphoreGive(usb_app_devices_mutex);
+    usb_app_poll_power(change);
+    if (arm) usb_app_poll_start_timer();
+}
+
+/* Call with usb_app_devices_mutex held, the interface starts active */
+static void usb_app_poll_attach(usb_app_iface_route_t *route) {
+    usb_app_poll_init(&route->poll, USB_APP_POLL_IDLE_AFTER_MS, USB_APP_POLL_IDLE_INTERVAL_MS,
+                      esp_timer_get_time() / 1000);
+    route->poll_delay_ms = 0;
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    const int change = usb_app_poll_count(true, false);
+    const bool arm = usb_app_poll_arm();
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    usb_app_poll_power(change);
+    if (arm) usb_app_poll_start_timer();
+}
+
+/* Call with usb_app_devices_mutex held */
+static void usb_app_poll_detach(usb_app_iface_route_t *route) {
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    const int change = usb_app_poll_count(route->poll.idle, true);
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    usb_app_poll_power(change);
+}
+
+/* Runs in the client task for every report, before the driver resubmits the IN transfer */
+static void usb_app_poll_on_report(hid_host_device_handle_t handle, usb_app_iface_route_t *route,
+                                   const uint8_t *data, size_t length) {
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    const bool was_idle = route->poll.idle;
+    const uint32_t delay_ms = usb_app_poll_report(&route->poll, data, length, now_ms);
+    const int change = usb_app_poll_count(was_idle, route->poll.idle);
+    const bool arm = usb_app_poll_arm();
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    usb_app_poll_power(change);
+    if (arm) usb_app_poll_start_timer();
+
+    if (delay_ms != route->poll_delay_ms && hid_host_device_set_poll_delay(handle, delay_ms) == ESP_OK) {
+        route->poll_delay_ms = delay_ms;
+    }
+}
+
+static void usb_app_poll_setup() {
+    const esp_timer_create_args_t timer_args = {
+        .callback = usb_app_poll_tick_callback,
+        .name = "usb_poll"
+    };
+    if (esp_timer_create(&timer_args, &usb_app_poll_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to create USB poll timer!");
+        esp_restart();
+    }
+}
+
+/*
+ * Reads the keys a paused keyboard holds right now, so keys released while paused do not stay down. Boot and report
+ * protocol keyboards alike, the report of the keyboard handler is requested by its Report ID and layout length.
+ */
+static void usb_app_device_read_keyboard(uint32_t id) {
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    const usb_app_device_t *device = usb_app_device_find(id);
+    const hid_host_device_handle_t handle = device ? device->handle : NULL;
+    uint8_t report_id = 0;
+    size_t length = 0;
+    for (uint8_t i = 0; device && i < USB_APP_ROUTE_REPORT_ID_MAX && !length; i++) {
+        if (device->route->kinds[i] != USB_APP_REPORT_KIND_KEYBOARD || !device->route->handlers[i]) continue;
+        report_id = i;
+        length = device->route->report_id_offset + device->route->keyboard_layout.length;
+    }
+    xSemaphoreGive(usb_app_devices_mutex);
+    if (!length || length > USB_APP_RESUME_REPORT_MAX) return;
+
+    // The driver looks the handle up in its own list, a closed one fails the request. With Report IDs the report
+    // comes back behind its ID, the way the IN endpoint sends it.
+    uint8_t report[USB_APP_RESUME_REPORT_MAX];
+    if (hid_class_request_get_report(handle, HID_REPORT_TYPE_INPUT, report_id, report, &length) != ESP_OK) return;
+
+    // The interface may have gone while the request ran, DISCONNECTED unlists it before the route is freed
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    device = usb_app_device_find(id);
+    if (device) usb_app_router_dispatch(device->route, report, length);
+    xSemaphoreGive(usb_app_devices_mutex);
+}
+
+/*
+ * Switches between dispatching the input and only waking the BLE side with it, the caller holds the mutex.
+ * Returns true when a listening host ends the wake-only mode.
+ */
+static bool usb_app_set_watching(bool watching, bool listening, int64_t now_us) {
+    if (listening) {
+        const uint32_t wake_ms = atomic_exchange(&usb_app_wake_ms, 0);
+        const uint32_t reconnect_ms = now_us / 1000 - wake_ms;
+        if (wake_ms && reconnect_ms > usb_app_event_stats.wake_reconnect_max_ms) {
+            usb_app_event_stats.wake_reconnect_max_ms = reconnect_ms;
         }
+        if (wake_ms) ESP_LOGI(TAG, "BLE host listens %lu ms after the last wake", reconnect_ms);
+    }
+    if (watching == atomic_load(&usb_app_watching)) return false;
 
-        // Key has been pressed
-        if (kb_report->key[i] > HID_KEY_ERROR_UNDEFINED && !key_found(prev_keys, kb_report->key[i], HID_KEYBOARD_KEY_MAX)) {
-            key_event.key_code = kb_report->key[i];
-            key_event.modifier = kb_report->modifier.val;
-            key_event.state = KEY_STATE_PRESSED;
-            key_event_callback(&key_event);
+    atomic_store(&usb_app_watching, watching);
+    if (watching) {
+        usb_app_watch_since_us = now_us;
+        ESP_LOGI(TAG, "BLE link down, USB input only wakes the host");
+        return false;
+    }
+    usb_app_event_stats.watch_us += now_us - usb_app_watch_since_us;
+    usb_app_watch_since_us = 0;
+    return listening;
+}
+
+/*
+ * Brings the IN transfers in line with the BLE listeners, runs where class requests may run.
+ *
+ * Starting and stopping happen with the mutex held, DISCONNECTED closes a handle only after it took the mutex to
+ * unlist it. Only the GET_REPORT of a resume runs without it, every interface is looked up again by its id after.
+ */
+static void usb_app_apply_listening() {
+    atomic_store(&usb_app_listening_pending, false);
+    const bool listening = !USB_APP_IDLE_WITHOUT_LISTENER || atomic_load(&usb_app_listening);
+    const bool watching = USB_APP_WAKE_ON_INPUT && !listening && !atomic_load(&usb_app_link_up);
+    const bool running = listening || watching;
+    const int64_t start_us = esp_timer_get_time();
+
+    // Interfaces listed when the state flips, the ones listed later start or stay stopped on their own
+    uint32_t ids[HID_HOST_MAX_INTERFACES];
+    size_t count = 0;
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    const bool changed = running != usb_app_devices_running;
+    usb_app_devices_running = running;
+    for (size_t i = 0; changed && i < HID_HOST_MAX_INTERFACES; i++) {
+        if (!usb_app_devices[i].handle) continue;
+        ids[count++] = usb_app_devices[i].id;
+        // Running interfaces keep the chip out of light sleep, the host controller stops there
+        if (running) {
+            power_manager_acquire(POWER_MANAGER_LOCK_USB_TRANSFERS);
+        } else {
+            power_manager_release(POWER_MANAGER_LOCK_USB_TRANSFERS);
+            hid_host_device_stop(usb_app_devices[i].handle);
         }
     }
+    // Set before the transfers start, their first reports already go the right way
+    const bool woken = usb_app_set_watching(watching, listening, start_us);
+    xSemaphoreGive(usb_app_devices_mutex);
+    if (!changed) {
+        if (woken) {
+            // The transfers never stopped, a listening host only ends the wake-only mode
+            usb_app_resumed_us = start_us;
+            atomic_store(&usb_app_resume_report_pending, true);
+            ESP_LOGI(TAG, "BLE host listens, USB input dispatched again");
+        }
+        return;
+    }
 
-    memcpy(prev_keys, &kb_report->key, HID_KEYBOARD_KEY_MAX);
+    const int64_t now_us = esp_timer_get_time();
+    if (!running) {
+        usb_app_event_stats.idle_periods++;
+        usb_app_idle_since_us = now_us;
+        ESP_LOGI(TAG, "No BLE host listens, USB input paused");
+        return;
+    }
+
+    // Every interface is still stopped, nothing else dispatches while the keyboards are read
+    for (size_t i = 0; listening && i < count; i++) {
+        usb_app_device_read_keyboard(ids[i]);
+    }
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    // A pause applied meanwhile has stopped the ones started so far and leaves the rest stopped
+    for (size_t i = 0; i < count && usb_app_devices_running; i++) {
+        const usb_app_device_t *device = usb_app_device_find(ids[i]);
+        if (device && hid_host_device_start(device->handle) != ESP_OK) {
+            ESP_LOGW(TAG, "Failed to resume HID interface %d", device->route->dev_params.iface_num);
+        }
+    }
+    xSemaphoreGive(usb_app_devices_mutex);
+    usb_app_event_stats.idle_us += now_us - usb_app_idle_since_us;
+    usb_app_idle_since_us = 0;
+    if (!listening) return;
+
+    const int64_t resumed_us = esp_timer_get_time();
+    const uint32_t resume_us = resumed_us - start_us;
+    if (resume_us > usb_app_event_stats.resume_max_us) usb_app_event_stats.resume_max_us = resume_us;
+    usb_app_resumed_us = resumed_us;
+    atomic_store(&usb_app_resume_report_pending, true);
+    ESP_LOGI(TAG, "BLE host listens, USB input resumed in %lu us", resume_us);
+}
+
+/*
+ * While the BLE link is down reports only wake the BLE side, returns true if the report was taken for that.
+ * Keyboard reports go on to the key callback as well with USB_APP_WAKE_KEEP_KEYS.
+ */
+static bool usb_app_watch_report(hid_host_device_handle_t handle, usb_app_iface_route_t *route,
+                                 const uint8_t *data, size_t length) {
+    if (!atomic_load(&usb_app_watching)) return false;
+
+    const uint8_t report_id = route->report_id_offset && length ? data[0] : 0;
+    const bool keys = USB_APP_WAKE_KEEP_KEYS && report_id < USB_APP_ROUTE_REPORT_ID_MAX &&
+                      route->kinds[report_id] == USB_APP_REPORT_KIND_KEYBOARD;
+
+    // Repeating devices are read less often, one that honors SET_IDLE(0) costs nothing until its input changes.
+    // Keyboards that keep their keys stay on the activity-adaptive delay, a slower poll would merge keystrokes.
+    if (!keys && route->poll_delay_ms != USB_APP_WAKE_POLL_MS &&
+        hid_host_device_set_poll_delay(handle, USB_APP_WAKE_POLL_MS) == ESP_OK) {
+        route->poll_delay_ms = USB_APP_WAKE_POLL_MS;
+    }
+
+    // Idle reports are all zeros, a pressed key or button and any motion are not
+    bool input = false;
+    for (size_t i = route->report_id_offset; i < length && !input; i++) input = data[i] != 0;
+
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    const uint32_t wake_ms = atomic_load(&usb_app_wake_ms);
+    if (!input || !usb_app_wake_callback || (wake_ms && now_ms - wake_ms < USB_APP_WAKE_HOLDOFF_MS)) return !keys;
+
+    atomic_store(&usb_app_wake_ms, now_ms ? now_ms : 1);
+    usb_app_event_stats.wakeups++;
+    usb_app_wake_callback();
+    return !keys;
+}
+
+/* The first report after a resume ends the resume-to-report time, it includes the wait for input */
+static void usb_app_resume_on_report() {
+    if (!atomic_load(&usb_app_resume_report_pending) || !atomic_exchange(&usb_app_resume_report_pending, false)) return;
+
+    const int64_t resumed_us = usb_app_resumed_us;
+    usb_app_resumed_us = 0;
+    ESP_LOGI(TAG, "First USB report %lld ms after resume", (esp_timer_get_time() - resumed_us) / 1000);
+}
+
+/*
+ * Lists an interface that finished its setup and starts its IN transfers while running. Started with the mutex
+ * held, a pause or DISCONNECTED right after listing it cannot run in between. Sets started if the transfers run.
+ */
+static esp_err_t usb_app_device_add(hid_host_device_handle_t handle, usb_app_iface_route_t *route, bool *started) {
+    if (atomic_load(&usb_app_listening_pending)) usb_app_apply_listening();
+
+    esp_err_t err = ESP_OK;
+    *started = false;
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    const bool running = usb_app_devices_running;
+    size_t i = 0;
+    while (i < HID_HOST_MAX_INTERFACES && usb_app_devices[i].handle) i++;
+    if (i < HID_HOST_MAX_INTERFACES) {
+        usb_app_devices[i] = (usb_app_device_t) { handle, route, usb_app_device_next_id++ };
+        if (running) power_manager_acquire(POWER_MANAGER_LOCK_USB_TRANSFERS);
+        usb_app_poll_attach(route);
+        // Interfaces attached while no BLE host listens start with the next subscriber
+        if (running) err = hid_host_device_start(handle);
+        *started = running && err == ESP_OK;
+    } else {
+        // Holds as many interfaces as the driver, an unlisted one could neither be paused nor tracked
+        ESP_LOGW(TAG, "HID device list full, iface %d not started", route->dev_params.iface_num);
+    }
+    xSemaphoreGive(usb_app_devices_mutex);
+    return err;
+}
+
+/* One pending change at a time, the USB side applies the newest state */
+static void usb_app_post_listening() {
+    if (atomic_exchange(&usb_app_listening_pending, true)) return;
+
+#if USB_APP_UNIFIED_EVENT_LOOP
+    // The daemon wakes the unified task, fails harmlessly while the stack is not installed
+    usb_host_lib_unblock();
+#else
+    const usb_app_event_queue_t evt_queue = {
+        .event_group = USB_APP_EVENT_LISTENERS,
+        .timestamp_us = esp_timer_get_time()
+    };
+    // Before the queue exists the change stays pending, the first interface that attaches applies it. A full
+    // queue keeps it pending too, every worker applies a pending change after the event it took.
+    if (usb_app_event_queue) xQueueSend(usb_app_event_queue, &evt_queue, 0);
+#endif
+}
+
+void usb_app_set_listening(bool listening) {
+    atomic_store(&usb_app_listening, listening);
+    usb_app_post_listening();
+}
+
+void usb_app_set_link(bool connected) {
+    atomic_store(&usb_app_link_up, connected);
+    usb_app_post_listening();
 }
 
 static void hid_host_interface_callback(
@@ -160,8 +1298,8 @@ static void hid_host_interface_callback(
     esp_err_t err;
     uint8_t data[64] = { 0 };
     size_t data_length = 0;
-    hid_host_dev_params_t dev_params;
-    ESP_ERROR_CHECK(hid_host_device_get_params(hid_device_handle, &dev_params));
+    usb_app_iface_route_t *route = (usb_app_iface_route_t *) arg;
+    const hid_host_dev_params_t *dev_params = &route->dev_params;
 
     switch (event) {
         case HID_HOST_INTERFACE_EVENT_INPUT_REPORT:
@@ -171,60 +1309,165 @@ static void hid_host_interface_callback(
                 return;
             }
 
-            if (dev_params.sub_class == HID_SUBCLASS_BOOT_INTERFACE) {
-                if (dev_params.proto == HID_PROTOCOL_KEYBOARD) {
-                    hid_host_keyboard_report_callback(data, data_length);
-                    // The bluetooth part...
-                }
-            } else {
-                // TODO (mouse?)
-            }
+            usb_app_capture_on_input(route, data, data_length);
+            usb_app_vbus_on_ready(true);
+            if (usb_app_watch_report(hid_device_handle, route, data, data_length)) break;
+            usb_app_poll_on_report(hid_device_handle, route, data, data_length);
+            usb_app_resume_on_report();
+
+            // Handler was chosen on attach, no protocol switch per report
+            usb_app_router_dispatch(route, data, data_length);
+            boot_milestone_mark_once(BOOT_MILESTONE_FIRST_REPORT);
         break;
         case HID_HOST_INTERFACE_EVENT_DISCONNECTED:
-            ESP_LOGI(TAG, "HID Device, protocol '%s' DISCONNECTED", hid_proto_name_str[dev_params.proto]);
-            ESP_ERROR_CHECK(hid_host_device_close(hid_device_handle));
+            ESP_LOGI(TAG, "HID Device, protocol '%s' DISCONNECTED", hid_proto_name_str[dev_params->proto]);
+            usb_app_capture_on_detach(route);
+            xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+            if (usb_app_device_remove(hid_device_handle)) usb_app_poll_detach(route);
+            // Keys still held on the unplugged keyboard must not stay down on the host
+            usb_app_keyboard_merge_detach(&usb_app_keyboard_merge, &route->keyboard, keymap_event_callback, NULL);
+            xSemaphoreGive(usb_app_devices_mutex);
+            if (hid_host_device_close(hid_device_handle) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to close HID Device!");
+            }
+            free(route);
         break;
         case HID_HOST_INTERFACE_EVENT_TRANSFER_ERROR:
             ESP_LOGI(TAG, "HID Device, protocol '%s' TRANSFER_ERROR",
-                 hid_proto_name_str[dev_params.proto]);
+                 hid_proto_name_str[dev_params->proto]);
         break;
         default:
             ESP_LOGE(TAG, "HID Device, protocol '%s' Unhandled event",
-                     hid_proto_name_str[dev_params.proto]);
+                     hid_proto_name_str[dev_params->proto]);
         break;
     }
 }
 
+/**
+ * @brief Runs the class requests of an opened interface and fetches its report descriptor
+ *
+ * @param[in] hid_device_handle  Opened HID interface
+ * @param[in] dev_params         Its parameters
+ * @param[out] report_desc       Report descriptor, NULL for boot interfaces or when unavailable
+ * @param[out] report_desc_len   Its length
+ * @return esp_err_t of the first required request that failed
+ */
+static esp_err_t usb_app_iface_prepare(hid_host_device_handle_t hid_device_handle,
+                                       const hid_host_dev_params_t *dev_params,
+                                       const uint8_t **report_desc,
+                                       size_t *report_desc_len)
+{
+    esp_err_t err = ESP_OK;
+    *report_desc = NULL;
+    *report_desc_len = 0;
+    if (dev_params->sub_class == HID_SUBCLASS_BOOT_INTERFACE) {
+        // Boot protocol pins the report layout the handlers expect
+        err = hid_class_request_set_protocol(hid_device_handle, HID_REPORT_PROTOCOL_BOOT);
+
+        if (err == ESP_OK && dev_params->proto == HID_PROTOCOL_KEYBOARD) {
+            err = hid_class_request_set_idle(hid_device_handle, 0, 0);
+        }
+    }
+    if (err == ESP_OK && (dev_params->sub_class != HID_SUBCLASS_BOOT_INTERFACE ||
+                          dev_params->proto != HID_PROTOCOL_KEYBOARD)) {
+        // Optional outside boot keyboards, a device that stalls it keeps repeating and is polled less when idle
+        if (hid_class_request_set_idle(hid_device_handle, 0, 0) != ESP_OK) {
+            ESP_LOGD(TAG, "Iface %d does not support SET_IDLE", dev_params->iface_num);
+        }
+    }
+    if (err == ESP_OK && dev_params->sub_class != HID_SUBCLASS_BOOT_INTERFACE) {
+        *report_desc = hid_host_get_report_descriptor(hid_device_handle, report_desc_len);
+        if (!*report_desc) {
+            ESP_LOGW(TAG, "Failed to get report descriptor, iface %d is not routed", dev_params->iface_num);
+        }
+    }
+    return err;
+}
+
 static void hid_host_device_event(
     hid_host_device_handle_t hid_device_handle,
     const hid_host_driver_event_t event,
     void *arg)
 {
+    esp_err_t err = ESP_OK;
+    bool opened = false;
     hid_host_dev_params_t dev_params;
-    ESP_ERROR_CHECK(hid_host_device_get_params(hid_device_handle, &dev_params));
+    if (hid_host_device_get_params(hid_device_handle, &dev_params) != ESP_OK) {
+        // Interface is gone already, e.g. unplugged while the event was queued
+        return;
+    }
 
     switch (event) {
         case HID_HOST_DRIVER_EVENT_CONNECTED:
             ESP_LOGI(TAG, "HID Device, protocol '%s' CONNECTED", hid_proto_name_str[dev_params.proto]);
 
+            usb_app_iface_route_t *route = calloc(1, sizeof(usb_app_iface_route_t));
+            if (!route) {
+                ESP_LOGE(TAG, "Failed to allocate HID interface route!");
+                return;
+            }
+            // Not captured until the setup attached it, a close before that must not detach channel 0
+            route->capture_channel = -1;
+
             const hid_host_device_config_t dev_config = {
                 .callback = hid_host_interface_callback,
-                .callback_arg = NULL
+                .callback_arg = route
             };
 
-            ESP_ERROR_CHECK(hid_host_device_open(hid_device_handle, &dev_config));
-            if (dev_params.sub_class == HID_SUBCLASS_BOOT_INTERFACE) {
-                hid_report_protocol_t protocol = HID_REPORT_PROTOCOL_REPORT;
-                ESP_ERROR_CHECK(hid_class_request_get_protocol(hid_device_handle, &protocol));
-
-                if (dev_params.proto == HID_PROTOCOL_KEYBOARD) {
-                    ESP_ERROR_CHECK(hid_class_request_set_idle(hid_device_handle, 0, 0));
+            const uint8_t *report_desc = NULL;
+            size_t report_desc_len = 0;
+            uint32_t failures;
+            // A failed attempt runs again in place until its device failed USB_APP_SETUP_MAX_FAILURES times or is gone
+            while (1) {
+                if (!opened) {
+                    err = hid_host_device_open(hid_device_handle, &dev_config);
+                    if (err == ESP_ERR_INVALID_STATE) {
+                        // Opened already: a handle reused by a replugged interface whose event another worker ran first
+                        free(route);
+                        return;
+                    }
+                    opened = err == ESP_OK;
                 }
+                if (opened) {
+                    err = usb_app_iface_prepare(hid_device_handle, &dev_params, &report_desc, &report_desc_len);
+                }
+                if (err == ESP_OK) break;
+
+                const bool counted = hid_host_device_count_failure(hid_device_handle, &failures) == ESP_OK;
+                const bool given_up = counted && failures >= USB_APP_SETUP_MAX_FAILURES;
+                portENTER_CRITICAL(&usb_app_recovery_lock);
+                usb_app_recovery_stats.setup_failed++;
+                if (given_up) usb_app_recovery_stats.setup_given_up++;
+                portEXIT_CRITICAL(&usb_app_recovery_lock);
+                if (!counted || given_up) break;
+                const uint32_t retry_ms = USB_APP_SETUP_RETRY_MS << (failures - 1);
+                ESP_LOGW(TAG, "HID Device setup failed: %s, iface %d retried in %lu ms",
+                         esp_err_to_name(err), dev_params.iface_num, retry_ms);
+                vTaskDelay(pdMS_TO_TICKS(retry_ms));
             }
-            ESP_ERROR_CHECK(hid_host_device_start(hid_device_handle));
+
+            if (err == ESP_OK) {
+                usb_app_router_build(route, &dev_params, report_desc, report_desc_len, usb_app_report_handlers);
+                usb_app_capture_on_attach(route, hid_device_handle, report_desc, report_desc_len);
+                bool started;
+                err = usb_app_device_add(hid_device_handle, route, &started);
+                if (started) usb_app_vbus_on_ready(false);
+            } else if (!opened) {
+                free(route);
+            }
+            // The route stays with the opened interface and is freed on DISCONNECTED
             break;
         default:
-            break;
+            return;
+    }
+
+    if (err != ESP_OK) {
+        // Only this interface is closed, the other ones and the stack stay up
+        ESP_LOGE(TAG, "HID Device setup failed: %s, iface %d closed", esp_err_to_name(err), dev_params.iface_num);
+        // The close raises DISCONNECTED, which unlists the interface and frees its route
+        if (opened && hid_host_device_close(hid_device_handle) != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to close HID Device!");
+        }
     }
 }
 
@@ -235,6 +1478,7 @@ static void hid_host_device_callback(
 {
     const usb_app_event_queue_t evt_queue = {
         .event_group = USB_APP_EVENT_HID_HOST,
+        .timestamp_us = esp_timer_get_time(),
         .hid_host_device = {
             .handle = hid_device_handle,
             .event = event,
@@ -242,23 +1486,254 @@ static void hid_host_device_callback(
         }
     };
 
-    if (usb_app_event_queue) {
-        xQueueSend(usb_app_event_queue, &evt_queue, 0);
+    if (event != HID_HOST_DRIVER_EVENT_CONNECTED) return;
+
+    // Class requests can not run inside the client callback. Entries of unplugged interfaces fill the set only
+    // until the next purge, the listed interfaces alone never exceed it.
+    if (!usb_app_connected_insert(&evt_queue)) {
+        usb_app_connected_purge();
+        if (!usb_app_connected_insert(&evt_queue)) {
+            ESP_LOGE(TAG, "USB app connected events full, HID event %d lost!", event);
+            return;
+        }
+    }
+#if !USB_APP_UNIFIED_EVENT_LOOP
+    // Wakes a worker, a full queue has a wake queued already and every worker drains the whole set
+    if (usb_app_event_queue) xQueueSend(usb_app_event_queue, &evt_queue, 0);
+#endif
+}
+
+static void usb_app_handle_event(const usb_app_event_queue_t *evt_queue) {
+    const uint32_t latency_us = esp_timer_get_time() - evt_queue->timestamp_us;
+    usb_app_event_stats.event_count++;
+    usb_app_event_stats.event_latency_sum_us += latency_us;
+    if (latency_us > usb_app_event_stats.event_latency_max_us) {
+        usb_app_event_stats.event_latency_max_us = latency_us;
+    }
+
+    uint8_t dev_addr;
+    switch (evt_queue->event_group) {
+        case USB_APP_EVENT_HID_HOST:
+            // An interface unplugged while its event was pending can not be held. One unplugged during its setup
+            // stays valid, the driver disconnects it with the last unhold.
+            if (hid_host_device_hold(evt_queue->hid_host_device.handle, &dev_addr) != ESP_OK) break;
+            hid_host_device_event(
+            evt_queue->hid_host_device.handle,
+            evt_queue->hid_host_device.event,
+            evt_queue->hid_host_device.arg);
+            hid_host_device_unhold(dev_addr);
+        break;
+        case USB_APP_EVENT_LISTENERS:
+            usb_app_apply_listening();
+        break;
+    }
+}
+
+/* Runs the CONNECTED events not handled yet and a pending listener change, called with a token held */
+static void usb_app_handle_pending() {
+    usb_app_event_queue_t evt_queue;
+    while (usb_app_connected_take(&evt_queue)) {
+        usb_app_handle_event(&evt_queue);
+    }
+
+    if (atomic_load(&usb_app_listening_pending)) usb_app_apply_listening();
+}
+
+#if !USB_APP_UNIFIED_EVENT_LOOP
+static void enum_task(void *args) {
+    usb_app_event_queue_t evt_queue;
+    while (1) {
+        if (xQueueReceive(usb_app_event_queue, &evt_queue, portMAX_DELAY)) {
+            usb_app_event_stats.queue_hops++;
+            xSemaphoreTake(usb_app_enum_tokens, portMAX_DELAY);
+            // Wakes carry no event, the set holds them and is empty after a teardown dropped the stack
+            if (evt_queue.event_group == USB_APP_EVENT_LISTENERS) usb_app_handle_event(&evt_queue);
+            usb_app_handle_pending();
+            xSemaphoreGive(usb_app_enum_tokens);
+        }
+    }
+}
+#endif
+
+#if USB_APP_UNIFIED_EVENT_LOOP
+/*
+ * HID client of the stack the daemon installed. The host library has no hook to notify a task, so this blocks on
+ * the client events alone: IN transfers complete there, control transfers and new devices once the daemon handled
+ * the library, and the daemon unblocks it for listener changes.
+ */
+static void unified_task(void *args) {
+    ESP_LOGI(TAG, "Starting USB unified event task...");
+
+    while (1) {
+        // One notification per installed stack
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Teardown holds the token, the driver is either up or gone here but never going away
+        xSemaphoreTake(usb_app_enum_tokens, portMAX_DELAY);
+        esp_err_t err = hid_host_handle_events(0);
+        xSemaphoreGive(usb_app_enum_tokens);
+
+        while (err == ESP_OK || err == ESP_ERR_TIMEOUT) {
+            if (err == ESP_OK) usb_app_event_stats.client_wakeups++;
+            // Without the token a teardown runs, the driver uninstall ends the wait below
+            if (xSemaphoreTake(usb_app_enum_tokens, 0) == pdTRUE) {
+                usb_app_handle_pending();
+                xSemaphoreGive(usb_app_enum_tokens);
+            }
+            err = hid_host_handle_events(portMAX_DELAY);
+        }
+        // Events of a stack that is gone
+        usb_app_connected_clear();
+    }
+}
+#endif
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+static bool usb_app_is_usb_task(const char *task_name) {
+    return strncmp(task_name, "usb_", 4) == 0 ||
+           strcmp(task_name, "daemon_task") == 0 ||
+           strcmp(task_name, "USB HID Host") == 0;
+}
+
+#endif
+
+/* Report rates of the attached interfaces per state, each report is one wakeup of the USB tasks */
+static void usb_app_log_poll_stats() {
+    const uint32_t now_ms = esp_timer_get_time() / 1000;
+    usb_app_poll_stats_t total = { 0 };
+    size_t interfaces = 0;
+
+    xSemaphoreTake(usb_app_devices_mutex, portMAX_DELAY);
+    portENTER_CRITICAL(&usb_app_poll_lock);
+    for (size_t i = 0; i < HID_HOST_MAX_INTERFACES; i++) {
+        if (!usb_app_devices[i].route) continue;
+        usb_app_poll_stats_t stats;
+        usb_app_poll_get_stats(&usb_app_devices[i].route->poll, now_ms, &stats);
+        total.repeats += stats.repeats;
+        total.idle_periods += stats.idle_periods;
+        total.deferred += stats.deferred;
+        total.active_reports += stats.active_reports;
+        total.idle_reports += stats.idle_reports;
+        total.active_ms += stats.active_ms;
+        total.idle_ms += stats.idle_ms;
+        interfaces++;
+    }
+    const size_t active = usb_app_poll_active;
+    portEXIT_CRITICAL(&usb_app_poll_lock);
+    xSemaphoreGive(usb_app_devices_mutex);
+
+    ESP_LOGI(TAG, "USB polling: %u of %u interfaces active | reports/s active %llu, idle %llu | "
+             "repeats %lu, deferred %lu, idle periods %lu",
+             (unsigned) active, (unsigned) interfaces,
+             total.active_ms ? total.active_reports * 1000ULL / total.active_ms : 0,
+             total.idle_ms ? total.idle_reports * 1000ULL / total.idle_ms : 0,
+             total.repeats, total.deferred, total.idle_periods);
+}
+
+static void usb_app_log_event_stats(TimerHandle_t timer) {
+    const usb_app_event_stats_t stats = usb_app_event_stats;
+    const uint32_t latency_avg_us = stats.event_count ? stats.event_latency_sum_us / stats.event_count : 0;
+    const int64_t idle_since_us = usb_app_idle_since_us;
+    const uint64_t idle_us = stats.idle_us + (idle_since_us ? esp_timer_get_time() - idle_since_us : 0);
+
+    ESP_LOGI(TAG, "USB events (%s): %lu, latency avg %lu us max %lu us | wakeups lib %lu, client %lu, queue hops %lu",
+             USB_APP_UNIFIED_EVENT_LOOP ? "unified" : "queued",
+             stats.event_count, latency_avg_us, stats.event_latency_max_us,
+             stats.lib_wakeups, stats.client_wakeups, stats.queue_hops);
+    const int64_t watch_since_us = usb_app_watch_since_us;
+    const uint64_t watch_us = stats.watch_us + (watch_since_us ? esp_timer_get_time() - watch_since_us : 0);
+
+    // Task run times below are split by this state when comparing load with and without a listener
+    ESP_LOGI(TAG, "USB input %s | paused %lu times, %llu ms in total | wake only %llu ms, %lu wakeups | "
+             "resume max %lu us, wake to host max %lu ms",
+             idle_since_us ? "paused" : watch_since_us ? "waking" : "running", stats.idle_periods, idle_us / 1000,
+             watch_us / 1000, stats.wakeups, stats.resume_max_us, stats.wake_reconnect_max_ms);
+    usb_app_log_poll_stats();
+    usb_app_log_vbus_stats();
+
+#if configUSE_TRACE_FACILITY && configGENERATE_RUN_TIME_STATS
+    static TaskStatus_t task_status[USB_APP_STATS_MAX_TASKS];
+    uint32_t total_run_time = 0;
+    const UBaseType_t task_count = uxTaskGetSystemState(task_status, USB_APP_STATS_MAX_TASKS, &total_run_time);
+
+    for (UBaseType_t i = 0; i < task_count && total_run_time; i++) {
+        if (usb_app_is_usb_task(task_status[i].pcTaskName)) {
+            ESP_LOGI(TAG, "  %-16s run time %lu (%lu.%02lu%%)",
+                     task_status[i].pcTaskName,
+                     task_status[i].ulRunTimeCounter,
+                     (uint32_t)(task_status[i].ulRunTimeCounter * 100ULL / total_run_time),
+                     (uint32_t)(task_status[i].ulRunTimeCounter * 10000ULL / total_run_time % 100));
+        }
+    }
+#endif
+}
+
+static void usb_app_start_event_stats() {
+    if (USB_APP_EVENT_STATS_PERIOD_MS == 0) {
+        return;
+    }
+
+    TimerHandle_t stats_timer = xTimerCreate(
+        "usb_stats",
+        pdMS_TO_TICKS(USB_APP_EVENT_STATS_PERIOD_MS),
+        pdTRUE,
+        NULL,
+        usb_app_log_event_stats
+    );
+    if (!stats_timer || xTimerStart(stats_timer, 0) != pdPASS) {
+        ESP_LOGW(TAG, "Failed to start USB event stats timer!");
     }
 }
 
 void usb_init() {
-    TaskHandle_t daemon_task_handle = NULL;
-    usb_app_event_queue = xQueueCreate(10, sizeof(usb_app_event_queue_t));
+    usb_app_devices_mutex = xSemaphoreCreateMutex();
+    if (!usb_app_devices_mutex) {
+        ESP_LOGE(TAG, "Failed to create USB device list mutex!");
+        esp_restart();
+    }
+    usb_app_poll_setup();
+    usb_app_vbus_setup();
+    usb_app_start_event_stats();
+#if USB_APP_TAPHOLD_ENABLED
+    usb_app_taphold_setup();
+#endif
 
-    // Initialize daemon
+    usb_app_enum_tokens = xSemaphoreCreateCounting(USB_APP_EVENT_WORKERS, USB_APP_EVENT_WORKERS);
+#if USB_APP_UNIFIED_EVENT_LOOP
+    if (!usb_app_enum_tokens) {
+        ESP_LOGE(TAG, "Failed to create USB app event tokens!");
+        esp_restart();
+    }
+
+    const bool unified_task_created = xTaskCreatePinnedToCore(
+        unified_task,
+        "usb_unified",
+        USB_APP_UNIFIED_TASK_STACK_SIZE,
+        NULL,
+        USB_APP_UNIFIED_TASK_PRIORITY,
+        &usb_app_client_task,
+        USB_APP_UNIFIED_TASK_CORE_ID
+    );
+    if (!unified_task_created) {
+        ESP_LOGE(TAG, "Failed to create USB unified task!");
+        esp_restart();
+    }
+#else
+    usb_app_event_queue = xQueueCreate(HID_HOST_MAX_INTERFACES + 1, sizeof(usb_app_event_queue_t));
+    if (!usb_app_event_queue || !usb_app_enum_tokens) {
+        ESP_LOGE(TAG, "Failed to create USB app event queue!");
+        esp_restart();
+    }
+#endif
+
+    // Daemon owns the USB Host Library and HID driver, including their recovery
     const bool daemon_task_created = xTaskCreatePinnedToCore(
         daemon_task,
         "daemon_task",
         USB_APP_DEAMON_TASK_STACK_SIZE,
-        xTaskGetCurrentTaskHandle(),
+        NULL,
         USB_APP_DEAMON_TASK_PRIORITY,
-        &daemon_task_handle,
+        NULL,
         USB_APP_DEAMON_TASK_CORE_ID
     );
     if (!daemon_task_created) {
@@ -266,39 +1741,24 @@ void usb_init() {
         esp_restart();
     }
 
-    // wait until USB Host driver is initialized
-    if (!ulTaskNotifyTake(false, pdMS_TO_TICKS(USB_APP_HID_INIT_TIMEOUT_MS))) {
-        ESP_LOGE(TAG, "TIMEOUT | USB Host Driver was not initialized in time!");
-        esp_restart();
-    }
-
-    const hid_host_driver_config_t hid_host_driver_config = {
-        .create_background_task = true,
-        .task_priority = USB_APP_HID_TASK_PRIORITY,
-        .stack_size =  USB_APP_HID_TASK_STACK_SIZE,
-        .core_id = USB_APP_HID_TASK_CORE_ID,
-        .callback = hid_host_device_callback,
-        .callback_arg = NULL
-    };
-
-    ESP_ERROR_CHECK(hid_host_install(&hid_host_driver_config));
-    xTaskNotifyGive(daemon_task_handle);
-
-    usb_app_event_queue_t evt_queue;
-    while (1) {
-        if (xQueueReceive(usb_app_event_queue, &evt_queue, portMAX_DELAY)) {
-            switch (evt_queue.event_group) {
-                case USB_APP_EVENT_HID_HOST:
-                    hid_host_device_event(
-                    evt_queue.hid_host_device.handle,
-                    evt_queue.hid_host_device.event,
-                    evt_queue.hid_host_device.arg);
-                break;
-            }
+#if !USB_APP_UNIFIED_EVENT_LOOP
+    // Several enumeration workers, so slow control requests of one device do not hold back the others
+    for (int i = 0; i < USB_APP_ENUM_TASK_COUNT; i++) {
+        char task_name[configMAX_TASK_NAME_LEN];
+        snprintf(task_name, sizeof(task_name), "usb_enum_%d", i);
+        const bool enum_task_created = xTaskCreatePinnedToCore(
+            enum_task,
+            task_name,
+            USB_APP_ENUM_TASK_STACK_SIZE,
+            NULL,
+            USB_APP_ENUM_TASK_PRIORITY,
+            NULL,
+            USB_APP_ENUM_TASK_CORE_ID
+        );
+        if (!enum_task_created) {
+            ESP_LOGE(TAG, "Failed to create USB enumeration task!");
+            esp_restart();
         }
     }
-
-    ESP_LOGI(TAG, "USB Driver uninstall");
-    xQueueReset(usb_app_event_queue);
-    vQueueDelete(usb_app_event_queue);
+#endif
 }
\ No newline at end of file
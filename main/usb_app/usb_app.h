@@ -5,13 +5,48 @@
 #ifndef USB_APP_H
 #define USB_APP_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <usb/usb_host.h>
 
 #include "hid_host.h"
+#include "usb_app_keyboard.h"
 
 #define USB_APP_VBUS_GPIO                       21          // GPIO to monitor if usb is connected
-#define USB_APP_HID_INIT_TIMEOUT_MS             60000       // 60 seconds
+#define USB_APP_VBUS_GATING                     1           // Install the USB stack only while VBUS is present, 0 keeps it installed
+#define USB_APP_VBUS_DEBOUNCE_MS                50          // VBUS level must last this long before the stack follows it
+#define USB_APP_VBUS_RECHECK_MS                 500         // Pin read period, the interrupt is lost in light sleep
+#define USB_APP_RECOVERY_BACKOFF_MIN_MS         100         // First reinstall delay after a USB stack failure
+#define USB_APP_RECOVERY_BACKOFF_MAX_MS         5000        // Backoff doubles up to this value
+#define USB_APP_RECOVERY_STABLE_MS              30000       // Stack up this long resets the backoff
+#define USB_APP_RECOVERY_MAX_FAILED             5           // Failed recoveries in a row before esp_restart
+#define USB_APP_RECOVERY_FREE_TIMEOUT_MS        1000        // Wait for devices to be freed on teardown
+#define USB_APP_SETUP_MAX_FAILURES              5           // Failed interface setups of a device before its interface is closed
+#define USB_APP_SETUP_RETRY_MS                  20          // First retry delay of a failed interface setup, doubles per failure
+
+/* When set to 1 one task blocks on the HID client events and handles driver events inline, the daemon keeps the host library */
+#define USB_APP_UNIFIED_EVENT_LOOP              0
+#define USB_APP_EVENT_STATS_PERIOD_MS           60000       // Period of USB event, pause and wake stats log, 0 disables it
+#define USB_APP_STATS_MAX_TASKS                 24
+#define USB_APP_IDLE_WITHOUT_LISTENER           1           // Stop the IN transfers while no BLE host is subscribed to the reports
+#define USB_APP_RESUME_REPORT_MAX               64          // Longest keyboard report read back when the transfers resume
+#define USB_APP_WAKE_ON_INPUT                   1           // While the BLE link is down input only wakes the BLE side, 0 stops it, needs USB_APP_IDLE_WITHOUT_LISTENER
+#define USB_APP_WAKE_POLL_MS                    50          // IN transfer delay while input only wakes
+#define USB_APP_WAKE_HOLDOFF_MS                 1000        // Min gap between two wakes
+#define USB_APP_WAKE_KEEP_KEYS                  1           // Keys typed while the link is down still go out for BT_HID_REPLAY_ENABLED, 0 slows keyboards too
+#define USB_APP_POLL_IDLE_AFTER_MS              2000        // An interface without a changed report this long is idle
+#define USB_APP_POLL_IDLE_INTERVAL_MS           16          // IN transfer delay of idle interfaces, 0 keeps polling at bInterval
+#define USB_APP_POLL_TICK_MS                    250         // Idle check while any interface is active
+#define USB_APP_CAPTURE_ENABLED                 0           // Record raw HID traffic into a RAM ring for usb_app_capture_dump()
+#define USB_APP_CAPTURE_RING_SIZE               16384
+#define USB_APP_KEYMAP_NVS_NAMESPACE            "usb_app"
+#define USB_APP_KEYMAP_NVS_KEY                  "keymap"
+#define USB_APP_KEYMAP_INSTALL_ATTEMPTS         10          // Ticks to wait for the USB task to leave the old keymap
+#define USB_APP_TAPHOLD_ENABLED                 0           // Dual-role keys and combos, see usb_app_taphold_keys in usb_app.c
+#define USB_APP_TAPHOLD_TAPPING_TERM_MS         200         // Held longer than this is a hold
+#define USB_APP_TAPHOLD_COMBO_TERM_MS           40          // Max gap between the two keys of a combo
+#define USB_APP_TAPHOLD_TICK_MS                 5           // Timer wheel tick, decisions fire at most one tick late
 
 /* Main char symbol for ENTER key */
 #define KEYBOARD_ENTER_MAIN_CHAR    '\r'
@@ -79,11 +114,13 @@ static const uint8_t keycode2ascii [57][2] = {
 };
 
 typedef enum {
-    USB_APP_EVENT_HID_HOST = 0
+    USB_APP_EVENT_HID_HOST = 0,
+    USB_APP_EVENT_LISTENERS                                 // BLE side gained its first or lost its last subscriber
 } usb_app_event_group_e;
 
 typedef struct {
     usb_app_event_group_e event_group;
+    int64_t timestamp_us;
     struct {
         hid_host_device_handle_t handle;
         hid_host_driver_event_t event;
@@ -91,21 +128,76 @@ typedef struct {
     } hid_host_device;
 } usb_app_event_queue_t;
 
-typedef struct {
-    enum key_state {
-        KEY_STATE_PRESSED = 0x00,
-        KEY_STATE_RELEASED = 0x01
-    } state;
-    uint8_t modifier;
-    uint8_t key_code;
-} key_event_t;
-
 static const char *hid_proto_name_str[] = {
     "NONE",
     "KEYBOARD",
     "MOUSE"
 };
 
+typedef struct {
+    uint32_t requested;
+    uint32_t recovered;
+    uint32_t failed;
+    uint32_t last_recovery_ms;
+    uint32_t setup_failed;                                  // Failed interface setup attempts, retried in place
+    uint32_t setup_given_up;                                // Interfaces closed after USB_APP_SETUP_MAX_FAILURES
+} usb_app_recovery_stats_t;
+
 void usb_init();
 
+/* Reinstalls the USB Host Library and HID driver in place, NimBLE keeps running */
+void usb_app_request_recovery(const char *reason);
+
+void usb_app_get_recovery_stats(usb_app_recovery_stats_t *stats);
+
+/* Prints the raw HID capture as hex lines prefixed with "UCAP:", see utils/usb-report-bench for replay */
+void usb_app_capture_dump(void);
+
+/* Installs a keymap blob (see usb_app_keymap.h) without pausing input, an empty blob restores the identity keymap */
+esp_err_t usb_app_set_keymap(const uint8_t *blob, size_t length, bool persist);
+
+/* Copies the installed keymap blob, returns its length, 0 for the identity keymap */
+size_t usb_app_get_keymap(uint8_t *blob, size_t max_length);
+
+/* Installs the keymap stored in NVS, call once NVS is initialized */
+esp_err_t usb_app_load_keymap(void);
+
+/* Called from the USB task when a keymap MACRO key is pressed */
+typedef void (*usb_app_macro_cb_t)(uint8_t slot);
+
+void usb_app_set_macro_callback(usb_app_macro_cb_t callback);
+
+/* Called from the USB task for every key press and release that reaches the output, modifiers included */
+typedef void (*usb_app_key_cb_t)(uint8_t key_code, bool pressed);
+
+void usb_app_set_key_callback(usb_app_key_cb_t callback);
+
+/* Called from the USB task for every report of the attached mice */
+typedef void (*usb_app_mouse_cb_t)(uint8_t buttons, int16_t x, int16_t y, int16_t wheel);
+
+void usb_app_set_mouse_callback(usb_app_mouse_cb_t callback);
+
+/* Called from the USB task when input arrives while the BLE link is down */
+typedef void (*usb_app_wake_cb_t)(void);
+
+void usb_app_set_wake_callback(usb_app_wake_cb_t callback);
+
+/**
+ * @brief Pauses or resumes the IN transfers of every attached interface, safe to call from any task
+ *
+ * Called when the first BLE host subscribes to the reports or the last one unsubscribes. Key state is latched while
+ * paused, every keyboard is read once with GET_REPORT of its keyboard report before it resumes.
+ */
+void usb_app_set_listening(bool listening);
+
+/**
+ * @brief Tells whether a BLE host is connected, safe to call from any task
+ *
+ * The USB device can not be suspended, the host library has no bus suspend. While the link is down and nobody
+ * listens the IN transfers run every USB_APP_WAKE_POLL_MS instead, and the first input calls the wake callback
+ * in place of a remote wakeup. With USB_APP_WAKE_KEEP_KEYS keyboards keep their poll rate and their key events
+ * still reach the key callback, for the BLE side to replay to the next host.
+ */
+void usb_app_set_link(bool connected);
+
 #endif //USB_APP_H
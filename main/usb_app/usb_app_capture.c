@@ -0,0 +1,159 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_capture.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static void usb_app_capture_ring_read(const usb_app_capture_t *capture, size_t pos, uint8_t *dst, size_t length) {
+    const size_t first = capture->ring_size - pos < length ? capture->ring_size - pos : length;
+    memcpy(dst, capture->ring + pos, first);
+    memcpy(dst + first, capture->ring, length - first);
+}
+
+static void usb_app_capture_ring_write(usb_app_capture_t *capture, const uint8_t *src, size_t length) {
+    if (!length) return;
+    const size_t first = capture->ring_size - capture->head < length ? capture->ring_size - capture->head : length;
+    memcpy(capture->ring + capture->head, src, first);
+    memcpy(capture->ring, src + first, length - first);
+    capture->head = (capture->head + length) % capture->ring_size;
+    capture->used += length;
+}
+
+static size_t usb_app_capture_tail(const usb_app_capture_t *capture) {
+    return (capture->head + capture->ring_size - capture->used) % capture->ring_size;
+}
+
+static void usb_app_capture_append(usb_app_capture_t *capture,
+                                   uint8_t type,
+                                   int channel,
+                                   const uint8_t *payload,
+                                   size_t length,
+                                   uint32_t timestamp_us) {
+    const size_t record_len = sizeof(usb_app_capture_record_header_t) + length;
+    if (!capture->ring || record_len > capture->ring_size) return;
+
+    // Make room by dropping the oldest records
+    while (capture->ring_size - capture->used < record_len) {
+        usb_app_capture_record_header_t oldest;
+        usb_app_capture_ring_read(capture, usb_app_capture_tail(capture), (uint8_t *) &oldest, sizeof(oldest));
+        capture->used -= sizeof(oldest) + oldest.length;
+        capture->dropped_records++;
+    }
+
+    const usb_app_capture_record_header_t header = {
+        .type = type,
+        .channel = channel,
+        .length = length,
+        .timestamp_us = timestamp_us
+    };
+    usb_app_capture_ring_write(capture, (const uint8_t *) &header, sizeof(header));
+    usb_app_capture_ring_write(capture, payload, length);
+}
+
+void usb_app_capture_init(usb_app_capture_t *capture, uint8_t *ring, size_t ring_size) {
+    memset(capture, 0, sizeof(usb_app_capture_t));
+    capture->ring = ring;
+    capture->ring_size = ring_size;
+}
+
+void usb_app_capture_reset(usb_app_capture_t *capture) {
+    for (int i = 0; i < capture->channel_count; i++) {
+        free(capture->channels[i]);
+    }
+    usb_app_capture_init(capture, capture->ring, capture->ring_size);
+}
+
+usb_app_capture_channel_t *usb_app_capture_alloc_channel(void) {
+    return malloc(sizeof(usb_app_capture_channel_t));
+}
+
+int usb_app_capture_attach(usb_app_capture_t *capture,
+                           usb_app_capture_channel_t *channel,
+                           const usb_app_capture_attach_t *attach,
+                           const uint8_t *report_desc,
+                           size_t report_desc_len,
+                           uint32_t timestamp_us) {
+    if (!channel || capture->channel_count >= USB_APP_CAPTURE_CHANNELS_MAX) return -1;
+
+    if (report_desc_len > USB_APP_CAPTURE_DESC_MAX) report_desc_len = USB_APP_CAPTURE_DESC_MAX;
+    if (!report_desc) report_desc_len = 0;
+
+    const int num = capture->channel_count++;
+    channel->header.type = USB_APP_CAPTURE_RECORD_ATTACH;
+    channel->header.channel = num;
+    channel->header.length = sizeof(usb_app_capture_attach_t) + report_desc_len;
+    channel->header.timestamp_us = timestamp_us;
+    memcpy(channel->payload, attach, sizeof(usb_app_capture_attach_t));
+    if (report_desc_len) {
+        memcpy(channel->payload + sizeof(usb_app_capture_attach_t), report_desc, report_desc_len);
+    }
+    capture->channels[num] = channel;
+    return num;
+}
+
+void usb_app_capture_input(usb_app_capture_t *capture, int channel, const uint8_t *data, size_t length, uint32_t timestamp_us) {
+    if (channel < 0) return;
+    usb_app_capture_append(capture, USB_APP_CAPTURE_RECORD_INPUT, channel, data, length, timestamp_us);
+}
+
+void usb_app_capture_detach(usb_app_capture_t *capture, int channel, uint32_t timestamp_us) {
+    if (channel < 0) return;
+    usb_app_capture_append(capture, USB_APP_CAPTURE_RECORD_DETACH, channel, NULL, 0, timestamp_us);
+}
+
+size_t usb_app_capture_size(const usb_app_capture_t *capture) {
+    size_t size = sizeof(usb_app_capture_file_header_t) + capture->used;
+    for (int i = 0; i < capture->channel_count; i++) {
+        size += sizeof(usb_app_capture_record_header_t) + capture->channels[i]->header.length;
+    }
+    return size;
+}
+
+void usb_app_capture_export(const usb_app_capture_t *capture, usb_app_capture_writer_t writer, void *arg) {
+    usb_app_capture_file_header_t header = {
+        .version = USB_APP_CAPTURE_VERSION,
+        .channel_count = capture->channel_count,
+        .dropped_records = capture->dropped_records
+    };
+    memcpy(header.magic, USB_APP_CAPTURE_MAGIC, sizeof(header.magic));
+    writer((const uint8_t *) &header, sizeof(header), arg);
+
+    for (int i = 0; i < capture->channel_count; i++) {
+        const usb_app_capture_channel_t *channel = capture->channels[i];
+        writer((const uint8_t *) channel, sizeof(channel->header) + channel->header.length, arg);
+    }
+
+    // Ring contents in at most two chunks
+    const size_t tail = usb_app_capture_tail(capture);
+    const size_t first = capture->ring_size - tail < capture->used ? capture->ring_size - tail : capture->used;
+    if (first) writer(capture->ring + tail, first, arg);
+    if (capture->used - first) writer(capture->ring, capture->used - first, arg);
+}
+
+bool usb_app_capture_next_record(const uint8_t *data,
+                                 size_t length,
+                                 size_t *offset,
+                                 usb_app_capture_record_header_t *header,
+                                 const uint8_t **payload) {
+    if (*offset == 0) {
+        usb_app_capture_file_header_t file_header;
+        if (length < sizeof(file_header)) return false;
+        memcpy(&file_header, data, sizeof(file_header));
+        if (memcmp(file_header.magic, USB_APP_CAPTURE_MAGIC, sizeof(file_header.magic)) != 0 ||
+            file_header.version != USB_APP_CAPTURE_VERSION) {
+            return false;
+        }
+        *offset = sizeof(file_header);
+    }
+
+    if (length - *offset < sizeof(usb_app_capture_record_header_t)) return false;
+    memcpy(header, data + *offset, sizeof(usb_app_capture_record_header_t));
+    if (length - *offset - sizeof(usb_app_capture_record_header_t) < header->length) return false;
+
+    *payload = data + *offset + sizeof(usb_app_capture_record_header_t);
+    *offset += sizeof(usb_app_capture_record_header_t) + header->length;
+    return true;
+}
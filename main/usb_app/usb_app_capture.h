@@ -0,0 +1,133 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_CAPTURE_H
+#define USB_APP_CAPTURE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hid_host.h"
+
+/*
+ * Binary capture of raw USB HID traffic, replayed on the host by utils/usb-report-bench.
+ *
+ * A capture is a file header followed by records, all fields little endian:
+ *
+ *   header  | magic "UCAP" | version u8 | channel count u8 | reserved u16 | dropped records u32 |
+ *   record  | type u8 | channel u8 | payload length u16 | timestamp_us u32 | payload |
+ *
+ * Every HID interface seen gets a channel. ATTACH records of all channels come first, their payload is
+ * usb_app_capture_attach_t followed by the report descriptor. INPUT records carry one raw input report as
+ * read from the interrupt IN transfer, DETACH records have no payload. Timestamps are the low 32 bits of
+ * the microsecond clock, only differences between them are meaningful.
+ */
+
+#define USB_APP_CAPTURE_MAGIC                   "UCAP"
+#define USB_APP_CAPTURE_VERSION                 1
+#define USB_APP_CAPTURE_CHANNELS_MAX            32          // Interfaces attached after this are not captured
+#define USB_APP_CAPTURE_DESC_MAX                512         // Longer report descriptors are truncated
+
+typedef enum {
+    USB_APP_CAPTURE_RECORD_ATTACH = 1,
+    USB_APP_CAPTURE_RECORD_INPUT,
+    USB_APP_CAPTURE_RECORD_DETACH
+} usb_app_capture_record_type_e;
+
+typedef struct {
+    char magic[4];
+    uint8_t version;
+    uint8_t channel_count;
+    uint16_t reserved;
+    uint32_t dropped_records;
+} __attribute__((packed)) usb_app_capture_file_header_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t channel;
+    uint16_t length;
+    uint32_t timestamp_us;
+} __attribute__((packed)) usb_app_capture_record_header_t;
+
+typedef struct {
+    uint8_t addr;
+    uint8_t iface_num;
+    uint8_t sub_class;
+    uint8_t proto;
+    uint16_t vid;
+    uint16_t pid;
+} __attribute__((packed)) usb_app_capture_attach_t;
+
+typedef struct {
+    usb_app_capture_record_header_t header;
+    uint8_t payload[sizeof(usb_app_capture_attach_t) + USB_APP_CAPTURE_DESC_MAX];
+} usb_app_capture_channel_t;
+
+/* Records overwrite the oldest ones once the ring is full, attach records are kept aside and never lost */
+typedef struct {
+    uint8_t *ring;
+    size_t ring_size;
+    size_t head;
+    size_t used;
+    uint32_t dropped_records;
+    uint8_t channel_count;
+    usb_app_capture_channel_t *channels[USB_APP_CAPTURE_CHANNELS_MAX];
+} usb_app_capture_t;
+
+typedef void (*usb_app_capture_writer_t)(const uint8_t *data, size_t length, void *arg);
+
+void usb_app_capture_init(usb_app_capture_t *capture, uint8_t *ring, size_t ring_size);
+
+/* Drops all records and channels */
+void usb_app_capture_reset(usb_app_capture_t *capture);
+
+/**
+ * @brief Start capturing one HID interface
+ *
+ * @param[in] channel           Channel returned by usb_app_capture_alloc_channel()
+ * @return Channel number to pass to the other calls, -1 when all channels are taken
+ */
+int usb_app_capture_attach(usb_app_capture_t *capture,
+                           usb_app_capture_channel_t *channel,
+                           const usb_app_capture_attach_t *attach,
+                           const uint8_t *report_desc,
+                           size_t report_desc_len,
+                           uint32_t timestamp_us);
+
+/* Channel storage is allocated outside of the caller's lock and owned by the capture after a successful attach */
+usb_app_capture_channel_t *usb_app_capture_alloc_channel(void);
+
+void usb_app_capture_input(usb_app_capture_t *capture, int channel, const uint8_t *data, size_t length, uint32_t timestamp_us);
+
+void usb_app_capture_detach(usb_app_capture_t *capture, int channel, uint32_t timestamp_us);
+
+/* Size of the exported capture in bytes */
+size_t usb_app_capture_size(const usb_app_capture_t *capture);
+
+/**
+ * @brief Write the whole capture, oldest record first
+ *
+ * @param[in] writer    Called with consecutive chunks of the capture
+ * @param[in] arg       Passed to the writer
+ */
+void usb_app_capture_export(const usb_app_capture_t *capture, usb_app_capture_writer_t writer, void *arg);
+
+/**
+ * @brief Read the next record of an exported capture
+ *
+ * @param[in] data          Exported capture
+ * @param[in] length        Length of the exported capture
+ * @param[in,out] offset    Start with 0, advanced past the returned record
+ * @param[out] header       Record header
+ * @param[out] payload      Record payload, points into data
+ * @return true when a complete record was read
+ */
+bool usb_app_capture_next_record(const uint8_t *data,
+                                 size_t length,
+                                 size_t *offset,
+                                 usb_app_capture_record_header_t *header,
+                                 const uint8_t **payload);
+
+#endif //USB_APP_CAPTURE_H
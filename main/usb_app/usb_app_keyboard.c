@@ -0,0 +1,169 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_keyboard.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+static inline bool key_bit(const uint8_t *bits, uint8_t key) {
+    return bits[key >> 3] & (1 << (key & 7));
+}
+
+/* Without a merge every event is passed on, with one only the first press and the last release of a usage */
+static inline void usb_app_keyboard_emit(usb_app_keyboard_merge_t *merge,
+                                         const key_event_t *key_event,
+                                         usb_app_keyboard_event_cb_t callback,
+                                         void *arg) {
+    if (merge) {
+        uint8_t *refs = &merge->refs[key_event->key_code];
+        if (key_event->state == KEY_STATE_PRESSED) {
+            if ((*refs)++ > 0) return;
+        } else {
+            if (*refs == 0 || --(*refs) > 0) return;
+        }
+    }
+    callback(key_event, arg);
+}
+
+static inline void usb_app_keyboard_diff(usb_app_keyboard_merge_t *merge,
+                                         usb_app_keyboard_state_t *state,
+                                         const hid_keyboard_input_report_boot_t *report,
+                                         usb_app_keyboard_event_cb_t callback,
+                                         void *arg) {
+    key_event_t key_event;
+
+    const uint8_t modifier_changed = state->prev_modifier ^ report->modifier.val;
+    for (int bit = 0; bit < 8; bit++) {
+        if (!(modifier_changed & (1 << bit))) continue;
+        key_event.key_code = HID_KEY_LEFT_CONTROL + bit;
+        key_event.modifier = report->modifier.val;
+        key_event.state = (report->modifier.val & (1 << bit)) ? KEY_STATE_PRESSED : KEY_STATE_RELEASED;
+        usb_app_keyboard_emit(merge, &key_event, callback, arg);
+    }
+    state->prev_modifier = report->modifier.val;
+
+    // Bitmap of the new report, every key is then looked up with one bit test instead of a scan
+    uint8_t bits[sizeof(state->prev_bits)] = { 0 };
+    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) {
+        const uint8_t key = report->key[i];
+        if (key > HID_KEY_ERROR_UNDEFINED) bits[key >> 3] |= 1 << (key & 7);
+    }
+
+    for (int i = 0; i < HID_KEYBOARD_KEY_MAX; i++) {
+        // Key has been released
+        if (state->prev_keys[i] > HID_KEY_ERROR_UNDEFINED && !key_bit(bits, state->prev_keys[i])) {
+            key_event.key_code = state->prev_keys[i];
+            key_event.modifier = 0;
+            key_event.state = KEY_STATE_RELEASED;
+            usb_app_keyboard_emit(merge, &key_event, callback, arg);
+        }
+
+        // Key has been pressed
+        if (report->key[i] > HID_KEY_ERROR_UNDEFINED && !key_bit(state->prev_bits, report->key[i])) {
+            key_event.key_code = report->key[i];
+            key_event.modifier = report->modifier.val;
+            key_event.state = KEY_STATE_PRESSED;
+            usb_app_keyboard_emit(merge, &key_event, callback, arg);
+        }
+    }
+
+    memcpy(state->prev_keys, report->key, HID_KEYBOARD_KEY_MAX);
+    memcpy(state->prev_bits, bits, sizeof(bits));
+}
+
+void usb_app_keyboard_process_report(usb_app_keyboard_state_t *state,
+                                     const hid_keyboard_input_report_boot_t *report,
+                                     usb_app_keyboard_event_cb_t callback,
+                                     void *arg) {
+    usb_app_keyboard_diff(NULL, state, report, callback, arg);
+}
+
+void usb_app_keyboard_layout_boot(usb_app_keyboard_layout_t *layout) {
+    *layout = (usb_app_keyboard_layout_t) {
+        .boot = true,
+        .length = sizeof(hid_keyboard_input_report_boot_t),
+        .keys = { offsetof(hid_keyboard_input_report_boot_t, key) * 8, HID_KEYBOARD_KEY_MAX, 0 },
+        .bitmaps = { { 0, 8, HID_KEY_LEFT_CONTROL } },
+    };
+}
+
+static inline bool usb_app_keyboard_field_equal(const usb_app_keyboard_field_t *a, const usb_app_keyboard_field_t *b) {
+    return a->count == b->count && (a->count == 0 || (a->offset == b->offset && a->usage_min == b->usage_min));
+}
+
+bool usb_app_keyboard_layout_finish(usb_app_keyboard_layout_t *layout, uint32_t bits) {
+    usb_app_keyboard_layout_t boot;
+    usb_app_keyboard_layout_boot(&boot);
+    layout->length = (bits + 7) / 8;
+    // Reports may carry more after the boot fields
+    layout->boot = layout->length >= boot.length && usb_app_keyboard_field_equal(&layout->keys, &boot.keys);
+    for (int b = 0; b < USB_APP_KEYBOARD_LAYOUT_BITMAPS; b++) {
+        layout->boot = layout->boot && usb_app_keyboard_field_equal(&layout->bitmaps[b], &boot.bitmaps[b]);
+    }
+    return layout->keys.count || layout->bitmaps[0].count;
+}
+
+static inline bool usb_app_keyboard_report_bit(const uint8_t *report, uint32_t offset) {
+    return report[offset >> 3] & (1 << (offset & 7));
+}
+
+/* Call with a report at least as long as the layout */
+static inline uint8_t usb_app_keyboard_report_byte(const uint8_t *report, uint32_t offset) {
+    if ((offset & 7) == 0) return report[offset >> 3];
+    const uint32_t last = (offset + 7) >> 3;
+    return (report[offset >> 3] >> (offset & 7)) | (report[last] << (8 - (offset & 7)));
+}
+
+static inline void usb_app_keyboard_boot_add(hid_keyboard_input_report_boot_t *boot, int *keys, uint8_t usage) {
+    if (usage >= HID_KEY_LEFT_CONTROL && usage <= HID_KEY_LEFT_CONTROL + 7) {
+        boot->modifier.val |= 1 << (usage - HID_KEY_LEFT_CONTROL);
+    } else if (usage > HID_KEY_ERROR_UNDEFINED && *keys < HID_KEYBOARD_KEY_MAX) {
+        boot->key[(*keys)++] = usage;
+    }
+}
+
+const hid_keyboard_input_report_boot_t *usb_app_keyboard_to_boot(const usb_app_keyboard_layout_t *layout,
+                                                                 const uint8_t *report,
+                                                                 size_t length,
+                                                                 hid_keyboard_input_report_boot_t *boot) {
+    if (length < layout->length) return NULL;
+    if (layout->boot) return (const hid_keyboard_input_report_boot_t *) report;
+
+    memset(boot, 0, sizeof(*boot));
+    int keys = 0;
+    for (uint16_t i = 0; i < layout->keys.count; i++) {
+        usb_app_keyboard_boot_add(boot, &keys, usb_app_keyboard_report_byte(report, layout->keys.offset + i * 8));
+    }
+    for (int b = 0; b < USB_APP_KEYBOARD_LAYOUT_BITMAPS; b++) {
+        const usb_app_keyboard_field_t *bitmap = &layout->bitmaps[b];
+        for (uint16_t i = 0; i < bitmap->count; i++) {
+            if (usb_app_keyboard_report_bit(report, bitmap->offset + i)) {
+                usb_app_keyboard_boot_add(boot, &keys, bitmap->usage_min + i);
+            }
+        }
+    }
+    return boot;
+}
+
+void usb_app_keyboard_merge_init(usb_app_keyboard_merge_t *merge) {
+    memset(merge, 0, sizeof(*merge));
+}
+
+void usb_app_keyboard_merge_report(usb_app_keyboard_merge_t *merge,
+                                   usb_app_keyboard_state_t *state,
+                                   const hid_keyboard_input_report_boot_t *report,
+                                   usb_app_keyboard_event_cb_t callback,
+                                   void *arg) {
+    usb_app_keyboard_diff(merge, state, report, callback, arg);
+}
+
+void usb_app_keyboard_merge_detach(usb_app_keyboard_merge_t *merge,
+                                   usb_app_keyboard_state_t *state,
+                                   usb_app_keyboard_event_cb_t callback,
+                                   void *arg) {
+    const hid_keyboard_input_report_boot_t released = { 0 };
+    usb_app_keyboard_diff(merge, state, &released, callback, arg);
+}
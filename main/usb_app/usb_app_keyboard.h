@@ -0,0 +1,120 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_KEYBOARD_H
+#define USB_APP_KEYBOARD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hid_usage_keyboard.h"
+
+/* Keyboard report processing */
+
+typedef struct {
+    enum key_state {
+        KEY_STATE_PRESSED = 0x00,
+        KEY_STATE_RELEASED = 0x01
+    } state;
+    uint8_t modifier;
+    uint8_t key_code;
+} key_event_t;
+
+typedef void (*usb_app_keyboard_event_cb_t)(const key_event_t *key_event, void *arg);
+
+typedef struct {
+    uint8_t prev_keys[HID_KEYBOARD_KEY_MAX];
+    uint8_t prev_bits[32];          // prev_keys as one bit per usage
+    uint8_t prev_modifier;
+} usb_app_keyboard_state_t;
+
+/**
+ * @brief Compare a boot keyboard report with the previous one and report every press and release
+ *
+ * Modifier bits are reported as HID_KEY_LEFT_CONTROL + bit, before the keys of the same report.
+ *
+ * @param[in,out] state     Keys of the previous report, updated with the new one
+ * @param[in] report        New boot keyboard report
+ * @param[in] callback      Called once per changed key
+ * @param[in] arg           Passed to the callback
+ */
+void usb_app_keyboard_process_report(usb_app_keyboard_state_t *state,
+                                     const hid_keyboard_input_report_boot_t *report,
+                                     usb_app_keyboard_event_cb_t callback,
+                                     void *arg);
+
+/*
+ * Where a report protocol keyboard puts its keys, read from the report descriptor. Modifiers are a bitmap of
+ * 0xE0-0xE7 or part of a larger bitmap, keys are an array of usages, a bitmap (NKRO) or both.
+ */
+#define USB_APP_KEYBOARD_LAYOUT_BITMAPS     2
+
+typedef struct {
+    uint16_t offset;                // In bits, after the Report ID
+    uint16_t count;                 // Usages of a bitmap or entries of an array, 0 if the field is absent
+    uint8_t usage_min;              // Usage of the first bit of a bitmap
+} usb_app_keyboard_field_t;
+
+typedef struct {
+    bool boot;                      // Boot layout, reports are used as they come
+    uint16_t length;                // Report length in bytes, shorter reports are dropped
+    usb_app_keyboard_field_t keys;  // 8 bit usages
+    usb_app_keyboard_field_t bitmaps[USB_APP_KEYBOARD_LAYOUT_BITMAPS];
+} usb_app_keyboard_layout_t;
+
+/* Layout of boot interfaces and of reports that keep the boot fields in place */
+void usb_app_keyboard_layout_boot(usb_app_keyboard_layout_t *layout);
+
+/**
+ * @brief Completes a layout read from a report descriptor
+ *
+ * @param[in] bits  Length of the input report in bits
+ * @return false if the report carries no keys
+ */
+bool usb_app_keyboard_layout_finish(usb_app_keyboard_layout_t *layout, uint32_t bits);
+
+/**
+ * @brief Boot keyboard report of a report in the given layout
+ *
+ * A bitmap can hold more keys than the six of a boot report, the ones past the sixth are left out until a key
+ * before them is released.
+ *
+ * @param[out] boot     Filled unless the layout is the boot layout
+ * @return The report itself for the boot layout, boot otherwise, NULL if the report is too short
+ */
+const hid_keyboard_input_report_boot_t *usb_app_keyboard_to_boot(const usb_app_keyboard_layout_t *layout,
+                                                                 const uint8_t *report,
+                                                                 size_t length,
+                                                                 hid_keyboard_input_report_boot_t *boot);
+
+/* Keys held across all attached keyboards, one reference per keyboard holding the usage */
+typedef struct {
+    uint8_t refs[256];
+} usb_app_keyboard_merge_t;
+
+void usb_app_keyboard_merge_init(usb_app_keyboard_merge_t *merge);
+
+/**
+ * @brief usb_app_keyboard_process_report() for one of several keyboards feeding the same output
+ *
+ * Only the first press and the last release of a usage across all keyboards reach the callback, so a key held
+ * on two keyboards stays down until both release it. Each event costs one counter update.
+ *
+ * @param[in,out] merge     Shared reference counts
+ * @param[in,out] state     Keys of the previous report of this keyboard
+ */
+void usb_app_keyboard_merge_report(usb_app_keyboard_merge_t *merge,
+                                   usb_app_keyboard_state_t *state,
+                                   const hid_keyboard_input_report_boot_t *report,
+                                   usb_app_keyboard_event_cb_t callback,
+                                   void *arg);
+
+/* Drops every key a keyboard still holds, for a keyboard that went away */
+void usb_app_keyboard_merge_detach(usb_app_keyboard_merge_t *merge,
+                                   usb_app_keyboard_state_t *state,
+                                   usb_app_keyboard_event_cb_t callback,
+                                   void *arg);
+
+#endif //USB_APP_KEYBOARD_H
@@ -0,0 +1,173 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_keymap.h"
+
+#include <string.h>
+
+static void usb_app_keymap_fill_identity(uint16_t *entry) {
+    for (int i = 0; i < 256; i++) {
+        entry[i] = USB_APP_KEYMAP_ACTION_KEY | i;
+    }
+}
+
+void usb_app_keymap_init(usb_app_keymap_t *keymap) {
+    memset(keymap, 0, sizeof(*keymap));
+    for (int bank = 0; bank < 2; bank++) {
+        keymap->banks[bank].layer_count = 1;
+        for (int layer = 0; layer < USB_APP_KEYMAP_MAX_LAYERS; layer++) {
+            usb_app_keymap_fill_identity(keymap->banks[bank].entry[layer]);
+        }
+    }
+    // Keys already held when the keymap comes up release as themselves
+    usb_app_keymap_fill_identity(keymap->pressed_as);
+    atomic_init(&keymap->active, 0);
+    atomic_init(&keymap->readers[0], 0);
+    atomic_init(&keymap->readers[1], 0);
+}
+
+int usb_app_keymap_check(const uint8_t *blob, size_t length) {
+    if (length < USB_APP_KEYMAP_HEADER_LEN ||
+        blob[0] != USB_APP_KEYMAP_MAGIC_0 || blob[1] != USB_APP_KEYMAP_MAGIC_1 ||
+        blob[2] != USB_APP_KEYMAP_VERSION) {
+        return -1;
+    }
+    const uint8_t layer_count = blob[3];
+    const uint16_t rule_count = blob[4] | (blob[5] << 8);
+    if (layer_count == 0 || layer_count > USB_APP_KEYMAP_MAX_LAYERS || rule_count > USB_APP_KEYMAP_MAX_RULES ||
+        length != USB_APP_KEYMAP_HEADER_LEN + (size_t) rule_count * USB_APP_KEYMAP_RULE_LEN) {
+        return -1;
+    }
+
+    const uint8_t *rules = blob + USB_APP_KEYMAP_HEADER_LEN;
+    for (uint16_t i = 0; i < rule_count; i++) {
+        const uint8_t *rule = rules + i * USB_APP_KEYMAP_RULE_LEN;
+        if (rule[0] >= layer_count) return -1;
+        switch (rule[1]) {
+            case USB_APP_KEYMAP_RULE_KEY:
+            case USB_APP_KEYMAP_RULE_SWAP:
+            case USB_APP_KEYMAP_RULE_MACRO:
+            break;
+            case USB_APP_KEYMAP_RULE_LAYER:
+                if (rule[3] >= layer_count) return -1;
+            break;
+            default:
+                return -1;
+        }
+    }
+    return 0;
+}
+
+int usb_app_keymap_compile(const uint8_t *blob, size_t length, usb_app_keymap_tables_t *tables) {
+    if (usb_app_keymap_check(blob, length) != 0) return -1;
+
+    const uint8_t layer_count = blob[3];
+    const uint16_t rule_count = blob[4] | (blob[5] << 8);
+    const uint8_t *rules = blob + USB_APP_KEYMAP_HEADER_LEN;
+
+    // Each layer starts as a copy of the one below, layers past layer_count stay copies of the last one
+    tables->layer_count = layer_count;
+    usb_app_keymap_fill_identity(tables->entry[0]);
+    for (uint8_t layer = 0; layer < USB_APP_KEYMAP_MAX_LAYERS; layer++) {
+        uint16_t *entry = tables->entry[layer];
+        if (layer > 0) memcpy(entry, tables->entry[layer - 1], sizeof(tables->entry[0]));
+        if (layer >= layer_count) continue;
+
+        for (uint16_t i = 0; i < rule_count; i++) {
+            const uint8_t *rule = rules + i * USB_APP_KEYMAP_RULE_LEN;
+            if (rule[0] != layer) continue;
+            const uint8_t from = rule[2];
+            const uint8_t to = rule[3];
+            switch (rule[1]) {
+                case USB_APP_KEYMAP_RULE_KEY:
+                    entry[from] = to ? USB_APP_KEYMAP_ACTION_KEY | to : USB_APP_KEYMAP_ACTION_NONE;
+                break;
+                case USB_APP_KEYMAP_RULE_SWAP:
+                    entry[from] = USB_APP_KEYMAP_ACTION_KEY | to;
+                    entry[to] = USB_APP_KEYMAP_ACTION_KEY | from;
+                break;
+                case USB_APP_KEYMAP_RULE_LAYER:
+                    entry[from] = USB_APP_KEYMAP_ACTION_LAYER | to;
+                break;
+                case USB_APP_KEYMAP_RULE_MACRO:
+                    entry[from] = USB_APP_KEYMAP_ACTION_MACRO | to;
+                break;
+                default:
+                break;
+            }
+        }
+    }
+    return 0;
+}
+
+int usb_app_keymap_install(usb_app_keymap_t *keymap, const uint8_t *blob, size_t length) {
+    const unsigned int target = !atomic_load(&keymap->active);
+
+    if (usb_app_keymap_check(blob, length) != 0) return USB_APP_KEYMAP_ERR_INVALID;
+    // A reader that picked the bank before the last flip may still be inside it
+    if (atomic_load(&keymap->readers[target])) return USB_APP_KEYMAP_ERR_BUSY;
+    usb_app_keymap_compile(blob, length, &keymap->banks[target]);
+
+    atomic_store(&keymap->active, target);
+    return 0;
+}
+
+static uint16_t usb_app_keymap_lookup(usb_app_keymap_t *keymap, uint8_t key_code) {
+    unsigned int bank;
+    for (;;) {
+        bank = atomic_load(&keymap->active);
+        atomic_fetch_add(&keymap->readers[bank], 1);
+        // The writer may have flipped between the load and the increment
+        if (atomic_load(&keymap->active) == bank) break;
+        atomic_fetch_sub(&keymap->readers[bank], 1);
+    }
+    const uint16_t entry = keymap->banks[bank].entry[keymap->top_layer][key_code];
+    atomic_fetch_sub(&keymap->readers[bank], 1);
+    return entry;
+}
+
+static void usb_app_keymap_update_top_layer(usb_app_keymap_t *keymap) {
+    keymap->top_layer = 0;
+    for (int layer = USB_APP_KEYMAP_MAX_LAYERS - 1; layer > 0; layer--) {
+        if (keymap->layer_refs[layer]) {
+            keymap->top_layer = layer;
+            break;
+        }
+    }
+}
+
+usb_app_keymap_result_e usb_app_keymap_translate(usb_app_keymap_t *keymap, const key_event_t *in, key_event_t *out) {
+    uint16_t entry;
+    if (in->state == KEY_STATE_PRESSED) {
+        entry = usb_app_keymap_lookup(keymap, in->key_code);
+        keymap->pressed_as[in->key_code] = entry;
+    } else {
+        // Release what was pressed, even if the layer or the keymap changed since
+        entry = keymap->pressed_as[in->key_code];
+        keymap->pressed_as[in->key_code] = USB_APP_KEYMAP_ACTION_KEY | in->key_code;
+    }
+
+    const uint8_t value = entry & 0xFF;
+    switch (entry & 0xFF00) {
+        case USB_APP_KEYMAP_ACTION_KEY:
+            *out = *in;
+            out->key_code = value;
+            return USB_APP_KEYMAP_KEY;
+        case USB_APP_KEYMAP_ACTION_LAYER:
+            if (in->state == KEY_STATE_PRESSED) {
+                if (keymap->layer_refs[value] < UINT8_MAX) keymap->layer_refs[value]++;
+            } else if (keymap->layer_refs[value]) {
+                keymap->layer_refs[value]--;
+            }
+            usb_app_keymap_update_top_layer(keymap);
+            return USB_APP_KEYMAP_DROP;
+        case USB_APP_KEYMAP_ACTION_MACRO:
+            if (in->state != KEY_STATE_PRESSED) return USB_APP_KEYMAP_DROP;
+            *out = *in;
+            out->key_code = value;
+            return USB_APP_KEYMAP_MACRO;
+        default:
+            return USB_APP_KEYMAP_DROP;
+    }
+}
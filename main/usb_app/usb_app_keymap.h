@@ -0,0 +1,110 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_KEYMAP_H
+#define USB_APP_KEYMAP_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "usb_app_keyboard.h"
+
+/*
+ * Key remapping.
+ *
+ * A keymap is written by the user as a list of rules and compiled into one 256 entry table per layer.
+ * Every layer table already contains the layers below it, so translating a key is a single indexed load
+ * from the table of the highest held layer, however many rules the keymap has.
+ *
+ * Keymap blob, as stored in NVS and written over GATT:
+ *      'K' 'M' | version u8 | layer_count u8 | rule_count u16 (little endian) | rule_count * rule |
+ * Rule:
+ *      layer u8 | type u8 | from u8 | to u8 |
+ *      KEY      'from' sends 'to' on this layer and above, 'to' 0 disables the key
+ *      SWAP     'from' and 'to' send each other, e.g. HID_KEY_LEFT_CONTROL and HID_KEY_LEFT_GUI
+ *      LAYER    holding 'from' activates layer 'to'
+ *      MACRO    pressing 'from' types macro slot 'to', see bt_app/bt_device_inject_handlers.h
+ */
+
+#define USB_APP_KEYMAP_MAGIC_0                  'K'
+#define USB_APP_KEYMAP_MAGIC_1                  'M'
+#define USB_APP_KEYMAP_VERSION                  1
+#define USB_APP_KEYMAP_HEADER_LEN               6
+#define USB_APP_KEYMAP_RULE_LEN                 4
+#define USB_APP_KEYMAP_MAX_LAYERS               4
+#define USB_APP_KEYMAP_MAX_RULES                126         // Blob fits the 512 byte GATT attribute limit
+#define USB_APP_KEYMAP_MAX_LEN                  (USB_APP_KEYMAP_HEADER_LEN + USB_APP_KEYMAP_MAX_RULES * USB_APP_KEYMAP_RULE_LEN)
+
+#define USB_APP_KEYMAP_ERR_INVALID              (-1)
+#define USB_APP_KEYMAP_ERR_BUSY                 (-2)
+
+#define USB_APP_KEYMAP_RULE_KEY                 0x01
+#define USB_APP_KEYMAP_RULE_SWAP                0x02
+#define USB_APP_KEYMAP_RULE_LAYER               0x03
+#define USB_APP_KEYMAP_RULE_MACRO               0x04
+
+/* Table entry: low byte is the output usage or layer, high byte the action */
+#define USB_APP_KEYMAP_ACTION_KEY               0x0000
+#define USB_APP_KEYMAP_ACTION_LAYER             0x0100
+#define USB_APP_KEYMAP_ACTION_NONE              0x0200
+#define USB_APP_KEYMAP_ACTION_MACRO             0x0300
+
+typedef enum {
+    USB_APP_KEYMAP_DROP = 0,                    // Key is disabled or switches layers
+    USB_APP_KEYMAP_KEY,                         // Send the translated event
+    USB_APP_KEYMAP_MACRO                        // Macro key pressed, the slot is in key_code
+} usb_app_keymap_result_e;
+
+typedef struct {
+    uint16_t entry[USB_APP_KEYMAP_MAX_LAYERS][256];
+    uint8_t layer_count;
+} usb_app_keymap_tables_t;
+
+/*
+ * Two banks of tables: the reader translates with the active one while a writer compiles into the other
+ * and then flips 'active'. Only one writer at a time, translation runs on one task.
+ */
+typedef struct {
+    usb_app_keymap_tables_t banks[2];
+    atomic_uint active;
+    atomic_uint readers[2];
+
+    /* Reader state */
+    uint16_t pressed_as[256];                   // Entry each held key was pressed with, so it releases the same
+    uint8_t layer_refs[USB_APP_KEYMAP_MAX_LAYERS];
+    uint8_t top_layer;
+} usb_app_keymap_t;
+
+/* Identity keymap on layer 0 */
+void usb_app_keymap_init(usb_app_keymap_t *keymap);
+
+/* Returns 0 if the blob is a well formed keymap, -1 otherwise */
+int usb_app_keymap_check(const uint8_t *blob, size_t length);
+
+/**
+ * @brief Check a keymap blob and compile it into tables
+ *
+ * @return 0 on success, -1 if the blob is malformed
+ */
+int usb_app_keymap_compile(const uint8_t *blob, size_t length, usb_app_keymap_tables_t *tables);
+
+/**
+ * @brief Compile a blob into the inactive bank and make it active, input is not paused
+ *
+ * @return 0 on success, USB_APP_KEYMAP_ERR_INVALID if the blob is malformed,
+ *         USB_APP_KEYMAP_ERR_BUSY if the inactive bank is still being read, try again
+ */
+int usb_app_keymap_install(usb_app_keymap_t *keymap, const uint8_t *blob, size_t length);
+
+/**
+ * @brief Translate one key event
+ *
+ * @param[in] in        Event from the keyboard report diff
+ * @param[out] out      Translated event
+ */
+usb_app_keymap_result_e usb_app_keymap_translate(usb_app_keymap_t *keymap, const key_event_t *in, key_event_t *out);
+
+#endif //USB_APP_KEYMAP_H
@@ -0,0 +1,54 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_mouse.h"
+
+#include "hid_usage_mouse.h"
+
+void usb_app_mouse_layout_boot(usb_app_mouse_layout_t *layout) {
+    // The five bits after the three boot buttons are device specific, mice put buttons 4 and 5 there
+    *layout = (usb_app_mouse_layout_t) {
+        .length = sizeof(hid_mouse_input_report_boot_t),
+        .buttons = { 0, 8 },
+        .x = { offsetof(hid_mouse_input_report_boot_t, x_displacement) * 8, 8 },
+        .y = { offsetof(hid_mouse_input_report_boot_t, y_displacement) * 8, 8 },
+        .wheel = { sizeof(hid_mouse_input_report_boot_t) * 8, 8 },
+    };
+}
+
+bool usb_app_mouse_layout_finish(usb_app_mouse_layout_t *layout, uint32_t bits) {
+    layout->length = (bits + 7) / 8;
+    return layout->x.size && layout->y.size;
+}
+
+/* Call with a report that holds the field */
+static inline uint32_t usb_app_mouse_bits(const uint8_t *report, const usb_app_mouse_field_t *field) {
+    const uint32_t first = field->offset >> 3;
+    const uint32_t last = (field->offset + field->size - 1) >> 3;
+    uint32_t value = 0;
+    for (uint32_t i = last + 1; i-- > first;) {
+        value = value << 8 | report[i];
+    }
+    return (value >> (field->offset & 7)) & ((1u << field->size) - 1);
+}
+
+static inline int16_t usb_app_mouse_axis(const uint8_t *report, size_t length, const usb_app_mouse_field_t *field) {
+    if (!field->size || field->offset + field->size > length * 8) return 0;
+    const uint32_t value = usb_app_mouse_bits(report, field);
+    const uint32_t sign = 1u << (field->size - 1);
+    return (int16_t) ((value ^ sign) - sign);
+}
+
+bool usb_app_mouse_parse(const usb_app_mouse_layout_t *layout,
+                         const uint8_t *report,
+                         size_t length,
+                         usb_app_mouse_report_t *mouse) {
+    if (length < layout->length) return false;
+
+    mouse->buttons = layout->buttons.size ? usb_app_mouse_bits(report, &layout->buttons) : 0;
+    mouse->x = usb_app_mouse_axis(report, length, &layout->x);
+    mouse->y = usb_app_mouse_axis(report, length, &layout->y);
+    mouse->wheel = usb_app_mouse_axis(report, length, &layout->wheel);
+    return true;
+}
@@ -0,0 +1,61 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_MOUSE_H
+#define USB_APP_MOUSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Where a mouse puts its buttons and motion. Boot mice use the fixed boot layout, a report protocol mouse gets the
+ * one its report descriptor gives: buttons are a bitmap, X, Y and the wheel are relative signed fields of 2 to 16
+ * bits anywhere in the report, so 12 and 16 bit mice keep their full motion.
+ */
+#define USB_APP_MOUSE_BUTTONS_MAX           8           // Buttons past the eighth are ignored
+#define USB_APP_MOUSE_AXIS_BITS_MAX         16
+
+typedef struct {
+    uint16_t offset;                // In bits, after the Report ID
+    uint8_t size;                   // In bits, one per button, 0 if the field is absent
+} usb_app_mouse_field_t;
+
+typedef struct {
+    uint16_t length;                // Report length in bytes, shorter reports are dropped
+    usb_app_mouse_field_t buttons;
+    usb_app_mouse_field_t x;
+    usb_app_mouse_field_t y;
+    usb_app_mouse_field_t wheel;    // Read only if the report is long enough, boot mice may append one
+} usb_app_mouse_layout_t;
+
+typedef struct {
+    uint8_t buttons;                // Button 1 in bit 0
+    int16_t x;
+    int16_t y;
+    int16_t wheel;
+} usb_app_mouse_report_t;
+
+/* Layout of boot interfaces: buttons, X and Y of 8 bits, then an optional wheel byte */
+void usb_app_mouse_layout_boot(usb_app_mouse_layout_t *layout);
+
+/**
+ * @brief Completes a layout read from a report descriptor
+ *
+ * @param[in] bits  Length of the input report in bits
+ * @return false if the report carries no X and Y motion
+ */
+bool usb_app_mouse_layout_finish(usb_app_mouse_layout_t *layout, uint32_t bits);
+
+/**
+ * @brief Reads a report in the given layout
+ *
+ * @return false if the report is too short for the layout
+ */
+bool usb_app_mouse_parse(const usb_app_mouse_layout_t *layout,
+                         const uint8_t *report,
+                         size_t length,
+                         usb_app_mouse_report_t *mouse);
+
+#endif //USB_APP_MOUSE_H
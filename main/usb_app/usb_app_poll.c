@@ -0,0 +1,62 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_poll.h"
+
+#include <string.h>
+
+void usb_app_poll_init(usb_app_poll_t *poll, uint32_t idle_after_ms, uint32_t idle_interval_ms, uint32_t now_ms) {
+    memset(poll, 0, sizeof(*poll));
+    poll->idle_after_ms = idle_after_ms;
+    poll->idle_interval_ms = idle_interval_ms;
+    poll->last_change_ms = now_ms;
+    poll->state_since_ms = now_ms;
+}
+
+static void usb_app_poll_set_idle(usb_app_poll_t *poll, bool idle, uint32_t now_ms) {
+    if (poll->idle == idle) return;
+
+    const uint32_t elapsed_ms = now_ms - poll->state_since_ms;
+    if (poll->idle) poll->stats.idle_ms += elapsed_ms;
+    else poll->stats.active_ms += elapsed_ms;
+    if (idle) poll->stats.idle_periods++;
+    poll->idle = idle;
+    poll->state_since_ms = now_ms;
+}
+
+uint32_t usb_app_poll_report(usb_app_poll_t *poll, const uint8_t *data, size_t length, uint32_t now_ms) {
+    const size_t compared = length < USB_APP_POLL_REPORT_MAX ? length : USB_APP_POLL_REPORT_MAX;
+    const bool repeat = compared == poll->last_report_len && memcmp(data, poll->last_report, compared) == 0;
+
+    poll->stats.reports++;
+    if (poll->idle) poll->stats.idle_reports++;
+    else poll->stats.active_reports++;
+
+    if (!repeat) {
+        memcpy(poll->last_report, data, compared);
+        poll->last_report_len = compared;
+        poll->last_change_ms = now_ms;
+        usb_app_poll_set_idle(poll, false, now_ms);
+        return 0;
+    }
+
+    poll->stats.repeats++;
+    if (now_ms - poll->last_change_ms >= poll->idle_after_ms) usb_app_poll_set_idle(poll, true, now_ms);
+    if (!poll->idle || !poll->idle_interval_ms) return 0;
+    poll->stats.deferred++;
+    return poll->idle_interval_ms;
+}
+
+bool usb_app_poll_tick(usb_app_poll_t *poll, uint32_t now_ms) {
+    if (poll->idle || now_ms - poll->last_change_ms < poll->idle_after_ms) return false;
+    usb_app_poll_set_idle(poll, true, now_ms);
+    return true;
+}
+
+void usb_app_poll_get_stats(const usb_app_poll_t *poll, uint32_t now_ms, usb_app_poll_stats_t *stats) {
+    *stats = poll->stats;
+    const uint32_t elapsed_ms = now_ms - poll->state_since_ms;
+    if (poll->idle) stats->idle_ms += elapsed_ms;
+    else stats->active_ms += elapsed_ms;
+}
@@ -0,0 +1,68 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_POLL_H
+#define USB_APP_POLL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Activity-adaptive polling of one HID interface.
+ *
+ * The HID driver resubmits the IN transfer as soon as one completes. A device that honors SET_IDLE(0) answers only
+ * when its report changes, the host controller retries the NAKed polls on its own and the CPU stays asleep. Many
+ * devices send the same report every bInterval anyway, and each of those wakes the USB tasks.
+ *
+ * An interface is active from its first changed report on. After idle_after_ms without a change it is idle, and the
+ * IN transfer is resubmitted only idle_interval_ms after each report, which caps the repeats to that rate. The first
+ * changed report makes it active again and resubmits at once, it arrives at most idle_interval_ms late.
+ */
+
+#define USB_APP_POLL_REPORT_MAX             64          // Longer reports are compared by their first bytes only
+
+typedef struct {
+    uint32_t reports;                   // Reports in, one wakeup each
+    uint32_t repeats;                   // Reports equal to the previous one
+    uint32_t idle_periods;
+    uint32_t deferred;                  // IN transfers resubmitted late because the interface was idle
+    uint32_t active_reports;
+    uint32_t idle_reports;
+    uint64_t active_ms;                 // Time spent in each state, the current period not included
+    uint64_t idle_ms;
+} usb_app_poll_stats_t;
+
+typedef struct {
+    uint32_t idle_after_ms;
+    uint32_t idle_interval_ms;          // 0 keeps resubmitting at once and only tracks the activity
+    bool idle;
+    uint32_t last_change_ms;
+    uint32_t state_since_ms;
+    uint8_t last_report[USB_APP_POLL_REPORT_MAX];
+    size_t last_report_len;
+    usb_app_poll_stats_t stats;
+} usb_app_poll_t;
+
+/* The interface starts active at now_ms */
+void usb_app_poll_init(usb_app_poll_t *poll, uint32_t idle_after_ms, uint32_t idle_interval_ms, uint32_t now_ms);
+
+/**
+ * @brief Call for every report of the interface
+ *
+ * @return Delay in ms before the next IN transfer is submitted, 0 to submit it at once
+ */
+uint32_t usb_app_poll_report(usb_app_poll_t *poll, const uint8_t *data, size_t length, uint32_t now_ms);
+
+/**
+ * @brief Call periodically, a device that honors SET_IDLE sends nothing that would tell it went idle
+ *
+ * @return true if the interface went idle
+ */
+bool usb_app_poll_tick(usb_app_poll_t *poll, uint32_t now_ms);
+
+/* Copies the stats with the current period counted up to now_ms */
+void usb_app_poll_get_stats(const usb_app_poll_t *poll, uint32_t now_ms, usb_app_poll_stats_t *stats);
+
+#endif //USB_APP_POLL_H
@@ -0,0 +1,327 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_router.h"
+
+#include <esp_log.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "hid.h"
+
+static const char TAG[] = "usb_app_router";
+
+/* Short item prefixes (tag | type), size bits masked out */
+#define HID_ITEM_MAIN_INPUT                     0x80
+#define HID_ITEM_MAIN_COLLECTION                0xA0
+#define HID_ITEM_MAIN_END_COLLECTION            0xC0
+#define HID_ITEM_GLOBAL_USAGE_PAGE              0x04
+#define HID_ITEM_GLOBAL_REPORT_SIZE             0x74
+#define HID_ITEM_GLOBAL_REPORT_ID               0x84
+#define HID_ITEM_GLOBAL_REPORT_COUNT            0x94
+#define HID_ITEM_LOCAL_USAGE                    0x08
+#define HID_ITEM_LOCAL_USAGE_MIN                0x18
+#define HID_ITEM_LOCAL_USAGE_MAX                0x28
+#define HID_ITEM_LONG                           0xFE
+
+#define HID_COLLECTION_APPLICATION              0x01
+
+#define HID_INPUT_CONSTANT                      0x01
+#define HID_INPUT_VARIABLE                      0x02
+#define HID_INPUT_RELATIVE                      0x04
+
+#define HID_USAGE_PAGE_GENERIC_DESKTOP          0x01
+#define HID_USAGE_PAGE_KEYBOARD                 0x07
+#define HID_USAGE_PAGE_BUTTON                   0x09
+#define HID_USAGE_PAGE_CONSUMER                 0x0C
+#define HID_USAGE_PAGE_VENDOR_MIN               0xFF00
+#define HID_USAGE_GD_MOUSE                      0x02
+#define HID_USAGE_GD_KEYBOARD                   0x06
+#define HID_USAGE_GD_KEYPAD                     0x07
+#define HID_USAGE_GD_X                          0x30
+#define HID_USAGE_GD_Y                          0x31
+#define HID_USAGE_GD_WHEEL                      0x38
+
+#define USB_APP_ROUTER_USAGES                   8           // Usages kept per main item, the rest repeat the last
+
+static usb_app_report_kind_e usb_app_router_kind_from_usage(uint16_t usage_page, uint16_t usage) {
+    if (usage_page >= HID_USAGE_PAGE_VENDOR_MIN) return USB_APP_REPORT_KIND_VENDOR;
+    if (usage_page == HID_USAGE_PAGE_CONSUMER) return USB_APP_REPORT_KIND_CONSUMER;
+    if (usage_page == HID_USAGE_PAGE_KEYBOARD) return USB_APP_REPORT_KIND_KEYBOARD;
+    if (usage_page == HID_USAGE_PAGE_GENERIC_DESKTOP) {
+        if (usage == HID_USAGE_GD_KEYBOARD || usage == HID_USAGE_GD_KEYPAD) return USB_APP_REPORT_KIND_KEYBOARD;
+        if (usage == HID_USAGE_GD_MOUSE) return USB_APP_REPORT_KIND_MOUSE;
+    }
+    return USB_APP_REPORT_KIND_UNKNOWN;
+}
+
+static bool usb_app_router_bind(usb_app_iface_route_t *route,
+                                uint8_t report_id,
+                                usb_app_report_kind_e kind,
+                                const usb_app_report_handler_t kind_handlers[USB_APP_REPORT_KIND_MAX]) {
+    if (report_id >= USB_APP_ROUTE_REPORT_ID_MAX) {
+        ESP_LOGW(TAG, "Report ID %d of iface %d is not routed", report_id, route->dev_params.iface_num);
+        return false;
+    }
+    route->kinds[report_id] = kind;
+    route->handlers[report_id] = kind_handlers[kind];
+    return true;
+}
+
+/* Adds one Input item of a keyboard report to the layout, fields past the ones the layout holds are ignored */
+static void usb_app_router_keyboard_field(usb_app_keyboard_layout_t *layout, uint32_t flags, uint32_t offset,
+                                          uint32_t size, uint32_t count, uint32_t usage_min) {
+    if (flags & HID_INPUT_CONSTANT || offset > UINT16_MAX) return;
+    if (size == 8 && !(flags & HID_INPUT_VARIABLE) && !layout->keys.count) {
+        layout->keys = (usb_app_keyboard_field_t) { offset, count, 0 };
+    } else if (size == 1 && flags & HID_INPUT_VARIABLE && usage_min <= UINT8_MAX) {
+        // Usages stop at 0xFF on the keyboard page
+        if (count > UINT8_MAX + 1 - usage_min) count = UINT8_MAX + 1 - usage_min;
+        for (int b = 0; b < USB_APP_KEYBOARD_LAYOUT_BITMAPS; b++) {
+            if (layout->bitmaps[b].count) continue;
+            layout->bitmaps[b] = (usb_app_keyboard_field_t) { offset, count, usage_min };
+            break;
+        }
+    }
+}
+
+/*
+ * Adds one Input item of a mouse report to the layout, fields the layout already holds are kept. Usages without a
+ * page in their upper 16 bits are on usage_page. An item with fewer usages than fields repeats the last one.
+ */
+static void usb_app_router_mouse_field(usb_app_mouse_layout_t *layout, uint32_t flags, uint32_t offset,
+                                       uint32_t size, uint32_t count, uint16_t usage_page,
+                                       const uint32_t *usages, uint8_t usage_count,
+                                       uint32_t usage_min, uint32_t usage_max) {
+    if (flags & HID_INPUT_CONSTANT || offset + size * count > UINT16_MAX) return;
+    if (usage_page == HID_USAGE_PAGE_BUTTON && size == 1 && flags & HID_INPUT_VARIABLE) {
+        if (!layout->buttons.size) {
+            layout->buttons = (usb_app_mouse_field_t) { offset, MIN(count, USB_APP_MOUSE_BUTTONS_MAX) };
+        }
+        return;
+    }
+    // Absolute axes are tablets and touch screens, their position is no motion
+    if (!(flags & HID_INPUT_VARIABLE) || !(flags & HID_INPUT_RELATIVE) || size < 2 ||
+        size > USB_APP_MOUSE_AXIS_BITS_MAX) return;
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t usage;
+        if (usage_count) {
+            usage = usages[MIN(i, usage_count - 1u)];
+        } else if (usage_min + i <= usage_max) {
+            usage = usage_min + i;
+        } else {
+            break;
+        }
+        const uint16_t page = usage >> 16 ? usage >> 16 : usage_page;
+        if (page != HID_USAGE_PAGE_GENERIC_DESKTOP) continue;
+
+        usb_app_mouse_field_t *field = NULL;
+        switch (usage & 0xFFFF) {
+            case HID_USAGE_GD_X: field = &layout->x; break;
+            case HID_USAGE_GD_Y: field = &layout->y; break;
+            case HID_USAGE_GD_WHEEL: field = &layout->wheel; break;
+            default: break;
+        }
+        if (field && !field->size) *field = (usb_app_mouse_field_t) { offset + i * size, size };
+    }
+}
+
+/*
+ * Walks the short items once, binding every Report ID to the application collection it belongs to. Input items
+ * on the keyboard page of the first keyboard report make up its layout, the buttons and relative axes of the first
+ * mouse report make up the mouse layout.
+ */
+static void usb_app_router_parse(usb_app_iface_route_t *route,
+                                 const uint8_t *desc,
+                                 size_t len,
+                                 const usb_app_report_handler_t kind_handlers[USB_APP_REPORT_KIND_MAX]) {
+    uint16_t usage_page = 0;
+    uint32_t usage = 0;
+    bool usage_extended = false;                // The Usage carries its page in the upper 16 bits
+    uint32_t usage_min = 0;
+    uint32_t usage_max = 0;
+    uint32_t usages[USB_APP_ROUTER_USAGES];     // Of the next main item
+    uint8_t usage_count = 0;
+    uint32_t report_size = 0;
+    uint32_t report_count = 0;
+    uint8_t report_id = 0;
+    uint32_t input_bits = 0;                    // Of the current report, after the Report ID
+    int depth = 0;
+    usb_app_report_kind_e app_kind = USB_APP_REPORT_KIND_UNKNOWN;
+    bool app_bound = false;
+    uint32_t app_ids = 0;                       // Report IDs bound in the current application collection
+    int keyboard_id = -1;                       // Report ID the layout belongs to
+    uint32_t keyboard_bits = 0;
+    bool keyboard_done = false;
+    int mouse_id = -1;                          // Report ID the mouse layout belongs to
+    uint32_t mouse_bits = 0;
+    bool mouse_done = false;
+
+    size_t i = 0;
+    while (i < len) {
+        const uint8_t prefix = desc[i];
+        if (prefix == HID_ITEM_LONG) {
+            if (i + 1 >= len) break;
+            i += 3 + desc[i + 1];
+            continue;
+        }
+
+        const uint8_t size = (prefix & 0x03) == 3 ? 4 : (prefix & 0x03);
+        if (i + 1 + size > len) break;
+
+        uint32_t value = 0;
+        for (uint8_t b = 0; b < size; b++) {
+            value |= (uint32_t)desc[i + 1 + b] << (8 * b);
+        }
+
+        switch (prefix & 0xFC) {
+            case HID_ITEM_GLOBAL_USAGE_PAGE:
+                usage_page = value;
+            break;
+            case HID_ITEM_GLOBAL_REPORT_SIZE:
+                report_size = value;
+            break;
+            case HID_ITEM_GLOBAL_REPORT_COUNT:
+                report_count = value;
+            break;
+            case HID_ITEM_LOCAL_USAGE:
+                usage = value;
+                usage_extended = size == 4;
+                if (usage_count < USB_APP_ROUTER_USAGES) usages[usage_count++] = value;
+            break;
+            case HID_ITEM_LOCAL_USAGE_MIN:
+                usage_min = value;
+            break;
+            case HID_ITEM_LOCAL_USAGE_MAX:
+                usage_max = value;
+            break;
+            case HID_ITEM_MAIN_COLLECTION:
+                if (depth == 0 && value == HID_COLLECTION_APPLICATION) {
+                    const uint16_t page = usage_extended ? usage >> 16 : usage_page;
+                    app_kind = usb_app_router_kind_from_usage(page, usage & 0xFFFF);
+                    app_bound = false;
+                    app_ids = 0;
+                }
+                depth++;
+                usage = 0;
+                usage_extended = false;
+                usage_min = 0;
+                usage_max = 0;
+                usage_count = 0;
+            break;
+            case HID_ITEM_MAIN_END_COLLECTION:
+                if (depth > 0) depth--;
+                if (depth != 0) break;
+                // Application collection without Report ID owns the whole interface
+                if (!app_bound && !route->report_id_offset) {
+                    if (usb_app_router_bind(route, 0, app_kind, kind_handlers)) app_ids |= 1;
+                    app_bound = true;
+                }
+                if (app_kind == USB_APP_REPORT_KIND_MOUSE && app_ids) {
+                    // Likewise one mouse layout, the other reports of the collection would be read with it
+                    const bool mouse_routed = !mouse_done && mouse_id >= 0 && (app_ids & (1u << mouse_id)) &&
+                                              usb_app_mouse_layout_finish(&route->mouse_layout, mouse_bits);
+                    mouse_done = mouse_done || mouse_routed;
+                    for (int id = 0; id < USB_APP_ROUTE_REPORT_ID_MAX; id++) {
+                        if (!(app_ids & (1u << id)) || (mouse_routed && id == mouse_id)) continue;
+                        ESP_LOGW(TAG, "Mouse report %d of iface %d is not routed, layout not supported",
+                                 id, route->dev_params.iface_num);
+                        usb_app_router_bind(route, id, USB_APP_REPORT_KIND_UNKNOWN, kind_handlers);
+                    }
+                    if (!mouse_done) {
+                        // A later mouse collection gets its own try
+                        mouse_id = -1;
+                        memset(&route->mouse_layout, 0, sizeof(route->mouse_layout));
+                    }
+                }
+                if (app_kind != USB_APP_REPORT_KIND_KEYBOARD || !app_ids) break;
+
+                // The handler knows one layout, a second keyboard report or one without keys is not routed
+                bool routed = !keyboard_done && keyboard_id >= 0 && (app_ids & (1u << keyboard_id)) &&
+                              usb_app_keyboard_layout_finish(&route->keyboard_layout, keyboard_bits);
+                keyboard_done = keyboard_done || routed;
+                for (int id = 0; !routed && id < USB_APP_ROUTE_REPORT_ID_MAX; id++) {
+                    if (!(app_ids & (1u << id))) continue;
+                    ESP_LOGW(TAG, "Keyboard report %d of iface %d is not routed, layout not supported",
+                             id, route->dev_params.iface_num);
+                    usb_app_router_bind(route, id, USB_APP_REPORT_KIND_UNKNOWN, kind_handlers);
+                }
+            break;
+            case HID_ITEM_GLOBAL_REPORT_ID:
+                if (!route->report_id_offset) {
+                    // Anything bound before the first Report ID was a guess
+                    memset(route->handlers, 0, sizeof(route->handlers));
+                    memset(route->kinds, 0, sizeof(route->kinds));
+                    route->report_id_offset = 1;
+                }
+                report_id = value;
+                input_bits = 0;
+                if (usb_app_router_bind(route, value, app_kind, kind_handlers)) app_ids |= 1u << value;
+                app_bound = true;
+            break;
+            case HID_ITEM_MAIN_INPUT:
+                if (app_kind == USB_APP_REPORT_KIND_KEYBOARD && !keyboard_done &&
+                    usage_page == HID_USAGE_PAGE_KEYBOARD && (keyboard_id < 0 || keyboard_id == report_id)) {
+                    keyboard_id = report_id;
+                    usb_app_router_keyboard_field(&route->keyboard_layout, value, input_bits,
+                                                  report_size, report_count, usage_min);
+                }
+                if (app_kind == USB_APP_REPORT_KIND_MOUSE && !mouse_done &&
+                    (mouse_id < 0 || mouse_id == report_id)) {
+                    mouse_id = report_id;
+                    usb_app_router_mouse_field(&route->mouse_layout, value, input_bits, report_size, report_count,
+                                               usage_page, usages, usage_count, usage_min, usage_max);
+                }
+                input_bits += report_size * report_count;
+                if (keyboard_id == report_id) keyboard_bits = input_bits;
+                if (mouse_id == report_id) mouse_bits = input_bits;
+                usage = 0;
+                usage_extended = false;
+                usage_min = 0;
+                usage_max = 0;
+                usage_count = 0;
+            break;
+            default:
+                // Main items (Output, Feature) clear the local usage
+                if ((prefix & 0x0C) == 0x00) {
+                    usage = 0;
+                    usage_extended = false;
+                    usage_min = 0;
+                    usage_max = 0;
+                    usage_count = 0;
+                }
+            break;
+        }
+
+        i += 1 + size;
+    }
+}
+
+void usb_app_router_build(usb_app_iface_route_t *route,
+                          const hid_host_dev_params_t *dev_params,
+                          const uint8_t *report_desc,
+                          size_t report_desc_len,
+                          const usb_app_report_handler_t kind_handlers[USB_APP_REPORT_KIND_MAX]) {
+    memset(route, 0, sizeof(usb_app_iface_route_t));
+    route->dev_params = *dev_params;
+
+    if (dev_params->sub_class == HID_SUBCLASS_BOOT_INTERFACE || !report_desc) {
+        usb_app_report_kind_e kind = USB_APP_REPORT_KIND_UNKNOWN;
+        if (dev_params->proto == HID_PROTOCOL_KEYBOARD) kind = USB_APP_REPORT_KIND_KEYBOARD;
+        else if (dev_params->proto == HID_PROTOCOL_MOUSE) kind = USB_APP_REPORT_KIND_MOUSE;
+        usb_app_router_bind(route, 0, kind, kind_handlers);
+        usb_app_keyboard_layout_boot(&route->keyboard_layout);
+        usb_app_mouse_layout_boot(&route->mouse_layout);
+    } else {
+        usb_app_router_parse(route, report_desc, report_desc_len, kind_handlers);
+    }
+
+    for (int id = 0; id < USB_APP_ROUTE_REPORT_ID_MAX; id++) {
+        if (route->kinds[id] != USB_APP_REPORT_KIND_UNKNOWN) {
+            ESP_LOGI(TAG, "Addr %d iface %d report %d -> kind %d",
+                     dev_params->addr, dev_params->iface_num, id, route->kinds[id]);
+        }
+    }
+}
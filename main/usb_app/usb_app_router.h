@@ -0,0 +1,77 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_ROUTER_H
+#define USB_APP_ROUTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hid_host.h"
+#include "usb_app_keyboard.h"
+#include "usb_app_mouse.h"
+#include "usb_app_poll.h"
+
+#define USB_APP_ROUTE_REPORT_ID_MAX             16          // Report IDs above this are not routed
+
+typedef enum {
+    USB_APP_REPORT_KIND_UNKNOWN = 0,
+    USB_APP_REPORT_KIND_KEYBOARD,
+    USB_APP_REPORT_KIND_MOUSE,
+    USB_APP_REPORT_KIND_CONSUMER,
+    USB_APP_REPORT_KIND_VENDOR,
+    USB_APP_REPORT_KIND_MAX
+} usb_app_report_kind_e;
+
+typedef struct usb_app_iface_route usb_app_iface_route_t;
+
+/* Report payload is passed without the leading Report ID byte */
+typedef void (*usb_app_report_handler_t)(usb_app_iface_route_t *route, const uint8_t *data, size_t length);
+
+/* Built once when the interface attaches, looked up on every input report */
+struct usb_app_iface_route {
+    hid_host_dev_params_t dev_params;
+    uint8_t report_id_offset;                                           // 1 when the interface uses Report IDs
+    usb_app_report_handler_t handlers[USB_APP_ROUTE_REPORT_ID_MAX];     // Indexed by Report ID, [0] without IDs
+    usb_app_report_kind_e kinds[USB_APP_ROUTE_REPORT_ID_MAX];
+    int capture_channel;                                                // Set by the application, -1 when not captured
+    usb_app_keyboard_layout_t keyboard_layout;                          // Of the one keyboard report routed per interface
+    usb_app_keyboard_state_t keyboard;                                  // Keys this interface holds, kept by the keyboard handler
+    usb_app_mouse_layout_t mouse_layout;                                // Of the one mouse report routed per interface
+    usb_app_poll_t poll;                                                // Set by the application, activity of the interface
+    uint32_t poll_delay_ms;                                             // IN transfer delay last applied to the interface
+};
+
+/**
+ * @brief Fill the routing table of one HID interface
+ *
+ * Boot interfaces are routed by their protocol. Otherwise every Report ID found in the report
+ * descriptor is bound to the handler of its top level application collection. The layout of a
+ * report protocol keyboard is read from its Input items, only the first keyboard report of an
+ * interface is routed and one without keys is not. Mice work the same way, a mouse report without
+ * relative X and Y is not routed.
+ *
+ * @param[out] route            Routing table to fill
+ * @param[in] dev_params        Interface parameters
+ * @param[in] report_desc       Report descriptor or NULL for boot interfaces
+ * @param[in] report_desc_len   Report descriptor length
+ * @param[in] kind_handlers     Handler for every report kind, NULL entries are not routed
+ */
+void usb_app_router_build(usb_app_iface_route_t *route,
+                          const hid_host_dev_params_t *dev_params,
+                          const uint8_t *report_desc,
+                          size_t report_desc_len,
+                          const usb_app_report_handler_t kind_handlers[USB_APP_REPORT_KIND_MAX]);
+
+static inline void usb_app_router_dispatch(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    if (length <= route->report_id_offset) return;
+
+    const uint8_t report_id = route->report_id_offset ? data[0] : 0;
+    if (report_id >= USB_APP_ROUTE_REPORT_ID_MAX || !route->handlers[report_id]) return;
+
+    route->handlers[report_id](route, data + route->report_id_offset, length - route->report_id_offset);
+}
+
+#endif //USB_APP_ROUTER_H
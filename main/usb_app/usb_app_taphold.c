@@ -0,0 +1,332 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_taphold.h"
+
+#include <string.h>
+
+#define USB_APP_TAPHOLD_WHEEL_MASK  (USB_APP_TAPHOLD_WHEEL_SLOTS - 1)
+
+static void usb_app_taphold_timer_start(usb_app_taphold_t *engine, uint8_t index, uint32_t expires_tick) {
+    usb_app_taphold_decision_t *decision = &engine->decisions[index];
+    uint8_t *slot = &engine->wheel[expires_tick & USB_APP_TAPHOLD_WHEEL_MASK];
+
+    decision->expires_tick = expires_tick;
+    decision->timer_prev = USB_APP_TAPHOLD_NONE;
+    decision->timer_next = *slot;
+    if (*slot != USB_APP_TAPHOLD_NONE) engine->decisions[*slot].timer_prev = index;
+    *slot = index;
+    decision->timer_armed = true;
+    engine->armed_timers++;
+}
+
+static void usb_app_taphold_timer_cancel(usb_app_taphold_t *engine, uint8_t index) {
+    usb_app_taphold_decision_t *decision = &engine->decisions[index];
+    if (!decision->timer_armed) return;
+
+    if (decision->timer_prev != USB_APP_TAPHOLD_NONE) {
+        engine->decisions[decision->timer_prev].timer_next = decision->timer_next;
+    } else {
+        engine->wheel[decision->expires_tick & USB_APP_TAPHOLD_WHEEL_MASK] = decision->timer_next;
+    }
+    if (decision->timer_next != USB_APP_TAPHOLD_NONE) {
+        engine->decisions[decision->timer_next].timer_prev = decision->timer_prev;
+    }
+    decision->timer_armed = false;
+    engine->armed_timers--;
+}
+
+static void usb_app_taphold_decide(usb_app_taphold_t *engine, uint8_t index, usb_app_taphold_state_e state) {
+    usb_app_taphold_decision_t *decision = &engine->decisions[index];
+    usb_app_taphold_timer_cancel(engine, index);
+    decision->state = state;
+
+    switch (state) {
+        case USB_APP_TAPHOLD_TAP: engine->stats.taps++; break;
+        case USB_APP_TAPHOLD_HOLD: engine->stats.holds++; break;
+        case USB_APP_TAPHOLD_COMBO: engine->stats.combos++; break;
+        default: break;
+    }
+}
+
+/* A timed out tap-hold key is held, a timed out combo key is sent as itself */
+static void usb_app_taphold_expire(usb_app_taphold_t *engine, uint8_t index) {
+    usb_app_taphold_decide(engine, index, engine->decisions[index].is_combo ? USB_APP_TAPHOLD_PLAIN
+                                                                            : USB_APP_TAPHOLD_HOLD);
+}
+
+static void usb_app_taphold_advance(usb_app_taphold_t *engine, uint32_t now_tick) {
+    if (engine->armed_timers == 0) {
+        engine->wheel_tick = now_tick;
+        return;
+    }
+
+    // One pass over the wheel is enough however far behind it is, expiry is checked against now
+    uint32_t steps = now_tick - engine->wheel_tick;
+    if (steps > USB_APP_TAPHOLD_WHEEL_SLOTS) steps = USB_APP_TAPHOLD_WHEEL_SLOTS;
+    for (uint32_t i = 1; i <= steps; i++) {
+        uint8_t index = engine->wheel[(engine->wheel_tick + i) & USB_APP_TAPHOLD_WHEEL_MASK];
+        while (index != USB_APP_TAPHOLD_NONE) {
+            const uint8_t next = engine->decisions[index].timer_next;
+            if ((int32_t)(now_tick - engine->decisions[index].expires_tick) >= 0) {
+                usb_app_taphold_expire(engine, index);
+            }
+            index = next;
+        }
+    }
+    engine->wheel_tick = now_tick;
+}
+
+static void usb_app_taphold_send(usb_app_taphold_t *engine, enum key_state state, uint8_t modifier, uint8_t key_code) {
+    const key_event_t key_event = {
+        .state = state,
+        .modifier = modifier,
+        .key_code = key_code
+    };
+    engine->callback(&key_event, engine->arg);
+}
+
+static void usb_app_taphold_emit(usb_app_taphold_t *engine, const usb_app_taphold_entry_t *entry) {
+    if (entry->swallow) return;
+
+    const key_event_t *key_event = &entry->event;
+    const uint8_t key = key_event->key_code;
+
+    if (key_event->state == KEY_STATE_RELEASED) {
+        const uint8_t release = engine->release_as[key];
+        const uint8_t partner = engine->combo_partner[key];
+        engine->release_as[key] = key;
+        if (partner) {
+            // First key up releases the combo, the other key's release is dropped
+            engine->release_as[partner] = 0;
+            engine->combo_partner[key] = 0;
+            engine->combo_partner[partner] = 0;
+        }
+        if (release) usb_app_taphold_send(engine, KEY_STATE_RELEASED, key_event->modifier, release);
+        return;
+    }
+
+    uint8_t press = key;
+    if (entry->decision != USB_APP_TAPHOLD_NONE) {
+        const usb_app_taphold_decision_t *decision = &engine->decisions[entry->decision];
+        const usb_app_taphold_key_t *taphold = decision->is_combo ? NULL
+                                              : &engine->config->keys[engine->taphold_index[key] - 1];
+        switch (decision->state) {
+            case USB_APP_TAPHOLD_TAP:
+                press = taphold->tap;
+            break;
+            case USB_APP_TAPHOLD_HOLD:
+                press = taphold->hold;
+            break;
+            case USB_APP_TAPHOLD_COMBO:
+                press = decision->output;
+                engine->release_as[decision->partner] = press;
+                engine->combo_partner[key] = decision->partner;
+                engine->combo_partner[decision->partner] = key;
+            break;
+            default:
+            break;
+        }
+    }
+    engine->release_as[key] = press;
+    usb_app_taphold_send(engine, KEY_STATE_PRESSED, key_event->modifier, press);
+}
+
+/* Sends buffered events up to the first open decision */
+static void usb_app_taphold_drain(usb_app_taphold_t *engine) {
+    while (engine->queue_count) {
+        const usb_app_taphold_entry_t *entry = &engine->queue[engine->queue_head];
+        if (entry->decision != USB_APP_TAPHOLD_NONE &&
+            engine->decisions[entry->decision].state == USB_APP_TAPHOLD_UNDECIDED) {
+            break;
+        }
+
+        usb_app_taphold_emit(engine, entry);
+        if (entry->decision != USB_APP_TAPHOLD_NONE) engine->decisions[entry->decision].in_use = false;
+        engine->queue_head = (engine->queue_head + 1) % USB_APP_TAPHOLD_QUEUE_LEN;
+        engine->queue_count--;
+    }
+}
+
+/* Forces the oldest open decision so the buffer and the pool cannot overflow */
+static void usb_app_taphold_force_oldest(usb_app_taphold_t *engine) {
+    for (uint8_t i = 0; i < engine->queue_count; i++) {
+        const uint8_t decision = engine->queue[(engine->queue_head + i) % USB_APP_TAPHOLD_QUEUE_LEN].decision;
+        if (decision != USB_APP_TAPHOLD_NONE && engine->decisions[decision].state == USB_APP_TAPHOLD_UNDECIDED) {
+            usb_app_taphold_expire(engine, decision);
+            engine->stats.forced++;
+            break;
+        }
+    }
+    usb_app_taphold_drain(engine);
+}
+
+static uint8_t usb_app_taphold_open(usb_app_taphold_t *engine, uint8_t key, bool is_combo, uint32_t expires_tick) {
+    for (;;) {
+        for (uint8_t i = 0; i < USB_APP_TAPHOLD_MAX_DECISIONS; i++) {
+            usb_app_taphold_decision_t *decision = &engine->decisions[i];
+            if (decision->in_use) continue;
+
+            memset(decision, 0, sizeof(*decision));
+            decision->in_use = true;
+            decision->is_combo = is_combo;
+            decision->state = USB_APP_TAPHOLD_UNDECIDED;
+            decision->key = key;
+            usb_app_taphold_timer_start(engine, i, expires_tick);
+            return i;
+        }
+        usb_app_taphold_force_oldest(engine);
+    }
+}
+
+static void usb_app_taphold_enqueue(usb_app_taphold_t *engine, const key_event_t *key_event, uint8_t decision, bool swallow) {
+    while (engine->queue_count == USB_APP_TAPHOLD_QUEUE_LEN) {
+        usb_app_taphold_force_oldest(engine);
+    }
+
+    usb_app_taphold_entry_t *entry = &engine->queue[(engine->queue_head + engine->queue_count) % USB_APP_TAPHOLD_QUEUE_LEN];
+    entry->event = *key_event;
+    entry->decision = decision;
+    entry->swallow = swallow;
+    engine->queue_count++;
+    if (engine->queue_count > engine->stats.max_queued) engine->stats.max_queued = engine->queue_count;
+}
+
+static uint8_t usb_app_taphold_combo_output(const usb_app_taphold_t *engine, uint8_t first, uint8_t second) {
+    for (size_t i = 0; i < engine->config->combo_count; i++) {
+        const usb_app_taphold_combo_t *combo = &engine->config->combos[i];
+        if ((combo->keys[0] == first && combo->keys[1] == second) ||
+            (combo->keys[0] == second && combo->keys[1] == first)) {
+            return combo->output;
+        }
+    }
+    return 0;
+}
+
+static uint8_t usb_app_taphold_find_open(const usb_app_taphold_t *engine, uint8_t key) {
+    for (uint8_t i = 0; i < USB_APP_TAPHOLD_MAX_DECISIONS; i++) {
+        const usb_app_taphold_decision_t *decision = &engine->decisions[i];
+        if (decision->in_use && decision->key == key && decision->state == USB_APP_TAPHOLD_UNDECIDED) return i;
+    }
+    return USB_APP_TAPHOLD_NONE;
+}
+
+static void usb_app_taphold_press(usb_app_taphold_t *engine, const key_event_t *key_event, uint32_t now_tick) {
+    const uint8_t key = key_event->key_code;
+
+    // A combo only counts when nothing else is pressed in between
+    uint8_t combo_output = 0;
+    uint8_t combo_first = USB_APP_TAPHOLD_NONE;
+    for (uint8_t i = 0; i < USB_APP_TAPHOLD_MAX_DECISIONS; i++) {
+        usb_app_taphold_decision_t *decision = &engine->decisions[i];
+        if (!decision->in_use || !decision->is_combo || decision->state != USB_APP_TAPHOLD_UNDECIDED) continue;
+
+        const uint8_t output = engine->combo_member[key] ? usb_app_taphold_combo_output(engine, decision->key, key) : 0;
+        if (output && combo_first == USB_APP_TAPHOLD_NONE) {
+            combo_output = output;
+            combo_first = i;
+        } else {
+            usb_app_taphold_decide(engine, i, USB_APP_TAPHOLD_PLAIN);
+        }
+    }
+
+    if (combo_first != USB_APP_TAPHOLD_NONE) {
+        engine->decisions[combo_first].output = combo_output;
+        engine->decisions[combo_first].partner = key;
+        usb_app_taphold_decide(engine, combo_first, USB_APP_TAPHOLD_COMBO);
+        usb_app_taphold_enqueue(engine, key_event, USB_APP_TAPHOLD_NONE, true);
+        return;
+    }
+
+    uint8_t decision = USB_APP_TAPHOLD_NONE;
+    if (engine->taphold_index[key]) {
+        decision = usb_app_taphold_open(engine, key, false, now_tick + engine->tapping_ticks);
+    } else if (engine->combo_member[key]) {
+        decision = usb_app_taphold_open(engine, key, true, now_tick + engine->combo_ticks);
+    }
+    usb_app_taphold_enqueue(engine, key_event, decision, false);
+}
+
+static void usb_app_taphold_release(usb_app_taphold_t *engine, const key_event_t *key_event) {
+    const uint8_t key = key_event->key_code;
+
+    const uint8_t open = usb_app_taphold_find_open(engine, key);
+    if (open != USB_APP_TAPHOLD_NONE) {
+        // Released before its term
+        usb_app_taphold_decide(engine, open, engine->decisions[open].is_combo ? USB_APP_TAPHOLD_PLAIN
+                                                                              : USB_APP_TAPHOLD_TAP);
+    } else {
+        // A key tapped while a tap-hold key is held makes that key a hold
+        for (uint8_t i = 0; i < engine->queue_count; i++) {
+            const usb_app_taphold_entry_t *entry = &engine->queue[(engine->queue_head + i) % USB_APP_TAPHOLD_QUEUE_LEN];
+            if (entry->event.key_code == key && entry->event.state == KEY_STATE_PRESSED) {
+                for (uint8_t j = 0; j < i; j++) {
+                    const uint8_t decision = engine->queue[(engine->queue_head + j) % USB_APP_TAPHOLD_QUEUE_LEN].decision;
+                    if (decision != USB_APP_TAPHOLD_NONE && !engine->decisions[decision].is_combo &&
+                        engine->decisions[decision].state == USB_APP_TAPHOLD_UNDECIDED) {
+                        usb_app_taphold_decide(engine, decision, USB_APP_TAPHOLD_HOLD);
+                    }
+                }
+                break;
+            }
+        }
+    }
+    usb_app_taphold_enqueue(engine, key_event, USB_APP_TAPHOLD_NONE, false);
+}
+
+void usb_app_taphold_init(usb_app_taphold_t *engine, const usb_app_taphold_config_t *config,
+                          usb_app_keyboard_event_cb_t callback, void *arg) {
+    memset(engine, 0, sizeof(*engine));
+    engine->config = config;
+    engine->callback = callback;
+    engine->arg = arg;
+
+    const uint16_t tick_ms = config->tick_ms ? config->tick_ms : 1;
+    // At least one tick, a timer due now would sit a full wheel turn in a slot that was just passed
+    engine->tapping_ticks = (config->tapping_term_ms + tick_ms - 1) / tick_ms;
+    engine->combo_ticks = (config->combo_term_ms + tick_ms - 1) / tick_ms;
+    if (engine->tapping_ticks == 0) engine->tapping_ticks = 1;
+    if (engine->combo_ticks == 0) engine->combo_ticks = 1;
+
+    for (int i = 0; i < 256; i++) {
+        engine->release_as[i] = i;
+    }
+    for (size_t i = 0; i < config->key_count && i < UINT8_MAX; i++) {
+        engine->taphold_index[config->keys[i].key] = i + 1;
+    }
+    for (size_t i = 0; i < config->combo_count; i++) {
+        engine->combo_member[config->combos[i].keys[0]] = true;
+        engine->combo_member[config->combos[i].keys[1]] = true;
+    }
+    memset(engine->wheel, USB_APP_TAPHOLD_NONE, sizeof(engine->wheel));
+}
+
+void usb_app_taphold_process(usb_app_taphold_t *engine, const key_event_t *key_event, uint32_t now_ms) {
+    const uint32_t now_tick = now_ms / (engine->config->tick_ms ? engine->config->tick_ms : 1);
+    usb_app_taphold_advance(engine, now_tick);
+
+    const uint8_t key = key_event->key_code;
+    if (engine->queue_count == 0 && !engine->taphold_index[key] && !engine->combo_member[key] &&
+        engine->combo_partner[key] == 0 && engine->release_as[key] == key) {
+        // Nothing open and nothing to translate, no reason to buffer
+        engine->callback(key_event, engine->arg);
+        return;
+    }
+
+    if (key_event->state == KEY_STATE_PRESSED) {
+        usb_app_taphold_press(engine, key_event, now_tick);
+    } else {
+        usb_app_taphold_release(engine, key_event);
+    }
+    usb_app_taphold_drain(engine);
+}
+
+void usb_app_taphold_tick(usb_app_taphold_t *engine, uint32_t now_ms) {
+    usb_app_taphold_advance(engine, now_ms / (engine->config->tick_ms ? engine->config->tick_ms : 1));
+    usb_app_taphold_drain(engine);
+}
+
+bool usb_app_taphold_pending(const usb_app_taphold_t *engine) {
+    return engine->queue_count != 0;
+}
@@ -0,0 +1,133 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_TAPHOLD_H
+#define USB_APP_TAPHOLD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "usb_app_keyboard.h"
+
+/*
+ * Tap-hold keys and two key combos.
+ *
+ * Key events are buffered in order while any decision is open and released as soon as the oldest one is
+ * decided, so the host sees the same order the keys were pressed in. Keys that take part in nothing pass
+ * straight through while nothing is open, otherwise they wait at most the longest term plus one tick.
+ *
+ * Tap-hold key:    released before tapping_term_ms sends 'tap', held longer sends 'hold'. Another key
+ *                  pressed and released while it is held also decides hold, so quick shortcuts work.
+ * Combo:           both keys pressed within combo_term_ms send 'output' instead, released on the first
+ *                  release. Any other key or the timeout sends the first key as usual.
+ *
+ * All open decisions share one hashed timer wheel advanced by usb_app_taphold_tick(). Memory is fixed,
+ * when the buffer or the decision pool is full the oldest open decision is forced (hold, or no combo).
+ */
+
+#define USB_APP_TAPHOLD_QUEUE_LEN               16          // Buffered key events
+#define USB_APP_TAPHOLD_MAX_DECISIONS           8           // Open tap-hold and combo decisions
+#define USB_APP_TAPHOLD_WHEEL_SLOTS             16          // Power of two
+#define USB_APP_TAPHOLD_NONE                    0xFF
+
+typedef struct {
+    uint8_t key;
+    uint8_t tap;
+    uint8_t hold;
+} usb_app_taphold_key_t;
+
+typedef struct {
+    uint8_t keys[2];
+    uint8_t output;
+} usb_app_taphold_combo_t;
+
+typedef struct {
+    const usb_app_taphold_key_t *keys;          // A key that is both tap-hold and combo acts as tap-hold
+    size_t key_count;
+    const usb_app_taphold_combo_t *combos;
+    size_t combo_count;
+    uint16_t tapping_term_ms;
+    uint16_t combo_term_ms;
+    uint16_t tick_ms;                           // Timer wheel resolution
+} usb_app_taphold_config_t;
+
+typedef enum {
+    USB_APP_TAPHOLD_UNDECIDED = 0,
+    USB_APP_TAPHOLD_PLAIN,
+    USB_APP_TAPHOLD_TAP,
+    USB_APP_TAPHOLD_HOLD,
+    USB_APP_TAPHOLD_COMBO
+} usb_app_taphold_state_e;
+
+typedef struct {
+    bool in_use;
+    bool is_combo;
+    uint8_t state;
+    uint8_t key;
+    uint8_t output;                             // Combo output
+    uint8_t partner;                            // Second combo key
+    uint8_t timer_next;
+    uint8_t timer_prev;
+    bool timer_armed;
+    uint32_t expires_tick;
+} usb_app_taphold_decision_t;
+
+typedef struct {
+    key_event_t event;
+    uint8_t decision;
+    bool swallow;                               // Second key of a combo, already sent as the combo output
+} usb_app_taphold_entry_t;
+
+typedef struct {
+    uint32_t forced;                            // Decisions forced by a full buffer or pool
+    uint32_t taps;
+    uint32_t holds;
+    uint32_t combos;
+    uint32_t max_queued;
+} usb_app_taphold_stats_t;
+
+typedef struct {
+    const usb_app_taphold_config_t *config;
+    uint32_t tapping_ticks;
+    uint32_t combo_ticks;
+
+    uint8_t taphold_index[256];                 // Config index + 1, 0 if the key is not tap-hold
+    bool combo_member[256];
+    uint8_t release_as[256];                    // Usage to release for each held key, 0 swallows the release
+    uint8_t combo_partner[256];
+
+    usb_app_taphold_entry_t queue[USB_APP_TAPHOLD_QUEUE_LEN];
+    uint8_t queue_head;
+    uint8_t queue_count;
+    usb_app_taphold_decision_t decisions[USB_APP_TAPHOLD_MAX_DECISIONS];
+
+    uint8_t wheel[USB_APP_TAPHOLD_WHEEL_SLOTS];
+    uint32_t wheel_tick;
+    uint8_t armed_timers;
+
+    usb_app_keyboard_event_cb_t callback;
+    void *arg;
+    usb_app_taphold_stats_t stats;
+} usb_app_taphold_t;
+
+/**
+ * @brief Set up the engine, the config must stay valid while it is used
+ *
+ * @param[in] callback      Receives the resolved key events
+ * @param[in] arg           Passed to the callback
+ */
+void usb_app_taphold_init(usb_app_taphold_t *engine, const usb_app_taphold_config_t *config,
+                          usb_app_keyboard_event_cb_t callback, void *arg);
+
+/* Feeds one key event, resolved events may be emitted before it returns */
+void usb_app_taphold_process(usb_app_taphold_t *engine, const key_event_t *key_event, uint32_t now_ms);
+
+/* Advances the timer wheel, call every tick_ms while usb_app_taphold_pending() */
+void usb_app_taphold_tick(usb_app_taphold_t *engine, uint32_t now_ms);
+
+/* True while key events are buffered behind an open decision */
+bool usb_app_taphold_pending(const usb_app_taphold_t *engine);
+
+#endif //USB_APP_TAPHOLD_H
@@ -0,0 +1,88 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "usb_app_vbus.h"
+
+#include <string.h>
+
+void usb_app_vbus_init(usb_app_vbus_t *vbus, uint32_t debounce_ms, bool level, uint32_t now_ms) {
+    memset(vbus, 0, sizeof(*vbus));
+    vbus->debounce_ms = debounce_ms;
+    vbus->level = level;
+    vbus->level_since_ms = now_ms;
+    vbus->debounced = level;
+    vbus->debounced_since_ms = now_ms;
+    vbus->powered = level;
+    if (level) {
+        vbus->stats.attaches++;
+        vbus->ready_pending = true;
+        vbus->first_report_pending = true;
+        vbus->attach_edge_ms = now_ms;
+    }
+}
+
+static void usb_app_vbus_settle(usb_app_vbus_t *vbus, uint32_t now_ms) {
+    if (vbus->level == vbus->debounced || now_ms - vbus->level_since_ms < vbus->debounce_ms) return;
+    vbus->debounced = vbus->level;
+    vbus->debounced_since_ms = vbus->level_since_ms;
+}
+
+void usb_app_vbus_edge(usb_app_vbus_t *vbus, bool level, uint32_t now_ms) {
+    if (level == vbus->level) return;
+
+    // A level that lasted counts even if nobody polled before this edge
+    usb_app_vbus_settle(vbus, now_ms);
+    if (vbus->level != vbus->debounced) vbus->stats.glitches++;
+    vbus->level = level;
+    vbus->level_since_ms = now_ms;
+}
+
+usb_app_vbus_event_e usb_app_vbus_poll(usb_app_vbus_t *vbus, uint32_t now_ms) {
+    usb_app_vbus_settle(vbus, now_ms);
+    if (vbus->debounced == vbus->powered) return USB_APP_VBUS_EVENT_NONE;
+
+    vbus->powered = vbus->debounced;
+    if (!vbus->powered) {
+        vbus->stats.detaches++;
+        vbus->ready_pending = false;
+        vbus->first_report_pending = false;
+        return USB_APP_VBUS_EVENT_DETACH;
+    }
+    vbus->stats.attaches++;
+    vbus->ready_pending = true;
+    vbus->first_report_pending = true;
+    vbus->attach_edge_ms = vbus->debounced_since_ms;
+    return USB_APP_VBUS_EVENT_ATTACH;
+}
+
+uint32_t usb_app_vbus_wait_ms(const usb_app_vbus_t *vbus, uint32_t now_ms) {
+    if (vbus->debounced != vbus->powered) return 0;
+
+    // A glitch back to the debounced level is waited out as well, its end may still come
+    const uint32_t elapsed_ms = now_ms - vbus->level_since_ms;
+    if (elapsed_ms < vbus->debounce_ms) return vbus->debounce_ms - elapsed_ms;
+    return vbus->level == vbus->debounced ? UINT32_MAX : 0;
+}
+
+bool usb_app_vbus_ready(usb_app_vbus_t *vbus, uint32_t now_ms) {
+    if (!vbus->ready_pending) return false;
+
+    const uint32_t ready_ms = now_ms - vbus->attach_edge_ms;
+    vbus->ready_pending = false;
+    vbus->stats.cold_ready_last_ms = ready_ms;
+    if (ready_ms > vbus->stats.cold_ready_max_ms) vbus->stats.cold_ready_max_ms = ready_ms;
+    return true;
+}
+
+bool usb_app_vbus_report(usb_app_vbus_t *vbus, uint32_t now_ms) {
+    if (!vbus->first_report_pending) return false;
+
+    const uint32_t attach_ms = now_ms - vbus->attach_edge_ms;
+    vbus->first_report_pending = false;
+    vbus->stats.cold_attaches++;
+    vbus->stats.cold_attach_last_ms = attach_ms;
+    vbus->stats.cold_attach_sum_ms += attach_ms;
+    if (attach_ms > vbus->stats.cold_attach_max_ms) vbus->stats.cold_attach_max_ms = attach_ms;
+    return true;
+}
@@ -0,0 +1,86 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef USB_APP_VBUS_H
+#define USB_APP_VBUS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Debounced VBUS state that gates the USB host stack.
+ *
+ * Every edge of the VBUS pin goes in with usb_app_vbus_edge(), from an interrupt or from a simulation. The level
+ * counts only after it stayed the same for debounce_ms, then usb_app_vbus_poll() returns the attach or detach once.
+ * Contact bounce and glitches shorter than that never reach the stack.
+ *
+ * The cold attach time runs from the rising edge that stuck to the first report after the attach, so it covers the
+ * debounce, the stack install and the enumeration. A keyboard that honors SET_IDLE(0) sends nothing until a key goes
+ * down, so the time until its first interface started is kept as well.
+ */
+
+typedef enum {
+    USB_APP_VBUS_EVENT_NONE = 0,
+    USB_APP_VBUS_EVENT_ATTACH,                      // Install the stack
+    USB_APP_VBUS_EVENT_DETACH,                      // Uninstall the stack
+} usb_app_vbus_event_e;
+
+typedef struct {
+    uint32_t attaches;
+    uint32_t detaches;
+    uint32_t glitches;                              // Edges that did not last for the debounce time
+    uint32_t cold_ready_last_ms;                    // Rising edge to the first started interface
+    uint32_t cold_ready_max_ms;
+    uint32_t cold_attaches;                         // Attaches that reached a first report
+    uint32_t cold_attach_last_ms;
+    uint32_t cold_attach_max_ms;
+    uint64_t cold_attach_sum_ms;
+} usb_app_vbus_stats_t;
+
+typedef struct {
+    uint32_t debounce_ms;
+    bool level;                                     // Last level seen on the pin
+    uint32_t level_since_ms;
+    bool debounced;                                 // Last level that lasted for the debounce time
+    uint32_t debounced_since_ms;
+    bool powered;                                   // Level the stack follows, lags debounced until polled
+    bool ready_pending;
+    bool first_report_pending;
+    uint32_t attach_edge_ms;
+    usb_app_vbus_stats_t stats;
+} usb_app_vbus_t;
+
+/* A level present at start is taken at once, the stack comes up without waiting for the debounce */
+void usb_app_vbus_init(usb_app_vbus_t *vbus, uint32_t debounce_ms, bool level, uint32_t now_ms);
+
+/* Call on every change of the pin, repeated levels are ignored */
+void usb_app_vbus_edge(usb_app_vbus_t *vbus, bool level, uint32_t now_ms);
+
+/**
+ * @brief Call after an edge and once the wait returned by usb_app_vbus_wait_ms() has passed
+ *
+ * @return Change of the debounced state, USB_APP_VBUS_EVENT_NONE if there is none
+ */
+usb_app_vbus_event_e usb_app_vbus_poll(usb_app_vbus_t *vbus, uint32_t now_ms);
+
+/**
+ * @return Time until usb_app_vbus_poll() may return an event, UINT32_MAX once the pin was quiet for the debounce time
+ */
+uint32_t usb_app_vbus_wait_ms(const usb_app_vbus_t *vbus, uint32_t now_ms);
+
+/**
+ * @brief Call when an interface starts its IN transfers, the first one after an attach ends the ready time
+ *
+ * @return true if this start ended the ready time
+ */
+bool usb_app_vbus_ready(usb_app_vbus_t *vbus, uint32_t now_ms);
+
+/**
+ * @brief Call for reports of the interfaces, the first one after an attach ends the cold attach time
+ *
+ * @return true if this report ended a cold attach
+ */
+bool usb_app_vbus_report(usb_app_vbus_t *vbus, uint32_t now_ms);
+
+#endif //USB_APP_VBUS_H
@@ -0,0 +1,404 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * ble-bench-client: drives the benchmark GATT service of the bridge (BT_APP_BENCH_SERVICE_ENABLED) from Linux.
+ *
+ * Talks ATT directly over an LE L2CAP socket, so only a kernel with Bluetooth support is needed, no BlueZ
+ * library. The same binary works against a real adapter or an emulated controller (btvirt from BlueZ),
+ * pairing and bonding are left to the kernel and bluetoothd.
+ *
+ *   ble-bench-client [-r rate_hz] [-s size] [-n count] [-e echoes] [-p pings] [--random] AA:BB:CC:DD:EE:FF
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Kernel Bluetooth socket ABI, normally from <bluetooth/bluetooth.h> and <bluetooth/l2cap.h> */
+#ifndef AF_BLUETOOTH
+#define AF_BLUETOOTH                31
+#endif
+#define BTPROTO_L2CAP               0
+#define SOL_BLUETOOTH               274
+#define BT_SECURITY                 4
+#define BT_SECURITY_MEDIUM          2
+#define BDADDR_LE_PUBLIC            1
+#define BDADDR_LE_RANDOM            2
+
+typedef struct { uint8_t b[6]; } __attribute__((packed)) bt_bdaddr_t;
+
+struct bt_sockaddr_l2 {
+    sa_family_t l2_family;
+    unsigned short l2_psm;
+    bt_bdaddr_t l2_bdaddr;
+    unsigned short l2_cid;
+    uint8_t l2_bdaddr_type;
+};
+
+struct bt_security {
+    uint8_t level;
+    uint8_t key_size;
+};
+
+#define ATT_CID                     4
+#define ATT_MTU                     247
+
+#define ATT_OP_ERROR_RSP            0x01
+#define ATT_OP_MTU_REQ              0x02
+#define ATT_OP_MTU_RSP              0x03
+#define ATT_OP_READ_BY_TYPE_REQ     0x08
+#define ATT_OP_READ_BY_TYPE_RSP     0x09
+#define ATT_OP_READ_REQ             0x0A
+#define ATT_OP_READ_RSP             0x0B
+#define ATT_OP_WRITE_REQ            0x12
+#define ATT_OP_WRITE_RSP            0x13
+#define ATT_OP_NOTIFY               0x1B
+#define ATT_OP_WRITE_CMD            0x52
+#define ATT_ERR_ATTR_NOT_FOUND      0x0A
+
+/* Mirrors main/bt_app/bt_device_bench_handlers.h */
+#define BENCH_OP_START              0x01
+#define BENCH_OP_STOP               0x02
+#define BENCH_OP_PING               0x03
+#define BENCH_OP_RESET              0x04
+#define BENCH_CLIENT_ECHO           0xEC
+#define BENCH_PING_LEN              9
+#define BENCH_IDLE_TIMEOUT_MS       2000
+
+enum { CHR_CONTROL = 1, CHR_STREAM, CHR_ECHO, CHR_RESULTS, CHR_MAX };
+
+typedef struct {
+    uint32_t sent, failed, no_mem, bytes, elapsed_ms, throughput_bps, next_seq, echoes;
+    uint32_t rtt_count, rtt_min_us, rtt_avg_us, rtt_max_us;
+} __attribute__((packed)) bench_results_t;
+
+typedef struct {
+    int fd;
+    uint16_t handles[CHR_MAX];
+
+    // Stream
+    uint32_t received;
+    uint32_t lost;
+    uint32_t expected_seq;
+    bool seq_started;
+    uint64_t bytes;
+    int64_t first_us;
+    int64_t last_us;
+
+    // Round trips measured here
+    int64_t *echo_sent_us;
+    uint32_t echo_count;
+    uint32_t echo_received;
+    int64_t rtt_sum_us, rtt_min_us, rtt_max_us;
+    uint32_t pings_returned;
+} bench_t;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_u16(uint8_t *p, uint16_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    put_u16(p, v);
+    put_u16(p + 2, v >> 16);
+}
+
+static int att_send(bench_t *bench, const uint8_t *pdu, size_t len) {
+    if (write(bench->fd, pdu, len) != (ssize_t) len) {
+        perror("write");
+        return -1;
+    }
+    return 0;
+}
+
+static void bench_on_notify(bench_t *bench, uint16_t handle, const uint8_t *value, size_t len) {
+    const int64_t t = now_us();
+
+    if (handle == bench->handles[CHR_STREAM] && len >= 8) {
+        const uint32_t seq = get_u32(value);
+        if (bench->seq_started && seq > bench->expected_seq) bench->lost += seq - bench->expected_seq;
+        if (!bench->seq_started) bench->first_us = t;
+        bench->seq_started = true;
+        bench->expected_seq = seq + 1;
+        bench->received++;
+        bench->bytes += len;
+        bench->last_us = t;
+    } else if (handle == bench->handles[CHR_ECHO] && len == BENCH_PING_LEN && value[0] == BENCH_OP_PING) {
+        // Device ping, write it back unchanged so the device measures the round trip
+        uint8_t pdu[3 + BENCH_PING_LEN] = { ATT_OP_WRITE_CMD };
+        put_u16(pdu + 1, bench->handles[CHR_ECHO]);
+        memcpy(pdu + 3, value, BENCH_PING_LEN);
+        att_send(bench, pdu, sizeof(pdu));
+        bench->pings_returned++;
+    } else if (handle == bench->handles[CHR_ECHO] && len >= 5 && value[0] == BENCH_CLIENT_ECHO) {
+        const uint32_t seq = get_u32(value + 1);
+        if (seq >= bench->echo_count || !bench->echo_sent_us[seq]) return;
+        const int64_t rtt = t - bench->echo_sent_us[seq];
+        bench->echo_sent_us[seq] = 0;
+        if (!bench->echo_received || rtt < bench->rtt_min_us) bench->rtt_min_us = rtt;
+        if (rtt > bench->rtt_max_us) bench->rtt_max_us = rtt;
+        bench->rtt_sum_us += rtt;
+        bench->echo_received++;
+    }
+}
+
+/* Reads one PDU, notifications are handled on the way. Returns its length, 0 on timeout, -1 on error */
+static int att_read(bench_t *bench, uint8_t *pdu, size_t max, int timeout_ms) {
+    struct pollfd pfd = { .fd = bench->fd, .events = POLLIN };
+    const int ready = poll(&pfd, 1, timeout_ms);
+    if (ready <= 0) return ready;
+
+    const ssize_t len = read(bench->fd, pdu, max);
+    if (len <= 0) {
+        if (len < 0) perror("read");
+        return -1;
+    }
+    if (pdu[0] == ATT_OP_NOTIFY && len >= 3) {
+        bench_on_notify(bench, pdu[1] | (pdu[2] << 8), pdu + 3, len - 3);
+    }
+    return len;
+}
+
+/* Sends a request and waits for its response, returns the response length or -(ATT error code) */
+static int att_request(bench_t *bench, const uint8_t *req, size_t req_len, uint8_t rsp_op, uint8_t *rsp, size_t rsp_max) {
+    if (att_send(bench, req, req_len) != 0) return -0xFF;
+
+    while (1) {
+        const int len = att_read(bench, rsp, rsp_max, 5000);
+        if (len <= 0) {
+            fprintf(stderr, "no response to ATT request 0x%02x\n", req[0]);
+            return -0xFF;
+        }
+        if (rsp[0] == rsp_op) return len;
+        if (rsp[0] == ATT_OP_ERROR_RSP && len >= 5 && rsp[1] == req[0]) return -rsp[4];
+    }
+}
+
+static int att_write(bench_t *bench, uint16_t handle, const uint8_t *value, size_t len) {
+    uint8_t pdu[ATT_MTU] = { ATT_OP_WRITE_REQ };
+    uint8_t rsp[ATT_MTU];
+    put_u16(pdu + 1, handle);
+    memcpy(pdu + 3, value, len);
+    return att_request(bench, pdu, 3 + len, ATT_OP_WRITE_RSP, rsp, sizeof(rsp)) < 0 ? -1 : 0;
+}
+
+/* Finds the value handles of the benchmark characteristics by their 128-bit UUIDs */
+static int bench_discover(bench_t *bench) {
+    static const uint8_t uuid_base[16] = {
+        0x8b, 0x7a, 0x6f, 0x5e, 0x4d, 0x3c, 0x2b, 0x9a, 0x1e, 0x4c, 0x5e, 0x7f, 0x00, 0x00, 0x8d, 0x5b
+    };
+    uint16_t start = 0x0001;
+
+    while (start) {
+        uint8_t req[7] = { ATT_OP_READ_BY_TYPE_REQ };
+        uint8_t rsp[ATT_MTU];
+        put_u16(req + 1, start);
+        put_u16(req + 3, 0xFFFF);
+        put_u16(req + 5, 0x2803);   // Characteristic declaration
+
+        const int len = att_request(bench, req, sizeof(req), ATT_OP_READ_BY_TYPE_RSP, rsp, sizeof(rsp));
+        if (len == -ATT_ERR_ATTR_NOT_FOUND) break;
+        if (len < 2 || rsp[1] < 5) return -1;
+
+        const int entry_len = rsp[1];
+        const uint16_t prev_start = start;
+        for (int off = 2; off + entry_len <= len; off += entry_len) {
+            const uint16_t decl = rsp[off] | (rsp[off + 1] << 8);
+            const uint16_t value_handle = rsp[off + 3] | (rsp[off + 4] << 8);
+            if (entry_len == 21 && memcmp(rsp + off + 5, uuid_base, 12) == 0 &&
+                memcmp(rsp + off + 18, uuid_base + 13, 3) == 0 && rsp[off + 17] < CHR_MAX) {
+                bench->handles[rsp[off + 17]] = value_handle;
+            }
+            start = decl == 0xFFFF ? 0 : decl + 1;
+        }
+        if (start == prev_start) return -1;
+    }
+
+    for (int i = CHR_CONTROL; i < CHR_MAX; i++) {
+        if (!bench->handles[i]) {
+            fprintf(stderr, "benchmark service not found, is BT_APP_BENCH_SERVICE_ENABLED set?\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void bench_wait_idle(bench_t *bench, bool (*done)(const bench_t *)) {
+    uint8_t pdu[ATT_MTU];
+    int64_t last_activity = now_us();
+    while (!done(bench) && now_us() - last_activity < BENCH_IDLE_TIMEOUT_MS * 1000LL) {
+        if (att_read(bench, pdu, sizeof(pdu), 100) > 0) last_activity = now_us();
+    }
+}
+
+static uint32_t bench_stream_target;
+
+static bool bench_stream_done(const bench_t *bench) {
+    return bench_stream_target && bench->received + bench->lost >= bench_stream_target;
+}
+
+static bool bench_echo_done(const bench_t *bench) {
+    return bench->echo_received >= bench->echo_count;
+}
+
+static bool bench_never_done(const bench_t *bench) {
+    return false;
+}
+
+static int parse_bdaddr(const char *str, bt_bdaddr_t *addr) {
+    unsigned int b[6];
+    if (sscanf(str, "%x:%x:%x:%x:%x:%x", &b[5], &b[4], &b[3], &b[2], &b[1], &b[0]) != 6) return -1;
+    for (int i = 0; i < 6; i++) addr->b[i] = b[i];
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: ble-bench-client [-r rate_hz] [-s size] [-n count] [-e echoes] [-p pings] [--random] "
+                    "AA:BB:CC:DD:EE:FF\n");
+}
+
+int main(int argc, char *argv[]) {
+    unsigned rate_hz = 100, size = 20, count = 1000, echoes = 100, pings = 100;
+    bool random_addr = false;
+    const char *addr_str = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rate_hz = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) size = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) echoes = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) pings = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "--random") == 0) random_addr = true;
+        else if (argv[i][0] != '-' && !addr_str) addr_str = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    struct bt_sockaddr_l2 addr = {
+        .l2_family = AF_BLUETOOTH,
+        .l2_cid = ATT_CID,
+        .l2_bdaddr_type = random_addr ? BDADDR_LE_RANDOM : BDADDR_LE_PUBLIC
+    };
+    if (!addr_str || parse_bdaddr(addr_str, &addr.l2_bdaddr) != 0 || !count) {
+        usage();
+        return 2;
+    }
+
+    bench_t bench = { .echo_count = echoes };
+    bench.echo_sent_us = calloc(echoes ? echoes : 1, sizeof(int64_t));
+    bench.fd = socket(AF_BLUETOOTH, SOCK_SEQPACKET, BTPROTO_L2CAP);
+    if (bench.fd < 0 || !bench.echo_sent_us) {
+        perror("socket");
+        return 1;
+    }
+
+    // Local side binds to any LE adapter
+    struct bt_sockaddr_l2 local = { .l2_family = AF_BLUETOOTH, .l2_cid = ATT_CID, .l2_bdaddr_type = BDADDR_LE_PUBLIC };
+    const struct bt_security sec = { .level = BT_SECURITY_MEDIUM };
+    if (bind(bench.fd, (struct sockaddr *) &local, sizeof(local)) < 0 ||
+        setsockopt(bench.fd, SOL_BLUETOOTH, BT_SECURITY, &sec, sizeof(sec)) < 0 ||
+        connect(bench.fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror(addr_str);
+        return 1;
+    }
+
+    uint8_t pdu[ATT_MTU];
+    const uint8_t mtu_req[3] = { ATT_OP_MTU_REQ, ATT_MTU & 0xFF, ATT_MTU >> 8 };
+    const int mtu_len = att_request(&bench, mtu_req, sizeof(mtu_req), ATT_OP_MTU_RSP, pdu, sizeof(pdu));
+    const unsigned mtu = mtu_len >= 3 ? (pdu[1] | (pdu[2] << 8)) : 23;
+    printf("connected to %s, ATT MTU %u\n", addr_str, mtu < ATT_MTU ? mtu : ATT_MTU);
+
+    if (bench_discover(&bench) != 0) return 1;
+
+    const uint8_t notify_on[2] = { 0x01, 0x00 };
+    if (att_write(&bench, bench.handles[CHR_STREAM] + 1, notify_on, sizeof(notify_on)) != 0 ||
+        att_write(&bench, bench.handles[CHR_ECHO] + 1, notify_on, sizeof(notify_on)) != 0) {
+        fprintf(stderr, "failed to subscribe, pair the bridge first (bluetoothctl pair)\n");
+        return 1;
+    }
+
+    const uint8_t reset = BENCH_OP_RESET;
+    att_write(&bench, bench.handles[CHR_CONTROL], &reset, 1);
+
+    // Stream
+    uint8_t start[9] = { BENCH_OP_START };
+    put_u16(start + 1, rate_hz);
+    put_u16(start + 3, size);
+    put_u32(start + 5, count);
+    if (att_write(&bench, bench.handles[CHR_CONTROL], start, sizeof(start)) != 0) {
+        fprintf(stderr, "START rejected, rate 1..2000 Hz and size 8..244 bytes\n");
+        return 1;
+    }
+    bench_stream_target = count;
+    bench_wait_idle(&bench, bench_stream_done);
+
+    // Client measured round trips
+    for (uint32_t i = 0; i < bench.echo_count; i++) {
+        uint8_t echo[3 + 5] = { ATT_OP_WRITE_CMD };
+        put_u16(echo + 1, bench.handles[CHR_ECHO]);
+        echo[3] = BENCH_CLIENT_ECHO;
+        put_u32(echo + 4, i);
+        bench.echo_sent_us[i] = now_us();
+        att_send(&bench, echo, sizeof(echo));
+        // One echo in flight at a time keeps the measurement free of queueing
+        const int64_t deadline = now_us() + 500000;
+        while (bench.echo_sent_us[i] && now_us() < deadline) att_read(&bench, pdu, sizeof(pdu), 50);
+    }
+    bench_wait_idle(&bench, bench_echo_done);
+
+    // Device measured round trips
+    if (pings) {
+        uint8_t ping[3] = { BENCH_OP_PING };
+        put_u16(ping + 1, pings);
+        att_write(&bench, bench.handles[CHR_CONTROL], ping, sizeof(ping));
+        bench_wait_idle(&bench, bench_never_done);
+    }
+
+    const double duration_s = (bench.last_us - bench.first_us) / 1e6;
+    printf("client: received %u, lost %u, %.0f bps over %.3f s\n", bench.received, bench.lost,
+           duration_s > 0 ? bench.bytes * 8 / duration_s : 0, duration_s);
+    if (bench.echo_received) {
+        printf("client: echo rtt %u/%u, min %lld us, avg %lld us, max %lld us\n", bench.echo_received, bench.echo_count,
+               (long long) bench.rtt_min_us, (long long) (bench.rtt_sum_us / bench.echo_received),
+               (long long) bench.rtt_max_us);
+    }
+
+    uint8_t read_req[3] = { ATT_OP_READ_REQ };
+    put_u16(read_req + 1, bench.handles[CHR_RESULTS]);
+    const int len = att_request(&bench, read_req, sizeof(read_req), ATT_OP_READ_RSP, pdu, sizeof(pdu));
+    if (len >= 1 + (int) sizeof(bench_results_t)) {
+        bench_results_t r;
+        memcpy(&r, pdu + 1, sizeof(r));
+        printf("device: sent %u, failed %u (no mem %u), %u bps over %u ms, next seq %u, echoes %u\n",
+               r.sent, r.failed, r.no_mem, r.throughput_bps, r.elapsed_ms, r.next_seq, r.echoes);
+        printf("device: ping rtt %u/%u, min %u us, avg %u us, max %u us\n",
+               r.rtt_count, bench.pings_returned, r.rtt_min_us, r.rtt_avg_us, r.rtt_max_us);
+    }
+
+    const uint8_t stop = BENCH_OP_STOP;
+    att_write(&bench, bench.handles[CHR_CONTROL], &stop, 1);
+    close(bench.fd);
+    free(bench.echo_sent_us);
+    return 0;
+}
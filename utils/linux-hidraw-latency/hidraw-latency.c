@@ -0,0 +1,350 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * hidraw-latency: dumps the report map of a Linux hidraw device and timestamps every input report it sends.
+ *
+ * Reports are written as CSV (sequence, arrival time, inter-arrival time, latency, raw bytes) and summarised
+ * as report rate, inter-arrival jitter and, when the time of every stimulus is known, end-to-end latency.
+ *
+ *   hidraw-latency [-n count] [-o out.csv] [-s stimulus.txt] /dev/hidrawN
+ *   hidraw-latency --uhid [-n count] [-i interval_ms] [-o out.csv]
+ *
+ * The stimulus file holds one CLOCK_MONOTONIC timestamp in microseconds per line, the time the scripted
+ * input source caused the n-th report. With --uhid a virtual keyboard is created through /dev/uhid and
+ * typed on by the tool itself, which measures the kernel path without any radio.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/hidraw.h>
+#include <linux/input.h>
+#include <linux/uhid.h>
+
+#define REPORT_MAX_LEN          64
+#define DEFAULT_COUNT           1000
+#define DEFAULT_INTERVAL_MS     10
+#define UHID_DEVICE_NAME        "hidraw-latency virtual keyboard"
+
+/* Boot keyboard, the same layout the bridge sends over BLE */
+static const uint8_t uhid_report_map[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75, 0x08,
+    0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0
+};
+
+typedef struct {
+    int uhid_fd;
+    unsigned count;
+    unsigned interval_ms;
+    int64_t *stimulus_us;
+} uhid_typist_t;
+
+static int64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int cmp_i64(const void *a, const void *b) {
+    const int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_descriptor(int fd) {
+    struct hidraw_devinfo info;
+    char name[256] = "";
+    int desc_size = 0;
+    struct hidraw_report_descriptor desc;
+
+    if (ioctl(fd, HIDIOCGRAWNAME(sizeof(name)), name) < 0) name[0] = '\0';
+    if (ioctl(fd, HIDIOCGRAWINFO, &info) == 0) {
+        printf("%04X %04X: %s\n", info.vendor & 0xFFFF, info.product & 0xFFFF, name);
+    }
+    if (ioctl(fd, HIDIOCGRDESCSIZE, &desc_size) < 0) {
+        perror("HIDIOCGRDESCSIZE");
+        return;
+    }
+    desc.size = desc_size;
+    if (ioctl(fd, HIDIOCGRDESC, &desc) < 0) {
+        perror("HIDIOCGRDESC");
+        return;
+    }
+
+    printf("DESCRIPTOR:\n");
+    for (int i = 0; i < desc_size; i++) {
+        printf("  %02x", desc.value[i]);
+        if (i % 16 == 15) printf("\n");
+    }
+    if (desc_size % 16) printf("\n");
+    printf("  (%d bytes)\n", desc_size);
+}
+
+static int uhid_write(int fd, const struct uhid_event *ev) {
+    const ssize_t ret = write(fd, ev, sizeof(*ev));
+    if (ret != sizeof(*ev)) {
+        fprintf(stderr, "uhid write failed: %s\n", ret < 0 ? strerror(errno) : "short write");
+        return -1;
+    }
+    return 0;
+}
+
+static int uhid_create(void) {
+    const int fd = open("/dev/uhid", O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        perror("/dev/uhid");
+        return -1;
+    }
+
+    struct uhid_event ev = { .type = UHID_CREATE2 };
+    strncpy((char *) ev.u.create2.name, UHID_DEVICE_NAME, sizeof(ev.u.create2.name) - 1);
+    memcpy(ev.u.create2.rd_data, uhid_report_map, sizeof(uhid_report_map));
+    ev.u.create2.rd_size = sizeof(uhid_report_map);
+    ev.u.create2.bus = BUS_VIRTUAL;
+    ev.u.create2.vendor = 0x303A;
+    ev.u.create2.product = 0x4001;
+    if (uhid_write(fd, &ev) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    // The kernel answers with UHID_START once the hidraw node exists
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (poll(&pfd, 1, 2000) > 0) {
+        if (read(fd, &ev, sizeof(ev)) <= 0) break;
+        if (ev.type == UHID_START) return fd;
+    }
+    fprintf(stderr, "uhid device did not start\n");
+    close(fd);
+    return -1;
+}
+
+static int uhid_find_hidraw(char *path, size_t path_len) {
+    glob_t nodes;
+    if (glob("/dev/hidraw*", 0, NULL, &nodes) != 0) return -1;
+
+    int found = -1;
+    for (size_t i = 0; i < nodes.gl_pathc && found < 0; i++) {
+        const int fd = open(nodes.gl_pathv[i], O_RDONLY);
+        if (fd < 0) continue;
+        char name[256] = "";
+        if (ioctl(fd, HIDIOCGRAWNAME(sizeof(name)), name) >= 0 && strcmp(name, UHID_DEVICE_NAME) == 0) {
+            snprintf(path, path_len, "%s", nodes.gl_pathv[i]);
+            found = 0;
+        }
+        close(fd);
+    }
+    globfree(&nodes);
+    return found;
+}
+
+/* Alternates press and release of 'a', one report per interval, and remembers when each one was sent */
+static void *uhid_typist_task(void *arg) {
+    uhid_typist_t *typist = arg;
+    struct uhid_event ev = { .type = UHID_INPUT2 };
+    ev.u.input2.size = 8;
+
+    // Give the reader time to open the hidraw node
+    usleep(200000);
+    for (unsigned i = 0; i < typist->count; i++) {
+        memset(ev.u.input2.data, 0, 8);
+        ev.u.input2.data[2] = i % 2 == 0 ? 0x04 : 0x00;
+        typist->stimulus_us[i] = now_us();
+        if (uhid_write(typist->uhid_fd, &ev) != 0) break;
+        usleep(typist->interval_ms * 1000);
+    }
+    return NULL;
+}
+
+static int64_t *read_stimulus(const char *path, unsigned *count) {
+    FILE *in = fopen(path, "r");
+    if (!in) {
+        perror(path);
+        return NULL;
+    }
+    size_t cap = 1024, len = 0;
+    int64_t *stimulus = malloc(cap * sizeof(int64_t));
+    long long value;
+    while (stimulus && fscanf(in, "%lld%*[^\n]", &value) == 1) {
+        if (len == cap) {
+            cap *= 2;
+            int64_t *grown = realloc(stimulus, cap * sizeof(int64_t));
+            if (!grown) {
+                free(stimulus);
+                stimulus = NULL;
+                break;
+            }
+            stimulus = grown;
+        }
+        stimulus[len++] = value;
+    }
+    fclose(in);
+    *count = len;
+    return stimulus;
+}
+
+static void print_stats(const char *label, int64_t *values, unsigned count) {
+    if (!count) return;
+    double sum = 0, sq = 0;
+    for (unsigned i = 0; i < count; i++) {
+        sum += values[i];
+        sq += (double) values[i] * values[i];
+    }
+    const double mean = sum / count;
+    const double var = sq / count - mean * mean;
+    qsort(values, count, sizeof(int64_t), cmp_i64);
+    printf("%s: mean %.1f us, stddev %.1f us, min %lld, p50 %lld, p99 %lld, max %lld\n",
+           label, mean, var > 0 ? sqrt(var) : 0.0, (long long) values[0], (long long) values[count / 2],
+           (long long) values[count * 99 / 100], (long long) values[count - 1]);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: hidraw-latency [-n count] [-o out.csv] [-s stimulus.txt] /dev/hidrawN\n"
+                    "       hidraw-latency --uhid [-n count] [-i interval_ms] [-o out.csv]\n");
+}
+
+int main(int argc, char *argv[]) {
+    unsigned count = DEFAULT_COUNT;
+    unsigned interval_ms = DEFAULT_INTERVAL_MS;
+    const char *csv_path = NULL;
+    const char *stimulus_path = NULL;
+    const char *dev_path = NULL;
+    bool use_uhid = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--uhid") == 0) use_uhid = true;
+        else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) count = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) interval_ms = strtoul(argv[++i], NULL, 0);
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) csv_path = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) stimulus_path = argv[++i];
+        else if (argv[i][0] != '-' && !dev_path) dev_path = argv[i];
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (use_uhid == (dev_path != NULL) || !count) {
+        usage();
+        return 2;
+    }
+
+    unsigned stimulus_count = 0;
+    int64_t *stimulus_us = NULL;
+    uhid_typist_t typist = { .uhid_fd = -1, .count = count, .interval_ms = interval_ms };
+    char uhid_path[64];
+
+    if (use_uhid) {
+        typist.uhid_fd = uhid_create();
+        if (typist.uhid_fd < 0) return 1;
+        // udev may need a moment to create the node
+        int tries = 20;
+        while (uhid_find_hidraw(uhid_path, sizeof(uhid_path)) != 0 && --tries) {
+            usleep(100000);
+        }
+        if (!tries) {
+            fprintf(stderr, "hidraw node of the uhid device not found\n");
+            return 1;
+        }
+        dev_path = uhid_path;
+        stimulus_us = calloc(count, sizeof(int64_t));
+        stimulus_count = count;
+        typist.stimulus_us = stimulus_us;
+    } else if (stimulus_path) {
+        stimulus_us = read_stimulus(stimulus_path, &stimulus_count);
+        if (!stimulus_us) return 1;
+    }
+
+    const int fd = open(dev_path, O_RDONLY);
+    if (fd < 0) {
+        perror(dev_path);
+        return 1;
+    }
+    printf("%s:\n", dev_path);
+    print_descriptor(fd);
+
+    FILE *csv = NULL;
+    if (csv_path) {
+        csv = fopen(csv_path, "w");
+        if (!csv) {
+            perror(csv_path);
+            return 1;
+        }
+        fprintf(csv, "seq,arrival_us,delta_us,latency_us,length,data\n");
+    }
+
+    pthread_t typist_thread;
+    if (use_uhid && pthread_create(&typist_thread, NULL, uhid_typist_task, &typist) != 0) {
+        fprintf(stderr, "failed to start the typist\n");
+        return 1;
+    }
+
+    int64_t *arrival_us = calloc(count, sizeof(int64_t));
+    int64_t *deltas = calloc(count, sizeof(int64_t));
+    int64_t *latencies = calloc(count, sizeof(int64_t));
+    if (!arrival_us || !deltas || !latencies) return 1;
+
+    unsigned received = 0, latency_count = 0;
+    uint8_t report[REPORT_MAX_LEN];
+    while (received < count) {
+        const ssize_t len = read(fd, report, sizeof(report));
+        const int64_t t = now_us();
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            perror("read");
+            break;
+        }
+
+        arrival_us[received] = t;
+        int64_t delta = received ? t - arrival_us[received - 1] : 0;
+        if (received) deltas[received - 1] = delta;
+
+        // The typist stamps a report right before writing it, a stimulus file is read completely upfront
+        int64_t latency = -1;
+        if (received < stimulus_count && stimulus_us[received]) {
+            latency = t - stimulus_us[received];
+            latencies[latency_count++] = latency;
+        }
+
+        if (csv) {
+            fprintf(csv, "%u,%lld,%lld,%lld,%zd,", received, (long long) t, (long long) delta, (long long) latency, len);
+            for (ssize_t i = 0; i < len; i++) fprintf(csv, "%02x", report[i]);
+            fprintf(csv, "\n");
+        }
+        received++;
+    }
+
+    if (received > 1) {
+        const double duration_s = (arrival_us[received - 1] - arrival_us[0]) / 1e6;
+        printf("reports: %u in %.3f s, %.1f reports/s\n", received, duration_s, (received - 1) / duration_s);
+        print_stats("inter-arrival", deltas, received - 1);
+    }
+    print_stats("latency", latencies, latency_count);
+
+    if (use_uhid) {
+        pthread_join(typist_thread, NULL);
+        const struct uhid_event destroy = { .type = UHID_DESTROY };
+        uhid_write(typist.uhid_fd, &destroy);
+        close(typist.uhid_fd);
+    }
+    if (csv) fclose(csv);
+    close(fd);
+    free(arrival_us);
+    free(deltas);
+    free(latencies);
+    free(stimulus_us);
+    return 0;
+}
@@ -0,0 +1,405 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Discrete-event model of the key path from a physical key transition to the BLE connection event that carries it.
+ *
+ *   key transition -> next USB interrupt poll -> router + keyboard diff -> report scheduler -> host stack
+ *   -> connection event
+ *
+ * The router, the keyboard diff and the scheduler are the firmware code. Three event sources run on one virtual
+ * microsecond clock: a random typist, the USB poll interval and the BLE connection events. The scheduler hands
+ * `window` reports to the stack per connection event and folds the other key events into pending reports, the
+ * way the BT app drives it. A report has to reach the stack before the controller prepares the next event, the
+ * peripheral skips up to `latency` events while it has nothing queued, and every event can be missed. Latency is
+ * measured per key transition from the physical change to the event that delivered the first report carrying it.
+ *
+ * Without arguments a sweep over USB poll rates and connection parameters is printed as CSV.
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_app_sched.h"
+#include "usb_app_keyboard.h"
+#include "usb_app_router.h"
+
+#define SIM_DEFAULT_TRANSITIONS     20000
+#define SIM_STACK_BUFFERS           32          // Notifies the host stack holds before ble_gatts_notify fails
+#define SIM_PENDING_MAX             256         // Key transitions on their way to the host
+#define SIM_WINDOW                  1           // BT_HID_REPORTS_PER_EVENT of the firmware
+#define SIM_PREPARE_US              500         // Data queued later than this before an event waits for the next one
+#define SIM_PROCESSING_US           50          // USB callback to ble_gatts_notify on the ESP32
+#define SIM_HOLD_MIN_US             40000
+#define SIM_HOLD_MAX_US             120000
+#define SIM_MAX_HELD_KEYS           HID_KEYBOARD_KEY_MAX
+
+typedef struct {
+    uint32_t usb_poll_us;
+    uint32_t conn_interval_us;
+    uint16_t periph_latency;
+    double miss_ratio;
+    uint8_t window;                     // Reports the scheduler hands to the stack per connection event
+    uint8_t pkts_per_event;
+    uint32_t key_rate_hz;
+    uint32_t transitions;
+    uint64_t seed;
+} sim_config_t;
+
+typedef struct {
+    uint64_t transitions;               // Key events the USB side produced
+    uint64_t reports;                   // Reports on air
+    uint64_t merged;                    // Key events folded into a pending report
+    uint64_t refused;                   // Reports the full stack refused, sent again later
+    uint64_t lost;                      // Key events no report carried, an overflowed scheduler merged them away
+    uint64_t missed_events;
+    double mean_us;
+    uint32_t p50_us;
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} sim_result_t;
+
+typedef struct {
+    const sim_config_t *config;
+    uint64_t rng;
+
+    // Physical keyboard
+    uint8_t held[SIM_MAX_HELD_KEYS];
+    int64_t key_changed_at[256];
+    int64_t release_at[SIM_MAX_HELD_KEYS];
+    int64_t next_press_us;
+    uint32_t generated;
+
+    // Bridge
+    usb_app_iface_route_t route;
+    usb_app_keyboard_state_t keyboard;
+    uint8_t reported[SIM_MAX_HELD_KEYS];
+    int64_t now_us;
+
+    bt_app_sched_t sched;
+
+    // Reports in the host stack waiting for a connection event
+    struct {
+        bt_app_keyboard_t state;
+        int64_t queued_us;
+    } stack[SIM_STACK_BUFFERS];
+    size_t stack_head;
+    size_t stack_count;
+
+    // Key events not on air yet with the time of their physical change, and what the host has down
+    struct {
+        uint8_t usage;
+        int64_t changed_us;
+    } pending[SIM_PENDING_MAX];
+    size_t pending_count;
+    bt_app_keyboard_t host;
+
+    uint32_t *latencies;
+    uint32_t latency_count;
+    sim_result_t result;
+} sim_t;
+
+static sim_t *sim_active;
+
+static uint64_t sim_rand(sim_t *sim) {
+    sim->rng ^= sim->rng << 13;
+    sim->rng ^= sim->rng >> 7;
+    sim->rng ^= sim->rng << 17;
+    return sim->rng;
+}
+
+static double sim_rand_unit(sim_t *sim) {
+    return (sim_rand(sim) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static int64_t sim_rand_exp_us(sim_t *sim, double mean_us) {
+    double u = sim_rand_unit(sim);
+    if (u <= 0) u = 1e-12;
+    return (int64_t)(-log(u) * mean_us);
+}
+
+/* Send callback of the scheduler, the report reaches the stack once the bridge processed the USB report */
+static int sim_send(const bt_app_keyboard_t *state, void *arg) {
+    sim_t *sim = arg;
+    if (sim->stack_count == SIM_STACK_BUFFERS) {
+        sim->result.refused++;
+        return -1;
+    }
+    const size_t tail = (sim->stack_head + sim->stack_count++) % SIM_STACK_BUFFERS;
+    sim->stack[tail].state = *state;
+    sim->stack[tail].queued_us = sim->now_us + SIM_PROCESSING_US;
+    return 0;
+}
+
+static void sim_key_event(const key_event_t *key_event, void *arg) {
+    sim_t *sim = arg;
+    const bool pressed = key_event->state == KEY_STATE_PRESSED;
+    if (!bt_app_sched_event(&sim->sched, key_event->key_code, pressed)) return;
+
+    sim->result.transitions++;
+    if (sim->pending_count == SIM_PENDING_MAX) {
+        sim->result.lost++;
+        return;
+    }
+    sim->pending[sim->pending_count].usage = key_event->key_code;
+    sim->pending[sim->pending_count++].changed_us = sim->key_changed_at[key_event->key_code];
+}
+
+/* Every usage the report changes delivers the oldest pending key event of that usage */
+static void sim_host_receive(sim_t *sim, const bt_app_keyboard_t *report, int64_t now_us) {
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        if (!(report->bits[usage >> 3] ^ sim->host.bits[usage >> 3])) {
+            usage |= 7;
+            continue;
+        }
+        if (bt_app_keyboard_is_pressed(report, usage) == bt_app_keyboard_is_pressed(&sim->host, usage)) continue;
+        for (size_t i = 0; i < sim->pending_count; i++) {
+            if (sim->pending[i].usage != usage) continue;
+            sim->latencies[sim->latency_count++] = now_us - sim->pending[i].changed_us;
+            memmove(&sim->pending[i], &sim->pending[i + 1], (sim->pending_count - i - 1) * sizeof(sim->pending[0]));
+            sim->pending_count--;
+            break;
+        }
+    }
+    sim->host = *report;
+    sim->result.reports++;
+}
+
+static void sim_keyboard_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    usb_app_keyboard_process_report(&sim_active->keyboard, (const hid_keyboard_input_report_boot_t *) data,
+                                    sim_key_event, sim_active);
+}
+
+static const usb_app_report_handler_t sim_handlers[USB_APP_REPORT_KIND_MAX] = {
+    [USB_APP_REPORT_KIND_KEYBOARD] = sim_keyboard_handler
+};
+
+/* Releases the held keys that are due and presses a random key when the next press is due, returns the time of the next step */
+static int64_t sim_typist_step(sim_t *sim, int64_t now_us) {
+    for (int i = 0; i < SIM_MAX_HELD_KEYS; i++) {
+        if (sim->held[i] && sim->release_at[i] <= now_us) {
+            sim->key_changed_at[sim->held[i]] = now_us;
+            sim->held[i] = 0;
+            sim->generated++;
+        }
+    }
+
+    int free_slot = -1;
+    for (int i = 0; i < SIM_MAX_HELD_KEYS && free_slot < 0; i++) {
+        if (!sim->held[i]) free_slot = i;
+    }
+    if (now_us >= sim->next_press_us && sim->generated < sim->config->transitions) {
+        if (free_slot >= 0) {
+            // Held keys are skipped and a finger needs the minimum hold time before it hits the same key again
+            uint8_t key;
+            bool taken;
+            do {
+                key = HID_KEY_A + sim_rand(sim) % (HID_KEY_Z - HID_KEY_A + 1);
+                taken = sim->key_changed_at[key] && now_us - sim->key_changed_at[key] < SIM_HOLD_MIN_US;
+                for (int i = 0; i < SIM_MAX_HELD_KEYS; i++) taken |= sim->held[i] == key;
+            } while (taken);
+
+            sim->held[free_slot] = key;
+            sim->key_changed_at[key] = now_us;
+            sim->release_at[free_slot] = now_us + SIM_HOLD_MIN_US + sim_rand(sim) % (SIM_HOLD_MAX_US - SIM_HOLD_MIN_US);
+            sim->generated++;
+        }
+        sim->next_press_us = now_us + 1 + sim_rand_exp_us(sim, 1e6 / sim->config->key_rate_hz);
+    }
+
+    // Next step is the next press or the earliest release, whichever comes first
+    int64_t next_us = sim->generated < sim->config->transitions ? sim->next_press_us : INT64_MAX;
+    for (int i = 0; i < SIM_MAX_HELD_KEYS; i++) {
+        if (sim->held[i] && sim->release_at[i] < next_us) next_us = sim->release_at[i];
+    }
+    return next_us;
+}
+
+/* Interrupt IN poll: the device reports only when its key state changed since the last poll */
+static void sim_usb_poll(sim_t *sim) {
+    if (memcmp(sim->held, sim->reported, sizeof(sim->held)) == 0) return;
+    memcpy(sim->reported, sim->held, sizeof(sim->held));
+
+    hid_keyboard_input_report_boot_t report = { 0 };
+    memcpy(report.key, sim->held, sizeof(report.key));
+    sim_active = sim;
+    usb_app_router_dispatch(&sim->route, (const uint8_t *) &report, sizeof(report));
+}
+
+/* The stack sends what it got before the prepare deadline, then the scheduler opens the next window */
+static void sim_conn_event(sim_t *sim, uint64_t event_counter, int64_t queued_before_us, int64_t now_us) {
+    size_t ready = 0;
+    while (ready < sim->stack_count &&
+           sim->stack[(sim->stack_head + ready) % SIM_STACK_BUFFERS].queued_us <= queued_before_us) {
+        ready++;
+    }
+
+    const bool anchor = event_counter % (sim->config->periph_latency + 1) == 0;
+    if (ready || anchor) {
+        if (sim_rand_unit(sim) < sim->config->miss_ratio) {
+            sim->result.missed_events++;
+            ready = 0;
+        }
+        for (size_t i = 0; i < ready && i < sim->config->pkts_per_event; i++) {
+            sim_host_receive(sim, &sim->stack[sim->stack_head].state, now_us);
+            sim->stack_head = (sim->stack_head + 1) % SIM_STACK_BUFFERS;
+            sim->stack_count--;
+        }
+    }
+    bt_app_sched_connection_event(&sim->sched);
+}
+
+static int sim_cmp_u32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+static int sim_run(const sim_config_t *config, sim_result_t *result) {
+    sim_t *sim = calloc(1, sizeof(sim_t));
+    if (!sim) return -1;
+    sim->config = config;
+    sim->rng = config->seed ? config->seed : 1;
+    // Keys still held after the last press add their releases
+    sim->latencies = malloc(sizeof(uint32_t) * (config->transitions + SIM_MAX_HELD_KEYS));
+    bt_app_sched_init(&sim->sched, config->window, sim_send, sim);
+    bt_app_keyboard_init(&sim->host);
+    if (!sim->latencies) {
+        free(sim);
+        return -1;
+    }
+
+    const hid_host_dev_params_t dev_params = {
+        .sub_class = HID_SUBCLASS_BOOT_INTERFACE,
+        .proto = HID_PROTOCOL_KEYBOARD
+    };
+    usb_app_router_build(&sim->route, &dev_params, NULL, 0, sim_handlers);
+
+    // Random phases, USB and BLE clocks are not related
+    int64_t next_key_us = sim_rand(sim) % 100000;
+    int64_t next_poll_us = sim_rand(sim) % config->usb_poll_us;
+    int64_t next_event_us = sim_rand(sim) % config->conn_interval_us;
+    uint64_t event_counter = 0;
+
+    // Runs until every press got its release and all of them reached the host
+    while (next_key_us != INT64_MAX || bt_app_sched_pending(&sim->sched) || sim->stack_count ||
+           memcmp(sim->held, sim->reported, sizeof(sim->held)) != 0) {
+        if (next_key_us <= next_poll_us && next_key_us <= next_event_us) {
+            sim->now_us = next_key_us;
+            next_key_us = sim_typist_step(sim, sim->now_us);
+        } else if (next_poll_us <= next_event_us) {
+            sim->now_us = next_poll_us;
+            sim_usb_poll(sim);
+            next_poll_us += config->usb_poll_us;
+        } else {
+            sim->now_us = next_event_us;
+            sim_conn_event(sim, event_counter++, next_event_us - SIM_PREPARE_US, next_event_us);
+            next_event_us += config->conn_interval_us;
+        }
+    }
+
+    *result = sim->result;
+    result->merged = sim->sched.stats.merged;
+    result->lost += sim->pending_count;
+    if (sim->latency_count) {
+        qsort(sim->latencies, sim->latency_count, sizeof(uint32_t), sim_cmp_u32);
+        double sum = 0;
+        for (uint32_t i = 0; i < sim->latency_count; i++) sum += sim->latencies[i];
+        result->mean_us = sum / sim->latency_count;
+        result->p50_us = sim->latencies[sim->latency_count * 50 / 100];
+        result->p90_us = sim->latencies[sim->latency_count * 90 / 100];
+        result->p99_us = sim->latencies[sim->latency_count * 99 / 100];
+        result->max_us = sim->latencies[sim->latency_count - 1];
+    }
+
+    free(sim->latencies);
+    free(sim);
+    return 0;
+}
+
+static void sim_print_header(void) {
+    printf("usb_poll_us,conn_interval_us,periph_latency,miss_ratio,window,pkts_per_event,key_rate_hz,"
+           "transitions,reports,merged,refused,lost,missed_events,mean_us,p50_us,p90_us,p99_us,max_us\n");
+}
+
+static void sim_print(const sim_config_t *config, const sim_result_t *result) {
+    printf("%u,%u,%u,%.3f,%u,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%.0f,%u,%u,%u,%u\n",
+           config->usb_poll_us, config->conn_interval_us, config->periph_latency, config->miss_ratio,
+           config->window, config->pkts_per_event, config->key_rate_hz, (unsigned long long) result->transitions,
+           (unsigned long long) result->reports, (unsigned long long) result->merged,
+           (unsigned long long) result->refused, (unsigned long long) result->lost,
+           (unsigned long long) result->missed_events,
+           result->mean_us, result->p50_us, result->p90_us, result->p99_us, result->max_us);
+}
+
+int main(int argc, char *argv[]) {
+    sim_config_t config = {
+        .usb_poll_us = 1000,
+        .conn_interval_us = 15000,
+        .periph_latency = 0,
+        .miss_ratio = 0,
+        .window = SIM_WINDOW,
+        .pkts_per_event = 4,
+        .key_rate_hz = 10,
+        .transitions = SIM_DEFAULT_TRANSITIONS,
+        .seed = 1
+    };
+    sim_result_t result;
+
+    if (argc == 1) {
+        static const uint32_t polls[] = { 1000, 2000, 4000, 8000, 10000 };
+        static const uint32_t intervals[] = { 7500, 11250, 15000, 20000, 30000, 45000, 60000 };
+        static const uint16_t latencies[] = { 0, 4 };
+        static const double misses[] = { 0, 0.05, 0.2 };
+        static const uint32_t rates[] = { 10, 40 };
+        static const uint8_t windows[] = { SIM_WINDOW, 4 };
+
+        sim_print_header();
+        for (size_t p = 0; p < sizeof(polls) / sizeof(polls[0]); p++)
+        for (size_t i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++)
+        for (size_t l = 0; l < sizeof(latencies) / sizeof(latencies[0]); l++)
+        for (size_t m = 0; m < sizeof(misses) / sizeof(misses[0]); m++)
+        for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+        for (size_t w = 0; w < sizeof(windows) / sizeof(windows[0]); w++) {
+            config.usb_poll_us = polls[p];
+            config.conn_interval_us = intervals[i];
+            config.periph_latency = latencies[l];
+            config.miss_ratio = misses[m];
+            config.key_rate_hz = rates[r];
+            config.window = windows[w];
+            if (sim_run(&config, &result) != 0) return 1;
+            sim_print(&config, &result);
+        }
+        return 0;
+    }
+
+    if (argc < 5) {
+        fprintf(stderr, "usage: ble-latency-sim [usb_poll_us conn_interval_us periph_latency miss_ratio "
+                        "[window pkts_per_event key_rate_hz transitions seed]]\n");
+        return 2;
+    }
+    config.usb_poll_us = strtoul(argv[1], NULL, 0);
+    config.conn_interval_us = strtoul(argv[2], NULL, 0);
+    config.periph_latency = strtoul(argv[3], NULL, 0);
+    config.miss_ratio = strtod(argv[4], NULL);
+    if (argc > 5) config.window = strtoul(argv[5], NULL, 0);
+    if (argc > 6) config.pkts_per_event = strtoul(argv[6], NULL, 0);
+    if (argc > 7) config.key_rate_hz = strtoul(argv[7], NULL, 0);
+    if (argc > 8) config.transitions = strtoul(argv[8], NULL, 0);
+    if (argc > 9) config.seed = strtoull(argv[9], NULL, 0);
+    if (!config.usb_poll_us || !config.conn_interval_us || !config.window || !config.pkts_per_event ||
+        !config.key_rate_hz) {
+        fprintf(stderr, "intervals, window, pkts_per_event and key_rate_hz must not be 0\n");
+        return 2;
+    }
+
+    if (sim_run(&config, &result) != 0) return 1;
+    sim_print_header();
+    sim_print(&config, &result);
+    return 0;
+}
@@ -0,0 +1,441 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the whole firmware natively on Linux: app_main() with the USB app, the HID host driver and the BT app on top
+ * of the simulated USB Host Library, NimBLE and FreeRTOS in shim/. The harness plugs keyboards into the simulated
+ * bus, connects a simulated BLE central and types, one key event at a time, waiting for the notification it causes.
+ *
+ * Every notification must carry the report the BT app keyboard state gives for the keys typed so far, the boot report
+ * on a link with the default ATT MTU and the NKRO report on a larger one. Per scenario it reports the CPU time of the
+ * firmware tasks and the heap allocations per key event, and the USB report to notification latency. The exit
+ * status is non-zero on any mismatch or missing notification.
+ *
+ * The firmware logs go to stderr, the results to stdout.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_app_keyboard.h"
+#include "hid_usage_keyboard.h"
+#include "sim.h"
+#include "test-result.h"
+#include "usb_app.h"
+
+#define SIM_KEY_EVENTS              200         // Per scenario, presses and releases
+#define SIM_CONN_ITVL               6           // 7.5 ms in units of 1.25 ms
+#define SIM_MTU_DEFAULT             23
+#define SIM_MTU_LARGE               247
+#define SIM_INPUT_REPORT_UUID       0x2A4D      // The central enables notifications of every report
+#define SIM_NOTIFY_TIMEOUT_US       1000000
+#define SIM_BRINGUP_TIMEOUT_US      5000000
+#define SIM_SETTLE_US               (4 * SIM_CONN_ITVL * 1250)
+#define SIM_HUB_DEVICES             16          // Behind the simulated hub, every other one a keyboard and mouse combo
+#define SIM_HUB_ROUNDS              20          // Unplug and replug bursts
+#define SIM_HUB_TIMEOUT_US          10000000
+
+static volatile size_t sim_allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) { __atomic_fetch_add(&sim_allocs, 1, __ATOMIC_RELAXED); return __real_malloc(size); }
+void *__wrap_calloc(size_t nmemb, size_t size) { __atomic_fetch_add(&sim_allocs, 1, __ATOMIC_RELAXED); return __real_calloc(nmemb, size); }
+void *__wrap_realloc(void *ptr, size_t size) { __atomic_fetch_add(&sim_allocs, 1, __ATOMIC_RELAXED); return __real_realloc(ptr, size); }
+void __wrap_free(void *ptr) { __real_free(ptr); }
+
+int app_main(void);
+
+/* Boot keyboard: modifiers, reserved byte, six key array */
+static const uint8_t sim_keyboard_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+    0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06, 0x75, 0x08,
+    0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0
+};
+
+static const sim_usb_device_t sim_keyboard = {
+    .vid = 0x046d,
+    .pid = 0xc31c,
+    .iface_count = 1,
+    .ifaces = {
+        {
+            .sub_class = 1,
+            .protocol = 1,
+            .report_desc = sim_keyboard_desc,
+            .report_desc_len = sizeof(sim_keyboard_desc),
+            .max_packet_size = 8
+        }
+    }
+};
+
+/* Boot mouse: buttons, X, Y */
+static const uint8_t sim_mouse_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00, 0x05, 0x09, 0x19, 0x01, 0x29, 0x03,
+    0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05, 0x81, 0x01,
+    0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06,
+    0xC0, 0xC0
+};
+
+static const sim_usb_device_t sim_combo = {
+    .vid = 0x046d,
+    .pid = 0xc52b,
+    .iface_count = 2,
+    .ifaces = {
+        {
+            .sub_class = 1,
+            .protocol = 1,
+            .report_desc = sim_keyboard_desc,
+            .report_desc_len = sizeof(sim_keyboard_desc),
+            .max_packet_size = 8
+        },
+        {
+            .sub_class = 1,
+            .protocol = 2,
+            .report_desc = sim_mouse_desc,
+            .report_desc_len = sizeof(sim_mouse_desc),
+            .max_packet_size = 4
+        }
+    }
+};
+
+typedef struct {
+    const char *name;
+    uint16_t mtu;
+} sim_scenario_t;
+
+typedef struct {
+    const char *name;
+    const char *fault_name;
+    uint32_t faults;
+    bool transient;                     // Cleared after the first failed setup, the keyboard has to come up then
+} sim_fault_t;
+
+typedef struct {
+    size_t events;
+    size_t notifies;
+    size_t mismatches;
+    size_t missing;
+    uint64_t cpu_us;
+    size_t allocs;
+    int64_t latency_us[SIM_KEY_EVENTS];
+} sim_result_t;
+
+static FILE *sim_out;
+static int sim_expected_polled;
+static uint32_t sim_expected_setup_failed;
+static uint32_t sim_expected_setup_given_up;
+
+static bool sim_wait(bool (*done)(void), int64_t timeout_us) {
+    const int64_t deadline_us = sim_time_us() + timeout_us;
+    while (!done()) {
+        if (sim_time_us() > deadline_us) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+static bool sim_advertising_connect_default(void) {
+    return sim_ble_connect(SIM_CONN_ITVL, 23);
+}
+
+static bool sim_advertising_connect_large(void) {
+    return sim_ble_connect(SIM_CONN_ITVL, SIM_MTU_LARGE);
+}
+
+static bool sim_all_polled(void) {
+    return sim_usb_polled_count() == sim_expected_polled;
+}
+
+static bool sim_setup_failed(void) {
+    usb_app_recovery_stats_t stats;
+    usb_app_get_recovery_stats(&stats);
+    return stats.setup_failed >= sim_expected_setup_failed;
+}
+
+static bool sim_setup_given_up(void) {
+    usb_app_recovery_stats_t stats;
+    usb_app_get_recovery_stats(&stats);
+    return stats.setup_given_up >= sim_expected_setup_given_up;
+}
+
+/* Plugs a device in, retries while unplugged devices still hold every port until the host frees them */
+static int sim_plug(const sim_usb_device_t *device) {
+    const int64_t deadline_us = sim_time_us() + SIM_HUB_TIMEOUT_US;
+    int port;
+    while ((port = sim_usb_attach(device)) < 0 && sim_time_us() < deadline_us) usleep(1000);
+    return port;
+}
+
+/* Waits until no notification came for a few connection intervals, a resumed link may send the released state */
+static void sim_settle(void) {
+    size_t count;
+    do {
+        count = sim_ble_notify_count();
+        usleep(SIM_SETTLE_US);
+    } while (sim_ble_notify_count() != count);
+}
+
+static int sim_cmp_latency(const void *a, const void *b) {
+    const int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+/* Sends one key event on the keyboard interface of the port and checks the notification it causes */
+static void sim_key(int port, uint8_t key, bool pressed, bool nkro, bt_app_keyboard_t *expected,
+                    sim_result_t *result) {
+    const uint8_t usb_report[8] = { 0, 0, pressed ? key : 0 };
+    bt_app_keyboard_apply(expected, key, pressed);
+    result->events++;
+
+    const size_t index = sim_ble_notify_count();
+    const int64_t sent_us = sim_time_us();
+    if (!sim_usb_report(port, 0, usb_report, sizeof(usb_report)) ||
+        !sim_ble_wait_notify(index + 1, SIM_NOTIFY_TIMEOUT_US)) {
+        result->missing++;
+        return;
+    }
+
+    sim_ble_notify_t notify;
+    sim_ble_notifications(index, &notify, 1);
+    uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN];
+    size_t len = BT_APP_KEYBOARD_BOOT_REPORT_LEN;
+    if (nkro) {
+        bt_app_keyboard_nkro_report(expected, report);
+        len = BT_APP_KEYBOARD_NKRO_REPORT_LEN;
+    } else {
+        bt_app_keyboard_boot_report(expected, report);
+    }
+    if (notify.len != len || memcmp(notify.data, report, len) != 0) result->mismatches++;
+    if (result->notifies < SIM_KEY_EVENTS) result->latency_us[result->notifies++] = notify.time_us - sent_us;
+}
+
+/* Types SIM_KEY_EVENTS single key presses and releases on the keyboard port */
+static void sim_type(int port, uint16_t mtu, sim_result_t *result) {
+    bt_app_keyboard_t expected;
+    bt_app_keyboard_init(&expected);
+    const bool nkro = mtu >= BT_APP_KEYBOARD_NKRO_REPORT_LEN + 3;
+
+    const uint64_t cpu_start_us = sim_tasks_cpu_us();
+    const size_t allocs_start = __atomic_load_n(&sim_allocs, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < SIM_KEY_EVENTS; i++) {
+        sim_key(port, HID_KEY_A + (i / 2) % 26, i % 2 == 0, nkro, &expected, result);
+    }
+    result->cpu_us = sim_tasks_cpu_us() - cpu_start_us;
+    result->allocs = __atomic_load_n(&sim_allocs, __ATOMIC_RELAXED) - allocs_start;
+}
+
+static bool sim_connect(uint16_t mtu) {
+    if (!sim_wait(mtu == SIM_MTU_LARGE ? sim_advertising_connect_large : sim_advertising_connect_default,
+                  SIM_BRINGUP_TIMEOUT_US) || !sim_wait(sim_ble_encrypted, SIM_BRINGUP_TIMEOUT_US)) {
+        return false;
+    }
+    sim_ble_subscribe_uuid16(SIM_INPUT_REPORT_UUID, true);
+    sim_settle();
+    return true;
+}
+
+static bool sim_run(const sim_scenario_t *scenario, int port) {
+    sim_result_t result = { 0 };
+    if (!sim_connect(scenario->mtu)) {
+        fprintf(sim_out, "%s,no link,FAIL\n", scenario->name);
+        return false;
+    }
+
+    sim_type(port, scenario->mtu, &result);
+    sim_ble_disconnect();
+
+    qsort(result.latency_us, result.notifies, sizeof(result.latency_us[0]), sim_cmp_latency);
+    const int64_t p50_us = result.notifies ? result.latency_us[result.notifies / 2] : 0;
+    const int64_t p99_us = result.notifies ? result.latency_us[result.notifies * 99 / 100] : 0;
+    const bool passed = result.mismatches == 0 && result.missing == 0;
+    fprintf(sim_out, "%s,%u,%zu,%zu,%zu,%zu,%.1f,%.2f,%lld,%lld,%s\n", scenario->name, scenario->mtu, result.events,
+            result.notifies, result.mismatches, result.missing, (double) result.cpu_us / result.events,
+            (double) result.allocs / result.events, (long long) p50_us, (long long) p99_us,
+            test_result_str(passed));
+    return passed;
+}
+
+static const sim_usb_device_t *sim_hub_device(size_t index) {
+    return index % 2 ? &sim_combo : &sim_keyboard;
+}
+
+/*
+ * Plugs SIM_HUB_DEVICES devices in at once, then unplugs and replugs all of them in bursts. Every other burst
+ * unplugs half of them again right after the replug, while their CONNECTED events are still queued. Each burst
+ * must end with every interface polled and no stack recovery, then every keyboard of the hub types one key.
+ */
+static bool sim_hub(void) {
+    if (!sim_connect(SIM_MTU_DEFAULT)) {
+        fprintf(sim_out, "hub_burst,no link,FAIL\n");
+        return false;
+    }
+    usb_app_recovery_stats_t before;
+    usb_app_get_recovery_stats(&before);
+
+    int ports[SIM_HUB_DEVICES];
+    int interfaces = 0;
+    const int base_polled = sim_usb_polled_count();
+    const int64_t start_us = sim_time_us();
+    for (size_t i = 0; i < SIM_HUB_DEVICES; i++) {
+        ports[i] = sim_plug(sim_hub_device(i));
+        interfaces += sim_hub_device(i)->iface_count;
+    }
+    sim_expected_polled = base_polled + interfaces;
+    bool up = sim_wait(sim_all_polled, SIM_HUB_TIMEOUT_US);
+    const int64_t bringup_us = sim_time_us() - start_us;
+
+    int64_t replug_max_us = 0;
+    int rounds = 0;
+    for (; up && rounds < SIM_HUB_ROUNDS; rounds++) {
+        const int64_t round_start_us = sim_time_us();
+        for (size_t i = 0; i < SIM_HUB_DEVICES; i++) sim_usb_detach(ports[i]);
+        for (size_t i = 0; i < SIM_HUB_DEVICES; i++) ports[i] = sim_plug(sim_hub_device(i));
+        for (size_t i = 0; rounds % 2 && i < SIM_HUB_DEVICES; i += 2) {
+            sim_usb_detach(ports[i]);
+            ports[i] = sim_plug(sim_hub_device(i));
+        }
+        up = sim_wait(sim_all_polled, SIM_HUB_TIMEOUT_US);
+        const int64_t replug_us = sim_time_us() - round_start_us;
+        if (replug_us > replug_max_us) replug_max_us = replug_us;
+    }
+
+    // Every keyboard behind the hub still reaches the host
+    sim_result_t result = { 0 };
+    bt_app_keyboard_t expected;
+    bt_app_keyboard_init(&expected);
+    for (size_t i = 0; up && i < SIM_HUB_DEVICES; i++) {
+        sim_key(ports[i], HID_KEY_A + i, true, false, &expected, &result);
+        sim_key(ports[i], HID_KEY_A + i, false, false, &expected, &result);
+    }
+    usb_app_recovery_stats_t after;
+    usb_app_get_recovery_stats(&after);
+    sim_ble_disconnect();
+
+    for (size_t i = 0; i < SIM_HUB_DEVICES; i++) sim_usb_detach(ports[i]);
+    sim_expected_polled = base_polled;
+    sim_wait(sim_all_polled, SIM_HUB_TIMEOUT_US);
+
+    const uint32_t recoveries = after.requested - before.requested;
+    const bool passed = up && result.mismatches == 0 && result.missing == 0 && recoveries == 0;
+    fprintf(sim_out, "hub_burst,%d,%d,%d,%lld,%lld,%lu,%zu,%zu,%zu,%s\n", SIM_HUB_DEVICES, interfaces, rounds,
+            (long long) bringup_us / 1000, (long long) replug_max_us / 1000, (unsigned long) recoveries,
+            result.events, result.mismatches, result.missing, test_result_str(passed));
+    return passed;
+}
+
+/*
+ * Plugs a keyboard whose setup fails. A transient fault is cleared once the setup failed and the retries have to bring
+ * the keyboard up, recovery_ms runs from the clear to its first poll. A permanent fault has to be given up after
+ * USB_APP_SETUP_MAX_FAILURES failures, recovery_ms runs from the plug to the give up. The working keyboard types while
+ * the faulty one fails, the stack must not be reinstalled.
+ */
+static bool sim_fault(const sim_fault_t *fault, int keyboard_port) {
+    if (!sim_connect(SIM_MTU_DEFAULT)) {
+        fprintf(sim_out, "%s,no link,FAIL\n", fault->name);
+        return false;
+    }
+    usb_app_recovery_stats_t before;
+    usb_app_get_recovery_stats(&before);
+
+    sim_usb_device_t device = sim_keyboard;
+    device.faults = fault->faults;
+    const int base_polled = sim_usb_polled_count();
+    const int64_t plug_us = sim_time_us();
+    const int port = sim_plug(&device);
+    sim_expected_setup_failed = before.setup_failed + 1;
+    bool ok = port >= 0 && sim_wait(sim_setup_failed, SIM_BRINGUP_TIMEOUT_US);
+
+    // The working keyboard is not held up by the retries
+    sim_result_t result = { 0 };
+    bt_app_keyboard_t expected;
+    bt_app_keyboard_init(&expected);
+    sim_key(keyboard_port, HID_KEY_A, true, false, &expected, &result);
+    sim_key(keyboard_port, HID_KEY_A, false, false, &expected, &result);
+
+    int64_t recovery_us = 0;
+    if (ok && fault->transient) {
+        sim_usb_set_faults(port, 0);
+        const int64_t cleared_us = sim_time_us();
+        sim_expected_polled = base_polled + 1;
+        ok = sim_wait(sim_all_polled, SIM_BRINGUP_TIMEOUT_US);
+        recovery_us = sim_time_us() - cleared_us;
+        for (size_t i = 0; ok && i < 2; i++) sim_key(port, HID_KEY_B, i == 0, false, &expected, &result);
+    } else if (ok) {
+        sim_expected_setup_given_up = before.setup_given_up + 1;
+        ok = sim_wait(sim_setup_given_up, SIM_BRINGUP_TIMEOUT_US) && sim_usb_polled_count() == base_polled;
+        recovery_us = sim_time_us() - plug_us;
+    }
+    usb_app_recovery_stats_t after;
+    usb_app_get_recovery_stats(&after);
+    sim_ble_disconnect();
+
+    if (port >= 0) sim_usb_detach(port);
+    sim_expected_polled = base_polled;
+    sim_wait(sim_all_polled, SIM_BRINGUP_TIMEOUT_US);
+
+    const uint32_t failures = after.setup_failed - before.setup_failed;
+    const uint32_t given_up = after.setup_given_up - before.setup_given_up;
+    const uint32_t recoveries = after.requested - before.requested;
+    const bool passed = ok && recoveries == 0 && result.mismatches == 0 && result.missing == 0 &&
+                        (fault->transient ? given_up == 0 : failures == USB_APP_SETUP_MAX_FAILURES && given_up == 1);
+    fprintf(sim_out, "%s,%s,%lu,%lld,%lu,%zu,%zu,%zu,%s\n", fault->name, fault->fault_name, (unsigned long) failures,
+            (long long) recovery_us / 1000, (unsigned long) recoveries, result.events, result.mismatches,
+            result.missing, test_result_str(passed));
+    return passed;
+}
+
+int main(void) {
+    // The firmware prints to stdout, the results get the original one
+    sim_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!sim_out || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) return 1;
+    setvbuf(sim_out, NULL, _IOLBF, 0);
+
+    sim_gpio_set_level(USB_APP_VBUS_GPIO, 1);
+    app_main();
+
+    const int port = sim_usb_attach(&sim_keyboard);
+    sim_expected_polled = 1;
+    if (port < 0 || !sim_wait(sim_all_polled, SIM_BRINGUP_TIMEOUT_US)) {
+        fprintf(sim_out, "keyboard not polled\n1 failed\n");
+        return 1;
+    }
+
+    static const sim_scenario_t scenarios[] = {
+        { "boot_report", SIM_MTU_DEFAULT },
+        { "nkro_report", SIM_MTU_LARGE },
+    };
+    fprintf(sim_out, "scenario,mtu,events,notifies,mismatches,missing,cpu_us_per_event,allocs_per_event,"
+            "p50_latency_us,p99_latency_us,result\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        test_result(sim_run(&scenarios[i], port));
+    }
+
+    fprintf(sim_out, "scenario,devices,interfaces,rounds,bringup_ms,replug_max_ms,recoveries,events,mismatches,"
+            "missing,result\n");
+    test_result(sim_hub());
+
+    static const sim_fault_t faults[] = {
+        { "setup_transient", "claim", SIM_USB_FAULT_CLAIM, true },
+        { "setup_transient", "class", SIM_USB_FAULT_CLASS, true },
+        { "setup_permanent", "claim", SIM_USB_FAULT_CLAIM, false },
+        { "setup_permanent", "class", SIM_USB_FAULT_CLASS, false },
+    };
+    fprintf(sim_out, "scenario,fault,failures,recovery_ms,recoveries,events,mismatches,missing,result\n");
+    for (size_t i = 0; i < sizeof(faults) / sizeof(faults[0]); i++) {
+        test_result(sim_fault(&faults[i], port));
+    }
+
+    const int status = test_result_summary(sim_out);
+    fflush(sim_out);
+    // The firmware tasks never return
+    _exit(status);
+}
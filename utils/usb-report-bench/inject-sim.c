@@ -0,0 +1,198 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the text injection engine natively on Linux against a simulated BLE link and host.
+ *
+ * The link carries at most pkts_per_event notifications per connection event, and the engine gets a fresh
+ * window at every event, the way the connection interval timer drives it on the device. The stack can be
+ * made to refuse a share of the reports to exercise the retry path. The host keeps the previous report
+ * and types the character of every key that is new in the next one, so the reconstructed text has to
+ * match the input exactly, with and without the redundant release reports.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_app_inject.h"
+#include "usb_app/hid_usage_keyboard.h"
+
+#define SIM_QUEUE_LEN               16
+#define SIM_TEXT_MAX                4096
+#define SIM_RETRY_US                10000
+
+typedef struct {
+    uint32_t interval_us;
+    uint8_t pkts_per_event;
+    double refuse_ratio;
+} sim_link_t;
+
+typedef struct {
+    const sim_link_t *link;
+    uint8_t queue[SIM_QUEUE_LEN][BT_APP_INJECT_REPORT_LEN];
+    size_t queued;
+    uint8_t host_report[BT_APP_INJECT_REPORT_LEN];
+    char host_text[SIM_TEXT_MAX];
+    size_t host_len;
+    unsigned long refused;
+} sim_t;
+
+static char sim_usage_chars[2][256];
+
+static int sim_send(const uint8_t *report, size_t length, void *arg) {
+    sim_t *sim = arg;
+    if (sim->queued == SIM_QUEUE_LEN || (double) rand() / RAND_MAX < sim->link->refuse_ratio) {
+        sim->refused++;
+        return -1;
+    }
+    memcpy(sim->queue[sim->queued++], report, BT_APP_INJECT_REPORT_LEN);
+    return 0;
+}
+
+static void sim_host_append(sim_t *sim, const char *text) {
+    const size_t length = strlen(text);
+    if (sim->host_len + length < SIM_TEXT_MAX) {
+        memcpy(sim->host_text + sim->host_len, text, length + 1);
+        sim->host_len += length;
+    }
+}
+
+/* Every key that was not down in the previous report is one keystroke */
+static void sim_host_receive(sim_t *sim, const uint8_t *report) {
+    for (int i = 2; i < BT_APP_INJECT_REPORT_LEN; i++) {
+        const uint8_t usage = report[i];
+        if (!usage || memchr(sim->host_report + 2, usage, BT_APP_INJECT_REPORT_LEN - 2)) continue;
+
+        const bool shift = report[0] & (HID_LEFT_SHIFT | HID_RIGHT_SHIFT);
+        const char c = sim_usage_chars[shift][usage];
+        if (c && (report[0] & ~(HID_LEFT_SHIFT | HID_RIGHT_SHIFT)) == 0) {
+            const char typed[2] = { c, 0 };
+            sim_host_append(sim, typed);
+        } else {
+            char token[16];
+            snprintf(token, sizeof(token), "<%02x:%02x>", report[0], usage);
+            sim_host_append(sim, token);
+        }
+    }
+    memcpy(sim->host_report, report, BT_APP_INJECT_REPORT_LEN);
+}
+
+static void sim_expected(const uint8_t *data, size_t length, char *expected) {
+    size_t out = 0;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t modifier;
+        uint8_t usage;
+        if (data[i] == BT_APP_INJECT_OP_KEY && i + 2 < length) {
+            out += snprintf(expected + out, SIM_TEXT_MAX - out, "<%02x:%02x>", data[i + 1], data[i + 2]);
+            i += 2;
+        } else if (bt_app_inject_char_to_key(data[i], &modifier, &usage)) {
+            expected[out++] = data[i];
+        }
+    }
+    expected[out] = 0;
+}
+
+static bool sim_run(const char *name, const uint8_t *data, size_t length, const sim_link_t *link, bool collapse) {
+    static sim_t sim;
+    static bt_app_inject_t inject;
+    memset(&sim, 0, sizeof(sim));
+    sim.link = link;
+
+    bt_app_inject_init(&inject, link->pkts_per_event, sim_send, &sim);
+    inject.collapse_releases = collapse;
+
+    // Start half way into a connection interval
+    int64_t now_us = link->interval_us / 2;
+    int64_t retry_us = -1;
+    bt_app_inject_start(&inject, data, length, now_us);
+    if (bt_app_inject_pump(&inject, now_us)) retry_us = now_us + SIM_RETRY_US;
+
+    int64_t event_us = link->interval_us;
+    while (inject.active) {
+        if (retry_us >= 0 && retry_us < event_us) {
+            now_us = retry_us;
+            retry_us = bt_app_inject_pump(&inject, now_us) ? now_us + SIM_RETRY_US : -1;
+            continue;
+        }
+
+        now_us = event_us;
+        event_us += link->interval_us;
+        size_t sent = sim.queued < link->pkts_per_event ? sim.queued : link->pkts_per_event;
+        for (size_t i = 0; i < sent; i++) {
+            sim_host_receive(&sim, sim.queue[i]);
+        }
+        memmove(sim.queue, sim.queue[sent], (sim.queued - sent) * BT_APP_INJECT_REPORT_LEN);
+        sim.queued -= sent;
+        if (bt_app_inject_connection_event(&inject, now_us)) retry_us = now_us + SIM_RETRY_US;
+    }
+
+    static char expected[SIM_TEXT_MAX];
+    sim_expected(data, length, expected);
+    const bool match = strcmp(expected, sim.host_text) == 0;
+
+    printf("%s,%.1f,%d,%.2f,%s,%u,%u,%lu,%u,%u,%s\n", name, link->interval_us / 1000.0, link->pkts_per_event,
+           link->refuse_ratio, collapse ? "collapse" : "naive", inject.stats.chars, inject.stats.reports,
+           sim.refused, inject.stats.elapsed_ms, inject.stats.chars_per_s, match ? "match" : "MISMATCH");
+    if (!match) fprintf(stderr, "  expected: %s\n  host:     %s\n", expected, sim.host_text);
+    return match;
+}
+
+int main(void) {
+    for (int c = 1; c < 128; c++) {
+        uint8_t modifier;
+        uint8_t usage;
+        if (bt_app_inject_char_to_key(c, &modifier, &usage) && !sim_usage_chars[modifier != 0][usage]) {
+            sim_usage_chars[modifier != 0][usage] = c;
+        }
+    }
+
+    char printable[128];
+    size_t printable_len = 0;
+    for (int c = ' '; c < 127; c++) {
+        printable[printable_len++] = c;
+    }
+    printable[printable_len++] = '\n';
+
+    static const char pangram[] = "The quick brown fox jumps over the lazy dog. ";
+    char paragraph[BT_APP_INJECT_MAX_LEN];
+    size_t paragraph_len = 0;
+    while (paragraph_len + sizeof(pangram) - 1 <= sizeof(paragraph)) {
+        memcpy(paragraph + paragraph_len, pangram, sizeof(pangram) - 1);
+        paragraph_len += sizeof(pangram) - 1;
+    }
+
+    static const char repeats[] = "bookkeeper aardvark 1000000 Mississippi AAaa!!11";
+    static const uint8_t macro[] = {
+        BT_APP_INJECT_OP_KEY, HID_LEFT_CONTROL, HID_KEY_A,
+        BT_APP_INJECT_OP_KEY, HID_LEFT_CONTROL, HID_KEY_C,
+        'o', 'k', '\n',
+        BT_APP_INJECT_OP_KEY, HID_LEFT_CONTROL, HID_KEY_V,
+        BT_APP_INJECT_OP_KEY, HID_LEFT_CONTROL, HID_KEY_V
+    };
+
+    static const sim_link_t links[] = {
+        { 7500, 1, 0 },
+        { 15000, 1, 0 },
+        { 30000, 1, 0 },
+        { 7500, 4, 0 },
+        { 15000, 1, 0.2 },
+    };
+
+    int failed = 0;
+    printf("text,interval_ms,pkts_per_event,refuse_ratio,mode,chars,reports,refused,elapsed_ms,chars_per_s,result\n");
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        for (int collapse = 0; collapse <= 1; collapse++) {
+            srand(3);
+            failed += !sim_run("paragraph", (const uint8_t *) paragraph, paragraph_len, &links[l], collapse);
+            failed += !sim_run("printable", (const uint8_t *) printable, printable_len, &links[l], collapse);
+            failed += !sim_run("repeats", (const uint8_t *) repeats, sizeof(repeats) - 1, &links[l], collapse);
+            failed += !sim_run("macro", macro, sizeof(macro), &links[l], collapse);
+        }
+    }
+
+    fprintf(stderr, "%d mismatches\n", failed);
+    return failed != 0;
+}
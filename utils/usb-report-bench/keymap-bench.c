@@ -0,0 +1,195 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Measures usb_app_keymap_translate() natively on Linux for keymaps with a growing number of rules and
+ * layers. Rules are compiled into one table per layer, so the cost per key event should not move with
+ * the rule count.
+ *
+ * The second part hot-swaps two keymaps from another thread while the main thread translates, and checks
+ * that every press comes out of one of the two keymaps and every release matches its press.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "usb_app_keymap.h"
+
+#define BENCH_DEFAULT_EVENTS        20000000
+#define BENCH_STREAM_LEN            4096
+#define BENCH_LAYER_KEY             HID_KEY_CAPS_LOCK
+#define BENCH_SWAP_EVENTS           4000000
+
+static const uint16_t bench_rule_counts[] = { 0, 8, 32, 64, USB_APP_KEYMAP_MAX_RULES };
+
+static usb_app_keymap_t bench_keymap;
+static key_event_t bench_stream[BENCH_STREAM_LEN];
+
+static double bench_elapsed_ns(clockid_t clock, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static uint8_t bench_random_key(void) {
+    uint8_t key;
+    do {
+        key = HID_KEY_A + rand() % (HID_KEY_SLASH - HID_KEY_A + 1);
+    } while (key == BENCH_LAYER_KEY);
+    return key;
+}
+
+static size_t bench_build_keymap(uint8_t *blob, uint8_t layers, uint16_t rules) {
+    blob[0] = USB_APP_KEYMAP_MAGIC_0;
+    blob[1] = USB_APP_KEYMAP_MAGIC_1;
+    blob[2] = USB_APP_KEYMAP_VERSION;
+    blob[3] = layers;
+    blob[4] = rules;
+    blob[5] = rules >> 8;
+
+    uint8_t *rule = blob + USB_APP_KEYMAP_HEADER_LEN;
+    for (uint16_t i = 0; i < rules; i++, rule += USB_APP_KEYMAP_RULE_LEN) {
+        if (i == 0 && layers > 1) {
+            rule[0] = 0;
+            rule[1] = USB_APP_KEYMAP_RULE_LAYER;
+            rule[2] = BENCH_LAYER_KEY;
+            rule[3] = layers - 1;
+            continue;
+        }
+        rule[0] = rand() % layers;
+        rule[1] = (i % 4 == 0) ? USB_APP_KEYMAP_RULE_SWAP : USB_APP_KEYMAP_RULE_KEY;
+        rule[2] = bench_random_key();
+        rule[3] = bench_random_key();
+    }
+    return USB_APP_KEYMAP_HEADER_LEN + rules * USB_APP_KEYMAP_RULE_LEN;
+}
+
+/* Random press/release pairs, with the layer key held around every eighth pair */
+static void bench_build_stream(void) {
+    size_t i = 0;
+    while (i + 4 <= BENCH_STREAM_LEN) {
+        const uint8_t key = bench_random_key();
+        const bool layer = (i / 2) % 8 == 0;
+        if (layer) bench_stream[i++] = (key_event_t) { KEY_STATE_PRESSED, 0, BENCH_LAYER_KEY };
+        bench_stream[i++] = (key_event_t) { KEY_STATE_PRESSED, 0, key };
+        bench_stream[i++] = (key_event_t) { KEY_STATE_RELEASED, 0, key };
+        if (layer) bench_stream[i++] = (key_event_t) { KEY_STATE_RELEASED, 0, BENCH_LAYER_KEY };
+    }
+    while (i < BENCH_STREAM_LEN) {
+        bench_stream[i++] = (key_event_t) { KEY_STATE_RELEASED, 0, HID_KEY_A };
+    }
+}
+
+static double bench_translate(unsigned long events, uint32_t *checksum) {
+    key_event_t out;
+    struct timespec start;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+    for (unsigned long i = 0; i < events; i++) {
+        if (usb_app_keymap_translate(&bench_keymap, &bench_stream[i % BENCH_STREAM_LEN], &out) == USB_APP_KEYMAP_KEY) {
+            *checksum += out.key_code;
+        }
+    }
+    return bench_elapsed_ns(CLOCK_PROCESS_CPUTIME_ID, &start) / events;
+}
+
+typedef struct {
+    uint8_t blob[2][USB_APP_KEYMAP_MAX_LEN];
+    size_t length[2];
+    atomic_bool stop;
+    unsigned long swaps;
+    unsigned long busy;
+} bench_swapper_t;
+
+static void *bench_swapper(void *arg) {
+    bench_swapper_t *swapper = arg;
+    for (unsigned int i = 0; !atomic_load(&swapper->stop); i++) {
+        const int which = i & 1;
+        while (usb_app_keymap_install(&bench_keymap, swapper->blob[which], swapper->length[which]) ==
+               USB_APP_KEYMAP_ERR_BUSY) {
+            swapper->busy++;
+        }
+        swapper->swaps++;
+    }
+    return NULL;
+}
+
+/* Keymap 0 is the identity, keymap 1 maps every letter to the next one */
+static int bench_hot_swap(void) {
+    static bench_swapper_t swapper;
+    usb_app_keymap_tables_t tables[2];
+    const uint8_t letters = HID_KEY_Z - HID_KEY_A;
+
+    swapper.length[0] = bench_build_keymap(swapper.blob[0], 1, 0);
+    swapper.length[1] = bench_build_keymap(swapper.blob[1], 1, letters);
+    for (uint8_t i = 0; i < letters; i++) {
+        uint8_t *rule = swapper.blob[1] + USB_APP_KEYMAP_HEADER_LEN + i * USB_APP_KEYMAP_RULE_LEN;
+        rule[0] = 0;
+        rule[1] = USB_APP_KEYMAP_RULE_KEY;
+        rule[2] = HID_KEY_A + i;
+        rule[3] = HID_KEY_A + i + 1;
+    }
+    usb_app_keymap_compile(swapper.blob[0], swapper.length[0], &tables[0]);
+    usb_app_keymap_compile(swapper.blob[1], swapper.length[1], &tables[1]);
+
+    usb_app_keymap_init(&bench_keymap);
+    atomic_init(&swapper.stop, false);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, bench_swapper, &swapper) != 0) {
+        perror("pthread_create");
+        return 1;
+    }
+
+    unsigned long torn = 0;
+    unsigned long unmatched = 0;
+    for (unsigned long i = 0; i < BENCH_SWAP_EVENTS; i++) {
+        const uint8_t key = HID_KEY_A + i % letters;
+        const key_event_t press = { KEY_STATE_PRESSED, 0, key };
+        const key_event_t release = { KEY_STATE_RELEASED, 0, key };
+        key_event_t pressed, released;
+        usb_app_keymap_translate(&bench_keymap, &press, &pressed);
+        usb_app_keymap_translate(&bench_keymap, &release, &released);
+        if (pressed.key_code != tables[0].entry[0][key] && pressed.key_code != tables[1].entry[0][key]) torn++;
+        if (released.key_code != pressed.key_code) unmatched++;
+    }
+
+    atomic_store(&swapper.stop, true);
+    pthread_join(thread, NULL);
+    printf("hot swap: %d events, %lu swaps, %lu busy retries, %lu torn lookups, %lu unmatched releases\n",
+           BENCH_SWAP_EVENTS * 2, swapper.swaps, swapper.busy, torn, unmatched);
+    return torn || unmatched;
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned long events = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_EVENTS;
+    if (events == 0) {
+        fprintf(stderr, "usage: keymap-bench [events]\n");
+        return 2;
+    }
+
+    srand(1);
+    bench_build_stream();
+    printf("layers,rules,ns_per_event\n");
+
+    uint32_t checksum = 0;
+    for (uint8_t layers = 1; layers <= USB_APP_KEYMAP_MAX_LAYERS; layers += USB_APP_KEYMAP_MAX_LAYERS - 1) {
+        for (size_t i = 0; i < sizeof(bench_rule_counts) / sizeof(bench_rule_counts[0]); i++) {
+            uint8_t blob[USB_APP_KEYMAP_MAX_LEN];
+            const size_t length = bench_build_keymap(blob, layers, bench_rule_counts[i]);
+            usb_app_keymap_init(&bench_keymap);
+            if (usb_app_keymap_install(&bench_keymap, blob, length) != 0) {
+                fprintf(stderr, "keymap with %d rules rejected\n", bench_rule_counts[i]);
+                return 1;
+            }
+            printf("%d,%d,%.2f\n", layers, bench_rule_counts[i], bench_translate(events, &checksum));
+        }
+    }
+    fprintf(stderr, "checksum %u\n", checksum);
+
+    return bench_hot_swap();
+}
@@ -0,0 +1,207 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Replays interleaved boot reports of two keyboards natively on Linux through the real router and the
+ * reference counted keyboard merge. After every report the keys the output has down have to be the union
+ * of what the two keyboards hold: a key held on both stays down until both release it, nothing is pressed
+ * twice and nothing is released that is not down. Unplugging a keyboard with keys held only releases the
+ * keys the other one does not hold.
+ *
+ * The last part times one report of a keyboard while the other holds 0 to 6 keys, the merge cost should
+ * not move.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "test-result.h"
+#include "usb_app_keyboard.h"
+#include "usb_app_router.h"
+
+#define TEST_DEVICES                2
+#define TEST_RANDOM_REPORTS         400000
+#define TEST_BENCH_REPORTS          20000000
+
+typedef struct {
+    uint8_t down[256];                  // Keys the output has down
+    unsigned long events;
+    unsigned long double_press;
+    unsigned long stray_release;
+} test_output_t;
+
+static usb_app_keyboard_merge_t test_merge;
+static test_output_t test_output;
+static usb_app_iface_route_t test_routes[TEST_DEVICES];
+static hid_keyboard_input_report_boot_t test_reports[TEST_DEVICES];
+
+static void test_key_event(const key_event_t *key_event, void *arg) {
+    uint8_t *down = &test_output.down[key_event->key_code];
+    test_output.events++;
+    if (key_event->state == KEY_STATE_PRESSED) {
+        if (*down) test_output.double_press++;
+        *down = 1;
+    } else {
+        if (!*down) test_output.stray_release++;
+        *down = 0;
+    }
+}
+
+static void test_keyboard_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    if (length < sizeof(hid_keyboard_input_report_boot_t)) return;
+    usb_app_keyboard_merge_report(&test_merge, &route->keyboard, (const hid_keyboard_input_report_boot_t *) data,
+                                  test_key_event, NULL);
+}
+
+static const usb_app_report_handler_t test_handlers[USB_APP_REPORT_KIND_MAX] = {
+    [USB_APP_REPORT_KIND_KEYBOARD] = test_keyboard_handler
+};
+
+static void test_attach(int device) {
+    const hid_host_dev_params_t dev_params = {
+        .addr = device + 1,
+        .iface_num = 0,
+        .sub_class = HID_SUBCLASS_BOOT_INTERFACE,
+        .proto = HID_PROTOCOL_KEYBOARD
+    };
+    usb_app_router_build(&test_routes[device], &dev_params, NULL, 0, test_handlers);
+    memset(&test_reports[device], 0, sizeof(test_reports[device]));
+}
+
+static void test_send(int device) {
+    usb_app_router_dispatch(&test_routes[device], (const uint8_t *) &test_reports[device], sizeof(test_reports[device]));
+}
+
+static void test_detach(int device) {
+    usb_app_keyboard_merge_detach(&test_merge, &test_routes[device].keyboard, test_key_event, NULL);
+    memset(&test_reports[device], 0, sizeof(test_reports[device]));
+}
+
+static void test_reset(void) {
+    usb_app_keyboard_merge_init(&test_merge);
+    memset(&test_output, 0, sizeof(test_output));
+    for (int device = 0; device < TEST_DEVICES; device++) {
+        test_attach(device);
+    }
+}
+
+static bool test_held(const hid_keyboard_input_report_boot_t *report, int usage) {
+    if (usage >= HID_KEY_LEFT_CONTROL) return report->modifier.val & (1 << (usage - HID_KEY_LEFT_CONTROL));
+    return usage > HID_KEY_ERROR_UNDEFINED && memchr(report->key, usage, HID_KEYBOARD_KEY_MAX) != NULL;
+}
+
+/* Keys the output has down against the union of both keyboards */
+static unsigned long test_mismatches(void) {
+    unsigned long mismatches = 0;
+    for (int usage = 0; usage <= HID_KEY_LEFT_CONTROL + 7; usage++) {
+        bool expected = false;
+        for (int device = 0; device < TEST_DEVICES; device++) {
+            expected |= test_held(&test_reports[device], usage);
+        }
+        if (expected != test_output.down[usage]) mismatches++;
+    }
+    return mismatches;
+}
+
+static bool test_scripted(void) {
+    unsigned long failures = 0;
+    test_reset();
+
+    // A on both keyboards, released on the first one: still down
+    test_reports[0].key[0] = HID_KEY_A;
+    test_send(0);
+    test_reports[1].key[3] = HID_KEY_A;
+    test_send(1);
+    failures += test_output.events != 1;
+    test_reports[0].key[0] = 0;
+    test_send(0);
+    failures += !test_output.down[HID_KEY_A] || test_output.events != 1;
+    test_reports[1].key[3] = 0;
+    test_send(1);
+    failures += test_output.down[HID_KEY_A] || test_output.events != 2;
+
+    // Shift on both, B on the first, then the first keyboard is unplugged: only B goes up
+    test_reports[0].modifier.val = HID_LEFT_SHIFT;
+    test_reports[0].key[0] = HID_KEY_B;
+    test_send(0);
+    test_reports[1].modifier.val = HID_LEFT_SHIFT;
+    test_send(1);
+    test_detach(0);
+    failures += test_output.down[HID_KEY_B] || !test_output.down[HID_KEY_LEFT_CONTROL + 1];
+    test_reports[1].modifier.val = 0;
+    test_send(1);
+    failures += test_output.down[HID_KEY_LEFT_CONTROL + 1] || test_output.events != 6;
+
+    failures += test_mismatches() + test_output.double_press + test_output.stray_release;
+    printf("%s  scripted: shared key, shared modifier and unplug with keys held\n", test_result_str(!failures));
+    return failures == 0;
+}
+
+/* Random changes on a random keyboard, both drawing from the same small set so keys overlap often */
+static bool test_random(void) {
+    static const uint8_t keys[] = { HID_KEY_A, HID_KEY_S, HID_KEY_D, HID_KEY_F, HID_KEY_J, HID_KEY_K, HID_KEY_L,
+                                    HID_KEY_SPACE, HID_KEY_ENTER, HID_KEY_TAB };
+    unsigned long mismatches = 0;
+    unsigned long detaches = 0;
+    test_reset();
+    srand(5);
+
+    for (int r = 0; r < TEST_RANDOM_REPORTS; r++) {
+        const int device = rand() % TEST_DEVICES;
+        hid_keyboard_input_report_boot_t *report = &test_reports[device];
+
+        if (rand() % 1000 == 0) {
+            test_detach(device);
+            test_attach(device);
+            detaches++;
+        } else {
+            for (int n = 1 + rand() % 2; n > 0; n--) {
+                const int slot = rand() % HID_KEYBOARD_KEY_MAX;
+                const uint8_t usage = rand() % 3 ? keys[rand() % sizeof(keys)] : 0;
+                if (!usage || !memchr(report->key, usage, HID_KEYBOARD_KEY_MAX)) report->key[slot] = usage;
+            }
+            if (rand() % 4 == 0) report->modifier.val ^= 1 << (rand() % 2);
+            test_send(device);
+        }
+        mismatches += test_mismatches();
+    }
+
+    const bool passed = !mismatches && !test_output.double_press && !test_output.stray_release;
+    printf("%s  random: %d reports from %d keyboards, %lu unplugs, %lu events, %lu mismatches, "
+           "%lu double presses, %lu stray releases\n", test_result_str(passed), TEST_RANDOM_REPORTS, TEST_DEVICES,
+           detaches, test_output.events, mismatches, test_output.double_press, test_output.stray_release);
+    return passed;
+}
+
+static void test_bench(void) {
+    printf("other_keyboard_held,ns_per_report\n");
+    for (int held = 0; held <= HID_KEYBOARD_KEY_MAX; held += HID_KEYBOARD_KEY_MAX / 2) {
+        test_reset();
+        for (int i = 0; i < held; i++) {
+            test_reports[1].key[i] = HID_KEY_A + i;
+        }
+        test_send(1);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+        for (unsigned long i = 0; i < TEST_BENCH_REPORTS; i++) {
+            test_reports[0].key[0] = (i & 1) ? 0 : HID_KEY_A + i % HID_KEYBOARD_KEY_MAX;
+            test_send(0);
+        }
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+        const double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("%d,%.2f\n", held, ns / TEST_BENCH_REPORTS);
+    }
+}
+
+int main(void) {
+    test_result(test_scripted());
+    test_result(test_random());
+    test_bench();
+
+    return test_result_summary(stdout);
+}
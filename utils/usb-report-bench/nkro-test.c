@@ -0,0 +1,238 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the outgoing keyboard state natively on Linux. Random chords of 20 keys plus modifiers are pressed and
+ * released one event at a time, and a simulated host decodes every NKRO report against the previous one. It
+ * has to see exactly the transition that was fed, nothing lost and nothing extra, while the boot report
+ * carries the held keys up to six and ErrorRollOver above.
+ *
+ * The second part feeds random USB boot reports through usb_app_keyboard_process_report() into the same
+ * state, several keys changing per report, and checks the bitmap against the keys of the last USB report.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bt_app_keyboard.h"
+#include "test-result.h"
+#include "usb_app_keyboard.h"
+
+#define TEST_CHORD_KEYS             20
+#define TEST_CHORDS                 20000
+#define TEST_USB_REPORTS            200000
+#define TEST_BENCH_EVENTS           20000000
+
+typedef struct {
+    uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN];    // Last report the host received
+    unsigned long transitions;
+    unsigned long lost;
+    unsigned long extra;
+    unsigned long boot_errors;
+} test_host_t;
+
+static test_host_t test_host;
+static bt_app_keyboard_t test_keyboard;
+
+static bool test_nkro_pressed(const uint8_t *report, uint8_t usage) {
+    if (usage >= HID_KEY_LEFT_CONTROL) return report[0] & (1 << (usage - HID_KEY_LEFT_CONTROL));
+    return report[1 + (usage >> 3)] & (1 << (usage & 7));
+}
+
+/* Counts the usages that changed between the previous report and this one, expects exactly one */
+static void test_host_receive(const uint8_t *report, uint8_t usage, bool pressed) {
+    unsigned long changed = 0;
+    bool seen = false;
+    for (int u = 0; u <= BT_APP_KEYBOARD_USAGE_MAX; u++) {
+        if (test_nkro_pressed(report, u) == test_nkro_pressed(test_host.report, u)) continue;
+        changed++;
+        if (u == usage && test_nkro_pressed(report, u) == pressed) seen = true;
+    }
+    test_host.transitions += changed;
+    if (!seen) test_host.lost++;
+    if (changed > seen) test_host.extra += changed - seen;
+    memcpy(test_host.report, report, sizeof(test_host.report));
+}
+
+static void test_check_boot(const uint8_t *held, size_t count) {
+    uint8_t boot[BT_APP_KEYBOARD_BOOT_REPORT_LEN];
+    bt_app_keyboard_boot_report(&test_keyboard, boot);
+    if (boot[0] != test_host.report[0]) test_host.boot_errors++;
+
+    if (count > BT_APP_KEYBOARD_BOOT_KEYS) {
+        for (int i = 2; i < BT_APP_KEYBOARD_BOOT_REPORT_LEN; i++) {
+            if (boot[i] != HID_KEY_ROLLOVER) test_host.boot_errors++;
+        }
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (!memchr(boot + 2, held[i], BT_APP_KEYBOARD_BOOT_KEYS)) test_host.boot_errors++;
+    }
+    for (size_t i = 2 + count; i < BT_APP_KEYBOARD_BOOT_REPORT_LEN; i++) {
+        if (boot[i]) test_host.boot_errors++;
+    }
+}
+
+static void test_event(uint8_t usage, bool pressed) {
+    uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN];
+    if (!bt_app_keyboard_apply(&test_keyboard, usage, pressed)) {
+        test_host.lost++;
+        return;
+    }
+    bt_app_keyboard_nkro_report(&test_keyboard, report);
+    test_host_receive(report, usage, pressed);
+}
+
+static void test_shuffle(uint8_t *usages, size_t count) {
+    for (size_t i = count - 1; i > 0; i--) {
+        const size_t j = rand() % (i + 1);
+        const uint8_t swap = usages[i];
+        usages[i] = usages[j];
+        usages[j] = swap;
+    }
+}
+
+static bool test_chords(void) {
+    bt_app_keyboard_init(&test_keyboard);
+    memset(&test_host, 0, sizeof(test_host));
+    unsigned long fed = 0;
+
+    for (int chord = 0; chord < TEST_CHORDS; chord++) {
+        // 20 distinct keys from the whole bitmap range and a random set of modifiers
+        uint8_t usages[TEST_CHORD_KEYS + 8];
+        size_t count = 0;
+        while (count < TEST_CHORD_KEYS) {
+            const uint8_t usage = HID_KEY_A + rand() % (HID_KEY_LEFT_CONTROL - HID_KEY_A);
+            if (!memchr(usages, usage, count)) usages[count++] = usage;
+        }
+        const size_t keys = count;
+        for (int bit = 0; bit < 8; bit++) {
+            if (rand() & 1) usages[count++] = HID_KEY_LEFT_CONTROL + bit;
+        }
+
+        test_shuffle(usages, count);
+        uint8_t held[TEST_CHORD_KEYS];
+        size_t held_count = 0;
+        for (size_t i = 0; i < count; i++) {
+            test_event(usages[i], true);
+            if (usages[i] < HID_KEY_LEFT_CONTROL) held[held_count++] = usages[i];
+            test_check_boot(held, held_count);
+        }
+
+        test_shuffle(usages, count);
+        for (size_t i = 0; i < count; i++) {
+            test_event(usages[i], false);
+            if (usages[i] < HID_KEY_LEFT_CONTROL) {
+                uint8_t *slot = memchr(held, usages[i], held_count);
+                memmove(slot, slot + 1, held_count - (slot - held) - 1);
+                held_count--;
+            }
+            test_check_boot(held, held_count);
+        }
+        fed += 2 * count;
+        if (keys != TEST_CHORD_KEYS) test_host.lost++;
+    }
+
+    const bool passed = !test_host.lost && !test_host.extra && !test_host.boot_errors &&
+                        test_host.transitions == fed;
+    printf("%s  %d chords of %d keys: %lu transitions fed, %lu seen by the host, %lu lost, %lu extra, "
+           "%lu boot report errors\n", test_result_str(passed), TEST_CHORDS, TEST_CHORD_KEYS, fed,
+           test_host.transitions, test_host.lost, test_host.extra, test_host.boot_errors);
+    return passed;
+}
+
+typedef struct {
+    unsigned long events;
+    unsigned long ignored;
+} test_usb_t;
+
+static void test_usb_event(const key_event_t *key_event, void *arg) {
+    test_usb_t *usb = arg;
+    usb->events++;
+    if (!bt_app_keyboard_apply(&test_keyboard, key_event->key_code, key_event->state == KEY_STATE_PRESSED)) {
+        usb->ignored++;
+    }
+}
+
+static bool test_usb_reports(void) {
+    usb_app_keyboard_state_t state;
+    test_usb_t usb = { 0 };
+    hid_keyboard_input_report_boot_t report;
+    memset(&state, 0, sizeof(state));
+    memset(&report, 0, sizeof(report));
+    bt_app_keyboard_init(&test_keyboard);
+
+    unsigned long mismatches = 0;
+    unsigned long changes = 0;
+    for (int r = 0; r < TEST_USB_REPORTS; r++) {
+        hid_keyboard_input_report_boot_t next = report;
+        // Up to three slots change per report, keys stay distinct like a real keyboard sends them
+        for (int n = rand() % 4; n > 0; n--) {
+            const int slot = rand() % HID_KEYBOARD_KEY_MAX;
+            const uint8_t usage = rand() % 3 ? HID_KEY_A + rand() % (HID_KEY_SLASH - HID_KEY_A + 1) : 0;
+            if (!usage || !memchr(next.key, usage, HID_KEYBOARD_KEY_MAX)) next.key[slot] = usage;
+        }
+        if (rand() % 4 == 0) next.modifier.val ^= 1 << (rand() % 8);
+
+        for (int u = 0; u <= BT_APP_KEYBOARD_USAGE_MAX; u++) {
+            const bool before = u >= HID_KEY_LEFT_CONTROL ? report.modifier.val & (1 << (u - HID_KEY_LEFT_CONTROL))
+                                                          : memchr(report.key, u, HID_KEYBOARD_KEY_MAX) != NULL;
+            const bool after = u >= HID_KEY_LEFT_CONTROL ? next.modifier.val & (1 << (u - HID_KEY_LEFT_CONTROL))
+                                                         : memchr(next.key, u, HID_KEYBOARD_KEY_MAX) != NULL;
+            if (u > HID_KEY_ERROR_UNDEFINED && before != after) changes++;
+        }
+        report = next;
+        usb_app_keyboard_process_report(&state, &report, test_usb_event, &usb);
+
+        uint8_t nkro[BT_APP_KEYBOARD_NKRO_REPORT_LEN];
+        bt_app_keyboard_nkro_report(&test_keyboard, nkro);
+        for (int u = HID_KEY_A; u <= BT_APP_KEYBOARD_USAGE_MAX; u++) {
+            const bool expected = u >= HID_KEY_LEFT_CONTROL ? report.modifier.val & (1 << (u - HID_KEY_LEFT_CONTROL))
+                                                            : memchr(report.key, u, HID_KEYBOARD_KEY_MAX) != NULL;
+            if (test_nkro_pressed(nkro, u) != expected) mismatches++;
+        }
+    }
+
+    const bool passed = !mismatches && !usb.ignored && usb.events == changes;
+    printf("%s  %d USB reports: %lu key changes, %lu events, %lu ignored, %lu bitmap mismatches\n",
+           test_result_str(passed), TEST_USB_REPORTS, changes, usb.events, usb.ignored, mismatches);
+    return passed;
+}
+
+/* Press and release one more key with a growing number held, the report cost should not move */
+static void test_bench(void) {
+    printf("held,ns_per_event\n");
+    for (int held = 0; held <= TEST_CHORD_KEYS; held += TEST_CHORD_KEYS / 4) {
+        bt_app_keyboard_init(&test_keyboard);
+        for (int i = 0; i < held; i++) {
+            bt_app_keyboard_apply(&test_keyboard, HID_KEY_A + i, true);
+        }
+
+        uint8_t report[BT_APP_KEYBOARD_NKRO_REPORT_LEN];
+        uint32_t checksum = 0;
+        struct timespec start, end;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+        for (unsigned long i = 0; i < TEST_BENCH_EVENTS; i++) {
+            bt_app_keyboard_apply(&test_keyboard, HID_KEY_SPACE, !(i & 1));
+            bt_app_keyboard_nkro_report(&test_keyboard, report);
+            checksum += report[1 + (HID_KEY_SPACE >> 3)];
+        }
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+        const double ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+        printf("%d,%.2f\n", held, ns / TEST_BENCH_EVENTS);
+        if (checksum == 0) fprintf(stderr, "no reports\n");
+    }
+}
+
+int main(void) {
+    srand(11);
+    test_result(test_chords());
+    test_result(test_usb_reports());
+    test_bench();
+
+    return test_result_summary(stdout);
+}
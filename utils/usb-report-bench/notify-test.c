@@ -0,0 +1,338 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the notification backpressure natively on Linux against a fake GATT server.
+ *
+ * The server behaves like NimBLE with a small buffer pool: a notification takes a buffer or fails with ENOMEM,
+ * and the controller frees the buffers of the packets it puts on air at each connection event. Some links send
+ * fewer packets per event than are queued, one fades out for 200 ms every 2 s, and one has a share of the
+ * notifications fail with ENOMEM as if other traffic held the buffers.
+ *
+ * A random typist and a mouse moving in strokes on every 1 ms poll feed the keyboard scheduler and the mouse queue, which send
+ * through the link tracker the way bt_app.c does. The host checks that every key transition arrives in order, that
+ * every click arrives, and with the merge policy that the sum of the motion arrives too. Each link runs with the
+ * tracker off, which hands everything to the stack like before, and on.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_app_mouse.h"
+#include "bt_app_notify.h"
+#include "bt_app_sched.h"
+#include "test-result.h"
+#include "usb_app/hid_usage_keyboard.h"
+
+#define TEST_USB_POLL_US            1000
+#define TEST_RUN_US                 20000000
+#define TEST_SEEDS                  10
+#define TEST_INTERVAL_US            15000
+#define TEST_BUFFERS_MAX            16
+#define TEST_TRANSITIONS_MAX        4096
+#define TEST_CLICKS_MAX             1024
+#define TEST_ENOMEM                 (-1)
+#define TEST_EBUSY                  (-2)
+
+typedef struct {
+    const char *name;
+    uint8_t buffers;                    // Notifications the stack holds before ENOMEM
+    uint8_t per_event_min;              // Packets the controller sends per connection event
+    uint8_t per_event_max;
+    double enomem_ratio;                // Notifications failing as if other traffic held the buffers
+    bool fading;                        // Nothing goes out 200 ms of every 2 s
+} test_link_t;
+
+typedef enum {
+    TEST_PACKET_KEYS,
+    TEST_PACKET_MOUSE
+} test_packet_kind_t;
+
+typedef struct {
+    test_packet_kind_t kind;
+    bt_app_keyboard_t keys;
+    uint8_t mouse[BT_APP_MOUSE_REPORT_LEN];
+} test_packet_t;
+
+/* The fake GATT server, a FIFO of the notifications that hold a buffer */
+typedef struct {
+    const test_link_t *link;
+    test_packet_t queue[TEST_BUFFERS_MAX];
+    uint8_t head;
+    uint8_t count;
+    unsigned int seed;                  // Own random stream, so the sources see the same link in every mode
+    unsigned long enomem;
+} test_server_t;
+
+typedef struct {
+    uint8_t usage;
+    bool pressed;
+    int64_t at_us;
+} test_transition_t;
+
+typedef struct {
+    bt_app_keyboard_t keys;             // What the host has down
+    test_transition_t usb[TEST_TRANSITIONS_MAX];
+    size_t usb_count;
+    size_t matched;
+    uint8_t clicks[TEST_CLICKS_MAX];    // Button states the mouse went through
+    size_t click_count;
+    size_t clicks_seen;
+    uint8_t buttons;
+    long usb_x, usb_y;
+    long host_x, host_y;
+    unsigned long violations;
+    int64_t max_latency_us;
+} test_host_t;
+
+static test_server_t test_server;
+static test_host_t test_host;
+static bt_app_notify_link_t test_link;
+static bool test_tracked;
+static bt_app_sched_t test_sched;
+static bt_app_mouse_t test_mouse;
+static int64_t test_now_us;
+
+static int test_gatts_notify(const test_packet_t *packet) {
+    test_server_t *server = &test_server;
+    if (server->count == server->link->buffers || (double) rand_r(&server->seed) / RAND_MAX < server->link->enomem_ratio) {
+        server->enomem++;
+        return TEST_ENOMEM;
+    }
+    server->queue[(server->head + server->count++) % TEST_BUFFERS_MAX] = *packet;
+    return 0;
+}
+
+/* What bt_app_notify_tracked() does around ble_gatts_notify_custom() */
+static int test_notify(const test_packet_t *packet) {
+    if (!test_tracked) return test_gatts_notify(packet);
+    if (!bt_app_notify_reserve(&test_link)) return TEST_EBUSY;
+
+    const int rc = test_gatts_notify(packet);
+    bt_app_notify_complete(&test_link, rc == 0 ? BT_APP_NOTIFY_OK
+                                     : rc == TEST_ENOMEM ? BT_APP_NOTIFY_NOMEM
+                                     : BT_APP_NOTIFY_ERROR);
+    return rc;
+}
+
+static int test_send_keys(const bt_app_keyboard_t *state, void *arg) {
+    test_packet_t packet = { .kind = TEST_PACKET_KEYS, .keys = *state };
+    return test_notify(&packet);
+}
+
+static int test_send_mouse(const uint8_t *report, void *arg) {
+    test_packet_t packet = { .kind = TEST_PACKET_MOUSE };
+    memcpy(packet.mouse, report, sizeof(packet.mouse));
+    return test_notify(&packet);
+}
+
+/* The next USB transitions have to be exactly the usages this report changes */
+static void test_host_keys(const bt_app_keyboard_t *report) {
+    test_host_t *host = &test_host;
+    size_t changed = 0;
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        if (bt_app_keyboard_is_pressed(report, usage) != bt_app_keyboard_is_pressed(&host->keys, usage)) changed++;
+    }
+    if (changed == 0 || host->matched + changed > host->usb_count) {
+        host->violations++;
+        host->keys = *report;
+        return;
+    }
+    for (size_t i = host->matched; i < host->matched + changed; i++) {
+        const test_transition_t *transition = &host->usb[i];
+        if (bt_app_keyboard_is_pressed(report, transition->usage) != transition->pressed ||
+            bt_app_keyboard_is_pressed(&host->keys, transition->usage) == transition->pressed) {
+            host->violations++;
+        }
+        if (test_now_us - transition->at_us > host->max_latency_us) host->max_latency_us = test_now_us - transition->at_us;
+    }
+    host->matched += changed;
+    host->keys = *report;
+}
+
+static void test_host_mouse(const uint8_t *report) {
+    test_host_t *host = &test_host;
+    if (report[0] != host->buttons) {
+        if (host->clicks_seen == host->click_count || host->clicks[host->clicks_seen] != report[0]) host->violations++;
+        host->clicks_seen++;
+        host->buttons = report[0];
+    }
+    host->host_x += (int8_t) report[1];
+    host->host_y += (int8_t) report[2];
+}
+
+static void test_connection_event(void) {
+    test_server_t *server = &test_server;
+    const test_link_t *link = server->link;
+    int budget = link->per_event_min + rand_r(&server->seed) % (link->per_event_max - link->per_event_min + 1);
+    if (link->fading && test_now_us % 2000000 < 200000) budget = 0;
+
+    for (; budget > 0 && server->count; budget--) {
+        const test_packet_t *packet = &server->queue[server->head];
+        if (packet->kind == TEST_PACKET_KEYS) test_host_keys(&packet->keys);
+        else test_host_mouse(packet->mouse);
+        server->head = (server->head + 1) % TEST_BUFFERS_MAX;
+        server->count--;
+    }
+
+    if (test_tracked) bt_app_notify_connection_event(&test_link);
+    bt_app_sched_connection_event(&test_sched);
+    bt_app_mouse_connection_event(&test_mouse);
+}
+
+static uint32_t test_between(uint32_t min, uint32_t max) {
+    return min + (max > min ? rand() % (max - min + 1) : 0);
+}
+
+typedef struct {
+    unsigned long key_events;
+    unsigned long key_retries;
+    unsigned long mouse_events;
+    unsigned long mouse_merged;
+    unsigned long mouse_dropped;
+    unsigned long enomem;
+    unsigned long deferred;
+    unsigned long budget_cuts;
+    unsigned long overflows;
+    unsigned long violations;
+    long motion_lost;
+    int64_t max_latency_us;
+} test_totals_t;
+
+static void test_run(const test_link_t *link, bool tracked, bt_app_mouse_policy_t policy, unsigned int seed,
+                     test_totals_t *totals) {
+    test_host_t *host = &test_host;
+    memset(&test_server, 0, sizeof(test_server));
+    memset(host, 0, sizeof(*host));
+    test_server.link = link;
+    test_server.seed = seed;
+    test_tracked = tracked;
+    bt_app_keyboard_init(&host->keys);
+    bt_app_notify_init(&test_link, BT_APP_NOTIFY_MAX_PER_EVENT);
+    bt_app_sched_init(&test_sched, 1, test_send_keys, NULL);
+    bt_app_mouse_init(&test_mouse, 1, policy, test_send_mouse, NULL);
+    srand(seed);
+
+    int64_t release_at_us[256];
+    for (int usage = 0; usage < 256; usage++) {
+        release_at_us[usage] = -1;
+    }
+    uint8_t held = 0;
+    uint8_t buttons = 0;
+    int64_t next_press_us = test_between(20000, 80000);
+    int64_t next_click_us = test_between(100000, 500000);
+    int64_t stroke_until_us = 0;
+    int stroke_vx = 0;
+    int stroke_vy = 0;
+    int64_t next_event_us = TEST_INTERVAL_US / 2;
+
+    for (test_now_us = 0; test_now_us < TEST_RUN_US || held || buttons || bt_app_sched_pending(&test_sched) ||
+                          bt_app_mouse_pending(&test_mouse) || test_server.count;) {
+        const int64_t poll_us = test_now_us + TEST_USB_POLL_US;
+        while (next_event_us <= poll_us) {
+            test_now_us = next_event_us;
+            test_connection_event();
+            next_event_us += TEST_INTERVAL_US;
+        }
+        test_now_us = poll_us;
+        const bool typing = test_now_us < TEST_RUN_US && host->usb_count < TEST_TRANSITIONS_MAX - 16;
+
+        for (int usage = HID_KEY_A; usage <= HID_KEY_LEFT_CONTROL + 7; usage++) {
+            if (release_at_us[usage] < 0 || release_at_us[usage] > test_now_us) continue;
+            release_at_us[usage] = -1;
+            held--;
+            host->usb[host->usb_count++] = (test_transition_t) { usage, false, test_now_us };
+            bt_app_sched_event(&test_sched, usage, false);
+        }
+        if (typing && next_press_us <= test_now_us && held < 6) {
+            uint8_t usage;
+            do {
+                usage = HID_KEY_A + rand() % (HID_KEY_SLASH - HID_KEY_A + 1);
+            } while (release_at_us[usage] >= 0);
+            release_at_us[usage] = test_now_us + test_between(30000, 120000);
+            held++;
+            host->usb[host->usb_count++] = (test_transition_t) { usage, true, test_now_us };
+            bt_app_sched_event(&test_sched, usage, true);
+            next_press_us = test_now_us + test_between(20000, 80000);
+        }
+
+        // The mouse moves in strokes of 1 to 6 counts per poll on each axis, and clicks now and then
+        if (stroke_until_us <= test_now_us) {
+            const bool moving = !stroke_vx && !stroke_vy;
+            stroke_vx = moving ? (int) test_between(0, 12) - 6 : 0;
+            stroke_vy = moving ? (int) test_between(0, 12) - 6 : 0;
+            stroke_until_us = test_now_us + (moving ? test_between(100000, 400000) : test_between(100000, 600000));
+        }
+        uint8_t next_buttons = buttons;
+        if (next_click_us <= test_now_us) {
+            next_buttons = buttons ? 0 : 1 << (rand() % 3);
+            next_click_us = test_now_us + (next_buttons ? test_between(50000, 150000) : test_between(100000, 500000));
+        }
+        if (!typing) next_buttons = 0;
+        const int8_t x = typing && stroke_vx ? stroke_vx + (int) test_between(0, 2) - 1 : 0;
+        const int8_t y = typing && stroke_vy ? stroke_vy + (int) test_between(0, 2) - 1 : 0;
+        if (next_buttons != buttons) host->clicks[host->click_count++] = next_buttons;
+        buttons = next_buttons;
+        host->usb_x += x;
+        host->usb_y += y;
+        bt_app_mouse_report(&test_mouse, buttons, x, y, 0);
+    }
+
+    if (host->matched != host->usb_count || host->clicks_seen != host->click_count) host->violations++;
+    const long motion_lost = labs(host->usb_x - host->host_x) + labs(host->usb_y - host->host_y);
+    if (policy == BT_APP_MOUSE_POLICY_MERGE && motion_lost) host->violations++;
+
+    totals->key_events += test_sched.stats.events;
+    totals->key_retries += test_sched.stats.send_failures;
+    totals->mouse_events += test_mouse.stats.events;
+    totals->mouse_merged += test_mouse.stats.merged;
+    totals->mouse_dropped += test_mouse.stats.dropped;
+    totals->enomem += test_server.enomem;
+    totals->deferred += test_link.stats.deferred;
+    totals->budget_cuts += test_link.stats.budget_cuts;
+    totals->overflows += test_sched.stats.overflows + test_mouse.stats.overflows;
+    totals->violations += host->violations;
+    totals->motion_lost += motion_lost;
+    if (host->max_latency_us > totals->max_latency_us) totals->max_latency_us = host->max_latency_us;
+}
+
+int main(void) {
+    static const test_link_t links[] = {
+        { "clean", 8, 4, 4, 0, false },
+        { "congested", 3, 0, 2, 0, false },
+        { "fading", 4, 2, 4, 0, true },
+        { "shared pool", 8, 4, 4, 0.3, false },
+    };
+    static const struct {
+        const char *name;
+        bt_app_mouse_policy_t policy;
+    } policies[] = {
+        { "merge", BT_APP_MOUSE_POLICY_MERGE },
+        { "drop", BT_APP_MOUSE_POLICY_DROP },
+    };
+
+    printf("link,tracker,mouse_policy,key_events,key_retries,mouse_events,mouse_merged,mouse_dropped,enomem,deferred,"
+           "budget_cuts,motion_lost,max_key_latency_ms,result\n");
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        for (int tracked = 0; tracked <= 1; tracked++) {
+            for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+                test_totals_t totals = { 0 };
+                for (unsigned int seed = 1; seed <= TEST_SEEDS; seed++) {
+                    test_run(&links[l], tracked, policies[p].policy, seed, &totals);
+                }
+                const bool passed = totals.violations == 0 && totals.overflows == 0;
+                printf("%s,%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%ld,%.1f,%s\n", links[l].name,
+                       tracked ? "on" : "off", policies[p].name, totals.key_events, totals.key_retries,
+                       totals.mouse_events, totals.mouse_merged, totals.mouse_dropped, totals.enomem, totals.deferred,
+                       totals.budget_cuts, totals.motion_lost, totals.max_latency_us / 1000.0,
+                       test_result_str(passed));
+                test_result(passed);
+            }
+        }
+    }
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,205 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the activity-adaptive polling policy natively on Linux against simulated keyboards on a fake 1 ms clock.
+ *
+ * The host side works like the HID driver: an IN transfer waits for the device until it answers at a bInterval
+ * poll, the report wakes the USB tasks, and the transfer is resubmitted after the delay the policy returns. The
+ * idle check timer runs while the interface is active and each firing counts as a wakeup too. A device either
+ * honors SET_IDLE(0) and answers only when its keys change, or repeats its report at every poll.
+ *
+ * A typist types for 20 s and leaves the keyboard alone for 40 s, five times over. Wakeups per second are counted
+ * for both phases. Every key change must reach the host within bInterval plus the idle interval, and no press
+ * may be lost by a late poll. The interface must be idle at the end of every pause.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test-result.h"
+#include "usb_app_poll.h"
+
+#define TEST_IDLE_AFTER_MS          2000
+#define TEST_IDLE_INTERVAL_MS       16
+#define TEST_TICK_MS                250
+#define TEST_TYPING_MS              20000
+#define TEST_PAUSE_MS               40000
+#define TEST_CYCLES                 5
+#define TEST_SEEDS                  20
+#define TEST_KEYS                   6           // Boot report key slots
+
+typedef struct {
+    const char *name;
+    uint32_t b_interval_ms;
+    bool repeats;                       // Ignores SET_IDLE(0) and answers every poll
+} test_device_t;
+
+typedef struct {
+    const char *name;
+    uint32_t idle_interval_ms;
+} test_mode_t;
+
+typedef struct {
+    uint64_t typing_wakeups;
+    uint64_t typing_ms;
+    uint64_t pause_wakeups;
+    uint64_t pause_ms;
+    unsigned long deferred;
+    unsigned long idle_periods;
+    unsigned long lost;
+    unsigned long late;
+    unsigned long not_idle;
+    uint32_t max_latency_ms;
+    uint32_t max_wake_latency_ms;       // First key after a pause
+} test_totals_t;
+
+static uint32_t test_between(uint32_t min, uint32_t max) {
+    return min + (max > min ? rand() % (max - min + 1) : 0);
+}
+
+/* Boot keyboard report of the held keys */
+static void test_report(const uint8_t *keys, uint8_t *report) {
+    memset(report, 0, 8);
+    memcpy(report + 2, keys, TEST_KEYS);
+}
+
+static void test_run(const test_device_t *device, const test_mode_t *mode, unsigned int seed, test_totals_t *totals) {
+    usb_app_poll_t poll;
+    usb_app_poll_init(&poll, TEST_IDLE_AFTER_MS, mode->idle_interval_ms, 0);
+    srand(seed);
+
+    uint8_t keys[TEST_KEYS] = { 0 };
+    uint32_t release_at[TEST_KEYS] = { 0 };
+    uint32_t toggles[256] = { 0 };              // Changes of each usage since the last report
+    uint32_t released_at[256] = { 0 };          // A finger takes a while to hit the same key again
+    uint32_t changed_at = 0;                    // Oldest change the host has not seen
+    bool changed = false;
+    bool pending = true;                        // IN transfer waiting for the device
+    uint32_t resubmit_at = 0;
+    uint32_t next_tick = TEST_TICK_MS;
+    bool timer_armed = true;
+    bool wake_pending = false;                  // Next change is the first key after a pause
+    uint32_t next_press = 0;
+
+    for (int cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        const uint32_t typing_from = cycle * (TEST_TYPING_MS + TEST_PAUSE_MS);
+        const uint32_t pause_from = typing_from + TEST_TYPING_MS;
+        const uint32_t cycle_end = pause_from + TEST_PAUSE_MS;
+        next_press = typing_from + test_between(0, 200);
+        wake_pending = cycle > 0;
+
+        for (uint32_t now = typing_from; now < cycle_end; now++) {
+            const bool typing = now < pause_from;
+            uint64_t *wakeups = typing ? &totals->typing_wakeups : &totals->pause_wakeups;
+
+            // Typist, keys are released at the end of the typing phase
+            for (int i = 0; i < TEST_KEYS; i++) {
+                if (!keys[i] || release_at[i] > now) continue;
+                toggles[keys[i]]++;
+                released_at[keys[i]] = now;
+                keys[i] = 0;
+                if (!changed) changed_at = now;
+                changed = true;
+            }
+            if (typing && now >= next_press && now + 200 < pause_from) {
+                int slot = 0;
+                while (slot < 3 && keys[slot]) slot++;
+                if (slot < 3) {
+                    uint8_t usage;
+                    bool held;
+                    do {
+                        usage = 0x04 + rand() % 36;
+                        held = released_at[usage] && now - released_at[usage] < 60;
+                        for (int i = 0; i < TEST_KEYS; i++) held |= keys[i] == usage;
+                    } while (held);
+                    keys[slot] = usage;
+                    release_at[slot] = now + test_between(40, 150);
+                    toggles[usage]++;
+                    if (!changed) changed_at = now;
+                    changed = true;
+                }
+                next_press = now + test_between(60, 250);
+            }
+
+            // Host controller and device
+            if (!pending && now >= resubmit_at) pending = true;
+            if (pending && now % device->b_interval_ms == 0 && (changed || device->repeats)) {
+                uint8_t report[8];
+                test_report(keys, report);
+                (*wakeups)++;
+                if (changed) {
+                    const uint32_t latency = now - changed_at;
+                    if (latency > totals->max_latency_ms) totals->max_latency_ms = latency;
+                    if (wake_pending && latency > totals->max_wake_latency_ms) totals->max_wake_latency_ms = latency;
+                    if (latency > device->b_interval_ms + mode->idle_interval_ms) totals->late++;
+                    wake_pending = false;
+                    // A usage that went down and up again between two reports never reached the host
+                    for (int usage = 0; usage < 256; usage++) {
+                        if (toggles[usage] >= 2) totals->lost += toggles[usage] / 2;
+                        toggles[usage] = 0;
+                    }
+                }
+                changed = false;
+                const uint32_t delay = usb_app_poll_report(&poll, report, sizeof(report), now);
+                pending = delay == 0;
+                resubmit_at = now + delay;
+            }
+
+            // Idle check timer, runs while the interface is active
+            if (!poll.idle && !timer_armed) {
+                timer_armed = true;
+                next_tick = now + TEST_TICK_MS;
+            }
+            if (timer_armed && now >= next_tick) {
+                (*wakeups)++;
+                usb_app_poll_tick(&poll, now);
+                timer_armed = !poll.idle;
+                next_tick = now + TEST_TICK_MS;
+            }
+        }
+        if (!poll.idle) totals->not_idle++;
+        totals->typing_ms += TEST_TYPING_MS;
+        totals->pause_ms += TEST_PAUSE_MS;
+    }
+
+    totals->deferred += poll.stats.deferred;
+    totals->idle_periods += poll.stats.idle_periods;
+}
+
+int main(void) {
+    static const test_device_t devices[] = {
+        { "set_idle 10ms", 10, false },
+        { "set_idle 1ms", 1, false },
+        { "repeat 10ms", 10, true },
+        { "repeat 8ms", 8, true },
+        { "repeat 1ms", 1, true },
+    };
+    static const test_mode_t modes[] = {
+        { "off", 0 },
+        { "adaptive", TEST_IDLE_INTERVAL_MS },
+    };
+
+    printf("device,mode,typing_wakeups_per_s,pause_wakeups_per_s,deferred,idle_periods,max_latency_ms,"
+           "max_wake_latency_ms,lost,result\n");
+    for (size_t d = 0; d < sizeof(devices) / sizeof(devices[0]); d++) {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            test_totals_t totals = { 0 };
+            for (unsigned int seed = 1; seed <= TEST_SEEDS; seed++) {
+                test_run(&devices[d], &modes[m], seed, &totals);
+            }
+            const bool passed = totals.lost == 0 && totals.late == 0 && totals.not_idle == 0;
+            printf("%s,%s,%.1f,%.1f,%lu,%lu,%u,%u,%lu,%s\n", devices[d].name, modes[m].name,
+                   totals.typing_wakeups * 1000.0 / totals.typing_ms, totals.pause_wakeups * 1000.0 / totals.pause_ms,
+                   totals.deferred, totals.idle_periods, totals.max_latency_ms, totals.max_wake_latency_ms,
+                   totals.lost, test_result_str(passed));
+            test_result(passed);
+        }
+    }
+
+    return test_result_summary(stdout);
+}
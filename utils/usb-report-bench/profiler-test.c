@@ -0,0 +1,252 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Test of the sliding window math of the task profiler, run natively on Linux.
+ *
+ * A simulated scheduler hands each task a run time per sample period from its load profile, the sample periods
+ * jitter like a timer on a busy system and the counters start a few seconds before they wrap. Tasks come and go
+ * with new task numbers and reused names like the USB enumeration tasks, and at times there are more of them than
+ * the profiler has slots. Every task is shuffled to a new place in each sample.
+ *
+ * The reference keeps the run time of each period per task in 64 bits. After every sample each tracked task must
+ * have exactly the load of the periods it has been tracked for, up to the window length, every present task must be
+ * tracked while there is a slot and no gone task may be left. The exit status is non-zero on any mismatch.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "task_profiler_window.h"
+#include "test-result.h"
+
+#define TEST_SAMPLES                3000
+#define TEST_PERIOD_US              1000000
+#define TEST_JITTER_US              20000
+#define TEST_WRAP_AFTER_US          5000000     // Counters start this long before they wrap
+#define TEST_MAX_TASKS              40
+#define TEST_HISTORY                (TASK_PROFILER_WINDOW_MAX_SAMPLES + 1)
+
+static const uint16_t test_windows[] = { 1, 10, 60, 200 };
+
+typedef enum {
+    TEST_LOAD_STEADY = 0,               // Same load every period
+    TEST_LOAD_STEP,                     // Low load, then high load halfway through its life
+    TEST_LOAD_BURSTY,                   // Random load every period, mostly idle
+} test_load_e;
+
+typedef struct {
+    const char *name;
+    bool churn;                         // Tasks come and go
+    size_t steady_tasks;
+    size_t max_tasks;                   // Present at once, may exceed the profiler slots
+} test_scenario_t;
+
+typedef struct {
+    bool present;
+    uint32_t number;
+    char name[TASK_PROFILER_WINDOW_NAME_LEN];
+    test_load_e load;
+    uint32_t permille;                  // Load of steady tasks and the high load of step tasks
+    uint32_t age;                       // Samples since created
+    uint32_t run_time;                  // Counter, wraps
+    uint32_t run_us[TEST_HISTORY];      // Run time of each period, indexed like elapsed_us
+    int64_t tracked_since;              // Sample the profiler took the task in, -1 while untracked
+} test_task_t;
+
+typedef struct {
+    test_task_t tasks[TEST_MAX_TASKS];
+    uint32_t elapsed_us[TEST_HISTORY];  // Length of each period
+    uint32_t total;                     // Total counter, wraps
+    uint32_t next_number;
+    unsigned long checks;
+    unsigned long mismatches;
+    unsigned long slot_errors;
+    unsigned long created;
+    unsigned long deleted;
+} test_state_t;
+
+static uint32_t test_random(uint32_t bound) {
+    return (uint32_t) (((uint64_t) rand() << 16 ^ rand()) % bound);
+}
+
+static void test_create_task(test_state_t *state, test_task_t *task, size_t index) {
+    memset(task, 0, sizeof(*task));
+    task->present = true;
+    task->number = state->next_number++;
+    // Names come back like the USB enumeration tasks, only the number tells the tasks apart
+    snprintf(task->name, sizeof(task->name), "task_%zu", index % 12);
+    task->load = (test_load_e) test_random(3);
+    task->permille = test_random(1001);
+    task->run_time = UINT32_MAX - test_random(TEST_WRAP_AFTER_US);
+    task->tracked_since = -1;
+    state->created++;
+}
+
+static uint32_t test_run_us(const test_task_t *task, uint32_t period_us) {
+    uint32_t permille = task->permille;
+    switch (task->load) {
+        case TEST_LOAD_STEADY:
+        break;
+        case TEST_LOAD_STEP:
+            if (task->age < 45) permille /= 10;
+        break;
+        case TEST_LOAD_BURSTY:
+            permille = test_random(10) == 0 ? test_random(1001) : test_random(5);
+        break;
+    }
+    // The task counter is read a moment after the total one, it may come out a bit above a full period
+    return (uint64_t) period_us * permille / 1000 + (permille == 1000 ? test_random(50) : 0);
+}
+
+/* The load the profiler must report, from the 64 bit run time of each period */
+static uint16_t test_expected(const test_state_t *state, const test_task_t *task, uint32_t sample,
+                              uint16_t window, uint16_t *span) {
+    const uint32_t tracked = sample - task->tracked_since;
+    *span = window;
+    if (*span > tracked) *span = tracked;
+    if (*span > TASK_PROFILER_WINDOW_MAX_SAMPLES) *span = TASK_PROFILER_WINDOW_MAX_SAMPLES;
+
+    uint64_t run_us = 0;
+    uint64_t elapsed_us = 0;
+    for (uint32_t i = 0; i < *span; i++) {
+        run_us += task->run_us[(sample - i) % TEST_HISTORY];
+        elapsed_us += state->elapsed_us[(sample - i) % TEST_HISTORY];
+    }
+    if (!elapsed_us) return 0;
+    const uint64_t load = run_us * TASK_PROFILER_WINDOW_LOAD_FULL / elapsed_us;
+    return load > TASK_PROFILER_WINDOW_LOAD_FULL ? TASK_PROFILER_WINDOW_LOAD_FULL : (uint16_t) load;
+}
+
+static void test_check(test_state_t *state, const task_profiler_window_t *window, uint32_t sample, size_t present) {
+    size_t tracked = 0;
+    for (size_t slot = 0; slot < TASK_PROFILER_WINDOW_MAX_TASKS; slot++) {
+        if (!window->tasks[slot].used) continue;
+        tracked++;
+
+        test_task_t *task = NULL;
+        for (size_t i = 0; i < TEST_MAX_TASKS; i++) {
+            if (state->tasks[i].present && state->tasks[i].number == window->tasks[slot].last.number) {
+                task = &state->tasks[i];
+            }
+        }
+        if (!task || strcmp(task->name, window->tasks[slot].last.name) != 0) {
+            state->slot_errors++;
+            continue;
+        }
+        if (task->tracked_since < 0) task->tracked_since = sample;
+
+        for (size_t i = 0; i < sizeof(test_windows) / sizeof(test_windows[0]); i++) {
+            uint16_t span;
+            const uint16_t expected = test_expected(state, task, sample, test_windows[i], &span);
+            state->checks++;
+            if (task_profiler_window_load(window, slot, test_windows[i]) != expected ||
+                task_profiler_window_span(window, slot, test_windows[i]) != span) {
+                state->mismatches++;
+            }
+        }
+    }
+    // Present tasks fill the free slots, the ones left over are not tracked until a slot frees up
+    const size_t expected = present < TASK_PROFILER_WINDOW_MAX_TASKS ? present : TASK_PROFILER_WINDOW_MAX_TASKS;
+    if (tracked != expected) state->slot_errors++;
+}
+
+static bool test_run(const test_scenario_t *scenario, unsigned seed) {
+    static test_state_t state;
+    static task_profiler_window_t window;
+    memset(&state, 0, sizeof(state));
+    task_profiler_window_init(&window);
+    srand(seed);
+    state.next_number = 1;
+    state.total = UINT32_MAX - TEST_WRAP_AFTER_US;
+
+    for (size_t i = 0; i < scenario->steady_tasks; i++) {
+        test_create_task(&state, &state.tasks[i], i);
+    }
+
+    task_profiler_sample_t samples[TEST_MAX_TASKS];
+    for (uint32_t sample = 0; sample < TEST_SAMPLES; sample++) {
+        if (scenario->churn) {
+            for (size_t i = scenario->steady_tasks; i < scenario->max_tasks; i++) {
+                test_task_t *task = &state.tasks[i];
+                if (task->present && test_random(40) == 0) {
+                    task->present = false;
+                    state.deleted++;
+                } else if (!task->present && test_random(20) == 0) {
+                    test_create_task(&state, task, i);
+                }
+            }
+        }
+
+        // The first sample only starts the history
+        const uint32_t period_us = sample ? TEST_PERIOD_US - TEST_JITTER_US + test_random(2 * TEST_JITTER_US) : 0;
+        state.total += period_us;
+        state.elapsed_us[sample % TEST_HISTORY] = period_us;
+
+        size_t present = 0;
+        for (size_t i = 0; i < scenario->max_tasks; i++) {
+            test_task_t *task = &state.tasks[i];
+            if (!task->present) continue;
+
+            // A task created during the period only ran for part of it, its first sample starts the history
+            const uint32_t run_us = task->age ? test_run_us(task, period_us) : 0;
+            task->run_time += run_us;
+            task->run_us[sample % TEST_HISTORY] = run_us;
+            task->age++;
+            samples[present++] = (task_profiler_sample_t) {
+                .number = task->number,
+                .run_time = task->run_time,
+                .stack_free = 4096 - task->age % 2048,
+                .priority = 5,
+                .core = TASK_PROFILER_WINDOW_NO_AFFINITY,
+            };
+            memcpy(samples[present - 1].name, task->name, sizeof(task->name));
+        }
+        for (size_t i = present; i > 1; i--) {
+            const size_t j = test_random(i);
+            const task_profiler_sample_t swap = samples[i - 1];
+            samples[i - 1] = samples[j];
+            samples[j] = swap;
+        }
+
+        task_profiler_window_add(&window, samples, present, state.total);
+        for (size_t i = 0; i < scenario->max_tasks; i++) {
+            if (!state.tasks[i].present) continue;
+            // The history of a task that lost its slot starts over once it gets one
+            bool tracked = false;
+            for (size_t slot = 0; slot < TASK_PROFILER_WINDOW_MAX_TASKS; slot++) {
+                if (window.tasks[slot].used && window.tasks[slot].last.number == state.tasks[i].number) tracked = true;
+            }
+            if (!tracked) state.tasks[i].tracked_since = -1;
+        }
+        test_check(&state, &window, sample, present);
+    }
+
+    const bool passed = state.mismatches == 0 && state.slot_errors == 0 &&
+                        window.stats.created <= state.created && window.stats.sampled == TEST_SAMPLES;
+    printf("%s,%u,%d,%lu,%lu,%lu,%lu,%lu,%lu,%zu,%s\n", scenario->name, seed, TEST_SAMPLES,
+           state.created, state.deleted, (unsigned long) window.stats.untracked, state.checks, state.mismatches,
+           state.slot_errors, sizeof(window), test_result_str(passed));
+    return passed;
+}
+
+int main(void) {
+    static const test_scenario_t scenarios[] = {
+        { "steady", false, 16, 16 },
+        { "churn", true, 12, 22 },
+        { "overflow", true, 12, TEST_MAX_TASKS },
+    };
+
+    printf("scenario,seed,samples,created,deleted,untracked,checks,mismatches,slot_errors,state_bytes,result\n");
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+        for (unsigned seed = 1; seed <= 3; seed++) {
+            test_result(test_run(&scenarios[i], seed));
+        }
+    }
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,333 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Property test of the key replay across BLE reconnects, run natively on Linux.
+ *
+ * A random typist keeps typing through connected periods and link drops of 0.3 to 12 s. The transitions go through
+ * the replay ring and the keyboard scheduler to a simulated link that puts the reports handed to the stack on air at
+ * the next connection event. On a drop the host lets go of every key and the reports in flight are lost. When the
+ * link is back the host subscribes again and the buffered keys drain.
+ *
+ * The host diffs every report against the previous one. The transitions it sees after a reconnect must be exactly,
+ * in order: the buffered ones not older than the maximum age that fit the ring, then the ones typed during the
+ * replay, then the keys still held, each applied to an all released keyboard. After that every transition goes
+ * straight through. The ring may never hold more than its depth, and the host must end all released.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_app_replay.h"
+#include "test-result.h"
+#include "usb_app/hid_usage_keyboard.h"
+
+#define TEST_USB_POLL_US            1000
+#define TEST_MAX_AGE_MS             5000
+#define TEST_SEEDS                  20
+#define TEST_CYCLES                 20
+#define TEST_EXPECTED_MAX           8192
+#define TEST_SENT_MAX               64
+
+typedef struct {
+    const char *name;
+    uint32_t interval_us;
+} test_link_t;
+
+typedef struct {
+    const char *name;
+    uint32_t gap_min_us;                // Between two presses
+    uint32_t gap_max_us;
+    uint32_t hold_min_us;               // Key down time
+    uint32_t hold_max_us;
+    uint32_t modifier_hold_max_us;      // Modifiers may be held across a drop
+    uint8_t max_held;
+} test_profile_t;
+
+typedef struct {
+    uint8_t usage;
+    bool pressed;
+    uint32_t at_ms;
+} test_transition_t;
+
+typedef struct {
+    const test_link_t *link;
+    bt_app_keyboard_t sent[TEST_SENT_MAX];      // Handed to the stack, on air at the next connection event
+    size_t sent_count;
+    bool connected;
+    bt_app_keyboard_t host;                     // What the host has down
+    bt_app_keyboard_t held;                     // What the typist has down
+    bt_app_keyboard_t expected_state;           // Host state once every expected transition arrived
+    test_transition_t expected[TEST_EXPECTED_MAX];
+    size_t expected_count;
+    size_t matched;
+    test_transition_t ring[BT_APP_REPLAY_DEPTH];    // Reference of the buffered transitions
+    size_t ring_count;
+    bool replaying;
+    unsigned long violations;
+    unsigned long window_events;
+    int64_t resumed_us;
+    int64_t max_drain_us;
+} test_sim_t;
+
+static test_sim_t test_sim;
+static bt_app_sched_t test_sched;
+static bt_app_replay_t test_replay;
+
+static int test_send(const bt_app_keyboard_t *state, void *arg) {
+    test_sim_t *sim = arg;
+    if (!sim->connected || sim->sent_count == TEST_SENT_MAX) return -1;
+    sim->sent[sim->sent_count++] = *state;
+    return 0;
+}
+
+static uint32_t test_between(uint32_t min, uint32_t max) {
+    return min + (max > min ? rand() % (max - min + 1) : 0);
+}
+
+/* The transition reaches the host unless it repeats what the host will have */
+static void test_expect(test_sim_t *sim, uint8_t usage, bool pressed, uint32_t at_ms) {
+    if (!bt_app_keyboard_apply(&sim->expected_state, usage, pressed)) return;
+    if (sim->expected_count == TEST_EXPECTED_MAX) {
+        sim->violations++;
+        return;
+    }
+    sim->expected[sim->expected_count++] = (test_transition_t) { usage, pressed, at_ms };
+}
+
+/* Call after anything that may end the replay, the keys held right now follow it */
+static void test_check_replay_end(test_sim_t *sim, int64_t now_us) {
+    if (!sim->replaying || test_replay.replaying) return;
+    sim->replaying = false;
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        const bool held = bt_app_keyboard_is_pressed(&sim->held, usage);
+        if (held != bt_app_keyboard_is_pressed(&sim->expected_state, usage)) test_expect(sim, usage, held, now_us / 1000);
+    }
+    if (now_us - sim->resumed_us > sim->max_drain_us) sim->max_drain_us = now_us - sim->resumed_us;
+}
+
+/* The next expected transitions have to be exactly the usages this report changes */
+static void test_host_receive(test_sim_t *sim, const bt_app_keyboard_t *report) {
+    size_t changed = 0;
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        if (bt_app_keyboard_is_pressed(report, usage) != bt_app_keyboard_is_pressed(&sim->host, usage)) changed++;
+    }
+    // The state queued when the host subscribes may repeat what it has
+    if (changed == 0) return;
+    if (sim->matched + changed > sim->expected_count) {
+        sim->violations++;
+        sim->host = *report;
+        return;
+    }
+
+    for (size_t i = sim->matched; i < sim->matched + changed; i++) {
+        const test_transition_t *transition = &sim->expected[i];
+        const bool was = bt_app_keyboard_is_pressed(&sim->host, transition->usage);
+        const bool now = bt_app_keyboard_is_pressed(report, transition->usage);
+        if (was == now || now != transition->pressed) sim->violations++;
+    }
+    sim->matched += changed;
+    sim->host = *report;
+}
+
+static void test_connection_event(test_sim_t *sim, int64_t now_us) {
+    for (size_t i = 0; i < sim->sent_count; i++) {
+        test_host_receive(sim, &sim->sent[i]);
+    }
+    sim->sent_count = 0;
+    bt_app_replay_pump(&test_replay, &test_sched);
+    test_check_replay_end(sim, now_us);
+    bt_app_sched_connection_event(&test_sched);
+}
+
+static void test_key(test_sim_t *sim, uint8_t usage, bool pressed, int64_t now_us) {
+    const uint32_t now_ms = now_us / 1000;
+    bt_app_keyboard_apply(&sim->held, usage, pressed);
+    if (!sim->connected) {
+        // Reference ring, a full one pushes out the oldest transition
+        if (sim->ring_count == BT_APP_REPLAY_DEPTH) {
+            memmove(sim->ring, sim->ring + 1, (BT_APP_REPLAY_DEPTH - 1) * sizeof(sim->ring[0]));
+            sim->ring_count--;
+        }
+        sim->ring[sim->ring_count++] = (test_transition_t) { usage, pressed, now_ms };
+        sim->window_events++;
+    } else {
+        test_expect(sim, usage, pressed, now_ms);
+    }
+    bt_app_replay_event(&test_replay, &test_sched, usage, pressed, now_ms);
+    test_check_replay_end(sim, now_us);
+}
+
+/* Same order as the firmware: the subscription is gone first, then the link */
+static void test_disconnect(test_sim_t *sim) {
+    sim->connected = false;
+    sim->sent_count = 0;
+    bt_app_sched_pause(&test_sched);
+    bt_app_sched_reset(&test_sched);
+    bt_app_replay_begin(&test_replay, &test_sched);
+
+    // Reports not on air yet are lost with the link
+    bt_app_keyboard_init(&sim->host);
+    bt_app_keyboard_init(&sim->expected_state);
+    sim->expected_count = 0;
+    sim->matched = 0;
+    sim->ring_count = 0;
+}
+
+static void test_reconnect(test_sim_t *sim, int64_t now_us) {
+    const uint32_t now_ms = now_us / 1000;
+    sim->connected = true;
+    sim->replaying = true;
+    sim->resumed_us = now_us;
+    for (size_t i = 0; i < sim->ring_count; i++) {
+        if (now_ms - sim->ring[i].at_ms > TEST_MAX_AGE_MS) continue;
+        test_expect(sim, sim->ring[i].usage, sim->ring[i].pressed, sim->ring[i].at_ms);
+    }
+    sim->ring_count = 0;
+
+    bt_app_sched_resume(&test_sched);
+    bt_app_replay_resume(&test_replay, &test_sched, now_ms);
+    test_check_replay_end(sim, now_us);
+}
+
+typedef struct {
+    unsigned long cycles;
+    unsigned long window_events;
+    unsigned long recorded;
+    unsigned long replayed;
+    unsigned long expired;
+    unsigned long overflows;
+    unsigned long corrected;
+    unsigned long sched_overflows;
+    unsigned long violations;
+    uint16_t max_count;
+    int64_t max_drain_us;
+} test_totals_t;
+
+static void test_run(const test_link_t *link, const test_profile_t *profile, unsigned int seed, test_totals_t *totals) {
+    test_sim_t *sim = &test_sim;
+    memset(sim, 0, sizeof(*sim));
+    sim->link = link;
+    sim->connected = true;
+    bt_app_keyboard_init(&sim->host);
+    bt_app_keyboard_init(&sim->held);
+    bt_app_keyboard_init(&sim->expected_state);
+    bt_app_sched_init(&test_sched, 1, test_send, sim);
+    bt_app_replay_init(&test_replay, TEST_MAX_AGE_MS);
+    srand(seed);
+
+    int64_t release_at_us[256];
+    for (int usage = 0; usage < 256; usage++) {
+        release_at_us[usage] = -1;
+    }
+    uint8_t held = 0;
+
+    int64_t now_us = 0;
+    int64_t next_event_us = link->interval_us / 2;
+    int64_t next_press_us = test_between(profile->gap_min_us, profile->gap_max_us);
+    int64_t toggle_at_us = test_between(1000000, 4000000);
+    int cycle = 0;
+
+    while (cycle < TEST_CYCLES || held) {
+        now_us += TEST_USB_POLL_US;
+        if (sim->connected) {
+            while (next_event_us <= now_us) {
+                test_connection_event(sim, next_event_us);
+                next_event_us += link->interval_us;
+            }
+        }
+
+        if (cycle < TEST_CYCLES && now_us >= toggle_at_us) {
+            if (!sim->connected) {
+                test_reconnect(sim, now_us);
+                next_event_us = now_us + link->interval_us / 2;
+                toggle_at_us = now_us + test_between(1000000, 4000000);
+                cycle++;
+            } else if (!sim->replaying) {
+                // A drop in the middle of a replay is not modeled, the reference ring would have to know its head
+                test_disconnect(sim);
+                toggle_at_us = now_us + test_between(300000, 12000000);
+            }
+        }
+
+        // Everything that happened since the last poll, releases first like a boot report diff
+        for (int usage = HID_KEY_A; usage <= HID_KEY_LEFT_CONTROL + 7; usage++) {
+            if (release_at_us[usage] < 0 || release_at_us[usage] > now_us) continue;
+            release_at_us[usage] = -1;
+            held--;
+            test_key(sim, usage, false, now_us);
+        }
+        while (cycle < TEST_CYCLES && next_press_us <= now_us && held < profile->max_held) {
+            const bool modifier = rand() % 8 == 0;
+            uint8_t usage;
+            do {
+                usage = modifier ? HID_KEY_LEFT_CONTROL + rand() % 8
+                                 : HID_KEY_A + rand() % (HID_KEY_SLASH - HID_KEY_A + 1);
+            } while (release_at_us[usage] >= 0);
+            const uint32_t hold_max_us = modifier ? profile->modifier_hold_max_us : profile->hold_max_us;
+            release_at_us[usage] = now_us + test_between(profile->hold_min_us, hold_max_us);
+            held++;
+            test_key(sim, usage, true, now_us);
+            next_press_us += test_between(profile->gap_min_us, profile->gap_max_us);
+        }
+        if (next_press_us <= now_us && held >= profile->max_held) next_press_us = now_us + profile->gap_min_us;
+    }
+
+    // Drain
+    for (int i = 0; i < BT_APP_REPLAY_DEPTH * 4 && (test_replay.replaying || bt_app_sched_pending(&test_sched) ||
+                                                     sim->sent_count); i++) {
+        test_connection_event(sim, next_event_us);
+        next_event_us += link->interval_us;
+    }
+    bt_app_keyboard_t released;
+    bt_app_keyboard_init(&released);
+    if (sim->matched != sim->expected_count || memcmp(sim->host.bits, released.bits, sizeof(released.bits)) != 0 ||
+        test_replay.stats.max_count > BT_APP_REPLAY_DEPTH) {
+        sim->violations++;
+    }
+
+    totals->cycles += cycle;
+    totals->window_events += sim->window_events;
+    totals->recorded += test_replay.stats.recorded;
+    totals->replayed += test_replay.stats.replayed;
+    totals->expired += test_replay.stats.expired;
+    totals->overflows += test_replay.stats.overflows;
+    totals->corrected += test_replay.stats.corrected;
+    totals->sched_overflows += test_sched.stats.overflows;
+    totals->violations += sim->violations;
+    if (test_replay.stats.max_count > totals->max_count) totals->max_count = test_replay.stats.max_count;
+    if (sim->max_drain_us > totals->max_drain_us) totals->max_drain_us = sim->max_drain_us;
+}
+
+int main(void) {
+    static const test_link_t links[] = {
+        { "7.5ms", 7500 },
+        { "30ms", 30000 },
+    };
+    static const test_profile_t profiles[] = {
+        { "typing", 40000, 200000, 40000, 150000, 3000000, 4 },
+        { "fast", 20000, 60000, 30000, 100000, 3000000, 6 },
+    };
+
+    printf("link,profile,drops,offline_events,buffered,replayed,expired,overflows,corrected,max_buffered,"
+           "ring_bytes,max_drain_ms,result\n");
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+            test_totals_t totals = { 0 };
+            for (unsigned int seed = 1; seed <= TEST_SEEDS; seed++) {
+                test_run(&links[l], &profiles[p], seed, &totals);
+            }
+            const bool passed = totals.violations == 0 && totals.sched_overflows == 0;
+            printf("%s,%s,%lu,%lu,%lu,%lu,%lu,%lu,%lu,%u,%zu,%.1f,%s\n", links[l].name, profiles[p].name,
+                   totals.cycles, totals.window_events, totals.recorded, totals.replayed, totals.expired,
+                   totals.overflows, totals.corrected, totals.max_count, sizeof(bt_app_replay_t),
+                   totals.max_drain_us / 1000.0, test_result_str(passed));
+            test_result(passed);
+        }
+    }
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,73 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include "report-sink.h"
+
+#include <string.h>
+
+report_sink_t report_sink;
+
+static void report_sink_key_event(const key_event_t *key_event, void *arg) {
+    report_sink_t *sink = arg;
+    sink->key_events++;
+
+    if (key_event->key_code >= HID_KEY_LEFT_CONTROL && key_event->key_code <= HID_KEY_LEFT_CONTROL + 7) {
+        const uint8_t bit = 1 << (key_event->key_code - HID_KEY_LEFT_CONTROL);
+        if (key_event->state == KEY_STATE_PRESSED) {
+            sink->ble_report[0] |= bit;
+        } else {
+            sink->ble_report[0] &= ~bit;
+        }
+    } else if (key_event->state == KEY_STATE_PRESSED) {
+        for (int i = 2; i < REPORT_SINK_BLE_REPORT_LEN; i++) {
+            if (!sink->ble_report[i]) {
+                sink->ble_report[i] = key_event->key_code;
+                break;
+            }
+        }
+    } else {
+        for (int i = 2; i < REPORT_SINK_BLE_REPORT_LEN; i++) {
+            if (sink->ble_report[i] == key_event->key_code) {
+                sink->ble_report[i] = 0;
+            }
+        }
+    }
+
+    sink->notifies++;
+    if (sink->notify) {
+        sink->notify(sink->ble_report, REPORT_SINK_BLE_REPORT_LEN, sink->notify_arg);
+    }
+}
+
+static void report_sink_keyboard_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    hid_keyboard_input_report_boot_t converted;
+    const hid_keyboard_input_report_boot_t *report = usb_app_keyboard_to_boot(&route->keyboard_layout, data, length,
+                                                                              &converted);
+    if (!report) return;
+    usb_app_keyboard_merge_report(&report_sink.keyboards, &route->keyboard, report, report_sink_key_event, &report_sink);
+}
+
+static void report_sink_mouse_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    report_sink.mouse_reports++;
+}
+
+static void report_sink_consumer_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    report_sink.consumer_reports++;
+}
+
+const usb_app_report_handler_t report_sink_handlers[USB_APP_REPORT_KIND_MAX] = {
+    [USB_APP_REPORT_KIND_KEYBOARD] = report_sink_keyboard_handler,
+    [USB_APP_REPORT_KIND_MOUSE] = report_sink_mouse_handler,
+    [USB_APP_REPORT_KIND_CONSUMER] = report_sink_consumer_handler
+};
+
+void report_sink_reset(report_sink_notify_cb_t notify, void *notify_arg) {
+    memset(&report_sink, 0, sizeof(report_sink));
+    report_sink.notify = notify;
+    report_sink.notify_arg = notify_arg;
+}
+
+void report_sink_detach(usb_app_iface_route_t *route) {
+    usb_app_keyboard_merge_detach(&report_sink.keyboards, &route->keyboard, report_sink_key_event, &report_sink);
+}
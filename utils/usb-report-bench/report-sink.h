@@ -0,0 +1,39 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef REPORT_SINK_H
+#define REPORT_SINK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "usb_app_keyboard.h"
+#include "usb_app_router.h"
+
+#define REPORT_SINK_BLE_REPORT_LEN  8
+
+/* Called with the 8 byte BLE keyboard report every time a key event changes it */
+typedef void (*report_sink_notify_cb_t)(const uint8_t *report, size_t length, void *arg);
+
+/* Stands in for the BLE side: key events are folded into a boot keyboard report */
+typedef struct {
+    usb_app_keyboard_merge_t keyboards;     // Keys held across all attached keyboards
+    uint8_t ble_report[REPORT_SINK_BLE_REPORT_LEN];
+    uint64_t key_events;
+    uint64_t notifies;
+    uint64_t consumer_reports;
+    uint64_t mouse_reports;
+    report_sink_notify_cb_t notify;
+    void *notify_arg;
+} report_sink_t;
+
+extern report_sink_t report_sink;
+extern const usb_app_report_handler_t report_sink_handlers[USB_APP_REPORT_KIND_MAX];
+
+void report_sink_reset(report_sink_notify_cb_t notify, void *notify_arg);
+
+/* Releases the keys an interface still holds, call before the route goes away */
+void report_sink_detach(usb_app_iface_route_t *route);
+
+#endif //REPORT_SINK_H
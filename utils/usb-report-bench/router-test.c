@@ -0,0 +1,344 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Attaches the interfaces of composite devices to the real router natively on Linux and checks which handler
+ * every report reaches. Each interface gets the descriptor a real device of its kind sends, one report per Report
+ * ID is dispatched and must arrive at the handler of its application collection with the Report ID stripped, or at
+ * none for reports that are not routed.
+ *
+ * Keyboard reports go through the layout the router read from the descriptor, the boot report they turn into is
+ * compared with the keys that were sent. Covered are boot interfaces, a boot compatible report protocol keyboard,
+ * an NKRO bitmap keyboard, keys before modifiers, extended usages, a Collection item with 4 data bytes, a second
+ * keyboard report, a keyboard without keys and Report IDs past the table.
+ *
+ * Mouse reports go through the mouse layout the same way, covered are boot mice, 16 and 12 bit axes, axes listed in
+ * another order than X, Y, wheel and a second mouse collection with absolute axes. The exit status is non-zero on any
+ * failure.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test-result.h"
+#include "usb_app_keyboard.h"
+#include "usb_app_router.h"
+
+#define TEST_MAX_REPORT             32
+
+typedef struct {
+    usb_app_report_kind_e kind;         // Handler the last report reached, UNKNOWN for none
+    size_t length;
+    uint8_t data[TEST_MAX_REPORT];
+    bool converted;                     // The keyboard layout gave a boot report
+    hid_keyboard_input_report_boot_t boot;
+    bool parsed;                        // The mouse layout read the report
+    usb_app_mouse_report_t mouse;
+} test_hit_t;
+
+static test_hit_t test_hit;
+
+static void test_record(usb_app_report_kind_e kind, const uint8_t *data, size_t length) {
+    test_hit.kind = kind;
+    test_hit.length = length;
+    memcpy(test_hit.data, data, length < TEST_MAX_REPORT ? length : TEST_MAX_REPORT);
+}
+
+static void test_keyboard_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    test_record(USB_APP_REPORT_KIND_KEYBOARD, data, length);
+    hid_keyboard_input_report_boot_t converted;
+    const hid_keyboard_input_report_boot_t *boot = usb_app_keyboard_to_boot(&route->keyboard_layout, data, length,
+                                                                            &converted);
+    test_hit.converted = boot != NULL;
+    if (boot) test_hit.boot = *boot;
+}
+
+static void test_mouse_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    test_record(USB_APP_REPORT_KIND_MOUSE, data, length);
+    test_hit.parsed = usb_app_mouse_parse(&route->mouse_layout, data, length, &test_hit.mouse);
+}
+
+static void test_consumer_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    test_record(USB_APP_REPORT_KIND_CONSUMER, data, length);
+}
+
+static void test_vendor_handler(usb_app_iface_route_t *route, const uint8_t *data, size_t length) {
+    test_record(USB_APP_REPORT_KIND_VENDOR, data, length);
+}
+
+static const usb_app_report_handler_t test_handlers[USB_APP_REPORT_KIND_MAX] = {
+    [USB_APP_REPORT_KIND_KEYBOARD] = test_keyboard_handler,
+    [USB_APP_REPORT_KIND_MOUSE] = test_mouse_handler,
+    [USB_APP_REPORT_KIND_CONSUMER] = test_consumer_handler,
+    [USB_APP_REPORT_KIND_VENDOR] = test_vendor_handler
+};
+
+/* Boot keyboard fields: modifier bitmap, reserved byte, six key array */
+#define TEST_BOOT_KEYBOARD_FIELDS \
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, \
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01, \
+    0x95, 0x06, 0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00
+
+/* LED output report, must not move the input fields */
+#define TEST_LED_OUTPUT \
+    0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x95, 0x05, 0x75, 0x01, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01
+
+/* Keyboard (ID 1), consumer control (ID 2) and mouse (ID 3), the descriptor of usb-report-bench */
+static const uint8_t test_composite_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, TEST_BOOT_KEYBOARD_FIELDS, TEST_LED_OUTPUT, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A,
+    0xFF, 0x03, 0x75, 0x10, 0x95, 0x01, 0x81, 0x00, 0xC0,
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x03, 0x09, 0x01, 0xA1, 0x00, 0x05, 0x09, 0x19, 0x01,
+    0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+    0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02,
+    0x81, 0x06, 0xC0, 0xC0
+};
+
+/* NKRO keyboard (ID 4): modifier bitmap, then one bit for each usage 0x00-0x67 */
+static const uint8_t test_nkro_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x04,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    TEST_LED_OUTPUT,
+    0x05, 0x07, 0x19, 0x00, 0x29, 0x67, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x68, 0x81, 0x02,
+    0xC0,
+    // Vendor collection (ID 5) for the configuration tool of the keyboard
+    0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x05, 0x15, 0x00, 0x26, 0xFF, 0x00, 0x75, 0x08,
+    0x95, 0x07, 0x81, 0x02, 0xC0
+};
+
+/* No Report IDs: four keys first, then the modifier bitmap, then a constant padding byte */
+static const uint8_t test_keys_first_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01,
+    0x95, 0x04, 0x75, 0x08, 0x15, 0x00, 0x25, 0xFF, 0x05, 0x07, 0x19, 0x00, 0x29, 0xFF, 0x81, 0x00,
+    0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x08, 0x81, 0x01,
+    0xC0
+};
+
+/*
+ * Extended usages: the keyboard collection sits on the consumer page with a 4 byte Usage naming Generic Desktop
+ * Keyboard (ID 6), the mouse collection (ID 7) is opened with a Collection item of 4 data bytes.
+ */
+static const uint8_t test_extended_desc[] = {
+    0x05, 0x0C, 0x0B, 0x06, 0x00, 0x01, 0x00, 0xA1, 0x01, 0x85, 0x06, TEST_BOOT_KEYBOARD_FIELDS, 0xC0,
+    0x05, 0x01, 0x09, 0x02, 0xA3, 0x01, 0x00, 0x00, 0x00, 0x85, 0x07, 0x05, 0x09, 0x19, 0x01, 0x29, 0x03,
+    0x15, 0x00, 0x25, 0x01, 0x95, 0x08, 0x75, 0x01, 0x81, 0x02, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31,
+    0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06, 0xC0
+};
+
+/*
+ * A second keyboard report (ID 2) the handler has no layout for, a keyboard collection without keys (ID 3) and
+ * a consumer report (ID 20) past the routing table.
+ */
+static const uint8_t test_unsupported_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, TEST_BOOT_KEYBOARD_FIELDS, 0xC0,
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x02, TEST_BOOT_KEYBOARD_FIELDS, 0xC0,
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x03, 0x06, 0x00, 0xFF, 0x09, 0x01, 0x15, 0x00, 0x26,
+    0xFF, 0x00, 0x75, 0x08, 0x95, 0x08, 0x81, 0x02, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x14, 0x75, 0x10, 0x95, 0x01, 0x81, 0x00, 0xC0
+};
+
+/* Mouse (ID 2) with 16 buttons, 16 bit X and Y, a wheel and AC Pan on the consumer page */
+static const uint8_t test_mouse16_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x10, 0x15, 0x00, 0x25, 0x01, 0x95, 0x10, 0x75, 0x01, 0x81, 0x02,
+    0x05, 0x01, 0x16, 0x01, 0x80, 0x26, 0xFF, 0x7F, 0x75, 0x10, 0x95, 0x02, 0x09, 0x30, 0x09, 0x31, 0x81, 0x06,
+    0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x01, 0x09, 0x38, 0x81, 0x06,
+    0x05, 0x0C, 0x0A, 0x38, 0x02, 0x95, 0x01, 0x81, 0x06,
+    0xC0, 0xC0
+};
+
+/* No Report IDs: five buttons and padding, then 12 bit X and Y sharing a byte, then the wheel */
+static const uint8_t test_mouse12_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x09, 0x01, 0xA1, 0x00,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x05, 0x15, 0x00, 0x25, 0x01, 0x95, 0x05, 0x75, 0x01, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x03, 0x81, 0x01,
+    0x05, 0x01, 0x16, 0x01, 0xF8, 0x26, 0xFF, 0x07, 0x75, 0x0C, 0x95, 0x02, 0x09, 0x30, 0x09, 0x31, 0x81, 0x06,
+    0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x01, 0x09, 0x38, 0x81, 0x06,
+    0xC0, 0xC0
+};
+
+/* Wheel, Y and X in one item before the buttons (ID 1), then an absolute pointer (ID 2) that gives no motion */
+static const uint8_t test_mouse_order_desc[] = {
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x01,
+    0x05, 0x01, 0x09, 0x38, 0x09, 0x31, 0x09, 0x30, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x03, 0x81, 0x06,
+    0x05, 0x09, 0x19, 0x01, 0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02,
+    0x95, 0x01, 0x75, 0x05, 0x81, 0x01,
+    0xC0,
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x30, 0x09, 0x31, 0x15, 0x00, 0x26, 0xFF, 0x7F,
+    0x75, 0x10, 0x95, 0x02, 0x81, 0x02, 0xC0
+};
+
+typedef struct {
+    const char *name;
+    hid_host_dev_params_t dev_params;
+    const uint8_t *desc;
+    size_t desc_len;
+} test_iface_t;
+
+typedef struct {
+    uint8_t iface;                      // Index into the interfaces of the device
+    uint8_t report[TEST_MAX_REPORT];    // As it comes from the IN endpoint
+    size_t length;
+    usb_app_report_kind_e kind;         // Handler it has to reach
+    int modifier;                       // Boot report a keyboard report has to give, -1 for a report that is too short
+    uint8_t keys[HID_KEYBOARD_KEY_MAX];
+    struct {
+        int buttons;                    // Mouse report has to give, -1 for a report that is too short
+        int16_t x;
+        int16_t y;
+        int16_t wheel;
+    } mouse;
+} test_report_t;
+
+static const test_iface_t test_ifaces[] = {
+    { "boot keyboard", { 1, 0, HID_SUBCLASS_BOOT_INTERFACE, HID_PROTOCOL_KEYBOARD }, NULL, 0 },
+    { "boot mouse", { 1, 1, HID_SUBCLASS_BOOT_INTERFACE, HID_PROTOCOL_MOUSE }, NULL, 0 },
+    { "composite", { 1, 2, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_composite_desc, sizeof(test_composite_desc) },
+    { "nkro", { 2, 0, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE }, test_nkro_desc, sizeof(test_nkro_desc) },
+    { "keys first", { 2, 1, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_keys_first_desc, sizeof(test_keys_first_desc) },
+    { "extended", { 3, 0, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_extended_desc, sizeof(test_extended_desc) },
+    { "unsupported", { 3, 1, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_unsupported_desc, sizeof(test_unsupported_desc) },
+    { "16 bit mouse", { 4, 0, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_mouse16_desc, sizeof(test_mouse16_desc) },
+    { "12 bit mouse", { 4, 1, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_mouse12_desc, sizeof(test_mouse12_desc) },
+    { "mouse order", { 4, 2, HID_SUBCLASS_NO_SUBCLASS, HID_PROTOCOL_NONE },
+      test_mouse_order_desc, sizeof(test_mouse_order_desc) },
+};
+
+#define TEST_IFACES                 (sizeof(test_ifaces) / sizeof(test_ifaces[0]))
+
+static const test_report_t test_reports[] = {
+    { 0, { HID_LEFT_SHIFT, 0, HID_KEY_A, HID_KEY_B }, 8, USB_APP_REPORT_KIND_KEYBOARD,
+      HID_LEFT_SHIFT, { HID_KEY_A, HID_KEY_B } },
+    { 0, { 0, 0, HID_KEY_A }, 7, USB_APP_REPORT_KIND_KEYBOARD, -1 },
+    { 1, { 0x01, 0x05, 0xFB }, 3, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x01, 5, -5, 0 } },
+    { 1, { 0x01, 0x05, 0xFB, 0xFF }, 4, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x01, 5, -5, -1 } },
+    { 2, { 1, HID_LEFT_SHIFT, 0, HID_KEY_H, HID_KEY_I }, 9, USB_APP_REPORT_KIND_KEYBOARD,
+      HID_LEFT_SHIFT, { HID_KEY_H, HID_KEY_I } },
+    { 2, { 2, 0xE9, 0x00 }, 3, USB_APP_REPORT_KIND_CONSUMER },
+    { 2, { 3, 0xF9, 0x05, 0xFB }, 4, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x01, 5, -5, 0 } },
+    { 2, { 9, 0x01 }, 2, USB_APP_REPORT_KIND_UNKNOWN },
+    // NKRO: A (bit 4), Z (bit 29), Enter (bit 40), the modifiers in the first byte
+    { 3, { 4, HID_LEFT_SHIFT, 0x10, 0x00, 0x00, 0x20, 0x00, 0x01 }, 15, USB_APP_REPORT_KIND_KEYBOARD,
+      HID_LEFT_SHIFT, { HID_KEY_A, HID_KEY_Z, HID_KEY_ENTER } },
+    // Seven keys down (A-D, keypad 6-8), the boot report keeps the first six
+    { 3, { 4, 0x00, 0xF0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xC0, 0x01 }, 15,
+      USB_APP_REPORT_KIND_KEYBOARD, 0x00,
+      { HID_KEY_A, HID_KEY_B, HID_KEY_C, HID_KEY_D, HID_KEY_KEYPAD_6, HID_KEY_KEYPAD_7 } },
+    { 3, { 4, 0x00, 0x10 }, 3, USB_APP_REPORT_KIND_KEYBOARD, -1 },
+    { 3, { 5, 1, 2, 3, 4, 5, 6, 7 }, 8, USB_APP_REPORT_KIND_VENDOR },
+    { 4, { HID_KEY_Q, HID_KEY_ROLLOVER, 0, HID_KEY_W, HID_LEFT_ALT, 0 }, 6, USB_APP_REPORT_KIND_KEYBOARD,
+      HID_LEFT_ALT, { HID_KEY_Q, HID_KEY_W } },
+    { 5, { 6, 0, 0, HID_KEY_X }, 9, USB_APP_REPORT_KIND_KEYBOARD, 0x00, { HID_KEY_X } },
+    { 5, { 7, 0x02, 0x10, 0x20 }, 4, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x02, 16, 32, 0 } },
+    { 6, { 1, 0, 0, HID_KEY_Y }, 9, USB_APP_REPORT_KIND_KEYBOARD, 0x00, { HID_KEY_Y } },
+    { 6, { 2, 0, 0, HID_KEY_Y }, 9, USB_APP_REPORT_KIND_UNKNOWN },
+    { 6, { 3, 1, 2, 3, 4, 5, 6, 7, 8 }, 9, USB_APP_REPORT_KIND_UNKNOWN },
+    { 6, { 20, 0xE9, 0x00 }, 3, USB_APP_REPORT_KIND_UNKNOWN },
+    // Buttons 1, 2 and 10, X 300, Y -1000, wheel -1, pan 1: the buttons past the eighth are left out
+    { 7, { 2, 0x03, 0x02, 0x2C, 0x01, 0x18, 0xFC, 0xFF, 0x01 }, 9, USB_APP_REPORT_KIND_MOUSE,
+      .mouse = { 0x03, 300, -1000, -1 } },
+    { 7, { 2, 0x03, 0x02, 0x2C, 0x01 }, 5, USB_APP_REPORT_KIND_MOUSE, .mouse = { -1 } },
+    // Buttons 1 and 3, X -2 and Y 1500 in 12 bits each
+    { 8, { 0x05, 0xFE, 0xCF, 0x5D, 0x01 }, 5, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x05, -2, 1500, 1 } },
+    { 9, { 1, 0xFF, 0x10, 0x20, 0x04 }, 5, USB_APP_REPORT_KIND_MOUSE, .mouse = { 0x04, 32, 16, -1 } },
+    { 9, { 2, 0x00, 0x40, 0x00, 0x40 }, 5, USB_APP_REPORT_KIND_UNKNOWN },
+};
+
+#define TEST_REPORTS                (sizeof(test_reports) / sizeof(test_reports[0]))
+
+static const char *const test_kind_names[USB_APP_REPORT_KIND_MAX] = {
+    "none", "keyboard", "mouse", "consumer", "vendor"
+};
+
+static bool test_boot_matches(const test_report_t *report) {
+    if (!test_hit.converted || test_hit.boot.modifier.val != report->modifier) return false;
+    return memcmp(test_hit.boot.key, report->keys, sizeof(report->keys)) == 0;
+}
+
+static bool test_dispatch(usb_app_iface_route_t *routes, const test_report_t *report) {
+    usb_app_iface_route_t *route = &routes[report->iface];
+    memset(&test_hit, 0, sizeof(test_hit));
+    usb_app_router_dispatch(route, report->report, report->length);
+
+    if (test_hit.kind != report->kind) {
+        printf("FAIL  %s report %d: reached %s, expected %s\n", test_ifaces[report->iface].name,
+               report->report[0], test_kind_names[test_hit.kind], test_kind_names[report->kind]);
+        return false;
+    }
+    if (report->kind == USB_APP_REPORT_KIND_UNKNOWN) return true;
+
+    // Handlers get the report without its Report ID
+    const size_t offset = route->report_id_offset;
+    if (test_hit.length != report->length - offset || memcmp(test_hit.data, report->report + offset, test_hit.length)) {
+        printf("FAIL  %s report %d: payload of %zu bytes, expected %zu\n", test_ifaces[report->iface].name,
+               report->report[0], test_hit.length, report->length - offset);
+        return false;
+    }
+    if (report->kind == USB_APP_REPORT_KIND_MOUSE) {
+        const bool parsed = report->mouse.buttons >= 0
+            ? test_hit.parsed && test_hit.mouse.buttons == report->mouse.buttons &&
+              test_hit.mouse.x == report->mouse.x && test_hit.mouse.y == report->mouse.y &&
+              test_hit.mouse.wheel == report->mouse.wheel
+            : !test_hit.parsed;
+        if (!parsed) {
+            printf("FAIL  %s report %d: mouse %s buttons %02x x %d y %d wheel %d\n", test_ifaces[report->iface].name,
+                   report->report[0], test_hit.parsed ? "read" : "dropped", test_hit.mouse.buttons, test_hit.mouse.x,
+                   test_hit.mouse.y, test_hit.mouse.wheel);
+        }
+        return parsed;
+    }
+    if (report->kind != USB_APP_REPORT_KIND_KEYBOARD) return true;
+
+    const bool converted = report->modifier >= 0 ? test_boot_matches(report) : !test_hit.converted;
+    if (!converted) {
+        printf("FAIL  %s report %d: boot report %02x | %02x %02x %02x %02x %02x %02x\n",
+               test_ifaces[report->iface].name, report->report[0], test_hit.boot.modifier.val,
+               test_hit.boot.key[0], test_hit.boot.key[1], test_hit.boot.key[2], test_hit.boot.key[3],
+               test_hit.boot.key[4], test_hit.boot.key[5]);
+        return false;
+    }
+    return true;
+}
+
+static void test_check(bool passed, const char *what) {
+    printf("%s  %s\n", test_result_str(passed), what);
+    test_result(passed);
+}
+
+int main(void) {
+    static usb_app_iface_route_t routes[TEST_IFACES];
+    for (size_t i = 0; i < TEST_IFACES; i++) {
+        usb_app_router_build(&routes[i], &test_ifaces[i].dev_params, test_ifaces[i].desc, test_ifaces[i].desc_len,
+                             test_handlers);
+    }
+
+    // Reports that keep the boot fields in place are used as they come, the others are converted
+    test_check(routes[0].keyboard_layout.boot && routes[2].keyboard_layout.boot && routes[5].keyboard_layout.boot &&
+               !routes[3].keyboard_layout.boot && !routes[4].keyboard_layout.boot,
+               "boot layout found on the boot keyboard, the composite keyboard and the extended usage keyboard");
+    test_check(routes[3].keyboard_layout.length == 14 && routes[4].keyboard_layout.length == 6,
+               "report lengths of the NKRO and the keys first layouts");
+    test_check(routes[1].mouse_layout.length == 3 && routes[7].mouse_layout.length == 8 &&
+               routes[8].mouse_layout.length == 5, "report lengths of the boot, 16 bit and 12 bit mouse layouts");
+
+    int misrouted = 0;
+    for (size_t i = 0; i < TEST_REPORTS; i++) {
+        if (!test_dispatch(routes, &test_reports[i])) misrouted++;
+    }
+    char summary[64];
+    snprintf(summary, sizeof(summary), "%zu reports on %zu interfaces, %d misrouted", TEST_REPORTS, TEST_IFACES,
+             misrouted);
+    test_check(misrouted == 0, summary);
+
+    return test_result_summary(stdout);
+}
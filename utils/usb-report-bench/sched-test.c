@@ -0,0 +1,230 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Property test of the outgoing report scheduler, run natively on Linux.
+ *
+ * A random typist produces key transitions that the USB side picks up once per 1 ms poll: normal typing
+ * with rollover, chords, and taps far shorter than a connection interval. They go through the scheduler to a
+ * simulated link that puts the reports handed to the stack on air at the next connection event, and refuses
+ * some of them on the lossy links. The host diffs every report against the previous one.
+ *
+ * The property: cutting the USB transition sequence into consecutive groups, one per host report, gives
+ * exactly the change set of each report. So no transition is lost, none is invented and none moves past
+ * another one. It is checked over many seeds per link and typing profile.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bt_app_sched.h"
+#include "test-result.h"
+#include "usb_app/hid_usage_keyboard.h"
+
+#define TEST_USB_POLL_US            1000
+#define TEST_SEEDS                  50
+#define TEST_EVENTS_PER_RUN         4000
+#define TEST_TRANSITIONS_MAX        (TEST_EVENTS_PER_RUN + 64)
+#define TEST_SENT_MAX               64
+
+typedef struct {
+    const char *name;
+    uint32_t interval_us;
+    uint8_t window;
+    double refuse_ratio;
+} test_link_t;
+
+typedef struct {
+    const char *name;
+    uint32_t gap_min_us;                // Between two transitions
+    uint32_t gap_max_us;
+    uint32_t hold_min_us;               // Key down time
+    uint32_t hold_max_us;
+    uint8_t max_held;
+} test_profile_t;
+
+typedef struct {
+    uint8_t usage;
+    bool pressed;
+    int64_t at_us;                      // USB poll that picked it up
+} test_transition_t;
+
+typedef struct {
+    const test_link_t *link;
+    bt_app_keyboard_t sent[TEST_SENT_MAX];      // Handed to the stack, on air at the next connection event
+    size_t sent_count;
+    bt_app_keyboard_t host;                     // What the host has down
+    test_transition_t usb[TEST_TRANSITIONS_MAX];
+    size_t usb_count;
+    size_t matched;                             // USB transitions accounted for by host reports
+    unsigned long violations;
+    unsigned long refused;
+    int64_t max_latency_us;
+} test_sim_t;
+
+static test_sim_t test_sim;
+
+static int test_send(const bt_app_keyboard_t *state, void *arg) {
+    test_sim_t *sim = arg;
+    if (sim->sent_count == TEST_SENT_MAX || (double) rand() / RAND_MAX < sim->link->refuse_ratio) {
+        sim->refused++;
+        return -1;
+    }
+    sim->sent[sim->sent_count++] = *state;
+    return 0;
+}
+
+/* The next USB transitions have to be exactly the usages this report changes */
+static void test_host_receive(test_sim_t *sim, const bt_app_keyboard_t *report, int64_t now_us) {
+    size_t changed = 0;
+    for (int usage = 0; usage <= BT_APP_KEYBOARD_USAGE_MAX; usage++) {
+        if (bt_app_keyboard_is_pressed(report, usage) != bt_app_keyboard_is_pressed(&sim->host, usage)) changed++;
+    }
+    if (changed == 0 || sim->matched + changed > sim->usb_count) {
+        sim->violations++;
+        sim->host = *report;
+        return;
+    }
+
+    for (size_t i = sim->matched; i < sim->matched + changed; i++) {
+        const test_transition_t *transition = &sim->usb[i];
+        const bool was = bt_app_keyboard_is_pressed(&sim->host, transition->usage);
+        const bool now = bt_app_keyboard_is_pressed(report, transition->usage);
+        if (was == now || now != transition->pressed) sim->violations++;
+        if (now_us - transition->at_us > sim->max_latency_us) sim->max_latency_us = now_us - transition->at_us;
+    }
+    sim->matched += changed;
+    sim->host = *report;
+}
+
+static void test_connection_event(bt_app_sched_t *sched, int64_t now_us) {
+    test_sim_t *sim = &test_sim;
+    if (sim->sent_count > sim->link->window) sim->violations++;
+    for (size_t i = 0; i < sim->sent_count; i++) {
+        test_host_receive(sim, &sim->sent[i], now_us);
+    }
+    sim->sent_count = 0;
+    bt_app_sched_connection_event(sched);
+}
+
+static uint32_t test_between(uint32_t min, uint32_t max) {
+    return min + (max > min ? rand() % (max - min + 1) : 0);
+}
+
+typedef struct {
+    unsigned long events;
+    unsigned long reports;
+    unsigned long splits;
+    unsigned long overflows;
+    unsigned long violations;
+    unsigned long refused;
+    int64_t max_latency_us;
+    uint8_t max_depth;
+} test_totals_t;
+
+static void test_run(const test_link_t *link, const test_profile_t *profile, unsigned int seed, test_totals_t *totals) {
+    static bt_app_sched_t sched;
+    test_sim_t *sim = &test_sim;
+    memset(sim, 0, sizeof(*sim));
+    sim->link = link;
+    bt_app_keyboard_init(&sim->host);
+    bt_app_sched_init(&sched, link->window, test_send, sim);
+    srand(seed);
+
+    int64_t release_at_us[256];
+    for (int usage = 0; usage < 256; usage++) {
+        release_at_us[usage] = -1;
+    }
+    uint8_t held = 0;
+
+    // Start half way into a connection interval
+    int64_t now_us = 0;
+    int64_t next_event_us = link->interval_us / 2;
+    int64_t next_press_us = test_between(profile->gap_min_us, profile->gap_max_us);
+    size_t events = 0;
+
+    while (events < TEST_EVENTS_PER_RUN || held) {
+        now_us += TEST_USB_POLL_US;
+        while (next_event_us <= now_us) {
+            test_connection_event(&sched, next_event_us);
+            next_event_us += link->interval_us;
+        }
+
+        // Everything that happened since the last poll, releases first like a boot report diff
+        for (int usage = HID_KEY_A; usage <= HID_KEY_LEFT_CONTROL + 7; usage++) {
+            if (release_at_us[usage] < 0 || release_at_us[usage] > now_us) continue;
+            release_at_us[usage] = -1;
+            held--;
+            sim->usb[sim->usb_count++] = (test_transition_t) { usage, false, now_us };
+            bt_app_sched_event(&sched, usage, false);
+            events++;
+        }
+        while (events < TEST_EVENTS_PER_RUN && next_press_us <= now_us && held < profile->max_held) {
+            uint8_t usage;
+            do {
+                usage = rand() % 8 == 0 ? HID_KEY_LEFT_CONTROL + rand() % 8
+                                        : HID_KEY_A + rand() % (HID_KEY_SLASH - HID_KEY_A + 1);
+            } while (release_at_us[usage] >= 0);
+            // A tap released within the same poll still reaches the scheduler as a press and a release
+            release_at_us[usage] = now_us + test_between(profile->hold_min_us, profile->hold_max_us);
+            held++;
+            sim->usb[sim->usb_count++] = (test_transition_t) { usage, true, now_us };
+            bt_app_sched_event(&sched, usage, true);
+            events++;
+            next_press_us += test_between(profile->gap_min_us, profile->gap_max_us);
+        }
+        if (next_press_us <= now_us && held >= profile->max_held) next_press_us = now_us + profile->gap_min_us;
+    }
+
+    // Drain
+    for (int i = 0; i < BT_APP_SCHED_DEPTH * 4 && (bt_app_sched_pending(&sched) || sim->sent_count); i++) {
+        test_connection_event(&sched, next_event_us);
+        next_event_us += link->interval_us;
+    }
+    if (sim->matched != sim->usb_count) sim->violations++;
+
+    totals->events += sched.stats.events;
+    totals->reports += sched.stats.reports;
+    totals->splits += sched.stats.splits;
+    totals->overflows += sched.stats.overflows;
+    totals->violations += sim->violations;
+    totals->refused += sim->refused;
+    if (sim->max_latency_us > totals->max_latency_us) totals->max_latency_us = sim->max_latency_us;
+    if (sched.stats.max_depth > totals->max_depth) totals->max_depth = sched.stats.max_depth;
+}
+
+int main(void) {
+    static const test_link_t links[] = {
+        { "7.5ms/1", 7500, 1, 0 },
+        { "15ms/1", 15000, 1, 0 },
+        { "30ms/1", 30000, 1, 0 },
+        { "30ms/3", 30000, 3, 0 },
+        { "30ms/1 lossy", 30000, 1, 0.2 },
+    };
+    static const test_profile_t profiles[] = {
+        { "typing", 40000, 200000, 40000, 150000, 4 },
+        { "fast rollover", 20000, 80000, 30000, 120000, 8 },
+        { "chords", 1000, 3000, 100000, 300000, 20 },
+        { "short taps", 30000, 80000, 0, 3000, 2 },
+    };
+
+    printf("link,profile,events,reports,events_per_report,splits,max_depth,overflows,refused,max_latency_ms,result\n");
+    for (size_t l = 0; l < sizeof(links) / sizeof(links[0]); l++) {
+        for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+            test_totals_t totals = { 0 };
+            for (unsigned int seed = 1; seed <= TEST_SEEDS; seed++) {
+                test_run(&links[l], &profiles[p], seed, &totals);
+            }
+            const bool passed = totals.violations == 0 && totals.overflows == 0;
+            printf("%s,%s,%lu,%lu,%.2f,%lu,%u,%lu,%lu,%.1f,%s\n", links[l].name, profiles[p].name, totals.events,
+                   totals.reports, (double) totals.events / totals.reports, totals.splits, totals.max_depth,
+                   totals.overflows, totals.refused, totals.max_latency_us / 1000.0, test_result_str(passed));
+            test_result(passed);
+        }
+    }
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,145 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Two thread torture test of the seqlock that publishes the input reports for GATT reads, run natively on Linux.
+ *
+ * One thread publishes reports as fast as it can, every byte of report n is derived from n. The other thread reads
+ * them as fast as it can and checks that all bytes of each read belong to the same n, and that n never goes back.
+ * The boot and the NKRO report are tested, the mouse report fits one word and can not tear.
+ *
+ * The control reads the same words without the sequence check, it shows how often a read overlaps a publish. On a
+ * single CPU that only happens when the scheduler preempts one thread mid copy. The exit status is non-zero on any
+ * torn or reordered read through the seqlock.
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "bt_app_keyboard.h"
+#include "bt_app_report_state.h"
+#include "test-result.h"
+
+#define TEST_WRITES                 20000000
+
+typedef struct {
+    bt_app_report_state_t state;
+    atomic_bool done;
+    bool checked;                       // Reads go through the seqlock, otherwise the control
+    unsigned long reads;
+    unsigned long retries;
+    unsigned long torn;
+    unsigned long reordered;
+    double write_ns;
+} test_run_t;
+
+static uint8_t test_byte(uint32_t n, int i) {
+    return (uint8_t) ((n >> ((i & 3) * 8)) ^ (i * 0x3B));
+}
+
+static void test_make_report(uint32_t n, uint8_t length, uint8_t *report) {
+    for (int i = 0; i < length; i++) {
+        report[i] = test_byte(n, i);
+    }
+}
+
+/* Returns false if the bytes come from more than one report */
+static bool test_check_report(const uint8_t *report, uint8_t length, uint32_t *n) {
+    *n = 0;
+    for (int i = 0; i < 4; i++) {
+        *n |= (uint32_t) (report[i] ^ (uint8_t) (i * 0x3B)) << (i * 8);
+    }
+    for (int i = 4; i < length; i++) {
+        if (report[i] != test_byte(*n, i)) return false;
+    }
+    return true;
+}
+
+static double test_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void *test_writer(void *arg) {
+    test_run_t *run = arg;
+    uint8_t report[BT_APP_REPORT_STATE_MAX_LEN];
+    const double start_ns = test_now_ns();
+    for (uint32_t n = 1; n <= TEST_WRITES; n++) {
+        test_make_report(n, run->state.length, report);
+        bt_app_report_state_publish(&run->state, report);
+    }
+    run->write_ns = (test_now_ns() - start_ns) / TEST_WRITES;
+    atomic_store(&run->done, true);
+    return NULL;
+}
+
+/* The words as they are, without the sequence check */
+static void test_read_unchecked(bt_app_report_state_t *state, uint8_t *report) {
+    uint32_t words[BT_APP_REPORT_STATE_WORDS];
+    for (int i = 0; i < BT_APP_REPORT_STATE_WORDS; i++) {
+        words[i] = atomic_load_explicit(&state->words[i], memory_order_relaxed);
+    }
+    memcpy(report, words, state->length);
+}
+
+static void *test_reader(void *arg) {
+    test_run_t *run = arg;
+    uint8_t report[BT_APP_REPORT_STATE_MAX_LEN];
+    uint32_t last_n = 0;
+    while (!atomic_load(&run->done)) {
+        if (run->checked) run->retries += bt_app_report_state_read(&run->state, report);
+        else test_read_unchecked(&run->state, report);
+        run->reads++;
+
+        uint32_t n;
+        if (!test_check_report(report, run->state.length, &n)) {
+            run->torn++;
+            continue;
+        }
+        if (n < last_n) run->reordered++;
+        last_n = n;
+    }
+    return NULL;
+}
+
+static bool test_run(const char *name, uint8_t length, bool checked) {
+    static test_run_t run;
+    memset(&run, 0, sizeof(run));
+    bt_app_report_state_init(&run.state, length);
+    // Report 0 is there before the reader starts, all zeros would not decode
+    uint8_t report[BT_APP_REPORT_STATE_MAX_LEN];
+    test_make_report(0, length, report);
+    bt_app_report_state_publish(&run.state, report);
+    atomic_init(&run.done, false);
+    run.checked = checked;
+
+    pthread_t writer;
+    pthread_t reader;
+    pthread_create(&reader, NULL, test_reader, &run);
+    pthread_create(&writer, NULL, test_writer, &run);
+    pthread_join(writer, NULL);
+    pthread_join(reader, NULL);
+
+    const bool passed = !checked || (run.torn == 0 && run.reordered == 0);
+    printf("%s,%u,%s,%d,%lu,%lu,%lu,%lu,%.1f,%s\n", name, length, checked ? "seqlock" : "control", TEST_WRITES,
+           run.reads, run.retries, run.torn, run.reordered, run.write_ns,
+           checked ? test_result_str(passed) : "-");
+    return passed;
+}
+
+int main(void) {
+    printf("report,length,mode,writes,reads,retries,torn,reordered,write_ns,result\n");
+    test_result(test_run("boot", BT_APP_KEYBOARD_BOOT_REPORT_LEN, true));
+    test_result(test_run("nkro", BT_APP_KEYBOARD_NKRO_REPORT_LEN, true));
+    test_run("boot", BT_APP_KEYBOARD_BOOT_REPORT_LEN, false);
+    test_run("nkro", BT_APP_KEYBOARD_NKRO_REPORT_LEN, false);
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,56 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_DRIVER_GPIO_H
+#define SHIM_DRIVER_GPIO_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+/* Host build shim, input levels are set by the simulator and edges call the registered handler */
+
+typedef int gpio_num_t;
+typedef void (*gpio_isr_t)(void *arg);
+
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT = 1,
+    GPIO_MODE_OUTPUT = 2
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE,
+    GPIO_PULLUP_ENABLE
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE,
+    GPIO_PULLDOWN_ENABLE
+} gpio_pulldown_t;
+
+typedef enum {
+    GPIO_INTR_DISABLE,
+    GPIO_INTR_POSEDGE,
+    GPIO_INTR_NEGEDGE,
+    GPIO_INTR_ANYEDGE
+} gpio_int_type_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+esp_err_t gpio_config(const gpio_config_t *config);
+
+int gpio_get_level(gpio_num_t gpio_num);
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+
+#endif //SHIM_DRIVER_GPIO_H
@@ -0,0 +1,21 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_ESP_HEAP_CAPS_H
+#define SHIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Host build shim, the capabilities are ignored and the memory comes from malloc */
+
+#define MALLOC_CAP_DEFAULT          (1 << 12)
+#define MALLOC_CAP_INTERNAL         (1 << 11)
+#define MALLOC_CAP_8BIT             (1 << 2)
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps);
+
+void *heap_caps_malloc(size_t size, uint32_t caps);
+
+#endif //SHIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,433 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "esp_console.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_pm.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "sim.h"
+
+/* Host build shim of the ESP-IDF services the firmware uses outside of USB and BLE */
+
+#define SIM_ESP_TIMER_TASK_STACK_SIZE   4096
+#define SIM_GPIO_MAX                    49
+#define SIM_NVS_ENTRIES_MAX             32
+#define SIM_NVS_NAME_MAX                16
+#define SIM_CONSOLE_COMMANDS_MAX        16
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    bool active;
+    uint64_t period_us;                 // 0 for one shot timers
+    int64_t expiry_us;
+    struct esp_timer *next;
+};
+
+typedef struct {
+    char ns[SIM_NVS_NAME_MAX];
+    char key[SIM_NVS_NAME_MAX];
+    uint8_t *data;
+    size_t length;
+} sim_nvs_entry_t;
+
+static pthread_mutex_t sim_timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_timer_cond;
+static pthread_once_t sim_timer_once = PTHREAD_ONCE_INIT;
+static struct esp_timer *sim_esp_timers;
+
+static pthread_mutex_t sim_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static int sim_gpio_levels[SIM_GPIO_MAX];
+static gpio_int_type_t sim_gpio_intr[SIM_GPIO_MAX];
+static gpio_isr_t sim_gpio_handlers[SIM_GPIO_MAX];
+static void *sim_gpio_args[SIM_GPIO_MAX];
+static bool sim_gpio_isr_installed;
+
+static pthread_mutex_t sim_nvs_lock = PTHREAD_MUTEX_INITIALIZER;
+static sim_nvs_entry_t sim_nvs_entries[SIM_NVS_ENTRIES_MAX];
+static char sim_nvs_namespaces[SIM_NVS_ENTRIES_MAX][SIM_NVS_NAME_MAX];
+
+static esp_console_cmd_t sim_console_commands[SIM_CONSOLE_COMMANDS_MAX];
+static int sim_console_command_count;
+
+/* ---- esp_timer ---- */
+
+static void sim_esp_timer_task(void *arg) {
+    pthread_mutex_lock(&sim_timer_lock);
+    while (true) {
+        struct esp_timer *next = NULL;
+        for (struct esp_timer *timer = sim_esp_timers; timer; timer = timer->next) {
+            if (timer->active && (!next || timer->expiry_us < next->expiry_us)) next = timer;
+        }
+        if (!next) {
+            pthread_cond_wait(&sim_timer_cond, &sim_timer_lock);
+            continue;
+        }
+        if (next->expiry_us > sim_time_us()) {
+            sim_cond_wait_until(&sim_timer_cond, &sim_timer_lock, next->expiry_us);
+            continue;
+        }
+        if (next->period_us) {
+            next->expiry_us += next->period_us;
+            // Like skip_unhandled_events, a late timer does not fire a burst to catch up
+            if (next->expiry_us < sim_time_us()) next->expiry_us = sim_time_us() + next->period_us;
+        } else {
+            next->active = false;
+        }
+        pthread_mutex_unlock(&sim_timer_lock);
+        next->callback(next->arg);
+        pthread_mutex_lock(&sim_timer_lock);
+    }
+}
+
+static void sim_esp_timer_init(void) {
+    sim_cond_init(&sim_timer_cond);
+    if (xTaskCreatePinnedToCore(sim_esp_timer_task, "esp_timer", SIM_ESP_TIMER_TASK_STACK_SIZE, NULL, 22, NULL, 0) !=
+        pdPASS) {
+        abort();
+    }
+}
+
+int64_t esp_timer_get_time(void) {
+    return sim_time_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+    if (!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+    pthread_once(&sim_timer_once, sim_esp_timer_init);
+    struct esp_timer *timer = calloc(1, sizeof(struct esp_timer));
+    if (!timer) return ESP_ERR_NO_MEM;
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+    pthread_mutex_lock(&sim_timer_lock);
+    timer->next = sim_esp_timers;
+    sim_esp_timers = timer;
+    pthread_mutex_unlock(&sim_timer_lock);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t sim_esp_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_timer_lock);
+    if (timer->active) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->active = true;
+        timer->period_us = period_us;
+        timer->expiry_us = sim_time_us() + timeout_us;
+        pthread_cond_signal(&sim_timer_cond);
+    }
+    pthread_mutex_unlock(&sim_timer_lock);
+    return err;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return sim_esp_timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return sim_esp_timer_start(timer, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_timer_lock);
+    const bool active = timer->active;
+    timer->active = false;
+    pthread_mutex_unlock(&sim_timer_lock);
+    return active ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (!timer) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_timer_lock);
+    if (timer->active) {
+        pthread_mutex_unlock(&sim_timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (struct esp_timer **it = &sim_esp_timers; *it; it = &(*it)->next) {
+        if (*it == timer) {
+            *it = timer->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_timer_lock);
+    free(timer);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+    pthread_mutex_lock(&sim_timer_lock);
+    const bool active = timer && timer->active;
+    pthread_mutex_unlock(&sim_timer_lock);
+    return active;
+}
+
+/* ---- GPIO ---- */
+
+esp_err_t gpio_config(const gpio_config_t *config) {
+    pthread_mutex_lock(&sim_gpio_lock);
+    for (int i = 0; i < SIM_GPIO_MAX; i++) {
+        if (config->pin_bit_mask & (1ULL << i)) sim_gpio_intr[i] = config->intr_type;
+    }
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num) {
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_MAX) return 0;
+    pthread_mutex_lock(&sim_gpio_lock);
+    const int level = sim_gpio_levels[gpio_num];
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return level;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags) {
+    pthread_mutex_lock(&sim_gpio_lock);
+    const bool installed = sim_gpio_isr_installed;
+    sim_gpio_isr_installed = true;
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return installed ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args) {
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_MAX) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_gpio_lock);
+    const bool installed = sim_gpio_isr_installed;
+    if (installed) {
+        sim_gpio_handlers[gpio_num] = isr_handler;
+        sim_gpio_args[gpio_num] = args;
+    }
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return installed ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+void sim_gpio_set_level(int gpio_num, int level) {
+    if (gpio_num < 0 || gpio_num >= SIM_GPIO_MAX) return;
+    pthread_mutex_lock(&sim_gpio_lock);
+    const bool edge = sim_gpio_levels[gpio_num] != !!level;
+    sim_gpio_levels[gpio_num] = !!level;
+    const gpio_int_type_t type = sim_gpio_intr[gpio_num];
+    const gpio_isr_t handler = sim_gpio_handlers[gpio_num];
+    void *arg = sim_gpio_args[gpio_num];
+    pthread_mutex_unlock(&sim_gpio_lock);
+    const bool fires = type == GPIO_INTR_ANYEDGE || (type == GPIO_INTR_POSEDGE && level) ||
+                       (type == GPIO_INTR_NEGEDGE && !level);
+    if (edge && fires && handler) handler(arg);
+}
+
+/* ---- NVS ---- */
+
+esp_err_t nvs_flash_init(void) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    pthread_mutex_lock(&sim_nvs_lock);
+    for (int i = 0; i < SIM_NVS_ENTRIES_MAX; i++) {
+        free(sim_nvs_entries[i].data);
+        memset(&sim_nvs_entries[i], 0, sizeof(sim_nvs_entries[i]));
+        sim_nvs_namespaces[i][0] = '\0';
+    }
+    pthread_mutex_unlock(&sim_nvs_lock);
+    return ESP_OK;
+}
+
+/* Handles are the namespace index plus one */
+esp_err_t nvs_open(const char *namespace_name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle) {
+    if (strlen(namespace_name) >= SIM_NVS_NAME_MAX) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_ERR_NVS_NOT_FOUND;
+    pthread_mutex_lock(&sim_nvs_lock);
+    int free_slot = -1;
+    for (int i = 0; i < SIM_NVS_ENTRIES_MAX; i++) {
+        if (!strcmp(sim_nvs_namespaces[i], namespace_name)) {
+            *out_handle = i + 1;
+            err = ESP_OK;
+            break;
+        }
+        if (free_slot < 0 && !sim_nvs_namespaces[i][0]) free_slot = i;
+    }
+    if (err != ESP_OK && open_mode == NVS_READWRITE) {
+        if (free_slot < 0) {
+            err = ESP_ERR_NO_MEM;
+        } else {
+            strcpy(sim_nvs_namespaces[free_slot], namespace_name);
+            *out_handle = free_slot + 1;
+            err = ESP_OK;
+        }
+    }
+    pthread_mutex_unlock(&sim_nvs_lock);
+    return err;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
+
+static sim_nvs_entry_t *sim_nvs_find(nvs_handle_t handle, const char *key) {
+    for (int i = 0; i < SIM_NVS_ENTRIES_MAX; i++) {
+        sim_nvs_entry_t *entry = &sim_nvs_entries[i];
+        if (entry->data && !strcmp(entry->ns, sim_nvs_namespaces[handle - 1]) && !strcmp(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length) {
+    if (handle == 0 || handle > SIM_NVS_ENTRIES_MAX) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_nvs_lock);
+    const sim_nvs_entry_t *entry = sim_nvs_find(handle, key);
+    if (!entry) {
+        err = ESP_ERR_NVS_NOT_FOUND;
+    } else if (!out_value) {
+        *length = entry->length;
+    } else if (*length < entry->length) {
+        *length = entry->length;
+        err = ESP_ERR_NVS_INVALID_LENGTH;
+    } else {
+        memcpy(out_value, entry->data, entry->length);
+        *length = entry->length;
+    }
+    pthread_mutex_unlock(&sim_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length) {
+    if (handle == 0 || handle > SIM_NVS_ENTRIES_MAX || strlen(key) >= SIM_NVS_NAME_MAX) return ESP_ERR_INVALID_ARG;
+    uint8_t *data = malloc(length ? length : 1);
+    if (!data) return ESP_ERR_NO_MEM;
+    memcpy(data, value, length);
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_nvs_lock);
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key);
+    for (int i = 0; !entry && i < SIM_NVS_ENTRIES_MAX; i++) {
+        if (!sim_nvs_entries[i].data) entry = &sim_nvs_entries[i];
+    }
+    if (entry) {
+        free(entry->data);
+        strcpy(entry->ns, sim_nvs_namespaces[handle - 1]);
+        strcpy(entry->key, key);
+        entry->data = data;
+        entry->length = length;
+    } else {
+        free(data);
+        err = ESP_ERR_NO_MEM;
+    }
+    pthread_mutex_unlock(&sim_nvs_lock);
+    return err;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key) {
+    if (handle == 0 || handle > SIM_NVS_ENTRIES_MAX) return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&sim_nvs_lock);
+    sim_nvs_entry_t *entry = sim_nvs_find(handle, key);
+    if (entry) {
+        free(entry->data);
+        memset(entry, 0, sizeof(*entry));
+    }
+    pthread_mutex_unlock(&sim_nvs_lock);
+    return entry ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+/* ---- Power management, off like a build without CONFIG_PM_ENABLE ---- */
+
+esp_err_t esp_pm_configure(const void *config) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_create(esp_pm_lock_type_t lock_type, int arg, const char *name, esp_pm_lock_handle_t *out_handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_acquire(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_lock_release(esp_pm_lock_handle_t handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_pm_dump_locks(FILE *stream) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/* ---- Console ---- */
+
+struct esp_console_repl_s {
+    int unused;
+};
+
+static esp_console_repl_t sim_console_repl;
+
+esp_err_t esp_console_new_repl_uart(const esp_console_dev_uart_config_t *dev_config,
+                                    const esp_console_repl_config_t *repl_config, esp_console_repl_t **ret_repl) {
+    *ret_repl = &sim_console_repl;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_cmd_register(const esp_console_cmd_t *cmd) {
+    if (sim_console_command_count == SIM_CONSOLE_COMMANDS_MAX) return ESP_ERR_NO_MEM;
+    sim_console_commands[sim_console_command_count++] = *cmd;
+    return ESP_OK;
+}
+
+esp_err_t esp_console_start_repl(esp_console_repl_t *repl) {
+    return ESP_OK;
+}
+
+/* ---- System ---- */
+
+const char *esp_err_to_name(esp_err_t code) {
+    switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+    case ESP_ERR_NVS_NOT_FOUND: return "ESP_ERR_NVS_NOT_FOUND";
+    case ESP_ERR_NVS_INVALID_LENGTH: return "ESP_ERR_NVS_INVALID_LENGTH";
+    case ESP_ERR_NVS_NO_FREE_PAGES: return "ESP_ERR_NVS_NO_FREE_PAGES";
+    case ESP_ERR_NVS_NEW_VERSION_FOUND: return "ESP_ERR_NVS_NEW_VERSION_FOUND";
+    default: return "UNKNOWN ERROR";
+    }
+}
+
+void esp_restart(void) {
+    fprintf(stderr, "esp_restart() called, the simulation stops\n");
+    abort();
+}
+
+void *heap_caps_calloc(size_t n, size_t size, uint32_t caps) {
+    return calloc(n, size);
+}
+
+void *heap_caps_malloc(size_t size, uint32_t caps) {
+    return malloc(size);
+}
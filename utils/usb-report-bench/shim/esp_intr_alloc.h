@@ -0,0 +1,13 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_ESP_INTR_ALLOC_H
+#define SHIM_ESP_INTR_ALLOC_H
+
+/* Host build shim, interrupt flags are accepted and ignored */
+
+#define ESP_INTR_FLAG_LEVEL1        (1 << 1)
+#define ESP_INTR_FLAG_IRAM          (1 << 10)
+
+#endif //SHIM_ESP_INTR_ALLOC_H
@@ -0,0 +1,36 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_ESP_LOG_H
+#define SHIM_ESP_LOG_H
+
+#include <stdio.h>
+
+#include "esp_err.h"
+
+/* Host build shim, warnings and errors go to stderr, everything else is dropped to keep timings clean */
+
+typedef enum {
+    ESP_LOG_NONE,
+    ESP_LOG_ERROR,
+    ESP_LOG_WARN,
+    ESP_LOG_INFO,
+    ESP_LOG_DEBUG,
+    ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define ESP_LOGE(tag, fmt, ...)     fprintf(stderr, "E %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...)     fprintf(stderr, "W %s: " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...)     do { (void)(tag); } while (0)
+#define ESP_LOGD(tag, fmt, ...)     do { (void)(tag); } while (0)
+#define ESP_LOGV(tag, fmt, ...)     do { (void)(tag); } while (0)
+#define ESP_EARLY_LOGE(tag, fmt, ...)   ESP_LOGE(tag, fmt, ##__VA_ARGS__)
+#define ESP_EARLY_LOGW(tag, fmt, ...)   ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+
+#define ESP_LOG_BUFFER_HEX(tag, buffer, length)                         \
+    do { (void)(tag); (void)(buffer); (void)(length); } while (0)
+#define ESP_LOG_BUFFER_HEXDUMP(tag, buffer, length, level)              \
+    do { (void)(tag); (void)(buffer); (void)(length); (void)(level); } while (0)
+
+#endif //SHIM_ESP_LOG_H
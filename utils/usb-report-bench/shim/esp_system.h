@@ -0,0 +1,12 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_ESP_SYSTEM_H
+#define SHIM_ESP_SYSTEM_H
+
+/* Host build shim, a restart ends the simulation with an abort so the harness sees it */
+
+void esp_restart(void) __attribute__((noreturn));
+
+#endif //SHIM_ESP_SYSTEM_H
@@ -0,0 +1,546 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
+#include "sim.h"
+
+/*
+ * Host build shim of the FreeRTOS kernel. Tasks are threads scheduled by Linux, so priorities and core affinity are
+ * recorded but not enforced. Blocking calls wait on condition variables of the monotonic clock.
+ */
+
+#define SIM_TIMER_QUEUE_LENGTH      10      // CONFIG_FREERTOS_TIMER_QUEUE_LENGTH of the firmware
+#define SIM_TIMER_TASK_STACK_SIZE   2048
+
+struct sim_task {
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t number;
+    UBaseType_t priority;
+    BaseType_t core_id;
+    uint32_t stack_depth;
+    bool listed;                        // Threads not created by xTaskCreate are not reported to the profiler
+    TaskFunction_t function;
+    void *arg;
+    pthread_t thread;
+    clockid_t cpu_clock;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_count;
+    struct sim_task *next;
+};
+
+struct sim_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;              // 0 for semaphores
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *items;
+};
+
+struct sim_timer {
+    const char *name;
+    TickType_t period;
+    bool auto_reload;
+    bool active;
+    void *timer_id;
+    TimerCallbackFunction_t callback;
+    int64_t expiry_us;
+    struct sim_timer *next;
+};
+
+typedef struct {
+    PendedFunction_t function;
+    void *arg1;
+    uint32_t arg2;
+} sim_pended_call_t;
+
+static struct timespec sim_start;
+static pthread_once_t sim_start_once = PTHREAD_ONCE_INIT;
+
+static pthread_mutex_t sim_tasks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sim_task *sim_tasks;
+static UBaseType_t sim_task_number;
+static __thread struct sim_task *sim_current_task;
+
+static pthread_mutex_t sim_timers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_timers_cond;
+static struct sim_timer *sim_timers;
+static sim_pended_call_t sim_pended[SIM_TIMER_QUEUE_LENGTH];
+static int sim_pended_head;
+static int sim_pended_count;
+static pthread_once_t sim_timers_once = PTHREAD_ONCE_INIT;
+
+static void sim_start_init(void) {
+    clock_gettime(CLOCK_MONOTONIC, &sim_start);
+}
+
+int64_t sim_time_us(void) {
+    pthread_once(&sim_start_once, sim_start_init);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) (now.tv_sec - sim_start.tv_sec) * 1000000 + (now.tv_nsec - sim_start.tv_nsec) / 1000;
+}
+
+void sim_cond_init(pthread_cond_t *cond) {
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+/* Absolute monotonic deadline of a timeout in ticks, portMAX_DELAY waits forever */
+static bool sim_deadline(TickType_t timeout, struct timespec *deadline) {
+    if (timeout == portMAX_DELAY) return false;
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    uint64_t ns = (uint64_t) deadline->tv_nsec + (uint64_t) pdTICKS_TO_MS(timeout) * 1000000;
+    deadline->tv_sec += ns / 1000000000;
+    deadline->tv_nsec = ns % 1000000000;
+    return true;
+}
+
+/* Waits on cond until the deadline, returns false on timeout */
+static bool sim_cond_wait(pthread_cond_t *cond, pthread_mutex_t *lock, bool timed, const struct timespec *deadline) {
+    if (!timed) return pthread_cond_wait(cond, lock) == 0;
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+bool sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline_us) {
+    if (deadline_us < 0) return pthread_cond_wait(cond, lock) == 0;
+    pthread_once(&sim_start_once, sim_start_init);
+    struct timespec deadline = sim_start;
+    uint64_t ns = (uint64_t) deadline.tv_nsec + (uint64_t) deadline_us * 1000;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    return pthread_cond_timedwait(cond, lock, &deadline) != ETIMEDOUT;
+}
+
+int64_t sim_ticks_to_deadline_us(uint32_t ticks) {
+    if (ticks == portMAX_DELAY) return -1;
+    return sim_time_us() + (int64_t) pdTICKS_TO_MS(ticks) * 1000;
+}
+
+/* ---- Critical sections ---- */
+
+static __thread char sim_thread_token;
+
+void vPortEnterCritical(portMUX_TYPE *mux) {
+    void *self = &sim_thread_token;
+    if (atomic_load_explicit(&mux->owner, memory_order_relaxed) == self) {
+        mux->count++;
+        return;
+    }
+    void *expected = NULL;
+    while (!atomic_compare_exchange_weak_explicit(&mux->owner, &expected, self, memory_order_acquire,
+                                                  memory_order_relaxed)) {
+        expected = NULL;
+        sched_yield();
+    }
+    mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE *mux) {
+    if (atomic_load_explicit(&mux->owner, memory_order_relaxed) != &sim_thread_token || mux->count == 0) {
+        fprintf(stderr, "portEXIT_CRITICAL without a matching enter\n");
+        abort();
+    }
+    if (--mux->count == 0) atomic_store_explicit(&mux->owner, NULL, memory_order_release);
+}
+
+/* ---- Tasks ---- */
+
+static struct sim_task *sim_task_new(const char *name, uint32_t stack_depth, UBaseType_t priority, BaseType_t core_id) {
+    struct sim_task *task = calloc(1, sizeof(struct sim_task));
+    if (!task) return NULL;
+    snprintf(task->name, sizeof(task->name), "%s", name ? name : "");
+    task->stack_depth = stack_depth;
+    task->priority = priority;
+    task->core_id = core_id;
+    pthread_mutex_init(&task->lock, NULL);
+    sim_cond_init(&task->cond);
+    pthread_mutex_lock(&sim_tasks_lock);
+    task->number = ++sim_task_number;
+    pthread_mutex_unlock(&sim_tasks_lock);
+    return task;
+}
+
+static void sim_task_list(struct sim_task *task) {
+    pthread_mutex_lock(&sim_tasks_lock);
+    task->listed = true;
+    task->next = sim_tasks;
+    sim_tasks = task;
+    pthread_mutex_unlock(&sim_tasks_lock);
+}
+
+static void sim_task_unlist(struct sim_task *task) {
+    pthread_mutex_lock(&sim_tasks_lock);
+    for (struct sim_task **it = &sim_tasks; *it; it = &(*it)->next) {
+        if (*it == task) {
+            *it = task->next;
+            break;
+        }
+    }
+    task->listed = false;
+    pthread_mutex_unlock(&sim_tasks_lock);
+}
+
+static void *sim_task_entry(void *arg) {
+    struct sim_task *task = arg;
+    sim_current_task = task;
+    pthread_getcpuclockid(pthread_self(), &task->cpu_clock);
+    sim_task_list(task);
+    task->function(task->arg);
+    fprintf(stderr, "Task %s returned from its function\n", task->name);
+    abort();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core_id) {
+    struct sim_task *task = sim_task_new(name, stack_depth, priority, core_id);
+    if (!task) return pdFAIL;
+    task->function = function;
+    task->arg = arg;
+    // The handle is valid before the task runs, as on FreeRTOS
+    if (created) *created = task;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int err = pthread_create(&task->thread, &attr, sim_task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        if (created) *created = NULL;
+        free(task);
+        return pdFAIL;
+    }
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    if (task && task != xTaskGetCurrentTaskHandle()) {
+        fprintf(stderr, "vTaskDelete of another task is not simulated\n");
+        abort();
+    }
+    struct sim_task *self = xTaskGetCurrentTaskHandle();
+    sim_task_unlist(self);
+    // Other tasks may still hold the handle, it is not freed
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct timespec delay = {
+        .tv_sec = pdTICKS_TO_MS(ticks) / 1000,
+        .tv_nsec = (long) (pdTICKS_TO_MS(ticks) % 1000) * 1000000
+    };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {}
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t) (sim_time_us() / (portTICK_PERIOD_MS * 1000));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    if (!sim_current_task) {
+        // A thread of the harness, it gets a task entry for notifications but is not listed
+        struct sim_task *task = sim_task_new("sim", 0, 0, tskNO_AFFINITY);
+        if (!task) abort();
+        task->thread = pthread_self();
+        pthread_getcpuclockid(task->thread, &task->cpu_clock);
+        sim_current_task = task;
+    }
+    return sim_current_task;
+}
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task) {
+    if (!task) task = xTaskGetCurrentTaskHandle();
+    return task->core_id;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    pthread_mutex_lock(&task->lock);
+    task->notify_count++;
+    pthread_cond_signal(&task->cond);
+    pthread_mutex_unlock(&task->lock);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout) {
+    struct sim_task *task = xTaskGetCurrentTaskHandle();
+    struct timespec deadline;
+    bool timed = sim_deadline(timeout, &deadline);
+    pthread_mutex_lock(&task->lock);
+    while (task->notify_count == 0 && timeout != 0) {
+        if (!sim_cond_wait(&task->cond, &task->lock, timed, &deadline)) break;
+    }
+    uint32_t count = task->notify_count;
+    if (count) task->notify_count = clear_on_exit ? 0 : count - 1;
+    pthread_mutex_unlock(&task->lock);
+    return count;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&sim_tasks_lock);
+    for (struct sim_task *task = sim_tasks; task; task = task->next) count++;
+    pthread_mutex_unlock(&sim_tasks_lock);
+    return count;
+}
+
+static uint64_t sim_task_cpu_us(const struct sim_task *task) {
+    struct timespec cpu;
+    if (clock_gettime(task->cpu_clock, &cpu) != 0) return 0;
+    return (uint64_t) cpu.tv_sec * 1000000 + cpu.tv_nsec / 1000;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, configRUN_TIME_COUNTER_TYPE *total_run_time) {
+    UBaseType_t count = 0;
+    pthread_mutex_lock(&sim_tasks_lock);
+    for (struct sim_task *task = sim_tasks; task; task = task->next) count++;
+    if (count > size) {
+        pthread_mutex_unlock(&sim_tasks_lock);
+        return 0;
+    }
+    count = 0;
+    for (struct sim_task *task = sim_tasks; task; task = task->next, count++) {
+        status[count] = (TaskStatus_t) {
+            .xHandle = task,
+            .pcTaskName = task->name,
+            .xTaskNumber = task->number,
+            .eCurrentState = task == sim_current_task ? eRunning : eBlocked,
+            .uxCurrentPriority = task->priority,
+            .uxBasePriority = task->priority,
+            .ulRunTimeCounter = (configRUN_TIME_COUNTER_TYPE) sim_task_cpu_us(task),
+            .usStackHighWaterMark = task->stack_depth,
+            .xCoreID = task->core_id
+        };
+    }
+    pthread_mutex_unlock(&sim_tasks_lock);
+    if (total_run_time) *total_run_time = (configRUN_TIME_COUNTER_TYPE) sim_time_us();
+    return count;
+}
+
+uint64_t sim_tasks_cpu_us(void) {
+    uint64_t total = 0;
+    pthread_mutex_lock(&sim_tasks_lock);
+    for (struct sim_task *task = sim_tasks; task; task = task->next) total += sim_task_cpu_us(task);
+    pthread_mutex_unlock(&sim_tasks_lock);
+    return total;
+}
+
+/* ---- Queues and semaphores ---- */
+
+static QueueHandle_t sim_queue_new(UBaseType_t length, UBaseType_t item_size, UBaseType_t count) {
+    struct sim_queue *queue = calloc(1, sizeof(struct sim_queue));
+    if (!queue) return NULL;
+    if (item_size) {
+        queue->items = calloc(length, item_size);
+        if (!queue->items) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    queue->count = count;
+    pthread_mutex_init(&queue->lock, NULL);
+    sim_cond_init(&queue->not_empty);
+    sim_cond_init(&queue->not_full);
+    return queue;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    if (length == 0) return NULL;
+    return sim_queue_new(length, item_size, 0);
+}
+
+QueueHandle_t xQueueCreateCountingSemaphore(UBaseType_t max_count, UBaseType_t initial_count) {
+    if (max_count == 0 || initial_count > max_count) return NULL;
+    return sim_queue_new(max_count, 0, initial_count);
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    if (!queue) return;
+    pthread_mutex_destroy(&queue->lock);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_cond_destroy(&queue->not_full);
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout) {
+    struct timespec deadline;
+    bool timed = sim_deadline(timeout, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length) {
+        if (timeout == 0 || !sim_cond_wait(&queue->not_full, &queue->lock, timed, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size) {
+        UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout) {
+    struct timespec deadline;
+    bool timed = sim_deadline(timeout, &deadline);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0) {
+        if (timeout == 0 || !sim_cond_wait(&queue->not_empty, &queue->lock, timed, &deadline)) {
+            pthread_mutex_unlock(&queue->lock);
+            return pdFALSE;
+        }
+    }
+    if (queue->item_size) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+    }
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t queue, TickType_t timeout) {
+    return xQueueReceive(queue, NULL, timeout);
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    queue->count = 0;
+    queue->head = 0;
+    pthread_cond_broadcast(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    pthread_mutex_lock(&queue->lock);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+/* ---- Software timers ---- */
+
+static void sim_timer_task(void *arg) {
+    pthread_mutex_lock(&sim_timers_lock);
+    while (true) {
+        if (sim_pended_count) {
+            sim_pended_call_t call = sim_pended[sim_pended_head];
+            sim_pended_head = (sim_pended_head + 1) % SIM_TIMER_QUEUE_LENGTH;
+            sim_pended_count--;
+            pthread_mutex_unlock(&sim_timers_lock);
+            call.function(call.arg1, call.arg2);
+            pthread_mutex_lock(&sim_timers_lock);
+            continue;
+        }
+
+        struct sim_timer *next = NULL;
+        for (struct sim_timer *timer = sim_timers; timer; timer = timer->next) {
+            if (timer->active && (!next || timer->expiry_us < next->expiry_us)) next = timer;
+        }
+        if (!next) {
+            pthread_cond_wait(&sim_timers_cond, &sim_timers_lock);
+            continue;
+        }
+        if (next->expiry_us > sim_time_us()) {
+            sim_cond_wait_until(&sim_timers_cond, &sim_timers_lock, next->expiry_us);
+            continue;
+        }
+        if (next->auto_reload) {
+            next->expiry_us += (int64_t) pdTICKS_TO_MS(next->period) * 1000;
+        } else {
+            next->active = false;
+        }
+        pthread_mutex_unlock(&sim_timers_lock);
+        next->callback(next);
+        pthread_mutex_lock(&sim_timers_lock);
+    }
+}
+
+static void sim_timers_init(void) {
+    sim_cond_init(&sim_timers_cond);
+    if (xTaskCreatePinnedToCore(sim_timer_task, "Tmr Svc", SIM_TIMER_TASK_STACK_SIZE, NULL, 1, NULL, 0) != pdPASS) {
+        abort();
+    }
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id,
+                           TimerCallbackFunction_t callback) {
+    if (period == 0) return NULL;
+    pthread_once(&sim_timers_once, sim_timers_init);
+    struct sim_timer *timer = calloc(1, sizeof(struct sim_timer));
+    if (!timer) return NULL;
+    timer->name = name;
+    timer->period = period;
+    timer->auto_reload = auto_reload;
+    timer->timer_id = timer_id;
+    timer->callback = callback;
+    pthread_mutex_lock(&sim_timers_lock);
+    timer->next = sim_timers;
+    sim_timers = timer;
+    pthread_mutex_unlock(&sim_timers_lock);
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t timeout) {
+    pthread_mutex_lock(&sim_timers_lock);
+    timer->active = true;
+    timer->expiry_us = sim_time_us() + (int64_t) pdTICKS_TO_MS(timer->period) * 1000;
+    pthread_cond_signal(&sim_timers_cond);
+    pthread_mutex_unlock(&sim_timers_lock);
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t timeout) {
+    pthread_mutex_lock(&sim_timers_lock);
+    timer->active = false;
+    pthread_mutex_unlock(&sim_timers_lock);
+    return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer) {
+    return timer->timer_id;
+}
+
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t function, void *arg1, uint32_t arg2,
+                                         BaseType_t *higher_priority_task_woken) {
+    pthread_once(&sim_timers_once, sim_timers_init);
+    pthread_mutex_lock(&sim_timers_lock);
+    if (sim_pended_count == SIM_TIMER_QUEUE_LENGTH) {
+        pthread_mutex_unlock(&sim_timers_lock);
+        return pdFAIL;
+    }
+    sim_pended[(sim_pended_head + sim_pended_count) % SIM_TIMER_QUEUE_LENGTH] = (sim_pended_call_t) {
+        .function = function,
+        .arg1 = arg1,
+        .arg2 = arg2
+    };
+    sim_pended_count++;
+    pthread_cond_signal(&sim_timers_cond);
+    pthread_mutex_unlock(&sim_timers_lock);
+    if (higher_priority_task_woken) *higher_priority_task_woken = pdTRUE;
+    return pdPASS;
+}
@@ -0,0 +1,60 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_FREERTOS_H
+#define SHIM_FREERTOS_H
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_system.h"
+
+/*
+ * Host build shim, tasks are threads and the kernel objects live in shim/freertos.c. Critical sections are recursive
+ * spinlocks like on the ESP32, they keep the other tasks out but do not stop the scheduler.
+ */
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE                         0
+#define pdTRUE                          1
+#define pdFAIL                          pdFALSE
+#define pdPASS                          pdTRUE
+#define portMAX_DELAY                   ((TickType_t) 0xffffffffUL)
+#define configTICK_RATE_HZ              CONFIG_FREERTOS_HZ
+#define portTICK_PERIOD_MS              (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)               ((TickType_t) (((uint64_t) (ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(ticks)            ((uint32_t) (((uint64_t) (ticks) * 1000) / configTICK_RATE_HZ))
+#define configMAX_TASK_NAME_LEN         CONFIG_FREERTOS_MAX_TASK_NAME_LEN
+#define configUSE_TRACE_FACILITY        CONFIG_FREERTOS_USE_TRACE_FACILITY
+#define configGENERATE_RUN_TIME_STATS   CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+#define configRUN_TIME_COUNTER_TYPE     uint32_t
+#define tskNO_AFFINITY                  ((BaseType_t) 0x7fffffff)
+
+typedef struct {
+    _Atomic(void *) owner;              // Task holding the lock, NULL while free
+    uint32_t count;                     // Nesting depth of the owner
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED    { NULL, 0 }
+
+void vPortEnterCritical(portMUX_TYPE *mux);
+void vPortExitCritical(portMUX_TYPE *mux);
+
+#define portENTER_CRITICAL(mux)         vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux)          vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux)     vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux)      vPortExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux)    vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux)     vPortExitCritical(mux)
+#define portYIELD_FROM_ISR(woken)       ((void) (woken))
+
+#endif //SHIM_FREERTOS_H
@@ -0,0 +1,28 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_FREERTOS_QUEUE_H
+#define SHIM_FREERTOS_QUEUE_H
+
+#include "freertos/FreeRTOS.h"
+
+/* Host build shim, queues copy their items like FreeRTOS, semaphores are queues without item data */
+
+typedef struct sim_queue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+
+void vQueueDelete(QueueHandle_t queue);
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t timeout);
+
+#define xQueueSendToBack(queue, item, timeout)  xQueueSend(queue, item, timeout)
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t timeout);
+
+BaseType_t xQueueReset(QueueHandle_t queue);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+#endif //SHIM_FREERTOS_QUEUE_H
@@ -0,0 +1,25 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_FREERTOS_SEMPHR_H
+#define SHIM_FREERTOS_SEMPHR_H
+
+#include "freertos/queue.h"
+
+/* Host build shim, a mutex is a binary semaphore that starts given, there is no priority inheritance */
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+QueueHandle_t xQueueCreateCountingSemaphore(UBaseType_t max_count, UBaseType_t initial_count);
+
+BaseType_t xQueueSemaphoreTake(QueueHandle_t queue, TickType_t timeout);
+
+#define xSemaphoreCreateBinary()                        xQueueCreateCountingSemaphore(1, 0)
+#define xSemaphoreCreateMutex()                         xQueueCreateCountingSemaphore(1, 1)
+#define xSemaphoreCreateCounting(max_count, initial)    xQueueCreateCountingSemaphore(max_count, initial)
+#define xSemaphoreTake(semaphore, timeout)              xQueueSemaphoreTake(semaphore, timeout)
+#define xSemaphoreGive(semaphore)                       xQueueSend(semaphore, NULL, 0)
+#define vSemaphoreDelete(semaphore)                     vQueueDelete(semaphore)
+
+#endif //SHIM_FREERTOS_SEMPHR_H
@@ -0,0 +1,62 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_FREERTOS_TASK_H
+#define SHIM_FREERTOS_TASK_H
+
+#include "freertos/FreeRTOS.h"
+
+/* Host build shim, every task is a thread and its run time counter is the CPU time of that thread in us */
+
+typedef struct sim_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+typedef struct {
+    TaskHandle_t xHandle;
+    const char *pcTaskName;
+    UBaseType_t xTaskNumber;
+    eTaskState eCurrentState;
+    UBaseType_t uxCurrentPriority;
+    UBaseType_t uxBasePriority;
+    configRUN_TIME_COUNTER_TYPE ulRunTimeCounter;
+    StackType_t *pxStackBase;
+    uint32_t usStackHighWaterMark;      // The host does not measure it, this is the stack size the task was given
+    BaseType_t xCoreID;
+} TaskStatus_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *created, BaseType_t core_id);
+
+#define xTaskCreate(function, name, stack_depth, arg, priority, created) \
+    xTaskCreatePinnedToCore(function, name, stack_depth, arg, priority, created, tskNO_AFFINITY)
+
+/* Only the calling task may delete itself, pass NULL */
+void vTaskDelete(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+
+TickType_t xTaskGetTickCount(void);
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+
+BaseType_t xTaskGetCoreID(TaskHandle_t task);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t timeout);
+
+UBaseType_t uxTaskGetNumberOfTasks(void);
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *status, UBaseType_t size, configRUN_TIME_COUNTER_TYPE *total_run_time);
+
+#endif //SHIM_FREERTOS_TASK_H
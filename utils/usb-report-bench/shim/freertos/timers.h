@@ -0,0 +1,30 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_FREERTOS_TIMERS_H
+#define SHIM_FREERTOS_TIMERS_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Host build shim, callbacks and pended function calls run in the "Tmr Svc" task like on the ESP32 */
+
+typedef struct sim_timer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t timer);
+typedef void (*PendedFunction_t)(void *arg1, uint32_t arg2);
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *timer_id,
+                           TimerCallbackFunction_t callback);
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t timeout);
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t timeout);
+
+void *pvTimerGetTimerID(TimerHandle_t timer);
+
+/* Fails while the timer command queue is full, as on the ESP32 */
+BaseType_t xTimerPendFunctionCallFromISR(PendedFunction_t function, void *arg1, uint32_t arg2,
+                                         BaseType_t *higher_priority_task_woken);
+
+#endif //SHIM_FREERTOS_TIMERS_H
@@ -0,0 +1,527 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "host/ble_gatt.h"
+#include "host/ble_hs.h"
+#include "host/ble_hs_id.h"
+#include "nimble/nimble_port.h"
+#include "nimble/nimble_port_freertos.h"
+#include "services/gap/ble_svc_gap.h"
+#include "services/gatt/ble_svc_gatt.h"
+#include "store/config/ble_store_config.h"
+#include "sim.h"
+
+/*
+ * Host build shim of the NimBLE host with a simulated central. GAP events are served in the "nimble_host" task like
+ * on the ESP32, except NOTIFY_TX, which NimBLE raises inside the notify call. A notification is recorded when the
+ * stack takes it, there is no over the air timing beyond the credits per connection interval.
+ */
+
+#define SIM_BLE_EVENT_QUEUE         32
+#define SIM_BLE_MBUF_POOL           32      // Like CONFIG_BT_NIMBLE_MSYS_1_BLOCK_COUNT, notify returns ENOMEM without one
+#define SIM_BLE_ATTRS_MAX           64
+#define SIM_BLE_CONN_HANDLE         1
+#define SIM_BLE_HOST_TASK_STACK     4096
+#define SIM_BLE_EVENT_STOP          0xff    // Ends nimble_port_run()
+
+typedef struct {
+    uint16_t handle;
+    const struct ble_gatt_chr_def *chr;
+} sim_ble_attr_t;
+
+struct ble_hs_cfg ble_hs_cfg;
+
+static QueueHandle_t sim_ble_events;
+static atomic_bool sim_ble_synced;
+static char sim_ble_device_name[32];
+
+static pthread_mutex_t sim_ble_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_ble_notify_cond;
+static pthread_once_t sim_ble_once = PTHREAD_ONCE_INIT;
+static bool sim_ble_adv_active;
+static ble_gap_event_fn *sim_ble_adv_cb;
+static void *sim_ble_adv_cb_arg;
+static bool sim_ble_connected;
+static ble_gap_event_fn *sim_ble_conn_cb;           // The advertising callback the link was accepted with
+static void *sim_ble_conn_cb_arg;
+static struct ble_gap_conn_desc sim_ble_conn;
+static uint16_t sim_ble_mtu;
+static int64_t sim_ble_connected_us;
+static int sim_ble_credits;                         // Per connection interval, 0 for no limit
+static int64_t sim_ble_credit_window = -1;
+static int sim_ble_credits_used;
+
+static sim_ble_notify_t sim_ble_ring[SIM_BLE_NOTIFY_RING];
+static size_t sim_ble_notify_total;
+
+static struct os_mbuf sim_ble_mbufs[SIM_BLE_MBUF_POOL];
+static bool sim_ble_mbuf_used[SIM_BLE_MBUF_POOL];
+
+static sim_ble_attr_t sim_ble_attrs[SIM_BLE_ATTRS_MAX];
+static int sim_ble_attr_count;
+static uint16_t sim_ble_next_handle = 1;
+
+static void sim_ble_init(void) {
+    sim_cond_init(&sim_ble_notify_cond);
+}
+
+static void sim_ble_post(const struct ble_gap_event *event) {
+    if (!sim_ble_events || xQueueSend(sim_ble_events, event, 0) != pdPASS) {
+        fprintf(stderr, "Simulated NimBLE event queue full, event %u lost\n", event->type);
+    }
+}
+
+static void sim_ble_fill_desc(struct ble_gap_conn_desc *desc) {
+    *desc = sim_ble_conn;
+}
+
+/* ---- Port ---- */
+
+esp_err_t nimble_port_init(void) {
+    pthread_once(&sim_ble_once, sim_ble_init);
+    if (!sim_ble_events) sim_ble_events = xQueueCreate(SIM_BLE_EVENT_QUEUE, sizeof(struct ble_gap_event));
+    return sim_ble_events ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void nimble_port_run(void) {
+    atomic_store(&sim_ble_synced, true);
+    if (ble_hs_cfg.sync_cb) ble_hs_cfg.sync_cb();
+
+    struct ble_gap_event event;
+    while (xQueueReceive(sim_ble_events, &event, portMAX_DELAY) == pdPASS) {
+        if (event.type == SIM_BLE_EVENT_STOP) break;
+
+        pthread_mutex_lock(&sim_ble_lock);
+        ble_gap_event_fn *cb = sim_ble_conn_cb;
+        void *cb_arg = sim_ble_conn_cb_arg;
+        if (event.type == BLE_GAP_EVENT_ADV_COMPLETE) {
+            cb = sim_ble_adv_cb;
+            cb_arg = sim_ble_adv_cb_arg;
+        }
+        pthread_mutex_unlock(&sim_ble_lock);
+        if (cb) cb(&event, cb_arg);
+    }
+    atomic_store(&sim_ble_synced, false);
+}
+
+int nimble_port_stop(void) {
+    const struct ble_gap_event event = { .type = SIM_BLE_EVENT_STOP };
+    sim_ble_post(&event);
+    return 0;
+}
+
+void nimble_port_freertos_init(TaskFunction_t host_task) {
+    if (xTaskCreatePinnedToCore(host_task, "nimble_host", SIM_BLE_HOST_TASK_STACK, NULL, 21, NULL, 0) != pdPASS) {
+        abort();
+    }
+}
+
+void nimble_port_freertos_deinit(void) {
+}
+
+int ble_hs_synced(void) {
+    return atomic_load(&sim_ble_synced);
+}
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type) {
+    *out_addr_type = 0;
+    return 0;
+}
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr) {
+    return 0;
+}
+
+void ble_store_config_init(void) {
+}
+
+/* ---- GAP ---- */
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields *adv_fields) {
+    return 0;
+}
+
+int ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields) {
+    return 0;
+}
+
+/* Advertising runs until a central connects, the duration is not modelled */
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg) {
+    int rc = 0;
+    pthread_mutex_lock(&sim_ble_lock);
+    if (sim_ble_adv_active) rc = BLE_HS_EALREADY;
+    else if (sim_ble_connected) rc = BLE_HS_EBUSY;
+    else {
+        sim_ble_adv_active = true;
+        sim_ble_adv_cb = cb;
+        sim_ble_adv_cb_arg = cb_arg;
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    return rc;
+}
+
+int ble_gap_adv_stop(void) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool active = sim_ble_adv_active;
+    sim_ble_adv_active = false;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return active ? 0 : BLE_HS_EALREADY;
+}
+
+int ble_gap_adv_active(void) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool active = sim_ble_adv_active;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return active;
+}
+
+/* The central pairs and bonds right away, ENC_CHANGE follows */
+int ble_gap_security_initiate(uint16_t conn_handle) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool connected = sim_ble_connected && conn_handle == sim_ble_conn.conn_handle;
+    if (connected) {
+        sim_ble_conn.sec_state.encrypted = 1;
+        sim_ble_conn.sec_state.authenticated = 1;
+        sim_ble_conn.sec_state.bonded = 1;
+        sim_ble_conn.sec_state.key_size = 16;
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    if (!connected) return BLE_HS_ENOTCONN;
+
+    const struct ble_gap_event event = {
+        .type = BLE_GAP_EVENT_ENC_CHANGE,
+        .enc_change = { .status = 0, .conn_handle = conn_handle }
+    };
+    sim_ble_post(&event);
+    return 0;
+}
+
+static int sim_ble_drop_link(uint16_t conn_handle, int reason) {
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_DISCONNECT };
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool connected = sim_ble_connected && conn_handle == sim_ble_conn.conn_handle;
+    if (connected) {
+        sim_ble_connected = false;
+        event.disconnect.reason = reason;
+        sim_ble_fill_desc(&event.disconnect.conn);
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    if (!connected) return BLE_HS_ENOTCONN;
+
+    sim_ble_post(&event);
+    return 0;
+}
+
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason) {
+    return sim_ble_drop_link(conn_handle, hci_reason);
+}
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool connected = sim_ble_connected && handle == sim_ble_conn.conn_handle;
+    if (connected && out_desc) sim_ble_fill_desc(out_desc);
+    pthread_mutex_unlock(&sim_ble_lock);
+    return connected ? 0 : BLE_HS_ENOTCONN;
+}
+
+uint16_t ble_att_mtu(uint16_t conn_handle) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const uint16_t mtu = sim_ble_connected && conn_handle == sim_ble_conn.conn_handle ? sim_ble_mtu : 0;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return mtu;
+}
+
+/* ---- GATT ---- */
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs) {
+    return 0;
+}
+
+/* Handles are assigned in table order: the service, then a declaration and a value per characteristic and one per
+ * descriptor */
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs) {
+    pthread_mutex_lock(&sim_ble_lock);
+    for (const struct ble_gatt_svc_def *svc = svcs; svc->type != BLE_GATT_SVC_TYPE_END; svc++) {
+        sim_ble_next_handle++;
+        for (const struct ble_gatt_chr_def *chr = svc->characteristics; chr && chr->uuid; chr++) {
+            sim_ble_next_handle++;
+            const uint16_t value_handle = sim_ble_next_handle++;
+            if (chr->val_handle) *chr->val_handle = value_handle;
+            if (sim_ble_attr_count < SIM_BLE_ATTRS_MAX) {
+                sim_ble_attrs[sim_ble_attr_count++] = (sim_ble_attr_t) { .handle = value_handle, .chr = chr };
+            }
+            for (const struct ble_gatt_dsc_def *dsc = chr->descriptors; dsc && dsc->uuid; dsc++) {
+                sim_ble_next_handle++;
+            }
+            if (chr->flags & (BLE_GATT_CHR_F_NOTIFY | BLE_GATT_CHR_F_INDICATE)) sim_ble_next_handle++;   // CCCD
+        }
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    return 0;
+}
+
+static const struct ble_gatt_chr_def *sim_ble_find_chr(uint16_t attr_handle) {
+    for (int i = 0; i < sim_ble_attr_count; i++) {
+        if (sim_ble_attrs[i].handle == attr_handle) return sim_ble_attrs[i].chr;
+    }
+    return NULL;
+}
+
+/* Takes a credit of the current connection interval, false when none is left */
+static bool sim_ble_take_credit(void) {
+    if (sim_ble_credits <= 0) return true;
+    const int64_t interval_us = sim_ble_conn.conn_itvl * 1250;
+    const int64_t window = interval_us ? (sim_time_us() - sim_ble_connected_us) / interval_us : 0;
+    if (window != sim_ble_credit_window) {
+        sim_ble_credit_window = window;
+        sim_ble_credits_used = 0;
+    }
+    if (sim_ble_credits_used == sim_ble_credits) return false;
+    sim_ble_credits_used++;
+    return true;
+}
+
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om) {
+    // A NULL mbuf notifies the value the characteristic returns on reads
+    struct os_mbuf read_value = { .om_len = 0 };
+    if (!om) {
+        read_value.om_data = read_value.om_databuf;
+        pthread_mutex_lock(&sim_ble_lock);
+        const struct ble_gatt_chr_def *chr = sim_ble_find_chr(att_handle);
+        pthread_mutex_unlock(&sim_ble_lock);
+        if (chr && chr->access_cb) {
+            struct ble_gatt_access_ctxt ctxt = { .op = BLE_GATT_ACCESS_OP_READ_CHR, .om = &read_value, .chr = chr };
+            chr->access_cb(conn_handle, att_handle, &ctxt, chr->arg);
+        }
+    }
+    const struct os_mbuf *value = om ? om : &read_value;
+
+    int rc = 0;
+    ble_gap_event_fn *cb = NULL;
+    void *cb_arg = NULL;
+    pthread_mutex_lock(&sim_ble_lock);
+    if (!sim_ble_connected || conn_handle != sim_ble_conn.conn_handle) {
+        rc = BLE_HS_ENOTCONN;
+    } else if (!sim_ble_take_credit()) {
+        rc = BLE_HS_ENOMEM;
+    } else {
+        sim_ble_notify_t *notify = &sim_ble_ring[sim_ble_notify_total % SIM_BLE_NOTIFY_RING];
+        notify->time_us = sim_time_us();
+        notify->attr_handle = att_handle;
+        notify->len = MIN(value->om_len, SIM_BLE_NOTIFY_MAX);
+        memcpy(notify->data, value->om_data, notify->len);
+        sim_ble_notify_total++;
+        pthread_cond_broadcast(&sim_ble_notify_cond);
+    }
+    if (rc != BLE_HS_ENOTCONN) {
+        cb = sim_ble_conn_cb;
+        cb_arg = sim_ble_conn_cb_arg;
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    if (om) os_mbuf_free_chain(om);
+
+    if (cb) {
+        struct ble_gap_event event = {
+            .type = BLE_GAP_EVENT_NOTIFY_TX,
+            .notify_tx = { .status = rc, .conn_handle = conn_handle, .attr_handle = att_handle }
+        };
+        cb(&event, cb_arg);
+    }
+    return rc;
+}
+
+void ble_svc_gatt_init(void) {
+}
+
+const char *ble_svc_gap_device_name(void) {
+    return sim_ble_device_name;
+}
+
+int ble_svc_gap_device_name_set(const char *name) {
+    if (strlen(name) >= sizeof(sim_ble_device_name)) return BLE_HS_EINVAL;
+    strcpy(sim_ble_device_name, name);
+    return 0;
+}
+
+void ble_svc_gap_init(void) {
+}
+
+int ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2) {
+    if (uuid1->type != uuid2->type) return uuid1->type - uuid2->type;
+    if (uuid1->type == BLE_UUID_TYPE_16) {
+        return ((const ble_uuid16_t *) uuid1)->value - ((const ble_uuid16_t *) uuid2)->value;
+    }
+    return memcmp(((const ble_uuid128_t *) uuid1)->value, ((const ble_uuid128_t *) uuid2)->value, 16);
+}
+
+/* ---- mbufs ---- */
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len) {
+    if (len > OS_MBUF_DATA_MAX) return NULL;
+    struct os_mbuf *om = NULL;
+    pthread_mutex_lock(&sim_ble_lock);
+    for (int i = 0; i < SIM_BLE_MBUF_POOL; i++) {
+        if (!sim_ble_mbuf_used[i]) {
+            sim_ble_mbuf_used[i] = true;
+            om = &sim_ble_mbufs[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    if (!om) return NULL;
+
+    om->om_data = om->om_databuf;
+    om->om_len = len;
+    memcpy(om->om_data, buf, len);
+    return om;
+}
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len) {
+    const uint16_t len = MIN(om->om_len, max_len);
+    memcpy(flat, om->om_data, len);
+    if (out_copy_len) *out_copy_len = len;
+    return len == om->om_len ? 0 : BLE_HS_EMSGSIZE;
+}
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len) {
+    if (!om->om_data) om->om_data = om->om_databuf;
+    if (om->om_data + om->om_len + len > om->om_databuf + OS_MBUF_DATA_MAX) return BLE_HS_ENOMEM;
+    memcpy(om->om_data + om->om_len, data, len);
+    om->om_len += len;
+    return 0;
+}
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst) {
+    if (off < 0 || len < 0 || off + len > om->om_len) return -1;
+    memcpy(dst, om->om_data + off, len);
+    return 0;
+}
+
+/* Mbufs the harness built on the stack for writes are not from the pool */
+void os_mbuf_free_chain(struct os_mbuf *om) {
+    if (om < sim_ble_mbufs || om >= sim_ble_mbufs + SIM_BLE_MBUF_POOL) return;
+    pthread_mutex_lock(&sim_ble_lock);
+    sim_ble_mbuf_used[om - sim_ble_mbufs] = false;
+    pthread_mutex_unlock(&sim_ble_lock);
+}
+
+/* ---- Simulated central ---- */
+
+bool sim_ble_connect(uint16_t conn_itvl, uint16_t mtu) {
+    struct ble_gap_event event = { .type = BLE_GAP_EVENT_CONNECT };
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool accepted = sim_ble_adv_active && !sim_ble_connected;
+    if (accepted) {
+        sim_ble_adv_active = false;
+        sim_ble_connected = true;
+        sim_ble_conn_cb = sim_ble_adv_cb;
+        sim_ble_conn_cb_arg = sim_ble_adv_cb_arg;
+        sim_ble_conn = (struct ble_gap_conn_desc) {
+            .peer_id_addr = { .type = 0, .val = { 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 } },
+            .conn_handle = SIM_BLE_CONN_HANDLE,
+            .conn_itvl = conn_itvl,
+            .conn_latency = 0,
+            .supervision_timeout = 400
+        };
+        sim_ble_mtu = mtu;
+        sim_ble_connected_us = sim_time_us();
+        sim_ble_credit_window = -1;
+        event.connect.conn_handle = SIM_BLE_CONN_HANDLE;
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    if (!accepted) return false;
+
+    sim_ble_post(&event);
+    if (mtu != BLE_ATT_MTU_DFLT) {
+        const struct ble_gap_event mtu_event = {
+            .type = BLE_GAP_EVENT_MTU,
+            .mtu = { .conn_handle = SIM_BLE_CONN_HANDLE, .value = mtu }
+        };
+        sim_ble_post(&mtu_event);
+    }
+    return true;
+}
+
+void sim_ble_disconnect(void) {
+    sim_ble_drop_link(SIM_BLE_CONN_HANDLE, BLE_ERR_REM_USER_CONN_TERM);
+}
+
+bool sim_ble_encrypted(void) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const bool encrypted = sim_ble_connected && sim_ble_conn.sec_state.encrypted;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return encrypted;
+}
+
+void sim_ble_subscribe(uint16_t attr_handle, bool notify) {
+    const struct ble_gap_event event = {
+        .type = BLE_GAP_EVENT_SUBSCRIBE,
+        .subscribe = {
+            .conn_handle = SIM_BLE_CONN_HANDLE, .attr_handle = attr_handle, .prev_notify = !notify, .cur_notify = notify
+        }
+    };
+    sim_ble_post(&event);
+}
+
+void sim_ble_subscribe_uuid16(uint16_t uuid, bool notify) {
+    uint16_t handles[SIM_BLE_ATTRS_MAX];
+    int count = 0;
+    pthread_mutex_lock(&sim_ble_lock);
+    for (int i = 0; i < sim_ble_attr_count; i++) {
+        const struct ble_gatt_chr_def *chr = sim_ble_attrs[i].chr;
+        if (!(chr->flags & BLE_GATT_CHR_F_NOTIFY) || chr->uuid->type != BLE_UUID_TYPE_16) continue;
+        if (((const ble_uuid16_t *) chr->uuid)->value == uuid) handles[count++] = sim_ble_attrs[i].handle;
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    for (int i = 0; i < count; i++) sim_ble_subscribe(handles[i], notify);
+}
+
+void sim_ble_set_credits(int credits) {
+    pthread_mutex_lock(&sim_ble_lock);
+    sim_ble_credits = credits;
+    pthread_mutex_unlock(&sim_ble_lock);
+}
+
+size_t sim_ble_notifications(size_t index, sim_ble_notify_t *out, size_t max) {
+    size_t copied = 0;
+    pthread_mutex_lock(&sim_ble_lock);
+    // Older ones were overwritten
+    if (sim_ble_notify_total > SIM_BLE_NOTIFY_RING && index < sim_ble_notify_total - SIM_BLE_NOTIFY_RING) {
+        index = sim_ble_notify_total - SIM_BLE_NOTIFY_RING;
+    }
+    for (; index < sim_ble_notify_total && copied < max; index++, copied++) {
+        out[copied] = sim_ble_ring[index % SIM_BLE_NOTIFY_RING];
+    }
+    pthread_mutex_unlock(&sim_ble_lock);
+    return copied;
+}
+
+size_t sim_ble_notify_count(void) {
+    pthread_mutex_lock(&sim_ble_lock);
+    const size_t count = sim_ble_notify_total;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return count;
+}
+
+bool sim_ble_wait_notify(size_t count, int64_t timeout_us) {
+    pthread_once(&sim_ble_once, sim_ble_init);
+    const int64_t deadline_us = sim_time_us() + timeout_us;
+    pthread_mutex_lock(&sim_ble_lock);
+    bool reached = sim_ble_notify_total >= count;
+    while (!reached && sim_cond_wait_until(&sim_ble_notify_cond, &sim_ble_lock, deadline_us)) {
+        reached = sim_ble_notify_total >= count;
+    }
+    reached = sim_ble_notify_total >= count;
+    pthread_mutex_unlock(&sim_ble_lock);
+    return reached;
+}
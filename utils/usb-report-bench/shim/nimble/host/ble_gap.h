@@ -0,0 +1,134 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_GAP_H
+#define SHIM_BLE_GAP_H
+
+#include <stdint.h>
+
+/* Host build shim of the NimBLE host, only what the BT app sources use */
+
+#define BLE_GAP_EVENT_CONNECT               0
+#define BLE_GAP_EVENT_DISCONNECT            1
+#define BLE_GAP_EVENT_CONN_UPDATE           3
+#define BLE_GAP_EVENT_ADV_COMPLETE          9
+#define BLE_GAP_EVENT_ENC_CHANGE            10
+#define BLE_GAP_EVENT_NOTIFY_TX             13
+#define BLE_GAP_EVENT_SUBSCRIBE             14
+#define BLE_GAP_EVENT_MTU                   15
+#define BLE_GAP_EVENT_PARING_COMPLETE       27
+#define BLE_GAP_EVENT_AUTHORIZE             33
+
+#define BLE_GAP_CONN_MODE_NON               0
+#define BLE_GAP_CONN_MODE_DIR               1
+#define BLE_GAP_CONN_MODE_UND               2
+#define BLE_GAP_DISC_MODE_NON               0
+#define BLE_GAP_DISC_MODE_LTD               1
+#define BLE_GAP_DISC_MODE_GEN               2
+
+#define BLE_GAP_ADV_ITVL_MS(t)              ((t) * 1000 / 625)
+
+typedef struct {
+    uint8_t type;
+    uint8_t val[6];
+} ble_addr_t;
+
+struct ble_gap_sec_state {
+    unsigned encrypted:1;
+    unsigned authenticated:1;
+    unsigned bonded:1;
+    unsigned key_size:5;
+};
+
+struct ble_gap_conn_desc {
+    struct ble_gap_sec_state sec_state;
+    ble_addr_t our_id_addr;
+    ble_addr_t peer_id_addr;
+    uint16_t conn_handle;
+    uint16_t conn_itvl;
+    uint16_t conn_latency;
+    uint16_t supervision_timeout;
+};
+
+struct ble_gap_adv_params {
+    uint8_t conn_mode;
+    uint8_t disc_mode;
+    uint16_t itvl_min;
+    uint16_t itvl_max;
+    uint8_t channel_map;
+    uint8_t filter_policy;
+    uint8_t high_duty_cycle;
+};
+
+struct ble_gap_event {
+    uint8_t type;
+    union {
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } connect;
+        struct {
+            int reason;
+            struct ble_gap_conn_desc conn;
+        } disconnect;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } conn_update;
+        struct {
+            int reason;
+        } adv_complete;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } enc_change;
+        struct {
+            int status;
+            uint16_t conn_handle;
+            uint16_t attr_handle;
+            uint8_t indication:1;
+        } notify_tx;
+        struct {
+            uint16_t conn_handle;
+            uint16_t attr_handle;
+            uint8_t reason;
+            uint8_t prev_notify:1;
+            uint8_t cur_notify:1;
+            uint8_t prev_indicate:1;
+            uint8_t cur_indicate:1;
+        } subscribe;
+        struct {
+            uint16_t conn_handle;
+            uint16_t channel_id;
+            uint16_t value;
+        } mtu;
+        struct {
+            int status;
+            uint16_t conn_handle;
+        } pairing_complete;
+    };
+};
+
+typedef int ble_gap_event_fn(struct ble_gap_event *event, void *arg);
+
+struct ble_hs_adv_fields;
+
+int ble_gap_adv_set_fields(const struct ble_hs_adv_fields *adv_fields);
+
+int ble_gap_adv_rsp_set_fields(const struct ble_hs_adv_fields *rsp_fields);
+
+int ble_gap_adv_start(uint8_t own_addr_type, const ble_addr_t *direct_addr, int32_t duration_ms,
+                      const struct ble_gap_adv_params *adv_params, ble_gap_event_fn *cb, void *cb_arg);
+
+int ble_gap_adv_stop(void);
+
+int ble_gap_adv_active(void);
+
+int ble_gap_security_initiate(uint16_t conn_handle);
+
+int ble_gap_terminate(uint16_t conn_handle, uint8_t hci_reason);
+
+int ble_gap_conn_find(uint16_t handle, struct ble_gap_conn_desc *out_desc);
+
+#endif //SHIM_BLE_GAP_H
@@ -0,0 +1,83 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_GATT_H
+#define SHIM_BLE_GATT_H
+
+#include <stdint.h>
+
+#include "os/os_mbuf.h"
+#include "host/ble_uuid.h"
+
+/* Host build shim of the NimBLE host, only what the BT app sources use */
+
+#define BLE_GATT_ACCESS_OP_READ_CHR         0
+#define BLE_GATT_ACCESS_OP_WRITE_CHR        1
+#define BLE_GATT_ACCESS_OP_READ_DSC         2
+#define BLE_GATT_ACCESS_OP_WRITE_DSC        3
+
+#define BLE_GATT_SVC_TYPE_END               0
+#define BLE_GATT_SVC_TYPE_PRIMARY           1
+#define BLE_GATT_SVC_TYPE_SECONDARY         2
+
+#define BLE_GATT_CHR_F_BROADCAST            0x0001
+#define BLE_GATT_CHR_F_READ                 0x0002
+#define BLE_GATT_CHR_F_WRITE_NO_RSP         0x0004
+#define BLE_GATT_CHR_F_WRITE                0x0008
+#define BLE_GATT_CHR_F_NOTIFY               0x0010
+#define BLE_GATT_CHR_F_INDICATE             0x0020
+#define BLE_GATT_CHR_F_READ_ENC             0x0200
+#define BLE_GATT_CHR_F_WRITE_ENC            0x1000
+
+#define BLE_ATT_F_READ                      0x01
+#define BLE_ATT_F_WRITE                     0x02
+
+#define BLE_ATT_ERR_REQ_NOT_SUPPORTED       0x06
+#define BLE_ATT_ERR_INVALID_ATTR_VALUE_LEN  0x0d
+#define BLE_ATT_ERR_UNLIKELY                0x0e
+#define BLE_ATT_ERR_INSUFFICIENT_RES        0x11
+#define BLE_ATT_ERR_VALUE_NOT_ALLOWED       0x13
+
+struct ble_gatt_access_ctxt {
+    uint8_t op;
+    struct os_mbuf *om;
+    const void *chr;
+};
+
+typedef int ble_gatt_access_fn(uint16_t conn_handle, uint16_t attr_handle, struct ble_gatt_access_ctxt *ctxt,
+                               void *arg);
+
+struct ble_gatt_dsc_def {
+    const ble_uuid_t *uuid;
+    uint8_t att_flags;
+    uint8_t min_key_size;
+    ble_gatt_access_fn *access_cb;
+    void *arg;
+};
+
+struct ble_gatt_chr_def {
+    const ble_uuid_t *uuid;
+    ble_gatt_access_fn *access_cb;
+    void *arg;
+    struct ble_gatt_dsc_def *descriptors;
+    uint16_t flags;
+    uint8_t min_key_size;
+    uint16_t *val_handle;
+};
+
+struct ble_gatt_svc_def {
+    uint8_t type;
+    const ble_uuid_t *uuid;
+    const struct ble_gatt_svc_def **includes;
+    const struct ble_gatt_chr_def *characteristics;
+};
+
+int ble_gatts_count_cfg(const struct ble_gatt_svc_def *defs);
+
+int ble_gatts_add_svcs(const struct ble_gatt_svc_def *svcs);
+
+/* Consumes om whatever the result, like NimBLE */
+int ble_gatts_notify_custom(uint16_t conn_handle, uint16_t att_handle, struct os_mbuf *om);
+
+#endif //SHIM_BLE_GATT_H
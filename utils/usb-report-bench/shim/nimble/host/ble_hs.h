@@ -0,0 +1,87 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_HS_H
+#define SHIM_BLE_HS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "os/os_mbuf.h"
+#include "host/ble_uuid.h"
+#include "host/ble_gatt.h"
+#include "host/ble_gap.h"
+
+/* Host build shim of the NimBLE host, backed by the simulated link in shim/nimble.c. Pulls in esp_log.h like NimBLE */
+
+#define BLE_HS_EAGAIN                       1
+#define BLE_HS_EALREADY                     2
+#define BLE_HS_EINVAL                       3
+#define BLE_HS_EMSGSIZE                     4
+#define BLE_HS_ENOENT                       5
+#define BLE_HS_ENOMEM                       6
+#define BLE_HS_ENOTCONN                     7
+#define BLE_HS_ENOTSUP                      8
+#define BLE_HS_ETIMEOUT                     13
+#define BLE_HS_EBUSY                        15
+
+#define BLE_HS_FOREVER                      INT32_MAX
+#define BLE_HS_CONN_HANDLE_NONE             0xffff
+
+#define BLE_HS_ADV_F_DISC_LTD               0x01
+#define BLE_HS_ADV_F_DISC_GEN               0x02
+#define BLE_HS_ADV_F_BREDR_UNSUP            0x04
+#define BLE_HS_ADV_TX_PWR_LVL_AUTO          (-128)
+
+#define BLE_SM_IO_CAP_NO_IO                 0x03
+#define BLE_SM_PAIR_KEY_DIST_ENC            0x01
+#define BLE_SM_PAIR_KEY_DIST_ID             0x02
+
+#define BLE_ERR_REM_USER_CONN_TERM          0x13
+
+#define BLE_ATT_MTU_DFLT                    23
+
+struct ble_hs_adv_fields {
+    uint8_t flags;
+    const ble_uuid16_t *uuids16;
+    uint8_t num_uuids16;
+    unsigned uuids16_is_complete:1;
+    const uint8_t *name;
+    uint8_t name_len;
+    unsigned name_is_complete:1;
+    int8_t tx_pwr_lvl;
+    unsigned tx_pwr_lvl_is_present:1;
+    uint16_t appearance;
+    unsigned appearance_is_present:1;
+};
+
+struct ble_hs_cfg {
+    void (*reset_cb)(int reason);
+    void (*sync_cb)(void);
+    void *store_status_cb;
+    uint8_t sm_io_cap;
+    unsigned sm_oob_data_flag:1;
+    unsigned sm_bonding:1;
+    unsigned sm_mitm:1;
+    unsigned sm_sc:1;
+    unsigned sm_keypress:1;
+    uint8_t sm_our_key_dist;
+    uint8_t sm_their_key_dist;
+};
+
+extern struct ble_hs_cfg ble_hs_cfg;
+
+struct os_mbuf *ble_hs_mbuf_from_flat(const void *buf, uint16_t len);
+
+int ble_hs_mbuf_to_flat(const struct os_mbuf *om, void *flat, uint16_t max_len, uint16_t *out_copy_len);
+
+uint16_t ble_att_mtu(uint16_t conn_handle);
+
+int ble_store_util_delete_peer(const ble_addr_t *peer_id_addr);
+
+int ble_hs_synced(void);
+
+#endif //SHIM_BLE_HS_H
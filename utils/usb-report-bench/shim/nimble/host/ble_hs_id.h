@@ -0,0 +1,14 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_HS_ID_H
+#define SHIM_BLE_HS_ID_H
+
+#include <stdint.h>
+
+/* Host build shim of the NimBLE host, the simulated controller has a public address */
+
+int ble_hs_id_infer_auto(int privacy, uint8_t *out_addr_type);
+
+#endif //SHIM_BLE_HS_ID_H
@@ -0,0 +1,36 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_UUID_H
+#define SHIM_BLE_UUID_H
+
+#include <stdint.h>
+
+/* Host build shim of the NimBLE host, only what the BT app sources use */
+
+#define BLE_UUID_TYPE_16            16
+#define BLE_UUID_TYPE_128           128
+
+typedef struct {
+    uint8_t type;
+} ble_uuid_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint16_t value;
+} ble_uuid16_t;
+
+typedef struct {
+    ble_uuid_t u;
+    uint8_t value[16];
+} ble_uuid128_t;
+
+#define BLE_UUID16_INIT(uuid16)     { .u = { .type = BLE_UUID_TYPE_16 }, .value = (uuid16) }
+#define BLE_UUID128_INIT(...)       { .u = { .type = BLE_UUID_TYPE_128 }, .value = { __VA_ARGS__ } }
+#define BLE_UUID16_DECLARE(uuid16)  ((const ble_uuid_t *) (&(ble_uuid16_t) BLE_UUID16_INIT(uuid16)))
+#define BLE_UUID128_DECLARE(...)    ((const ble_uuid_t *) (&(ble_uuid128_t) BLE_UUID128_INIT(__VA_ARGS__)))
+
+int ble_uuid_cmp(const ble_uuid_t *uuid1, const ble_uuid_t *uuid2);
+
+#endif //SHIM_BLE_UUID_H
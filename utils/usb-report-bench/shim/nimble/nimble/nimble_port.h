@@ -0,0 +1,18 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_NIMBLE_PORT_H
+#define SHIM_NIMBLE_PORT_H
+
+#include "esp_err.h"
+
+/* Host build shim, nimble_port_run() serves the events the simulator posts until the host stops */
+
+esp_err_t nimble_port_init(void);
+
+void nimble_port_run(void);
+
+int nimble_port_stop(void);
+
+#endif //SHIM_NIMBLE_PORT_H
@@ -0,0 +1,17 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_NIMBLE_PORT_FREERTOS_H
+#define SHIM_NIMBLE_PORT_FREERTOS_H
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+/* Host build shim, starts the "nimble_host" task that calls host_task */
+
+void nimble_port_freertos_init(TaskFunction_t host_task);
+
+void nimble_port_freertos_deinit(void);
+
+#endif //SHIM_NIMBLE_PORT_FREERTOS_H
@@ -0,0 +1,28 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_OS_MBUF_H
+#define SHIM_OS_MBUF_H
+
+#include <stdint.h>
+
+/* Host build shim, an mbuf is a single flat buffer from a fixed pool, chains are not modelled */
+
+#define OS_MBUF_DATA_MAX            512
+
+struct os_mbuf {
+    uint8_t *om_data;
+    uint16_t om_len;
+    uint8_t om_databuf[OS_MBUF_DATA_MAX];
+};
+
+#define OS_MBUF_PKTLEN(om)          ((om)->om_len)
+
+int os_mbuf_append(struct os_mbuf *om, const void *data, uint16_t len);
+
+int os_mbuf_copydata(const struct os_mbuf *om, int off, int len, void *dst);
+
+void os_mbuf_free_chain(struct os_mbuf *om);
+
+#endif //SHIM_OS_MBUF_H
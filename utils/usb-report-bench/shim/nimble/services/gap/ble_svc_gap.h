@@ -0,0 +1,18 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_SVC_GAP_H
+#define SHIM_BLE_SVC_GAP_H
+
+/* Host build shim of the NimBLE GAP service */
+
+#define BLE_SVC_GAP_APPEARANCE_GEN_HID      960
+
+const char *ble_svc_gap_device_name(void);
+
+int ble_svc_gap_device_name_set(const char *name);
+
+void ble_svc_gap_init(void);
+
+#endif //SHIM_BLE_SVC_GAP_H
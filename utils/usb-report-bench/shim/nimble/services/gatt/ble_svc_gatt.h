@@ -0,0 +1,12 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_SVC_GATT_H
+#define SHIM_BLE_SVC_GATT_H
+
+/* Host build shim of the NimBLE GATT service */
+
+void ble_svc_gatt_init(void);
+
+#endif //SHIM_BLE_SVC_GATT_H
@@ -0,0 +1,12 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_BLE_STORE_CONFIG_H
+#define SHIM_BLE_STORE_CONFIG_H
+
+/* Host build shim, bonds are not persisted */
+
+void ble_store_config_init(void);
+
+#endif //SHIM_BLE_STORE_CONFIG_H
@@ -0,0 +1,16 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_NVS_FLASH_H
+#define SHIM_NVS_FLASH_H
+
+#include "esp_err.h"
+
+/* Host build shim, the partition always initializes */
+
+esp_err_t nvs_flash_init(void);
+
+esp_err_t nvs_flash_erase(void);
+
+#endif //SHIM_NVS_FLASH_H
@@ -0,0 +1,18 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_SDKCONFIG_H
+#define SHIM_SDKCONFIG_H
+
+/* Host build shim, the options of sdkconfig the firmware sources read */
+
+#define CONFIG_FREERTOS_HZ                          100
+#define CONFIG_FREERTOS_USE_TRACE_FACILITY          1
+#define CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS     1
+#define CONFIG_FREERTOS_MAX_TASK_NAME_LEN           16
+#define CONFIG_ESP_CONSOLE_UART_DEFAULT             1
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ             160
+#define CONFIG_BT_NIMBLE_ATT_PREFERRED_MTU          256
+
+#endif //SHIM_SDKCONFIG_H
@@ -0,0 +1,110 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_SIM_H
+#define SHIM_SIM_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Control side of the simulated stacks. The harness plugs devices into the simulated USB bus, types on them, drives the
+ * VBUS pin and connects a simulated BLE central that records every notification the firmware sends.
+ */
+
+#define SIM_USB_PORTS_MAX           32      // Devices on the simulated bus at the same time
+#define SIM_USB_IFACES_MAX          4       // Interfaces per simulated device
+#define SIM_USB_REPORT_MAX          64      // Longest simulated input report
+#define SIM_USB_REPORT_QUEUE        32      // Input reports buffered per interface until the host polls
+#define SIM_BLE_NOTIFY_RING         1024    // Notifications kept for the harness
+#define SIM_BLE_NOTIFY_MAX          64      // Longest recorded notification
+
+#define SIM_USB_FAULT_CLAIM         (1 << 0)    // Interface claims fail
+#define SIM_USB_FAULT_IN_SUBMIT     (1 << 1)    // IN transfer submits fail
+#define SIM_USB_FAULT_CLASS         (1 << 2)    // HID class requests stall
+
+typedef struct {
+    uint8_t sub_class;                  // 1 for boot interfaces
+    uint8_t protocol;                   // Boot protocol, 1 keyboard, 2 mouse
+    const uint8_t *report_desc;
+    uint16_t report_desc_len;
+    uint16_t max_packet_size;
+} sim_usb_iface_t;
+
+typedef struct {
+    uint16_t vid;
+    uint16_t pid;
+    uint8_t iface_count;
+    sim_usb_iface_t ifaces[SIM_USB_IFACES_MAX];
+    uint32_t faults;                    // SIM_USB_FAULT_* from the plug on, sim_usb_set_faults() changes them later
+} sim_usb_device_t;
+
+typedef struct {
+    int64_t time_us;
+    uint16_t attr_handle;
+    uint16_t len;
+    uint8_t data[SIM_BLE_NOTIFY_MAX];
+} sim_ble_notify_t;
+
+/* Plugs a device in, returns its port or -1 when the bus is full. The host enumerates it once installed. */
+int sim_usb_attach(const sim_usb_device_t *device);
+
+void sim_usb_detach(int port);
+
+/* Queues an input report on an interface of the port, false when the queue is full or the port is empty */
+bool sim_usb_report(int port, uint8_t iface, const uint8_t *data, size_t len);
+
+void sim_usb_set_faults(int port, uint32_t faults);
+
+/* Devices the host has enumerated and claimed interfaces whose IN endpoint the host polled since the claim */
+int sim_usb_enumerated_count(void);
+
+int sim_usb_polled_count(void);
+
+/* Sets the input level, an edge calls the registered interrupt handler from the calling thread */
+void sim_gpio_set_level(int gpio_num, int level);
+
+/*
+ * Central side of the link, the firmware sees CONNECT and pairs. Connection interval in units of 1.25 ms. False while
+ * the firmware is not advertising.
+ */
+bool sim_ble_connect(uint16_t conn_itvl, uint16_t mtu);
+
+void sim_ble_disconnect(void);
+
+bool sim_ble_encrypted(void);
+
+/* Writes the CCCD of the attribute, the firmware sees SUBSCRIBE */
+void sim_ble_subscribe(uint16_t attr_handle, bool notify);
+
+/* Writes the CCCD of every characteristic of the 16 bit UUID that notifies, like a HID host does for the reports */
+void sim_ble_subscribe_uuid16(uint16_t uuid, bool notify);
+
+/* Notifications the link accepts per connection interval, beyond that NimBLE runs out of buffers */
+void sim_ble_set_credits(int credits);
+
+/* Copies the notifications recorded from index on, returns how many were copied */
+size_t sim_ble_notifications(size_t index, sim_ble_notify_t *out, size_t max);
+
+size_t sim_ble_notify_count(void);
+
+/* Waits until at least count notifications were recorded, false on timeout */
+bool sim_ble_wait_notify(size_t count, int64_t timeout_us);
+
+/* CPU time of every task that is still running, in us */
+uint64_t sim_tasks_cpu_us(void);
+
+/* Shared by the simulated stacks */
+int64_t sim_time_us(void);
+
+void sim_cond_init(pthread_cond_t *cond);
+
+/* Waits until the monotonic deadline in us of sim_time_us(), forever if negative. False on timeout. */
+bool sim_cond_wait_until(pthread_cond_t *cond, pthread_mutex_t *lock, int64_t deadline_us);
+
+int64_t sim_ticks_to_deadline_us(uint32_t ticks);
+
+#endif //SHIM_SIM_H
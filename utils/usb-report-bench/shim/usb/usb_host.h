@@ -0,0 +1,265 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef SHIM_USB_HOST_H
+#define SHIM_USB_HOST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_intr_alloc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+/*
+ * Host build shim of the USB Host Library, backed by the simulated bus in shim/usb_host.c. Events and transfer
+ * callbacks are delivered from usb_host_lib_handle_events() and usb_host_client_handle_events() like the real library.
+ */
+
+#define USB_SETUP_PACKET_SIZE                       8
+#define USB_STANDARD_DESC_SIZE                      2
+#define USB_DEVICE_DESC_SIZE                        18
+#define USB_CONFIG_DESC_SIZE                        9
+#define USB_INTF_DESC_SIZE                          9
+#define USB_EP_DESC_SIZE                            7
+
+#define USB_B_DESCRIPTOR_TYPE_DEVICE                0x01
+#define USB_B_DESCRIPTOR_TYPE_CONFIGURATION         0x02
+#define USB_B_DESCRIPTOR_TYPE_STRING                0x03
+#define USB_B_DESCRIPTOR_TYPE_INTERFACE             0x04
+#define USB_B_DESCRIPTOR_TYPE_ENDPOINT              0x05
+
+#define USB_BM_REQUEST_TYPE_DIR_OUT                 (0 << 7)
+#define USB_BM_REQUEST_TYPE_DIR_IN                  (1 << 7)
+#define USB_BM_REQUEST_TYPE_TYPE_STANDARD           (0 << 5)
+#define USB_BM_REQUEST_TYPE_TYPE_CLASS              (1 << 5)
+#define USB_BM_REQUEST_TYPE_RECIP_DEVICE            0
+#define USB_BM_REQUEST_TYPE_RECIP_INTERFACE         1
+#define USB_BM_REQUEST_TYPE_RECIP_ENDPOINT          2
+
+#define USB_B_REQUEST_GET_STATUS                    0x00
+#define USB_B_REQUEST_CLEAR_FEATURE                 0x01
+#define USB_B_REQUEST_SET_FEATURE                   0x03
+#define USB_B_REQUEST_GET_DESCRIPTOR                0x06
+
+#define USB_B_ENDPOINT_ADDRESS_EP_NUM_MASK          0x0f
+#define USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK          0x80
+#define USB_BM_ATTRIBUTES_XFERTYPE_MASK             0x03
+#define USB_BM_ATTRIBUTES_XFER_INT                  0x03
+#define USB_W_MAX_PACKET_SIZE_MPS_MASK              0x07ff
+
+#define USB_CLASS_HID                               0x03
+
+#define USB_EP_DESC_GET_EP_DIR(desc)    (((desc)->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK) ? 1 : 0)
+#define USB_EP_DESC_GET_MPS(desc)       ((desc)->wMaxPacketSize & USB_W_MAX_PACKET_SIZE_MPS_MASK)
+
+#define USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS         0x01
+#define USB_HOST_LIB_EVENT_FLAGS_ALL_FREE           0x02
+
+typedef struct usb_device_s *usb_device_handle_t;
+typedef struct usb_host_client_s *usb_host_client_handle_t;
+
+typedef struct {
+    uint8_t bmRequestType;
+    uint8_t bRequest;
+    uint16_t wValue;
+    uint16_t wIndex;
+    uint16_t wLength;
+} __attribute__((packed)) usb_setup_packet_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+} __attribute__((packed)) usb_standard_desc_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t bcdUSB;
+    uint8_t bDeviceClass;
+    uint8_t bDeviceSubClass;
+    uint8_t bDeviceProtocol;
+    uint8_t bMaxPacketSize0;
+    uint16_t idVendor;
+    uint16_t idProduct;
+    uint16_t bcdDevice;
+    uint8_t iManufacturer;
+    uint8_t iProduct;
+    uint8_t iSerialNumber;
+    uint8_t bNumConfigurations;
+} __attribute__((packed)) usb_device_desc_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t wTotalLength;
+    uint8_t bNumInterfaces;
+    uint8_t bConfigurationValue;
+    uint8_t iConfiguration;
+    uint8_t bmAttributes;
+    uint8_t bMaxPower;
+} __attribute__((packed)) usb_config_desc_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bInterfaceNumber;
+    uint8_t bAlternateSetting;
+    uint8_t bNumEndpoints;
+    uint8_t bInterfaceClass;
+    uint8_t bInterfaceSubClass;
+    uint8_t bInterfaceProtocol;
+    uint8_t iInterface;
+} __attribute__((packed)) usb_intf_desc_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint8_t bEndpointAddress;
+    uint8_t bmAttributes;
+    uint16_t wMaxPacketSize;
+    uint8_t bInterval;
+} __attribute__((packed)) usb_ep_desc_t;
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;
+    uint16_t wData[];
+} __attribute__((packed)) usb_str_desc_t;
+
+typedef struct {
+    uint8_t dev_addr;
+    uint8_t bMaxPacketSize0;
+    uint8_t bConfigurationValue;
+    const usb_str_desc_t *str_desc_manufacturer;
+    const usb_str_desc_t *str_desc_product;
+    const usb_str_desc_t *str_desc_serial_num;
+} usb_device_info_t;
+
+typedef enum {
+    USB_TRANSFER_STATUS_COMPLETED,
+    USB_TRANSFER_STATUS_ERROR,
+    USB_TRANSFER_STATUS_TIMED_OUT,
+    USB_TRANSFER_STATUS_CANCELED,
+    USB_TRANSFER_STATUS_STALL,
+    USB_TRANSFER_STATUS_OVERFLOW,
+    USB_TRANSFER_STATUS_SKIPPED,
+    USB_TRANSFER_STATUS_NO_DEVICE
+} usb_transfer_status_t;
+
+typedef struct usb_transfer_s usb_transfer_t;
+typedef void (*usb_transfer_cb_t)(usb_transfer_t *transfer);
+
+struct usb_transfer_s {
+    uint8_t *const data_buffer;
+    const size_t data_buffer_size;
+    int num_bytes;
+    int actual_num_bytes;
+    uint32_t flags;
+    usb_device_handle_t device_handle;
+    uint8_t bEndpointAddress;
+    usb_transfer_status_t status;
+    uint32_t timeout_ms;
+    usb_transfer_cb_t callback;
+    void *context;
+};
+
+typedef enum {
+    USB_HOST_CLIENT_EVENT_NEW_DEV,
+    USB_HOST_CLIENT_EVENT_DEV_GONE
+} usb_host_client_event_t;
+
+typedef struct {
+    usb_host_client_event_t event;
+    union {
+        struct {
+            uint8_t address;
+        } new_dev;
+        struct {
+            usb_device_handle_t dev_hdl;
+        } dev_gone;
+    };
+} usb_host_client_event_msg_t;
+
+typedef void (*usb_host_client_event_cb_t)(const usb_host_client_event_msg_t *event_msg, void *arg);
+
+typedef struct {
+    bool is_synchronous;
+    int max_num_event_msg;
+    union {
+        struct {
+            usb_host_client_event_cb_t client_event_callback;
+            void *callback_arg;
+        } async;
+    };
+} usb_host_client_config_t;
+
+typedef struct {
+    bool skip_phy_setup;
+    int intr_flags;
+} usb_host_config_t;
+
+const usb_standard_desc_t *usb_parse_next_descriptor_of_type(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                             uint8_t bDescriptorType, int *offset);
+
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_index(const usb_intf_desc_t *intf_desc, int index,
+                                                            uint16_t wTotalLength, int *offset);
+
+esp_err_t usb_host_install(const usb_host_config_t *config);
+
+esp_err_t usb_host_uninstall(void);
+
+esp_err_t usb_host_lib_handle_events(TickType_t timeout_ticks, uint32_t *event_flags_ret);
+
+esp_err_t usb_host_lib_unblock(void);
+
+esp_err_t usb_host_device_free_all(void);
+
+esp_err_t usb_host_client_register(const usb_host_client_config_t *client_config,
+                                   usb_host_client_handle_t *client_hdl_ret);
+
+esp_err_t usb_host_client_deregister(usb_host_client_handle_t client_hdl);
+
+esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client_hdl, TickType_t timeout_ticks);
+
+esp_err_t usb_host_client_unblock(usb_host_client_handle_t client_hdl);
+
+esp_err_t usb_host_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr,
+                               usb_device_handle_t *dev_hdl_ret);
+
+esp_err_t usb_host_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl);
+
+esp_err_t usb_host_device_info(usb_device_handle_t dev_hdl, usb_device_info_t *dev_info);
+
+esp_err_t usb_host_device_addr(usb_device_handle_t dev_hdl, uint8_t *dev_addr);
+
+esp_err_t usb_host_get_device_descriptor(usb_device_handle_t dev_hdl, const usb_device_desc_t **device_desc);
+
+esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t dev_hdl, const usb_config_desc_t **config_desc);
+
+esp_err_t usb_host_interface_claim(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                   uint8_t bInterfaceNumber, uint8_t bAlternateSetting);
+
+esp_err_t usb_host_interface_release(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                     uint8_t bInterfaceNumber);
+
+esp_err_t usb_host_endpoint_halt(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+
+esp_err_t usb_host_endpoint_flush(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+
+esp_err_t usb_host_endpoint_clear(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress);
+
+esp_err_t usb_host_transfer_alloc(size_t data_buffer_size, int num_isoc_packets, usb_transfer_t **transfer);
+
+esp_err_t usb_host_transfer_free(usb_transfer_t *transfer);
+
+esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer);
+
+esp_err_t usb_host_transfer_submit_control(usb_host_client_handle_t client_hdl, usb_transfer_t *transfer);
+
+#endif //SHIM_USB_HOST_H
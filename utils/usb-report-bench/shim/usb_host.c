@@ -0,0 +1,820 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+
+#include "usb/usb_host.h"
+#include "sim.h"
+
+/*
+ * Host build shim of the USB Host Library on a simulated bus. The harness plugs devices into ports, the library
+ * enumerates them one per usb_host_lib_handle_events() call and the client gets NEW_DEV and DEV_GONE events and
+ * transfer completions from usb_host_client_handle_events(), in the calling task, like on the ESP32.
+ *
+ * Every device answers the HID requests the driver sends: the report descriptor, SET_PROTOCOL, SET_IDLE and GET_REPORT.
+ * Anything else stalls. IN transfers complete as soon as the harness queues a report, there is no bus timing.
+ */
+
+#define SIM_USB_CLIENTS_MAX         4
+#define SIM_USB_CLIENT_EVENTS_MAX   64
+#define SIM_USB_CONFIG_DESC_MAX     (USB_CONFIG_DESC_SIZE + SIM_USB_IFACES_MAX * (USB_INTF_DESC_SIZE + 9 + USB_EP_DESC_SIZE))
+#define SIM_USB_STR_DESC_MAX        32
+#define SIM_USB_EP_IN(iface)        (USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK | ((iface) + 1))
+#define SIM_USB_EP_IFACE(ep)        (((ep) & USB_B_ENDPOINT_ADDRESS_EP_NUM_MASK) - 1)
+
+#define HID_DESC_TYPE_HID           0x21
+#define HID_DESC_TYPE_REPORT        0x22
+#define HID_REQ_GET_REPORT          0x01
+#define HID_REQ_GET_IDLE            0x02
+#define HID_REQ_GET_PROTOCOL        0x03
+#define HID_REQ_SET_REPORT          0x09
+#define HID_REQ_SET_IDLE            0x0a
+#define HID_REQ_SET_PROTOCOL        0x0b
+
+typedef struct sim_transfer {
+    usb_transfer_t transfer;            // First, the driver only sees this part
+    usb_host_client_handle_t client;    // Client whose usb_host_client_handle_events() runs the callback
+    bool in_flight;                     // Submitted and the callback not run yet
+    struct sim_transfer *next_done;
+} sim_transfer_t;
+
+typedef struct {
+    bool connected;
+    struct usb_device_s *device;        // Host side of the device while enumerated
+    sim_usb_device_t config;
+    usb_device_desc_t device_desc;
+    uint8_t config_desc[SIM_USB_CONFIG_DESC_MAX] __attribute__((aligned(4)));
+    uint16_t str_product[SIM_USB_STR_DESC_MAX];
+    uint8_t reports[SIM_USB_IFACES_MAX][SIM_USB_REPORT_QUEUE][SIM_USB_REPORT_MAX];
+    uint8_t report_lens[SIM_USB_IFACES_MAX][SIM_USB_REPORT_QUEUE];
+    uint8_t report_head[SIM_USB_IFACES_MAX];
+    uint8_t report_count[SIM_USB_IFACES_MAX];
+    uint8_t last_report[SIM_USB_IFACES_MAX][SIM_USB_REPORT_MAX];
+    uint8_t last_report_len[SIM_USB_IFACES_MAX];
+    uint8_t protocol[SIM_USB_IFACES_MAX];
+    uint32_t faults;
+} sim_usb_port_t;
+
+struct usb_device_s {
+    sim_usb_port_t *port;
+    uint8_t addr;
+    bool gone;                          // Unplugged or freed, waiting for its openers to close it
+    uint32_t open_mask;                 // Bit per client
+    usb_host_client_handle_t claimed[SIM_USB_IFACES_MAX];
+    sim_transfer_t *in_pending[SIM_USB_IFACES_MAX];
+    bool polled[SIM_USB_IFACES_MAX];   // IN endpoint polled since the claim, stays set while a poll is deferred
+    struct usb_device_s *next;
+};
+
+struct usb_host_client_s {
+    int index;
+    usb_host_client_config_t config;
+    pthread_cond_t cond;
+    usb_host_client_event_msg_t events[SIM_USB_CLIENT_EVENTS_MAX];
+    int event_head;
+    int event_count;
+    sim_transfer_t *done_head;
+    sim_transfer_t *done_tail;
+    bool unblock;
+};
+
+static pthread_mutex_t sim_usb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sim_usb_lib_cond;
+static pthread_once_t sim_usb_once = PTHREAD_ONCE_INIT;
+static sim_usb_port_t sim_usb_ports[SIM_USB_PORTS_MAX];
+static struct usb_host_client_s *sim_usb_clients[SIM_USB_CLIENTS_MAX];
+static struct usb_device_s *sim_usb_devices;
+static bool sim_usb_installed;
+static bool sim_usb_freeing;            // usb_host_device_free_all() called, nothing enumerates until reinstalled
+static bool sim_usb_lib_unblock;
+static uint32_t sim_usb_lib_flags;
+static uint8_t sim_usb_next_addr = 1;
+
+static void sim_usb_init(void) {
+    sim_cond_init(&sim_usb_lib_cond);
+}
+
+/* ---- Descriptors ---- */
+
+static void sim_usb_build_descriptors(sim_usb_port_t *port, int index) {
+    const sim_usb_device_t *config = &port->config;
+    port->device_desc = (usb_device_desc_t) {
+        .bLength = USB_DEVICE_DESC_SIZE,
+        .bDescriptorType = USB_B_DESCRIPTOR_TYPE_DEVICE,
+        .bcdUSB = 0x0200,
+        .bMaxPacketSize0 = 8,
+        .idVendor = config->vid,
+        .idProduct = config->pid,
+        .iProduct = 2,
+        .bNumConfigurations = 1
+    };
+
+    uint8_t *p = port->config_desc + USB_CONFIG_DESC_SIZE;
+    for (int i = 0; i < config->iface_count; i++) {
+        const sim_usb_iface_t *iface = &config->ifaces[i];
+        const uint8_t intf[USB_INTF_DESC_SIZE] = {
+            USB_INTF_DESC_SIZE, USB_B_DESCRIPTOR_TYPE_INTERFACE, i, 0, 1, USB_CLASS_HID, iface->sub_class,
+            iface->protocol, 0
+        };
+        const uint8_t hid[9] = {
+            9, HID_DESC_TYPE_HID, 0x11, 0x01, 0, 1, HID_DESC_TYPE_REPORT, iface->report_desc_len & 0xff,
+            iface->report_desc_len >> 8
+        };
+        const uint16_t mps = iface->max_packet_size ? iface->max_packet_size : 8;
+        const uint8_t ep[USB_EP_DESC_SIZE] = {
+            USB_EP_DESC_SIZE, USB_B_DESCRIPTOR_TYPE_ENDPOINT, SIM_USB_EP_IN(i), USB_BM_ATTRIBUTES_XFER_INT,
+            mps & 0xff, mps >> 8, 1
+        };
+        memcpy(p, intf, sizeof(intf));
+        memcpy(p + sizeof(intf), hid, sizeof(hid));
+        memcpy(p + sizeof(intf) + sizeof(hid), ep, sizeof(ep));
+        p += sizeof(intf) + sizeof(hid) + sizeof(ep);
+    }
+    const uint16_t total = p - port->config_desc;
+    const uint8_t cfg[USB_CONFIG_DESC_SIZE] = {
+        USB_CONFIG_DESC_SIZE, USB_B_DESCRIPTOR_TYPE_CONFIGURATION, total & 0xff, total >> 8, config->iface_count,
+        1, 0, 0xa0, 50
+    };
+    memcpy(port->config_desc, cfg, sizeof(cfg));
+
+    char product[SIM_USB_STR_DESC_MAX - 1];
+    const int len = snprintf(product, sizeof(product), "Sim HID %d", index);
+    port->str_product[0] = (USB_B_DESCRIPTOR_TYPE_STRING << 8) | (USB_STANDARD_DESC_SIZE + 2 * len);
+    for (int i = 0; i < len; i++) port->str_product[i + 1] = product[i];
+}
+
+const usb_standard_desc_t *usb_parse_next_descriptor_of_type(const usb_standard_desc_t *cur_desc, uint16_t wTotalLength,
+                                                             uint8_t bDescriptorType, int *offset) {
+    const uint8_t *p = (const uint8_t *) cur_desc;
+    int off = *offset;
+    while (off < wTotalLength && off + p[0] < wTotalLength && p[0] != 0) {
+        off += p[0];
+        p += p[0];
+        if (p[1] == bDescriptorType) {
+            *offset = off;
+            return (const usb_standard_desc_t *) p;
+        }
+    }
+    return NULL;
+}
+
+const usb_ep_desc_t *usb_parse_endpoint_descriptor_by_index(const usb_intf_desc_t *intf_desc, int index,
+                                                            uint16_t wTotalLength, int *offset) {
+    if (index >= intf_desc->bNumEndpoints) return NULL;
+    int off = *offset;
+    const usb_standard_desc_t *desc = (const usb_standard_desc_t *) intf_desc;
+    for (int i = 0; i <= index; i++) {
+        desc = usb_parse_next_descriptor_of_type(desc, wTotalLength, USB_B_DESCRIPTOR_TYPE_ENDPOINT, &off);
+        if (!desc) return NULL;
+    }
+    *offset = off;
+    return (const usb_ep_desc_t *) desc;
+}
+
+/* ---- Event delivery, called with the lock held ---- */
+
+static void sim_usb_client_event(struct usb_host_client_s *client, const usb_host_client_event_msg_t *msg) {
+    if (client->event_count == client->config.max_num_event_msg || client->event_count == SIM_USB_CLIENT_EVENTS_MAX) {
+        fprintf(stderr, "W sim_usb: client event queue full, event %d lost\n", msg->event);
+        return;
+    }
+    client->events[(client->event_head + client->event_count) % SIM_USB_CLIENT_EVENTS_MAX] = *msg;
+    client->event_count++;
+    pthread_cond_signal(&client->cond);
+}
+
+static void sim_usb_transfer_done(sim_transfer_t *xfer, usb_transfer_status_t status) {
+    struct usb_host_client_s *client = xfer->client;
+    xfer->transfer.status = status;
+    xfer->next_done = NULL;
+    if (client->done_tail) {
+        client->done_tail->next_done = xfer;
+    } else {
+        client->done_head = xfer;
+    }
+    client->done_tail = xfer;
+    pthread_cond_signal(&client->cond);
+}
+
+static void sim_usb_complete_in(struct usb_device_s *device, int iface) {
+    sim_usb_port_t *port = device->port;
+    sim_transfer_t *xfer = device->in_pending[iface];
+    if (!xfer || !port || !port->report_count[iface]) return;
+    const uint8_t head = port->report_head[iface];
+    const size_t len = MIN(port->report_lens[iface][head], xfer->transfer.num_bytes);
+    memcpy(xfer->transfer.data_buffer, port->reports[iface][head], len);
+    xfer->transfer.actual_num_bytes = len;
+    port->report_head[iface] = (head + 1) % SIM_USB_REPORT_QUEUE;
+    port->report_count[iface]--;
+    device->in_pending[iface] = NULL;
+    sim_usb_transfer_done(xfer, USB_TRANSFER_STATUS_COMPLETED);
+}
+
+static struct usb_device_s *sim_usb_device_find(usb_device_handle_t dev_hdl) {
+    for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+        if (device == dev_hdl) return device;
+    }
+    return NULL;
+}
+
+static void sim_usb_device_free(struct usb_device_s *device) {
+    for (struct usb_device_s **it = &sim_usb_devices; *it; it = &(*it)->next) {
+        if (*it == device) {
+            *it = device->next;
+            break;
+        }
+    }
+    if (device->port) device->port->device = NULL;
+    free(device);
+    if (sim_usb_freeing && !sim_usb_devices) {
+        sim_usb_lib_flags |= USB_HOST_LIB_EVENT_FLAGS_ALL_FREE;
+        pthread_cond_signal(&sim_usb_lib_cond);
+    }
+}
+
+/* The device leaves the host: pending IN transfers end, the openers get DEV_GONE and close it */
+static void sim_usb_device_gone(struct usb_device_s *device) {
+    if (device->gone) return;
+    device->gone = true;
+    for (int i = 0; i < SIM_USB_IFACES_MAX; i++) {
+        if (device->in_pending[i]) {
+            sim_usb_transfer_done(device->in_pending[i], USB_TRANSFER_STATUS_NO_DEVICE);
+            device->in_pending[i] = NULL;
+        }
+    }
+    if (!device->open_mask) {
+        sim_usb_device_free(device);
+        return;
+    }
+    const usb_host_client_event_msg_t msg = {
+        .event = USB_HOST_CLIENT_EVENT_DEV_GONE,
+        .dev_gone.dev_hdl = device
+    };
+    for (int i = 0; i < SIM_USB_CLIENTS_MAX; i++) {
+        if (sim_usb_clients[i] && (device->open_mask & (1u << i))) sim_usb_client_event(sim_usb_clients[i], &msg);
+    }
+}
+
+static uint8_t sim_usb_alloc_addr(void) {
+    for (int tries = 0; tries < 127; tries++) {
+        const uint8_t addr = sim_usb_next_addr;
+        sim_usb_next_addr = sim_usb_next_addr % 127 + 1;
+        bool used = false;
+        for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+            if (device->addr == addr) used = true;
+        }
+        if (!used) return addr;
+    }
+    return 0;
+}
+
+/* Enumerates one connected port, returns false when there is none left */
+static bool sim_usb_enumerate_one(void) {
+    if (!sim_usb_installed || sim_usb_freeing) return false;
+    for (int i = 0; i < SIM_USB_PORTS_MAX; i++) {
+        sim_usb_port_t *port = &sim_usb_ports[i];
+        if (!port->connected || port->device) continue;
+        struct usb_device_s *device = calloc(1, sizeof(struct usb_device_s));
+        if (!device) return false;
+        device->port = port;
+        device->addr = sim_usb_alloc_addr();
+        device->next = sim_usb_devices;
+        sim_usb_devices = device;
+        port->device = device;
+        const usb_host_client_event_msg_t msg = {
+            .event = USB_HOST_CLIENT_EVENT_NEW_DEV,
+            .new_dev.address = device->addr
+        };
+        for (int c = 0; c < SIM_USB_CLIENTS_MAX; c++) {
+            if (sim_usb_clients[c]) sim_usb_client_event(sim_usb_clients[c], &msg);
+        }
+        return true;
+    }
+    return false;
+}
+
+/* ---- Library ---- */
+
+esp_err_t usb_host_install(const usb_host_config_t *config) {
+    pthread_once(&sim_usb_once, sim_usb_init);
+    pthread_mutex_lock(&sim_usb_lock);
+    if (sim_usb_installed) {
+        pthread_mutex_unlock(&sim_usb_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    sim_usb_installed = true;
+    sim_usb_freeing = false;
+    sim_usb_lib_unblock = false;
+    sim_usb_lib_flags = 0;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_uninstall(void) {
+    pthread_mutex_lock(&sim_usb_lock);
+    bool busy = !sim_usb_installed || sim_usb_devices;
+    for (int i = 0; i < SIM_USB_CLIENTS_MAX; i++) {
+        if (sim_usb_clients[i]) busy = true;
+    }
+    if (!busy) sim_usb_installed = false;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return busy ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t usb_host_lib_handle_events(TickType_t timeout_ticks, uint32_t *event_flags_ret) {
+    const int64_t deadline_us = sim_ticks_to_deadline_us(timeout_ticks);
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_usb_lock);
+    while (true) {
+        if (!sim_usb_installed) {
+            err = ESP_ERR_INVALID_STATE;
+            break;
+        }
+        if (sim_usb_enumerate_one() || sim_usb_lib_flags || sim_usb_lib_unblock) break;
+        if (timeout_ticks == 0 || !sim_cond_wait_until(&sim_usb_lib_cond, &sim_usb_lock, deadline_us)) {
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+    }
+    if (event_flags_ret) *event_flags_ret = err == ESP_OK ? sim_usb_lib_flags : 0;
+    if (err == ESP_OK) sim_usb_lib_flags = 0;
+    sim_usb_lib_unblock = false;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+esp_err_t usb_host_lib_unblock(void) {
+    pthread_once(&sim_usb_once, sim_usb_init);
+    pthread_mutex_lock(&sim_usb_lock);
+    sim_usb_lib_unblock = true;
+    pthread_cond_signal(&sim_usb_lib_cond);
+    pthread_mutex_unlock(&sim_usb_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_device_free_all(void) {
+    pthread_mutex_lock(&sim_usb_lock);
+    sim_usb_freeing = true;
+    struct usb_device_s *device = sim_usb_devices;
+    while (device) {
+        struct usb_device_s *next = device->next;
+        sim_usb_device_gone(device);
+        device = next;
+    }
+    const bool all_free = !sim_usb_devices;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return all_free ? ESP_OK : ESP_ERR_NOT_FINISHED;
+}
+
+/* ---- Clients ---- */
+
+esp_err_t usb_host_client_register(const usb_host_client_config_t *client_config,
+                                   usb_host_client_handle_t *client_hdl_ret) {
+    if (client_config->is_synchronous || !client_config->async.client_event_callback) return ESP_ERR_NOT_SUPPORTED;
+    struct usb_host_client_s *client = calloc(1, sizeof(struct usb_host_client_s));
+    if (!client) return ESP_ERR_NO_MEM;
+    client->config = *client_config;
+    sim_cond_init(&client->cond);
+    pthread_mutex_lock(&sim_usb_lock);
+    client->index = -1;
+    for (int i = 0; sim_usb_installed && i < SIM_USB_CLIENTS_MAX; i++) {
+        if (!sim_usb_clients[i]) {
+            client->index = i;
+            sim_usb_clients[i] = client;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    if (client->index < 0) {
+        free(client);
+        return ESP_ERR_INVALID_STATE;
+    }
+    *client_hdl_ret = client;
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_deregister(usb_host_client_handle_t client_hdl) {
+    pthread_mutex_lock(&sim_usb_lock);
+    for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+        if (device->open_mask & (1u << client_hdl->index)) {
+            pthread_mutex_unlock(&sim_usb_lock);
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+    sim_usb_clients[client_hdl->index] = NULL;
+    bool last = true;
+    for (int i = 0; i < SIM_USB_CLIENTS_MAX; i++) {
+        if (sim_usb_clients[i]) last = false;
+    }
+    if (last) {
+        sim_usb_lib_flags |= USB_HOST_LIB_EVENT_FLAGS_NO_CLIENTS;
+        pthread_cond_signal(&sim_usb_lib_cond);
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    pthread_cond_destroy(&client_hdl->cond);
+    free(client_hdl);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_handle_events(usb_host_client_handle_t client_hdl, TickType_t timeout_ticks) {
+    const int64_t deadline_us = sim_ticks_to_deadline_us(timeout_ticks);
+    pthread_mutex_lock(&sim_usb_lock);
+    while (!client_hdl->event_count && !client_hdl->done_head && !client_hdl->unblock) {
+        if (timeout_ticks == 0 || !sim_cond_wait_until(&client_hdl->cond, &sim_usb_lock, deadline_us)) {
+            pthread_mutex_unlock(&sim_usb_lock);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    client_hdl->unblock = false;
+    // Callbacks run without the lock, they submit transfers and open or close devices
+    while (client_hdl->done_head) {
+        sim_transfer_t *xfer = client_hdl->done_head;
+        client_hdl->done_head = xfer->next_done;
+        if (!client_hdl->done_head) client_hdl->done_tail = NULL;
+        xfer->in_flight = false;
+        pthread_mutex_unlock(&sim_usb_lock);
+        xfer->transfer.callback(&xfer->transfer);
+        pthread_mutex_lock(&sim_usb_lock);
+    }
+    while (client_hdl->event_count) {
+        const usb_host_client_event_msg_t msg = client_hdl->events[client_hdl->event_head];
+        client_hdl->event_head = (client_hdl->event_head + 1) % SIM_USB_CLIENT_EVENTS_MAX;
+        client_hdl->event_count--;
+        pthread_mutex_unlock(&sim_usb_lock);
+        client_hdl->config.async.client_event_callback(&msg, client_hdl->config.async.callback_arg);
+        pthread_mutex_lock(&sim_usb_lock);
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_client_unblock(usb_host_client_handle_t client_hdl) {
+    pthread_mutex_lock(&sim_usb_lock);
+    client_hdl->unblock = true;
+    pthread_cond_signal(&client_hdl->cond);
+    pthread_mutex_unlock(&sim_usb_lock);
+    return ESP_OK;
+}
+
+/* ---- Devices ---- */
+
+esp_err_t usb_host_device_open(usb_host_client_handle_t client_hdl, uint8_t dev_addr,
+                               usb_device_handle_t *dev_hdl_ret) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    pthread_mutex_lock(&sim_usb_lock);
+    for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+        if (device->addr == dev_addr && !device->gone) {
+            device->open_mask |= 1u << client_hdl->index;
+            *dev_hdl_ret = device;
+            err = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+esp_err_t usb_host_device_close(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (!device || !(device->open_mask & (1u << client_hdl->index))) {
+        pthread_mutex_unlock(&sim_usb_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (int i = 0; i < SIM_USB_IFACES_MAX; i++) {
+        if (device->claimed[i] == client_hdl) {
+            device->claimed[i] = NULL;
+            device->polled[i] = false;
+        }
+    }
+    device->open_mask &= ~(1u << client_hdl->index);
+    if (!device->open_mask && device->gone) sim_usb_device_free(device);
+    pthread_mutex_unlock(&sim_usb_lock);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_device_info(usb_device_handle_t dev_hdl, usb_device_info_t *dev_info) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (device) {
+        *dev_info = (usb_device_info_t) {
+            .dev_addr = device->addr,
+            .bMaxPacketSize0 = device->port->device_desc.bMaxPacketSize0,
+            .bConfigurationValue = 1,
+            .str_desc_product = (const usb_str_desc_t *) device->port->str_product
+        };
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t usb_host_device_addr(usb_device_handle_t dev_hdl, uint8_t *dev_addr) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (device) *dev_addr = device->addr;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t usb_host_get_device_descriptor(usb_device_handle_t dev_hdl, const usb_device_desc_t **device_desc) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (device) *device_desc = &device->port->device_desc;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t usb_host_get_active_config_descriptor(usb_device_handle_t dev_hdl, const usb_config_desc_t **config_desc) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (device) *config_desc = (const usb_config_desc_t *) device->port->config_desc;
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t usb_host_interface_claim(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                   uint8_t bInterfaceNumber, uint8_t bAlternateSetting) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (!device || device->gone || bInterfaceNumber >= device->port->config.iface_count) {
+        err = ESP_ERR_NOT_FOUND;
+    } else if (device->port->faults & SIM_USB_FAULT_CLAIM) {
+        err = ESP_FAIL;
+    } else if (device->claimed[bInterfaceNumber]) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        device->claimed[bInterfaceNumber] = client_hdl;
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+esp_err_t usb_host_interface_release(usb_host_client_handle_t client_hdl, usb_device_handle_t dev_hdl,
+                                     uint8_t bInterfaceNumber) {
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    if (!device || bInterfaceNumber >= SIM_USB_IFACES_MAX || device->claimed[bInterfaceNumber] != client_hdl) {
+        err = ESP_ERR_INVALID_STATE;
+    } else {
+        device->claimed[bInterfaceNumber] = NULL;
+        device->polled[bInterfaceNumber] = false;
+        if (device->in_pending[bInterfaceNumber]) {
+            device->in_pending[bInterfaceNumber]->in_flight = false;
+            device->in_pending[bInterfaceNumber] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+esp_err_t usb_host_endpoint_halt(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+/* Ends the pending IN transfer of the endpoint as canceled */
+esp_err_t usb_host_endpoint_flush(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(dev_hdl);
+    const int iface = SIM_USB_EP_IFACE(bEndpointAddress);
+    if (device && iface >= 0 && iface < SIM_USB_IFACES_MAX && device->in_pending[iface]) {
+        sim_usb_transfer_done(device->in_pending[iface], USB_TRANSFER_STATUS_CANCELED);
+        device->in_pending[iface] = NULL;
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return device ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t usb_host_endpoint_clear(usb_device_handle_t dev_hdl, uint8_t bEndpointAddress) {
+    return usb_host_endpoint_halt(dev_hdl, bEndpointAddress);
+}
+
+/* ---- Transfers ---- */
+
+esp_err_t usb_host_transfer_alloc(size_t data_buffer_size, int num_isoc_packets, usb_transfer_t **transfer) {
+    sim_transfer_t *xfer = calloc(1, sizeof(sim_transfer_t) + data_buffer_size);
+    if (!xfer) return ESP_ERR_NO_MEM;
+    const usb_transfer_t init = {
+        .data_buffer = (uint8_t *) (xfer + 1),
+        .data_buffer_size = data_buffer_size
+    };
+    memcpy(&xfer->transfer, &init, sizeof(init));
+    *transfer = &xfer->transfer;
+    return ESP_OK;
+}
+
+/* A completion not delivered yet is dropped with the transfer */
+esp_err_t usb_host_transfer_free(usb_transfer_t *transfer) {
+    if (!transfer) return ESP_OK;
+    sim_transfer_t *xfer = (sim_transfer_t *) transfer;
+    pthread_mutex_lock(&sim_usb_lock);
+    if (xfer->in_flight) {
+        struct usb_host_client_s *client = xfer->client;
+        sim_transfer_t *prev = NULL;
+        for (sim_transfer_t *it = client->done_head; it; prev = it, it = it->next_done) {
+            if (it != xfer) continue;
+            if (prev) {
+                prev->next_done = it->next_done;
+            } else {
+                client->done_head = it->next_done;
+            }
+            if (client->done_tail == it) client->done_tail = prev;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    free(xfer);
+    return ESP_OK;
+}
+
+esp_err_t usb_host_transfer_submit(usb_transfer_t *transfer) {
+    sim_transfer_t *xfer = (sim_transfer_t *) transfer;
+    const int iface = SIM_USB_EP_IFACE(transfer->bEndpointAddress);
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(transfer->device_handle);
+    if (!device || iface < 0 || iface >= SIM_USB_IFACES_MAX || !device->claimed[iface] ||
+        !(transfer->bEndpointAddress & USB_B_ENDPOINT_ADDRESS_EP_DIR_MASK)) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (device->gone) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (xfer->in_flight || device->in_pending[iface]) {
+        err = ESP_ERR_NOT_FINISHED;
+    } else if (device->port->faults & SIM_USB_FAULT_IN_SUBMIT) {
+        err = ESP_FAIL;
+    } else {
+        xfer->client = device->claimed[iface];
+        xfer->in_flight = true;
+        device->in_pending[iface] = xfer;
+        device->polled[iface] = true;
+        sim_usb_complete_in(device, iface);
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+/* Answers the request in the setup packet, returns the data stage length or -1 to stall */
+static int sim_usb_control(sim_usb_port_t *port, const usb_setup_packet_t *setup, uint8_t *data, size_t max_len) {
+    const uint8_t type = setup->bmRequestType & 0x60;
+    const uint8_t iface = setup->wIndex & 0xff;
+    if (type == USB_BM_REQUEST_TYPE_TYPE_STANDARD && setup->bRequest == USB_B_REQUEST_GET_DESCRIPTOR) {
+        const uint8_t desc_type = setup->wValue >> 8;
+        const uint8_t *desc = NULL;
+        size_t len = 0;
+        if (desc_type == USB_B_DESCRIPTOR_TYPE_DEVICE) {
+            desc = (const uint8_t *) &port->device_desc;
+            len = sizeof(port->device_desc);
+        } else if (desc_type == USB_B_DESCRIPTOR_TYPE_CONFIGURATION) {
+            desc = port->config_desc;
+            len = ((const usb_config_desc_t *) port->config_desc)->wTotalLength;
+        } else if (desc_type == HID_DESC_TYPE_REPORT && iface < port->config.iface_count) {
+            desc = port->config.ifaces[iface].report_desc;
+            len = port->config.ifaces[iface].report_desc_len;
+        } else {
+            return -1;
+        }
+        len = MIN(MIN(len, setup->wLength), max_len);
+        memcpy(data, desc, len);
+        return len;
+    }
+    if (type != USB_BM_REQUEST_TYPE_TYPE_CLASS || iface >= port->config.iface_count) return -1;
+    if (port->faults & SIM_USB_FAULT_CLASS) return -1;
+    switch (setup->bRequest) {
+    case HID_REQ_SET_PROTOCOL:
+        port->protocol[iface] = setup->wValue & 0xff;
+        return 0;
+    case HID_REQ_SET_IDLE:
+    case HID_REQ_SET_REPORT:
+        return 0;
+    case HID_REQ_GET_PROTOCOL:
+        if (max_len < 1) return -1;
+        data[0] = port->protocol[iface];
+        return 1;
+    case HID_REQ_GET_IDLE:
+        if (max_len < 1) return -1;
+        data[0] = 0;
+        return 1;
+    case HID_REQ_GET_REPORT: {
+        const size_t len = MIN(MIN(port->last_report_len[iface], setup->wLength), max_len);
+        memcpy(data, port->last_report[iface], len);
+        return len;
+    }
+    default:
+        return -1;
+    }
+}
+
+esp_err_t usb_host_transfer_submit_control(usb_host_client_handle_t client_hdl, usb_transfer_t *transfer) {
+    sim_transfer_t *xfer = (sim_transfer_t *) transfer;
+    if (transfer->num_bytes < USB_SETUP_PACKET_SIZE || transfer->num_bytes > (int) transfer->data_buffer_size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err = ESP_OK;
+    pthread_mutex_lock(&sim_usb_lock);
+    struct usb_device_s *device = sim_usb_device_find(transfer->device_handle);
+    if (!device) {
+        err = ESP_ERR_INVALID_ARG;
+    } else if (device->gone) {
+        err = ESP_ERR_INVALID_STATE;
+    } else if (xfer->in_flight) {
+        err = ESP_ERR_NOT_FINISHED;
+    } else {
+        const usb_setup_packet_t *setup = (const usb_setup_packet_t *) transfer->data_buffer;
+        const int len = sim_usb_control(device->port, setup, transfer->data_buffer + USB_SETUP_PACKET_SIZE,
+                                        transfer->num_bytes - USB_SETUP_PACKET_SIZE);
+        xfer->client = client_hdl;
+        xfer->in_flight = true;
+        transfer->actual_num_bytes = USB_SETUP_PACKET_SIZE + (len > 0 ? len : 0);
+        sim_usb_transfer_done(xfer, len < 0 ? USB_TRANSFER_STATUS_STALL : USB_TRANSFER_STATUS_COMPLETED);
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return err;
+}
+
+/* ---- Simulator side ---- */
+
+int sim_usb_attach(const sim_usb_device_t *device) {
+    if (device->iface_count == 0 || device->iface_count > SIM_USB_IFACES_MAX) return -1;
+    pthread_once(&sim_usb_once, sim_usb_init);
+    int index = -1;
+    pthread_mutex_lock(&sim_usb_lock);
+    for (int i = 0; i < SIM_USB_PORTS_MAX; i++) {
+        sim_usb_port_t *port = &sim_usb_ports[i];
+        if (port->connected || port->device) continue;
+        memset(port, 0, sizeof(*port));
+        port->connected = true;
+        port->config = *device;
+        port->faults = device->faults;
+        for (int f = 0; f < device->iface_count; f++) port->protocol[f] = 1;
+        sim_usb_build_descriptors(port, i);
+        index = i;
+        pthread_cond_signal(&sim_usb_lib_cond);
+        break;
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return index;
+}
+
+void sim_usb_detach(int port_index) {
+    pthread_mutex_lock(&sim_usb_lock);
+    sim_usb_port_t *port = &sim_usb_ports[port_index];
+    port->connected = false;
+    // The port stays taken until the host frees the device, the descriptors must outlive its last close
+    if (port->device) sim_usb_device_gone(port->device);
+    pthread_mutex_unlock(&sim_usb_lock);
+}
+
+bool sim_usb_report(int port_index, uint8_t iface, const uint8_t *data, size_t len) {
+    if (len > SIM_USB_REPORT_MAX) return false;
+    pthread_mutex_lock(&sim_usb_lock);
+    sim_usb_port_t *port = &sim_usb_ports[port_index];
+    const bool queued = port->connected && iface < port->config.iface_count &&
+                        port->report_count[iface] < SIM_USB_REPORT_QUEUE;
+    if (queued) {
+        const uint8_t tail = (port->report_head[iface] + port->report_count[iface]) % SIM_USB_REPORT_QUEUE;
+        memcpy(port->reports[iface][tail], data, len);
+        port->report_lens[iface][tail] = len;
+        port->report_count[iface]++;
+        memcpy(port->last_report[iface], data, len);
+        port->last_report_len[iface] = len;
+        if (port->device) sim_usb_complete_in(port->device, iface);
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return queued;
+}
+
+void sim_usb_set_faults(int port_index, uint32_t faults) {
+    pthread_mutex_lock(&sim_usb_lock);
+    sim_usb_ports[port_index].faults = faults;
+    pthread_mutex_unlock(&sim_usb_lock);
+}
+
+int sim_usb_enumerated_count(void) {
+    int count = 0;
+    pthread_mutex_lock(&sim_usb_lock);
+    for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+        if (!device->gone) count++;
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return count;
+}
+
+int sim_usb_polled_count(void) {
+    int count = 0;
+    pthread_mutex_lock(&sim_usb_lock);
+    for (struct usb_device_s *device = sim_usb_devices; device; device = device->next) {
+        for (int i = 0; !device->gone && i < SIM_USB_IFACES_MAX; i++) {
+            if (device->polled[i]) count++;
+        }
+    }
+    pthread_mutex_unlock(&sim_usb_lock);
+    return count;
+}
@@ -0,0 +1,213 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the tap-hold and combo engine natively on Linux against scripted, timed key streams and compares
+ * what comes out with the expected events. A random stream then checks the invariants: every press is
+ * released, nothing is sent twice, and a key that takes part in nothing never waits longer than the
+ * tapping term plus one tick.
+ *
+ * Script events are "<ms><+|-><usage hex>", a bare "<ms>" only advances the clock.
+ * Output events are "<ms><+|-><usage hex>" with the time they were sent.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "test-result.h"
+#include "usb_app_taphold.h"
+
+#define TEST_TICK_MS                5
+#define TEST_TAPPING_TERM_MS        200
+#define TEST_COMBO_TERM_MS          40
+#define TEST_RANDOM_EVENTS          200000
+#define TEST_OUTPUT_MAX             4096
+
+static const usb_app_taphold_key_t test_keys[] = {
+    { HID_KEY_CAPS_LOCK, HID_KEY_ESC, HID_KEY_LEFT_CONTROL },
+    { HID_KEY_SPACE, HID_KEY_SPACE, HID_KEY_LEFT_SHIFT },
+};
+
+static const usb_app_taphold_combo_t test_combos[] = {
+    { { HID_KEY_J, HID_KEY_K }, HID_KEY_DEL },
+    { { HID_KEY_D, HID_KEY_F }, HID_KEY_TAB },
+};
+
+static const usb_app_taphold_config_t test_config = {
+    .keys = test_keys,
+    .key_count = sizeof(test_keys) / sizeof(test_keys[0]),
+    .combos = test_combos,
+    .combo_count = sizeof(test_combos) / sizeof(test_combos[0]),
+    .tapping_term_ms = TEST_TAPPING_TERM_MS,
+    .combo_term_ms = TEST_COMBO_TERM_MS,
+    .tick_ms = TEST_TICK_MS
+};
+
+typedef struct {
+    const char *name;
+    const char *script;
+    const char *expected;
+} test_case_t;
+
+/* Usages: 39 Caps Lock, 29 Esc, e0 Left Control, e1 Left Shift, 2c Space, 0d J, 0e K, 2a Delete, 04 A */
+static const test_case_t test_cases[] = {
+    { "plain key passes through at once",   "0+04 30-04",                   "0+04 30-04" },
+    { "tap",                                "0+39 100-39",                  "100+29 100-29" },
+    { "hold on timeout",                    "0+39 300 400-39",              "200+e0 400-e0" },
+    { "hold when another key is tapped",    "0+39 50+04 80-04 120-39",      "80+e0 80+04 80-04 120-e0" },
+    { "roll over stays a tap",              "0+39 50+04 70-39 90-04",       "70+29 70+04 70-29 90-04" },
+    { "tap-hold as shift",                  "0+2c 10+04 30-04 40-2c",       "30+e1 30+04 30-04 40-e1" },
+    { "combo",                              "0+0d 20+0e 60-0d 70-0e",       "20+2a 60-2a" },
+    { "combo released in other order",      "0+0d 20+0e 60-0e 70-0d",       "20+2a 60-2a" },
+    { "combo key alone after timeout",      "0+0d 100 120-0d",              "40+0d 120-0d" },
+    { "combo broken by another key",        "0+0d 10+04 20-04 30-0d",       "10+0d 10+04 20-04 30-0d" },
+    { "combo key released early",           "0+0d 10-0d 20+0e 30-0e",       "10+0d 10-0d 30+0e 30-0e" },
+    { "combo then tap-hold tap",            "0+0d 10+0e 20-0d 25-0e 30+39 50-39",
+                                            "10+2a 20-2a 50+29 50-29" },
+    { "events behind an open hold wait",    "0+39 10+04 20+05 200 250-04 260-05 270-39",
+                                            "200+e0 200+04 200+05 250-04 260-05 270-e0" },
+};
+
+static uint32_t test_now_ms;
+static char test_output[TEST_OUTPUT_MAX];
+static size_t test_output_len;
+
+static void test_record(const key_event_t *key_event, void *arg) {
+    test_output_len += snprintf(test_output + test_output_len, sizeof(test_output) - test_output_len, "%s%u%c%02x",
+                                test_output_len ? " " : "", test_now_ms,
+                                key_event->state == KEY_STATE_PRESSED ? '+' : '-', key_event->key_code);
+}
+
+/* Advances the clock tick by tick, the way the periodic timer on the device does */
+static void test_advance(usb_app_taphold_t *engine, uint32_t to_ms) {
+    while (test_now_ms + TEST_TICK_MS <= to_ms) {
+        test_now_ms += TEST_TICK_MS;
+        usb_app_taphold_tick(engine, test_now_ms);
+    }
+    test_now_ms = to_ms;
+}
+
+static bool test_run_case(const test_case_t *test_case) {
+    usb_app_taphold_t engine;
+    usb_app_taphold_init(&engine, &test_config, test_record, NULL);
+    test_now_ms = 0;
+    test_output_len = 0;
+    test_output[0] = 0;
+
+    const char *cursor = test_case->script;
+    while (*cursor) {
+        char *end;
+        const uint32_t at_ms = strtoul(cursor, &end, 10);
+        test_advance(&engine, at_ms);
+        if (*end == '+' || *end == '-') {
+            const key_event_t key_event = {
+                .state = *end == '+' ? KEY_STATE_PRESSED : KEY_STATE_RELEASED,
+                .key_code = strtoul(end + 1, &end, 16)
+            };
+            usb_app_taphold_process(&engine, &key_event, test_now_ms);
+        }
+        cursor = end;
+        while (*cursor == ' ') cursor++;
+    }
+    test_advance(&engine, test_now_ms + 2 * TEST_TAPPING_TERM_MS);
+
+    const bool passed = strcmp(test_output, test_case->expected) == 0;
+    printf("%s  %s\n", test_result_str(passed), test_case->name);
+    if (!passed) {
+        printf("      script:   %s\n      expected: %s\n      got:      %s\n", test_case->script,
+               test_case->expected, test_output);
+    }
+    return passed;
+}
+
+typedef struct {
+    uint32_t pressed_at_ms[256];        // Input time of each plain key press still waiting
+    int held[256];                      // Output presses minus releases per usage
+    uint32_t max_delay_ms;
+    unsigned long late;
+    unsigned long double_press;
+    unsigned long stray_release;
+    unsigned long events;
+} test_random_t;
+
+static test_random_t test_random;
+
+static void test_random_record(const key_event_t *key_event, void *arg) {
+    test_random_t *state = &test_random;
+    const uint8_t key = key_event->key_code;
+    state->events++;
+
+    if (key_event->state == KEY_STATE_PRESSED) {
+        if (state->held[key]++ > 0) state->double_press++;
+        if (state->pressed_at_ms[key] != UINT32_MAX) {
+            const uint32_t delay = test_now_ms - state->pressed_at_ms[key];
+            if (delay > state->max_delay_ms) state->max_delay_ms = delay;
+            if (delay > TEST_TAPPING_TERM_MS + TEST_TICK_MS) state->late++;
+            state->pressed_at_ms[key] = UINT32_MAX;
+        }
+    } else if (state->held[key]-- <= 0) {
+        state->stray_release++;
+        state->held[key] = 0;
+    }
+}
+
+static bool test_run_random(void) {
+    static const uint8_t keys[] = {
+        HID_KEY_CAPS_LOCK, HID_KEY_SPACE, HID_KEY_J, HID_KEY_K, HID_KEY_D, HID_KEY_F,
+        HID_KEY_A, HID_KEY_S, HID_KEY_L, HID_KEY_E, HID_KEY_R, HID_KEY_T
+    };
+    const size_t key_count = sizeof(keys) / sizeof(keys[0]);
+    bool down[sizeof(keys) / sizeof(keys[0])] = { false };
+
+    usb_app_taphold_t engine;
+    usb_app_taphold_init(&engine, &test_config, test_random_record, NULL);
+    memset(&test_random, 0, sizeof(test_random));
+    memset(test_random.pressed_at_ms, 0xFF, sizeof(test_random.pressed_at_ms));
+    test_now_ms = 0;
+    srand(7);
+
+    for (int i = 0; i < TEST_RANDOM_EVENTS; i++) {
+        test_advance(&engine, test_now_ms + rand() % 120);
+        const size_t k = rand() % key_count;
+        const key_event_t key_event = {
+            .state = down[k] ? KEY_STATE_RELEASED : KEY_STATE_PRESSED,
+            .key_code = keys[k]
+        };
+        down[k] = !down[k];
+        // Only plain keys have a latency bound, the others are expected to wait for their decision
+        if (key_event.state == KEY_STATE_PRESSED && k >= 6) test_random.pressed_at_ms[keys[k]] = test_now_ms;
+        usb_app_taphold_process(&engine, &key_event, test_now_ms);
+    }
+    for (size_t k = 0; k < key_count; k++) {
+        if (!down[k]) continue;
+        const key_event_t key_event = { .state = KEY_STATE_RELEASED, .key_code = keys[k] };
+        usb_app_taphold_process(&engine, &key_event, test_now_ms);
+    }
+    test_advance(&engine, test_now_ms + 2 * TEST_TAPPING_TERM_MS);
+
+    unsigned long stuck = 0;
+    for (int key = 0; key < 256; key++) {
+        if (test_random.held[key]) stuck++;
+    }
+
+    const bool passed = !stuck && !test_random.late && !test_random.double_press && !test_random.stray_release &&
+                        !usb_app_taphold_pending(&engine);
+    printf("%s  random stream: %d events in, %lu out, %u taps, %u holds, %u combos, %u forced, max queued %u\n"
+           "      plain key max delay %u ms, %lu late, %lu stuck, %lu double presses, %lu stray releases\n",
+           test_result_str(passed), TEST_RANDOM_EVENTS, test_random.events, engine.stats.taps, engine.stats.holds,
+           engine.stats.combos, engine.stats.forced, engine.stats.max_queued, test_random.max_delay_ms,
+           test_random.late, stuck, test_random.double_press, test_random.stray_release);
+    return passed;
+}
+
+int main(void) {
+    for (size_t i = 0; i < sizeof(test_cases) / sizeof(test_cases[0]); i++) {
+        test_result(test_run_case(&test_cases[i]));
+    }
+    test_result(test_run_random());
+
+    return test_result_summary(stdout);
+}
@@ -0,0 +1,34 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+#ifndef TEST_RESULT_H
+#define TEST_RESULT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Pass/fail bookkeeping of the tests. Each one prints its rows ending in PASS or FAIL, then the number of failed
+ * rows on the last line, and exits non-zero when any failed.
+ */
+
+static int test_result_failed = 0;
+
+/* Counts a failed row, returns passed */
+static inline bool test_result(bool passed) {
+    if (!passed) test_result_failed++;
+    return passed;
+}
+
+static inline const char *test_result_str(bool passed) {
+    return passed ? "PASS" : "FAIL";
+}
+
+/* Prints the failed count, returns the exit status */
+static inline int test_result_summary(FILE *out) {
+    fprintf(out, "%d failed\n", test_result_failed);
+    return test_result_failed != 0;
+}
+
+#endif //TEST_RESULT_H
@@ -0,0 +1,287 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Replays a capture printed by usb_app_capture_dump() through the whole firmware, the way bridge-sim runs it:
+ * app_main() on the simulated USB Host Library and NimBLE in shim/. Every captured interface is plugged into the
+ * simulated bus as a device of its own and its raw input reports go through hid_host and the USB app, the keymap, the
+ * tap-hold keys and the BT app report scheduler. A simulated central records every notification, which is printed
+ * with the capture time of the input report that caused it. Without -s one report is in flight at a time and output
+ * depends only on the capture, so two builds can be diffed to spot regressions in the report path.
+ *
+ * Convert the device log first:  grep -o 'UCAP:[0-9a-f]*' log.txt | cut -c6- | xxd -r -p > capture.bin
+ *
+ * The firmware logs go to stderr, the notifications to stdout.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bt_app_keyboard.h"
+#include "bt_app_mouse.h"
+#include "sim.h"
+#include "usb_app.h"
+#include "usb_app_capture.h"
+
+#define REPLAY_CONN_ITVL            6           // 7.5 ms in units of 1.25 ms
+#define REPLAY_MTU_DEFAULT          23          // Boot reports, -m 247 gets the NKRO report
+#define REPLAY_INPUT_REPORT_UUID    0x2A4D      // The central enables notifications of every report
+#define REPLAY_BRINGUP_TIMEOUT_US   5000000
+#define REPLAY_SETTLE_US            (4 * REPLAY_CONN_ITVL * 1250)
+
+typedef struct {
+    FILE *out;
+    uint32_t first_timestamp_us;
+    size_t printed;                 // Notifications printed so far
+    size_t inputs;
+    size_t dropped;                 // Input reports the simulated bus did not take
+    int ports[USB_APP_CAPTURE_CHANNELS_MAX];
+} replay_ctx_t;
+
+static uint16_t replay_mtu = REPLAY_MTU_DEFAULT;
+static int replay_expected_polled;
+
+int app_main(void);
+
+static bool replay_wait(bool (*done)(void), int64_t timeout_us) {
+    const int64_t deadline_us = sim_time_us() + timeout_us;
+    while (!done()) {
+        if (sim_time_us() > deadline_us) return false;
+        usleep(1000);
+    }
+    return true;
+}
+
+static bool replay_advertising_connect(void) {
+    return sim_ble_connect(REPLAY_CONN_ITVL, replay_mtu);
+}
+
+static bool replay_all_polled(void) {
+    return sim_usb_polled_count() == replay_expected_polled;
+}
+
+/* Waits until no notification came for a few connection intervals */
+static void replay_settle(void) {
+    size_t count;
+    do {
+        count = sim_ble_notify_count();
+        sim_ble_wait_notify(count + 1, REPLAY_SETTLE_US);
+    } while (sim_ble_notify_count() != count);
+}
+
+static const char *replay_report_name(const sim_ble_notify_t *notify) {
+    switch (notify->len) {
+        case BT_APP_KEYBOARD_BOOT_REPORT_LEN: return "boot";
+        case BT_APP_KEYBOARD_NKRO_REPORT_LEN: return "nkro";
+        case BT_APP_MOUSE_REPORT_LEN: return "mouse";
+        default: return "other";
+    }
+}
+
+/* Prints the notifications recorded since the last call under the capture time given */
+static void replay_print(replay_ctx_t *ctx, uint32_t timestamp_us, uint8_t channel) {
+    sim_ble_notify_t notify;
+    while (sim_ble_notifications(ctx->printed, &notify, 1) == 1) {
+        fprintf(ctx->out, "%12.3f ms  ch %2d  %-5s", (uint32_t)(timestamp_us - ctx->first_timestamp_us) / 1000.0,
+                channel, replay_report_name(&notify));
+        for (size_t i = 0; i < notify.len; i++) {
+            fprintf(ctx->out, " %02x", notify.data[i]);
+        }
+        fprintf(ctx->out, "\n");
+        ctx->printed++;
+    }
+}
+
+static void replay_sleep_us(double us) {
+    if (us <= 0) return;
+    const struct timespec ts = {
+        .tv_sec = (time_t)(us / 1e6),
+        .tv_nsec = (long)(us - (time_t)(us / 1e6) * 1e6) * 1000
+    };
+    nanosleep(&ts, NULL);
+}
+
+static uint8_t *replay_read_file(const char *path, size_t *length) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror(path);
+        return NULL;
+    }
+    fseek(in, 0, SEEK_END);
+    *length = ftell(in);
+    rewind(in);
+
+    uint8_t *data = malloc(*length);
+    if (data && fread(data, 1, *length, in) != *length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(in);
+    return data;
+}
+
+/* Plugs the captured interface in as a device of its own and waits until the host polls it */
+static bool replay_attach(replay_ctx_t *ctx, uint8_t channel, const uint8_t *payload, size_t length) {
+    if (length < sizeof(usb_app_capture_attach_t) || ctx->ports[channel] >= 0) return false;
+    usb_app_capture_attach_t attach;
+    memcpy(&attach, payload, sizeof(attach));
+    const size_t desc_len = length - sizeof(attach);
+    const sim_usb_device_t device = {
+        .vid = attach.vid,
+        .pid = attach.pid,
+        .iface_count = 1,
+        .ifaces = {
+            {
+                .sub_class = attach.sub_class,
+                .protocol = attach.proto,
+                .report_desc = payload + sizeof(attach),
+                .report_desc_len = desc_len,
+                .max_packet_size = SIM_USB_REPORT_MAX
+            }
+        }
+    };
+
+    const int64_t deadline_us = sim_time_us() + REPLAY_BRINGUP_TIMEOUT_US;
+    int port;
+    // Unplugged devices hold their port until the host frees them
+    while ((port = sim_usb_attach(&device)) < 0 && sim_time_us() < deadline_us) usleep(1000);
+    if (port < 0) return false;
+    ctx->ports[channel] = port;
+    replay_expected_polled++;
+    fprintf(stderr, "ch %d: addr %d iface %d %04x:%04x, report descriptor %zu bytes, port %d\n",
+            channel, attach.addr, attach.iface_num, attach.vid, attach.pid, desc_len, port);
+    return replay_wait(replay_all_polled, REPLAY_BRINGUP_TIMEOUT_US);
+}
+
+static void replay_detach(replay_ctx_t *ctx, uint8_t channel) {
+    if (ctx->ports[channel] < 0) return;
+    sim_usb_detach(ctx->ports[channel]);
+    ctx->ports[channel] = -1;
+    replay_expected_polled--;
+}
+
+/* Queues the report, waits for the host to poll the ones before it when the interface queue is full */
+static void replay_input(replay_ctx_t *ctx, uint8_t channel, const uint8_t *payload, size_t length) {
+    if (ctx->ports[channel] < 0) return;
+    ctx->inputs++;
+    const int64_t deadline_us = sim_time_us() + REPLAY_BRINGUP_TIMEOUT_US;
+    while (!sim_usb_report(ctx->ports[channel], 0, payload, length)) {
+        if (length > SIM_USB_REPORT_MAX || sim_time_us() > deadline_us) {
+            ctx->dropped++;
+            return;
+        }
+        usleep(1000);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    double speed = 0;
+    while (argc > 3 && argv[1][0] == '-') {
+        if (strcmp(argv[1], "-s") == 0) {
+            speed = strtod(argv[2], NULL);
+        } else if (strcmp(argv[1], "-m") == 0) {
+            replay_mtu = strtoul(argv[2], NULL, 0);
+        } else {
+            break;
+        }
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc != 2) {
+        fprintf(stderr, "usage: usb-capture-replay [-s speed] [-m mtu] capture.bin\n"
+                        "  speed 1 keeps the original timing, 10 runs ten times faster, 0 (default) sends one report\n"
+                        "  at a time and waits for its notifications\n"
+                        "  mtu 23 (default) gets boot keyboard reports, 247 the NKRO report\n");
+        return 2;
+    }
+
+    size_t length = 0;
+    uint8_t *data = replay_read_file(argv[1], &length);
+    if (!data) return 1;
+
+    usb_app_capture_file_header_t file_header;
+    if (length < sizeof(file_header)) {
+        fprintf(stderr, "%s: not a capture\n", argv[1]);
+        free(data);
+        return 1;
+    }
+    memcpy(&file_header, data, sizeof(file_header));
+
+    replay_ctx_t ctx = { 0 };
+    // The firmware prints to stdout, the notifications get the original one
+    ctx.out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!ctx.out || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) return 1;
+    setvbuf(ctx.out, NULL, _IOLBF, 0);
+    for (int i = 0; i < USB_APP_CAPTURE_CHANNELS_MAX; i++) {
+        ctx.ports[i] = -1;
+    }
+    fprintf(stderr, "%d channels, %u records dropped on the device\n", file_header.channel_count,
+            file_header.dropped_records);
+
+    sim_gpio_set_level(USB_APP_VBUS_GPIO, 1);
+    app_main();
+    if (!replay_wait(replay_advertising_connect, REPLAY_BRINGUP_TIMEOUT_US) ||
+        !replay_wait(sim_ble_encrypted, REPLAY_BRINGUP_TIMEOUT_US)) {
+        fprintf(stderr, "central did not connect\n");
+        return 1;
+    }
+    sim_ble_subscribe_uuid16(REPLAY_INPUT_REPORT_UUID, true);
+    replay_settle();
+    ctx.printed = sim_ble_notify_count();
+
+    bool first = true;
+    uint32_t timestamp_us = 0;
+    uint8_t channel = 0;
+    size_t offset = 0;
+    usb_app_capture_record_header_t header;
+    const uint8_t *payload;
+    while (usb_app_capture_next_record(data, length, &offset, &header, &payload)) {
+        if (header.channel >= USB_APP_CAPTURE_CHANNELS_MAX) continue;
+
+        if (first) {
+            ctx.first_timestamp_us = header.timestamp_us;
+            timestamp_us = header.timestamp_us;
+            first = false;
+        } else if (speed > 0 && header.type != USB_APP_CAPTURE_RECORD_ATTACH) {
+            replay_sleep_us((uint32_t)(header.timestamp_us - timestamp_us) / speed);
+            replay_print(&ctx, timestamp_us, channel);
+        }
+        if (header.type != USB_APP_CAPTURE_RECORD_ATTACH) {
+            timestamp_us = header.timestamp_us;
+        }
+        channel = header.channel;
+
+        switch (header.type) {
+            case USB_APP_CAPTURE_RECORD_ATTACH:
+                if (!replay_attach(&ctx, header.channel, payload, header.length)) {
+                    fprintf(stderr, "ch %d: not polled\n", header.channel);
+                }
+            break;
+            case USB_APP_CAPTURE_RECORD_INPUT:
+                replay_input(&ctx, header.channel, payload, header.length);
+            break;
+            case USB_APP_CAPTURE_RECORD_DETACH:
+                replay_detach(&ctx, header.channel);
+            break;
+            default:
+            break;
+        }
+        if (speed <= 0) {
+            replay_settle();
+            replay_print(&ctx, timestamp_us, channel);
+        }
+    }
+    replay_settle();
+    replay_print(&ctx, timestamp_us, channel);
+
+    fprintf(stderr, "%zu input reports, %zu not taken by the simulated bus, %zu notifications\n",
+            ctx.inputs, ctx.dropped, ctx.printed);
+    free(data);
+    return 0;
+}
@@ -0,0 +1,169 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the portable part of the USB report path (router dispatch and keyboard diff) natively on Linux
+ * and reports CPU time and heap allocations per report. Key events are folded into an 8 byte boot
+ * keyboard report, the way it is handed to the BLE side, and every key event counts as one notify.
+ *
+ * With -o the same traffic is written as a usb_app_capture file instead, as input for usb-capture-replay.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "report-sink.h"
+#include "usb_app_capture.h"
+#include "usb_app_router.h"
+
+#define BENCH_DEFAULT_ITERATIONS    1000000
+#define BENCH_CAPTURE_RING_SIZE     65536
+#define BENCH_CAPTURE_POLL_US       1000        // Spacing of recorded reports, like a 1 ms interrupt endpoint
+
+static volatile size_t bench_allocs = 0;
+static volatile size_t bench_frees = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+void *__wrap_malloc(size_t size) { bench_allocs++; return __real_malloc(size); }
+void *__wrap_calloc(size_t nmemb, size_t size) { bench_allocs++; return __real_calloc(nmemb, size); }
+void *__wrap_realloc(void *ptr, size_t size) { bench_allocs++; return __real_realloc(ptr, size); }
+void __wrap_free(void *ptr) { if (ptr) bench_frees++; __real_free(ptr); }
+
+/* Keyboard (ID 1), consumer control (ID 2) and mouse (ID 3) behind one interface */
+static const uint8_t bench_composite_desc[] = {
+    0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x85, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00,
+    0x25, 0x01, 0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x06,
+    0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0,
+    0x05, 0x0C, 0x09, 0x01, 0xA1, 0x01, 0x85, 0x02, 0x15, 0x00, 0x26, 0xFF, 0x03, 0x19, 0x00, 0x2A,
+    0xFF, 0x03, 0x75, 0x10, 0x95, 0x01, 0x81, 0x00, 0xC0,
+    0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x03, 0x09, 0x01, 0xA1, 0x00, 0x05, 0x09, 0x19, 0x01,
+    0x29, 0x03, 0x15, 0x00, 0x25, 0x01, 0x95, 0x03, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x05,
+    0x81, 0x01, 0x05, 0x01, 0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02,
+    0x81, 0x06, 0xC0, 0xC0
+};
+
+/* Typing burst: press, shifted press, six key rollover, release all, then consumer and mouse traffic */
+static const uint8_t bench_script[][9] = {
+    { 1, 0x00, 0, HID_KEY_H, 0, 0, 0, 0, 0 },
+    { 1, 0x00, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, HID_LEFT_SHIFT, 0, HID_KEY_I, 0, 0, 0, 0, 0 },
+    { 1, 0x00, 0, 0, 0, 0, 0, 0, 0 },
+    { 1, 0x00, 0, HID_KEY_A, HID_KEY_S, HID_KEY_D, HID_KEY_F, HID_KEY_J, HID_KEY_K },
+    { 1, 0x00, 0, HID_KEY_S, HID_KEY_D, HID_KEY_F, HID_KEY_J, HID_KEY_K, 0 },
+    { 1, 0x00, 0, 0, 0, 0, 0, 0, 0 },
+    { 2, 0xE9, 0x00 },
+    { 2, 0x00, 0x00 },
+    { 3, 0x01, 0x05, 0xFB },
+    { 3, 0x00, 0x00, 0x00 },
+};
+static const size_t bench_script_len[] = { 9, 9, 9, 9, 9, 9, 9, 3, 3, 4, 4 };
+
+static double bench_elapsed_ns(clockid_t clock, const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(clock, &now);
+    return (now.tv_sec - start->tv_sec) * 1e9 + (now.tv_nsec - start->tv_nsec);
+}
+
+static void bench_capture_write(const uint8_t *data, size_t length, void *arg) {
+    fwrite(data, 1, length, (FILE *) arg);
+}
+
+static int bench_record(const char *path, unsigned long iterations, const hid_host_dev_params_t *dev_params) {
+    const size_t script_reports = sizeof(bench_script) / sizeof(bench_script[0]);
+    static uint8_t ring[BENCH_CAPTURE_RING_SIZE];
+    usb_app_capture_t capture;
+    usb_app_capture_init(&capture, ring, sizeof(ring));
+
+    FILE *out = fopen(path, "wb");
+    if (!out) {
+        perror(path);
+        return 1;
+    }
+
+    const usb_app_capture_attach_t attach = {
+        .addr = dev_params->addr,
+        .iface_num = dev_params->iface_num,
+        .sub_class = dev_params->sub_class,
+        .proto = dev_params->proto
+    };
+    uint32_t timestamp_us = 0;
+    const int channel = usb_app_capture_attach(&capture, usb_app_capture_alloc_channel(), &attach,
+                                               bench_composite_desc, sizeof(bench_composite_desc), timestamp_us);
+    for (unsigned long it = 0; it < iterations; it++) {
+        for (size_t r = 0; r < script_reports; r++) {
+            timestamp_us += BENCH_CAPTURE_POLL_US;
+            usb_app_capture_input(&capture, channel, bench_script[r], bench_script_len[r], timestamp_us);
+        }
+    }
+    usb_app_capture_detach(&capture, channel, timestamp_us + BENCH_CAPTURE_POLL_US);
+
+    usb_app_capture_export(&capture, bench_capture_write, out);
+    printf("capture: %zu bytes, %u records dropped\n", usb_app_capture_size(&capture), capture.dropped_records);
+    usb_app_capture_reset(&capture);
+    return fclose(out) == 0 ? 0 : 1;
+}
+
+int main(int argc, char *argv[]) {
+    const char *capture_path = NULL;
+    if (argc > 2 && strcmp(argv[1], "-o") == 0) {
+        capture_path = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    const unsigned long iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_ITERATIONS;
+    const size_t script_reports = sizeof(bench_script) / sizeof(bench_script[0]);
+
+    const hid_host_dev_params_t dev_params = {
+        .addr = 1,
+        .iface_num = 0,
+        .sub_class = HID_SUBCLASS_NO_SUBCLASS,
+        .proto = HID_PROTOCOL_NONE
+    };
+
+    if (capture_path) {
+        return bench_record(capture_path, iterations, &dev_params);
+    }
+
+    report_sink_reset(NULL, NULL);
+
+    size_t allocs_before = bench_allocs;
+    usb_app_iface_route_t *route = calloc(1, sizeof(usb_app_iface_route_t));
+    if (!route) return 1;
+    usb_app_router_build(route, &dev_params, bench_composite_desc, sizeof(bench_composite_desc), report_sink_handlers);
+    printf("attach: %zu allocations, route %zu bytes\n", bench_allocs - allocs_before, sizeof(usb_app_iface_route_t));
+
+    allocs_before = bench_allocs;
+    struct timespec wall_start, cpu_start;
+    clock_gettime(CLOCK_MONOTONIC, &wall_start);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+
+    for (unsigned long it = 0; it < iterations; it++) {
+        for (size_t r = 0; r < script_reports; r++) {
+            usb_app_router_dispatch(route, bench_script[r], bench_script_len[r]);
+        }
+    }
+
+    const double cpu_ns = bench_elapsed_ns(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+    const double wall_ns = bench_elapsed_ns(CLOCK_MONOTONIC, &wall_start);
+    const double reports = (double) iterations * script_reports;
+
+    printf("reports: %.0f, key events: %llu, notifies: %llu, consumer: %llu, mouse: %llu\n",
+           reports, (unsigned long long) report_sink.key_events, (unsigned long long) report_sink.notifies,
+           (unsigned long long) report_sink.consumer_reports, (unsigned long long) report_sink.mouse_reports);
+    printf("cpu: %.1f ns/report, wall: %.1f ns/report\n", cpu_ns / reports, wall_ns / reports);
+    printf("allocations in report path: %zu (%.3f per report)\n",
+           bench_allocs - allocs_before, (bench_allocs - allocs_before) / reports);
+
+    const size_t frees_before = bench_frees;
+    free(route);
+    printf("detach: %zu frees\n", bench_frees - frees_before);
+    return 0;
+}
@@ -0,0 +1,246 @@
+//
+// Created by Kok on 10/19/26.
+//
+
+/*
+ * Runs the VBUS gating state machine natively on Linux against a simulated VBUS pin on a fake 1 ms clock.
+ *
+ * The owner task works like the one in usb_app.c: it is woken by the pin interrupt, reads the pin, polls the state
+ * machine and sleeps for the timeout the state machine asks for, at most the recheck period. With light sleep the
+ * interrupt is lost unless the task holds the chip awake while it debounces a change, other edges are only seen by
+ * the recheck. An attach installs the stack, the interface starts after the enumeration and sends its first report
+ * either at once or only when a key goes down.
+ *
+ * Every plug and unplug bounces, the pin drops out for a few ms while plugged and spikes while unplugged. Each plug
+ * must install the stack exactly once and each unplug must uninstall it once, right after the debounce time, and
+ * no glitch may reach the stack. The measured cold attach times must match the simulated ones.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test-result.h"
+#include "usb_app_vbus.h"
+
+#define TEST_DEBOUNCE_MS            50
+#define TEST_RECHECK_MS             500
+#define TEST_INSTALL_MS             25          // USB Host Library and HID driver install
+#define TEST_ENUM_MIN_MS            80          // Enumeration and class requests up to the started interface
+#define TEST_ENUM_MAX_MS            250
+#define TEST_REPORT_INTERVAL_MS     8
+#define TEST_CYCLES                 20
+#define TEST_SEEDS                  20
+#define TEST_MAX_EDGES              4096
+#define TEST_NEVER                  UINT32_MAX
+
+typedef struct {
+    const char *name;
+    bool light_sleep;                   // The interrupt is lost while nothing holds the chip awake
+} test_profile_t;
+
+typedef struct {
+    const char *name;
+    bool repeats;                       // Reports at once, otherwise only when a key goes down
+} test_device_t;
+
+typedef struct {
+    uint32_t at_ms;
+    bool level;
+    bool settles;                       // The level lasts, the stack has to follow it
+} test_edge_t;
+
+typedef struct {
+    unsigned long plugs;
+    unsigned long unplugs;
+    unsigned long attaches;
+    unsigned long detaches;
+    unsigned long glitches;
+    unsigned long wrong;                // Events without a settled edge or too late
+    unsigned long mismatched;           // Measured cold attach times off the simulated ones
+    uint32_t detect_max_ms;             // Settled edge to the event
+    uint64_t unplugged_wakeups;
+    uint64_t unplugged_ms;
+    uint64_t ready_sum_ms;
+    uint32_t ready_max_ms;
+    uint64_t report_sum_ms;
+    uint32_t report_max_ms;
+    unsigned long reports;
+} test_totals_t;
+
+static uint32_t test_between(uint32_t min, uint32_t max) {
+    return min + (max > min ? rand() % (max - min + 1) : 0);
+}
+
+/* The time starts at the rising edge the firmware saw first, a recheck may see it late */
+static bool test_measured(const test_profile_t *profile, uint32_t measured_ms, uint32_t actual_ms) {
+    const uint32_t unseen_ms = profile->light_sleep ? 2 * TEST_RECHECK_MS : 0;
+    return measured_ms <= actual_ms && measured_ms + unseen_ms >= actual_ms;
+}
+
+static size_t test_add_edge(test_edge_t *edges, size_t count, uint32_t *now, uint32_t after_ms, bool level) {
+    *now += after_ms;
+    edges[count] = (test_edge_t) { *now, level, false };
+    return count + 1;
+}
+
+/* Plug or unplug with contact bounce, the last edge is the one that settles */
+static size_t test_add_transition(test_edge_t *edges, size_t count, uint32_t *now, bool level) {
+    const uint32_t bounces = test_between(0, 5);
+    for (uint32_t i = 0; i < bounces; i++) {
+        count = test_add_edge(edges, count, now, test_between(1, 2), level);
+        count = test_add_edge(edges, count, now, test_between(1, 3), !level);
+    }
+    count = test_add_edge(edges, count, now, 1, level);
+    edges[count - 1].settles = true;
+    return count;
+}
+
+/* Dropouts while plugged or spikes while unplugged, all shorter than the debounce time */
+static size_t test_add_glitches(test_edge_t *edges, size_t count, uint32_t *now, bool level, uint32_t duration_ms) {
+    const uint32_t end = *now + duration_ms;
+    while (*now + 2 * TEST_DEBOUNCE_MS + 300 < end) {
+        count = test_add_edge(edges, count, now, test_between(100, 300), !level);
+        count = test_add_edge(edges, count, now, test_between(1, TEST_DEBOUNCE_MS - 10), level);
+        if (rand() % 2) break;
+    }
+    *now = end;
+    return count;
+}
+
+static void test_run(const test_profile_t *profile, const test_device_t *device, unsigned int seed,
+                     test_totals_t *totals) {
+    static test_edge_t edges[TEST_MAX_EDGES];
+    srand(seed);
+
+    size_t count = 0;
+    uint32_t t = 0;
+    for (int cycle = 0; cycle < TEST_CYCLES; cycle++) {
+        count = test_add_glitches(edges, count, &t, false, test_between(1000, 6000));
+        count = test_add_transition(edges, count, &t, true);
+        count = test_add_glitches(edges, count, &t, true, test_between(2000, 8000));
+        count = test_add_transition(edges, count, &t, false);
+        totals->plugs++;
+        totals->unplugs++;
+    }
+    const uint32_t end_ms = t + 1000;
+
+    usb_app_vbus_t vbus;
+    usb_app_vbus_init(&vbus, TEST_DEBOUNCE_MS, false, 0);
+
+    bool pin = false;
+    size_t next_edge = 0;
+    uint32_t settled_at = 0;                    // Last edge that settles, the expected event follows it
+    bool expect_level = false;
+    uint32_t wake_at = TEST_RECHECK_MS;         // Owner task timeout
+    bool awake = false;                         // Owner holds the chip awake while it debounces
+    uint32_t ready_at = TEST_NEVER;             // Simulated interface start
+    uint32_t report_at = TEST_NEVER;
+
+    for (uint32_t now = 0; now < end_ms; now++) {
+        bool interrupt = false;
+        while (next_edge < count && edges[next_edge].at_ms == now) {
+            pin = edges[next_edge].level;
+            if (edges[next_edge].settles) {
+                settled_at = now;
+                expect_level = pin;
+            }
+            next_edge++;
+            // Outside light sleep the interrupt records the edge with its own timestamp and wakes the owner
+            if (!profile->light_sleep || awake) {
+                usb_app_vbus_edge(&vbus, pin, now);
+                interrupt = true;
+            }
+        }
+
+        if (!vbus.powered) totals->unplugged_ms++;
+        if (interrupt || now >= wake_at) {
+            if (!vbus.powered) totals->unplugged_wakeups++;
+            usb_app_vbus_edge(&vbus, pin, now);
+            const usb_app_vbus_event_e event = usb_app_vbus_poll(&vbus, now);
+
+            if (event != USB_APP_VBUS_EVENT_NONE) {
+                const bool attach = event == USB_APP_VBUS_EVENT_ATTACH;
+                // Without the interrupt a recheck finds the level up to its period late, one that lands in a
+                // glitch sees the old level and waits one period more
+                const uint32_t slack = profile->light_sleep ? 2 * TEST_RECHECK_MS : 1;
+                if (attach) totals->attaches++;
+                else totals->detaches++;
+                if (now - settled_at > totals->detect_max_ms) totals->detect_max_ms = now - settled_at;
+                if (attach != expect_level || now < settled_at + TEST_DEBOUNCE_MS ||
+                    now > settled_at + TEST_DEBOUNCE_MS + slack) {
+                    totals->wrong++;
+                }
+                ready_at = TEST_NEVER;
+                if (attach) ready_at = now + TEST_INSTALL_MS + test_between(TEST_ENUM_MIN_MS, TEST_ENUM_MAX_MS);
+                report_at = TEST_NEVER;
+            }
+
+            const uint32_t wait = usb_app_vbus_wait_ms(&vbus, now);
+            wake_at = now + (wait == UINT32_MAX ? TEST_RECHECK_MS : wait + 1);
+            awake = wait != UINT32_MAX;
+        }
+
+        // Stack and device
+        if (now == ready_at) {
+            if (!usb_app_vbus_ready(&vbus, now) ||
+                !test_measured(profile, vbus.stats.cold_ready_last_ms, now - settled_at)) {
+                totals->mismatched++;
+            }
+            const uint32_t ready_ms = vbus.stats.cold_ready_last_ms;
+            totals->ready_sum_ms += ready_ms;
+            if (ready_ms > totals->ready_max_ms) totals->ready_max_ms = ready_ms;
+            report_at = now + (device->repeats ? TEST_REPORT_INTERVAL_MS : test_between(200, 1000));
+        }
+        if (now == report_at && vbus.powered) {
+            if (!usb_app_vbus_report(&vbus, now) ||
+                !test_measured(profile, vbus.stats.cold_attach_last_ms, now - settled_at)) {
+                totals->mismatched++;
+            }
+            totals->reports++;
+            const uint32_t report_ms = vbus.stats.cold_attach_last_ms;
+            totals->report_sum_ms += report_ms;
+            if (report_ms > totals->report_max_ms) totals->report_max_ms = report_ms;
+            // Later reports end nothing
+            if (usb_app_vbus_report(&vbus, now + TEST_REPORT_INTERVAL_MS)) totals->mismatched++;
+        }
+    }
+
+    totals->glitches += vbus.stats.glitches;
+    if (vbus.powered) totals->wrong++;
+}
+
+int main(void) {
+    static const test_profile_t profiles[] = {
+        { "interrupt", false },
+        { "light sleep", true },
+    };
+    static const test_device_t devices[] = {
+        { "repeat", true },
+        { "set_idle", false },
+    };
+
+    printf("profile,device,plugs,attaches,unplugs,detaches,glitches,detect_max_ms,unplugged_wakeups_per_min,"
+           "cold_ready_avg_ms,cold_ready_max_ms,first_report_avg_ms,first_report_max_ms,result\n");
+    for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+        for (size_t d = 0; d < sizeof(devices) / sizeof(devices[0]); d++) {
+            test_totals_t totals = { 0 };
+            for (unsigned int seed = 1; seed <= TEST_SEEDS; seed++) {
+                test_run(&profiles[p], &devices[d], seed, &totals);
+            }
+            const bool passed = totals.attaches == totals.plugs && totals.detaches == totals.unplugs &&
+                                totals.wrong == 0 && totals.mismatched == 0 && totals.reports == totals.plugs;
+            printf("%s,%s,%lu,%lu,%lu,%lu,%lu,%u,%.1f,%llu,%u,%llu,%u,%s\n", profiles[p].name, devices[d].name,
+                   totals.plugs, totals.attaches, totals.unplugs, totals.detaches, totals.glitches,
+                   totals.detect_max_ms,
+                   totals.unplugged_wakeups * 60000.0 / totals.unplugged_ms,
+                   (unsigned long long) (totals.ready_sum_ms / totals.plugs), totals.ready_max_ms,
+                   (unsigned long long) (totals.reports ? totals.report_sum_ms / totals.reports : 0),
+                   totals.report_max_ms, test_result_str(passed));
+            test_result(passed);
+        }
+    }
+
+    return test_result_summary(stdout);
+}